@@ -25,5 +25,936 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "action/manager.h"
+#include "command/processor.h"
+#include "logger/module.h"
+#include "util/arithmetical.h"
+#include "util/clock.h"
+#include "util/debug.h"
+#include "util/hash.h"
+#include "values/value.h"
+
+/**
+ * Key binding
+ */
+struct binding {
+    uint32_t mode; //!< Index of the mode
+    uint32_t len; //!< Number of chords
+    struct ws_action_chord chords[WS_ACTION_MAX_SEQUENCE]; //!< The sequence
+    char* action; //!< Name of the bound action
+    size_t action_len; //!< Length of the name of the action
+};
+
+/**
+ * Mode other than the default mode
+ */
+struct mode {
+    char* name; //!< Name of the mode
+    size_t len; //!< Length of the name
+};
+
+/**
+ * Node of the compiled key trie
+ *
+ * The first nodes are the roots of the modes, indexed like the modes. As
+ * sequences which are prefixes of other sequences are rejected, a node
+ * either completes a sequence or has children.
+ */
+struct trie_node {
+    struct ws_action const* action; //!< Bound action, if registered
+    bool leaf; //!< Whether the node completes a sequence
+};
+
+/**
+ * Edge of the compiled key trie, a slot of the edge hash table
+ */
+struct trie_edge {
+    uint32_t parent; //!< Node the edge leaves
+    uint32_t child; //!< Node the edge leads to, 0 for an empty slot
+    struct ws_action_chord chord; //!< Chord labeling the edge
+};
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Find the position of an action
+ *
+ * @return Whether the action was found
+ */
+static bool
+action_find_pos(
+    char const* name, //!< Name of the action
+    size_t name_len, //!< Length of the name
+    size_t* pos //!< Output: position of the action or where it would be
+);
+
+/**
+ * Insert or replace an action
+ *
+ * Takes over the memory of owned actions, also on error.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+action_insert(
+    struct ws_action const* action //!< The action
+);
+
+/**
+ * Release the memory of an action
+ */
+static void
+action_release(
+    struct ws_action* action //!< The action
+);
+
+/**
+ * Find the index of a mode
+ *
+ * The default mode, i.e. the mode with the empty name, has index 0.
+ *
+ * @return The index, a negative error number if the mode could neither be
+ *         found nor created
+ */
+static int64_t
+mode_find(
+    char const* name, //!< Name of the mode
+    size_t len, //!< Length of the name
+    bool create //!< Whether to create the mode if it does not exist
+);
+
+/**
+ * Find a binding of exactly a given sequence
+ *
+ * @return The binding or NULL if the sequence is not bound
+ */
+static struct binding*
+binding_find(
+    uint32_t mode, //!< Index of the mode
+    struct ws_action_chord const* chords, //!< The key sequence
+    size_t num_chords //!< Number of chords
+);
+
+/**
+ * Hash an edge of the key trie
+ *
+ * @return The hash
+ */
+static size_t
+trie_hash(
+    uint32_t parent, //!< Node the edge leaves
+    struct ws_action_chord chord //!< Chord labeling the edge
+)
+__ws_const__;
+
+/**
+ * Find the slot of an edge in an edge hash table
+ *
+ * @return The slot holding the edge, or the empty slot it belongs in
+ */
+static struct trie_edge*
+trie_slot(
+    struct trie_edge* edges, //!< The hash table
+    size_t mask, //!< Number of slots minus 1
+    uint32_t parent, //!< Node the edge leaves
+    struct ws_action_chord chord //!< Chord labeling the edge
+);
+
+/**
+ * Compile the bindings into the key trie
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+trie_build(void);
+
+/**
+ * Get the key sequence of a command from pairs of integer arguments
+ *
+ * @return The number of chords or a negative error number
+ */
+static int
+command_get_chords(
+    struct ws_value const* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_action_chord* chords //!< Output: WS_ACTION_MAX_SEQUENCE chords
+);
+
+/**
+ * Command registering an action
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_register(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command unregistering an action
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_unregister(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command binding a key sequence
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_bind(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command removing the binding of a key sequence
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_unbind(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command switching the mode
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_mode(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Commands of the action manager
+ */
+static struct ws_command const action_commands[] = {
+    { .name = "action_register", .func = command_register },
+    { .name = "action_unregister", .func = command_unregister },
+    { .name = "action_bind", .func = command_bind },
+    { .name = "action_unbind", .func = command_unbind },
+    { .name = "action_mode", .func = command_mode },
+};
+
+/**
+ * Internal state of the action manager
+ */
+static struct {
+    struct ws_action* actions; //!< Registered actions, sorted by name
+    size_t len; //!< Number of actions
+    size_t cap; //!< Capacity of `actions`
+    struct binding* bindings; //!< Key bindings, unordered
+    size_t num_bindings; //!< Number of bindings
+    size_t cap_bindings; //!< Capacity of `bindings`
+    struct mode* modes; //!< Modes other than the default mode
+    size_t num_modes; //!< Number of modes other than the default mode
+    size_t cap_modes; //!< Capacity of `modes`
+    uint32_t mode; //!< Index of the current mode
+    uint32_t state; //!< Trie node of the pending sequence
+    struct trie_node* nodes; //!< Nodes of the key trie
+    struct trie_edge* edges; //!< Edge hash table of the key trie
+    size_t edges_mask; //!< Number of slots of `edges` minus 1
+    bool dirty; //!< Whether the key trie is out of date
+} manager;
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_action_manager_init(void)
+{
+    manager.actions = NULL;
+    manager.len = 0;
+    manager.cap = 0;
+    manager.bindings = NULL;
+    manager.num_bindings = 0;
+    manager.cap_bindings = 0;
+    manager.modes = NULL;
+    manager.num_modes = 0;
+    manager.cap_modes = 0;
+    manager.mode = 0;
+    manager.state = 0;
+    manager.nodes = NULL;
+    manager.edges = NULL;
+    manager.edges_mask = 0;
+    manager.dirty = true;
+
+    size_t i;
+    for (i = 0; i < sizeof(action_commands) / sizeof(*action_commands); ++i) {
+        int res = ws_command_register(action_commands + i);
+        if (res < 0) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+void
+ws_action_manager_deinit(void)
+{
+    size_t i;
+    for (i = 0; i < manager.len; ++i) {
+        action_release(manager.actions + i);
+    }
+    free(manager.actions);
+    manager.actions = NULL;
+    manager.len = 0;
+    manager.cap = 0;
+
+    for (i = 0; i < manager.num_bindings; ++i) {
+        free(manager.bindings[i].action);
+    }
+    free(manager.bindings);
+    manager.bindings = NULL;
+    manager.num_bindings = 0;
+    manager.cap_bindings = 0;
+
+    for (i = 0; i < manager.num_modes; ++i) {
+        free(manager.modes[i].name);
+    }
+    free(manager.modes);
+    manager.modes = NULL;
+    manager.num_modes = 0;
+    manager.cap_modes = 0;
+
+    free(manager.nodes);
+    free(manager.edges);
+    manager.nodes = NULL;
+    manager.edges = NULL;
+    manager.edges_mask = 0;
+    manager.mode = 0;
+    manager.state = 0;
+    manager.dirty = true;
+}
+
+int
+ws_action_register(
+    char const* name,
+    size_t name_len,
+    char const* body,
+    size_t body_len
+) {
+    if (!name_len) {
+        return -EINVAL;
+    }
+
+    // name and body share one allocation
+    char* copy = malloc(name_len + body_len + 1);
+    if (!copy) {
+        return -ENOMEM;
+    }
+    memcpy(copy, name, name_len);
+    if (body_len) {
+        memcpy(copy + name_len, body, body_len);
+    }
+
+    struct ws_action action = {
+        .name = copy,
+        .name_len = name_len,
+        .body = copy + name_len,
+        .body_len = body_len,
+        .owned = true,
+    };
+    return action_insert(&action);
+}
+
+int
+ws_action_register_borrowed(
+    char const* name,
+    size_t name_len,
+    char const* body,
+    size_t body_len
+) {
+    if (!name_len) {
+        return -EINVAL;
+    }
+
+    struct ws_action action = {
+        .name = name,
+        .name_len = name_len,
+        .body = body ? body : "",
+        .body_len = body_len,
+        .owned = false,
+    };
+    return action_insert(&action);
+}
+
+int
+ws_action_unregister(
+    char const* name,
+    size_t name_len
+) {
+    size_t pos;
+    if (!action_find_pos(name, name_len, &pos)) {
+        return -ENOENT;
+    }
+
+    action_release(manager.actions + pos);
+    --manager.len;
+    memmove(manager.actions + pos, manager.actions + pos + 1,
+            (manager.len - pos) * sizeof(*manager.actions));
+
+    // the trie refers to actions by address
+    manager.dirty = true;
+    return 0;
+}
+
+struct ws_action const*
+ws_action_find(
+    char const* name,
+    size_t name_len
+) {
+    size_t pos;
+    return action_find_pos(name, name_len, &pos) ? manager.actions + pos
+                                                 : NULL;
+}
+
+size_t
+ws_action_count(void)
+{
+    return manager.len;
+}
+
+struct ws_action const*
+ws_action_at(
+    size_t index
+) {
+    return (index < manager.len) ? manager.actions + index : NULL;
+}
+
+int
+ws_action_bind(
+    char const* mode,
+    size_t mode_len,
+    struct ws_action_chord const* chords,
+    size_t num_chords,
+    char const* action,
+    size_t action_len
+) {
+    if (!num_chords || (num_chords > WS_ACTION_MAX_SEQUENCE) || !action_len) {
+        return -EINVAL;
+    }
+
+    int64_t index = mode_find(mode, mode_len, true);
+    if (index < 0) {
+        return (int) index;
+    }
+
+    // sequences only conflict within a mode, and only if one is a prefix of
+    // the other, the same sequence just gets a new action
+    struct binding* binding = NULL;
+    size_t i;
+    for (i = 0; i < manager.num_bindings; ++i) {
+        struct binding* other = manager.bindings + i;
+        size_t len = WS_MIN(other->len, num_chords);
+        if ((other->mode != index) ||
+                (memcmp(other->chords, chords, len * sizeof(*chords)) != 0)) {
+            continue;
+        }
+        if (other->len != num_chords) {
+            return -EEXIST;
+        }
+        binding = other;
+    }
+
+    char* name = malloc(action_len);
+    if (!name) {
+        return -ENOMEM;
+    }
+    memcpy(name, action, action_len);
+
+    if (!binding) {
+        if (manager.num_bindings == manager.cap_bindings) {
+            size_t cap = manager.cap_bindings ? manager.cap_bindings * 2 : 32;
+            struct binding* bindings;
+            bindings = realloc(manager.bindings, cap * sizeof(*bindings));
+            if (!bindings) {
+                free(name);
+                return -ENOMEM;
+            }
+            manager.bindings = bindings;
+            manager.cap_bindings = cap;
+        }
+
+        binding = manager.bindings + manager.num_bindings++;
+        memset(binding, 0, sizeof(*binding));
+        binding->mode = (uint32_t) index;
+        binding->len = (uint32_t) num_chords;
+        memcpy(binding->chords, chords, num_chords * sizeof(*chords));
+    } else {
+        free(binding->action);
+    }
+
+    binding->action = name;
+    binding->action_len = action_len;
+    manager.dirty = true;
+    return 0;
+}
+
+int
+ws_action_unbind(
+    char const* mode,
+    size_t mode_len,
+    struct ws_action_chord const* chords,
+    size_t num_chords
+) {
+    int64_t index = mode_find(mode, mode_len, false);
+    if (index < 0) {
+        return -ENOENT;
+    }
+
+    struct binding* binding = binding_find((uint32_t) index, chords,
+                                           num_chords);
+    if (!binding) {
+        return -ENOENT;
+    }
+
+    free(binding->action);
+    *binding = manager.bindings[--manager.num_bindings];
+    manager.dirty = true;
+    return 0;
+}
+
+int
+ws_action_set_mode(
+    char const* mode,
+    size_t mode_len
+) {
+    int64_t index = mode_find(mode, mode_len, true);
+    if (index < 0) {
+        return (int) index;
+    }
+
+    manager.mode = (uint32_t) index;
+    manager.state = manager.mode;
+    return 0;
+}
+
+enum ws_action_key_result
+ws_action_key(
+    struct ws_action_chord chord,
+    struct ws_action const** action
+) {
+    *action = NULL;
+    if (WS_UNLIKELY(manager.dirty) && (trie_build() < 0)) {
+        return WS_ACTION_KEY_NONE;
+    }
+
+    struct trie_edge const* edge = trie_slot(manager.edges, manager.edges_mask,
+                                             manager.state, chord);
+    if (!edge->child && (manager.state != manager.mode)) {
+        // the key breaks the pending sequence, it may start a new one
+        manager.state = manager.mode;
+        edge = trie_slot(manager.edges, manager.edges_mask, manager.state,
+                         chord);
+    }
+    if (!edge->child) {
+        return WS_ACTION_KEY_NONE;
+    }
+
+    struct trie_node const* node = manager.nodes + edge->child;
+    if (!node->leaf) {
+        manager.state = edge->child;
+        return WS_ACTION_KEY_PENDING;
+    }
+
+    manager.state = manager.mode;
+    *action = node->action;
+    return WS_ACTION_KEY_MATCH;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static bool
+action_find_pos(
+    char const* name,
+    size_t name_len,
+    size_t* pos
+) {
+    size_t low = 0;
+    size_t high = manager.len;
+    int cmp = 1;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        struct ws_action const* action = manager.actions + mid;
+        cmp = memcmp(action->name, name, WS_MIN(action->name_len, name_len));
+        if (!cmp) {
+            cmp = (action->name_len > name_len) - (action->name_len < name_len);
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    *pos = low;
+    if (low == manager.len) {
+        return false;
+    }
+    struct ws_action const* action = manager.actions + low;
+    return (action->name_len == name_len) &&
+           (memcmp(action->name, name, name_len) == 0);
+}
+
+static int
+action_insert(
+    struct ws_action const* action
+) {
+    // the trie refers to actions by address
+    manager.dirty = true;
+
+    size_t pos;
+    if (action_find_pos(action->name, action->name_len, &pos)) {
+        action_release(manager.actions + pos);
+        manager.actions[pos] = *action;
+        return 0;
+    }
+
+    if (manager.len == manager.cap) {
+        size_t cap = manager.cap ? manager.cap * 2 : 16;
+        struct ws_action* actions;
+        actions = realloc(manager.actions, cap * sizeof(*actions));
+        if (!actions) {
+            struct ws_action rejected = *action;
+            action_release(&rejected);
+            return -ENOMEM;
+        }
+        manager.actions = actions;
+        manager.cap = cap;
+    }
+
+    memmove(manager.actions + pos + 1, manager.actions + pos,
+            (manager.len - pos) * sizeof(*manager.actions));
+    manager.actions[pos] = *action;
+    ++manager.len;
+    return 0;
+}
+
+static void
+action_release(
+    struct ws_action* action
+) {
+    if (action->owned) {
+        // the body shares the allocation of the name
+        free((char*) action->name);
+    }
+}
+
+static int64_t
+mode_find(
+    char const* name,
+    size_t len,
+    bool create
+) {
+    if (!len) {
+        return 0;
+    }
+
+    size_t i;
+    for (i = 0; i < manager.num_modes; ++i) {
+        struct mode const* mode = manager.modes + i;
+        if ((mode->len == len) && (memcmp(mode->name, name, len) == 0)) {
+            return (int64_t) i + 1;
+        }
+    }
+
+    if (!create) {
+        return -ENOENT;
+    }
+
+    if (manager.num_modes == manager.cap_modes) {
+        size_t cap = manager.cap_modes ? manager.cap_modes * 2 : 8;
+        struct mode* modes = realloc(manager.modes, cap * sizeof(*modes));
+        if (!modes) {
+            return -ENOMEM;
+        }
+        manager.modes = modes;
+        manager.cap_modes = cap;
+    }
+
+    char* copy = malloc(len);
+    if (!copy) {
+        return -ENOMEM;
+    }
+    memcpy(copy, name, len);
+
+    manager.modes[manager.num_modes].name = copy;
+    manager.modes[manager.num_modes].len = len;
+    ++manager.num_modes;
+
+    // the new mode needs a root in the trie
+    manager.dirty = true;
+    return (int64_t) manager.num_modes;
+}
+
+static struct binding*
+binding_find(
+    uint32_t mode,
+    struct ws_action_chord const* chords,
+    size_t num_chords
+) {
+    size_t i;
+    for (i = 0; i < manager.num_bindings; ++i) {
+        struct binding* binding = manager.bindings + i;
+        if ((binding->mode == mode) && (binding->len == num_chords) &&
+                (memcmp(binding->chords, chords,
+                        num_chords * sizeof(*chords)) == 0)) {
+            return binding;
+        }
+    }
+    return NULL;
+}
+
+static size_t
+trie_hash(
+    uint32_t parent,
+    struct ws_action_chord chord
+) {
+    uint64_t hash = ((uint64_t) chord.modifiers << 32) | chord.keysym;
+    hash ^= parent * UINT64_C(0x9e3779b97f4a7c15);
+    return (size_t) ws_hash_mix64(hash);
+}
+
+static struct trie_edge*
+trie_slot(
+    struct trie_edge* edges,
+    size_t mask,
+    uint32_t parent,
+    struct ws_action_chord chord
+) {
+    // the table is never more than half full, so there is always an empty slot
+    size_t i = trie_hash(parent, chord) & mask;
+    while (edges[i].child &&
+            ((edges[i].parent != parent) ||
+             (edges[i].chord.modifiers != chord.modifiers) ||
+             (edges[i].chord.keysym != chord.keysym))) {
+        i = (i + 1) & mask;
+    }
+    return edges + i;
+}
+
+static int
+trie_build(void)
+{
+    uint64_t start = ws_clock_now();
+
+    size_t num_roots = manager.num_modes + 1;
+    size_t num_edges = 0;
+    size_t i;
+    for (i = 0; i < manager.num_bindings; ++i) {
+        num_edges += manager.bindings[i].len;
+    }
+    if (num_roots + num_edges > UINT32_MAX) {
+        return -E2BIG;
+    }
+
+    size_t num_slots = 16;
+    while (num_slots < 2 * num_edges) {
+        num_slots *= 2;
+    }
+
+    struct trie_node* nodes = calloc(num_roots + num_edges, sizeof(*nodes));
+    struct trie_edge* edges = calloc(num_slots, sizeof(*edges));
+    if (!nodes || !edges) {
+        free(nodes);
+        free(edges);
+        return -ENOMEM;
+    }
+
+    // nodes are numbered in order of creation, the roots come first
+    uint32_t num_nodes = (uint32_t) num_roots;
+    for (i = 0; i < manager.num_bindings; ++i) {
+        struct binding const* binding = manager.bindings + i;
+        uint32_t node = binding->mode;
+        uint32_t j;
+        for (j = 0; j < binding->len; ++j) {
+            struct trie_edge* edge = trie_slot(edges, num_slots - 1, node,
+                                               binding->chords[j]);
+            if (!edge->child) {
+                edge->parent = node;
+                edge->child = num_nodes++;
+                edge->chord = binding->chords[j];
+            }
+            node = edge->child;
+        }
+
+        nodes[node].action = ws_action_find(binding->action,
+                                            binding->action_len);
+        nodes[node].leaf = true;
+    }
+
+    free(manager.nodes);
+    free(manager.edges);
+    manager.nodes = nodes;
+    manager.edges = edges;
+    manager.edges_mask = num_slots - 1;
+    manager.state = manager.mode;
+    manager.dirty = false;
+
+    WS_LOG(WS_LOG_MODULE_ACTION, WS_LOG_DEBUG,
+           "compiled %zu bindings into %u trie nodes in %lluus",
+           manager.num_bindings, (unsigned int) num_nodes,
+           (unsigned long long) (ws_clock_now() - start) / 1000);
+    return 0;
+}
+
+static int
+command_register(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc != 2) || (ws_value_get_type(args) != WS_VALUE_TYPE_STRING) ||
+            (ws_value_get_type(args + 1) != WS_VALUE_TYPE_STRING)) {
+        return -EINVAL;
+    }
+
+    int res = ws_action_register(ws_value_string_get(args),
+                                 ws_value_string_len(args),
+                                 ws_value_string_get(args + 1),
+                                 ws_value_string_len(args + 1));
+    if (res == 0) {
+        WS_LOG(WS_LOG_MODULE_ACTION, WS_LOG_DEBUG, "registered action %.*s",
+               (int) ws_value_string_len(args), ws_value_string_get(args));
+    }
+    return res;
+}
+
+static int
+command_unregister(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc != 1) || (ws_value_get_type(args) != WS_VALUE_TYPE_STRING)) {
+        return -EINVAL;
+    }
+    return ws_action_unregister(ws_value_string_get(args),
+                                ws_value_string_len(args));
+}
+
+static int
+command_get_chords(
+    struct ws_value const* args,
+    size_t argc,
+    struct ws_action_chord* chords
+) {
+    if (!argc || (argc % 2) || (argc / 2 > WS_ACTION_MAX_SEQUENCE)) {
+        return -EINVAL;
+    }
+
+    size_t i;
+    for (i = 0; i < argc; ++i) {
+        if (ws_value_get_type(args + i) != WS_VALUE_TYPE_INT) {
+            return -EINVAL;
+        }
+        int64_t value = ws_value_int_get(args + i);
+        if ((value < 0) || (value > UINT32_MAX)) {
+            return -EINVAL;
+        }
+
+        if (i % 2) {
+            chords[i / 2].keysym = (uint32_t) value;
+        } else {
+            chords[i / 2].modifiers = (uint32_t) value;
+        }
+    }
+    return (int) (argc / 2);
+}
+
+static int
+command_bind(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc < 2) || (ws_value_get_type(args) != WS_VALUE_TYPE_STRING) ||
+            (ws_value_get_type(args + 1) != WS_VALUE_TYPE_STRING)) {
+        return -EINVAL;
+    }
+
+    struct ws_action_chord chords[WS_ACTION_MAX_SEQUENCE];
+    int num = command_get_chords(args + 2, argc - 2, chords);
+    if (num < 0) {
+        return num;
+    }
+
+    return ws_action_bind(ws_value_string_get(args),
+                          ws_value_string_len(args), chords, (size_t) num,
+                          ws_value_string_get(args + 1),
+                          ws_value_string_len(args + 1));
+}
+
+static int
+command_unbind(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc < 1) || (ws_value_get_type(args) != WS_VALUE_TYPE_STRING)) {
+        return -EINVAL;
+    }
+
+    struct ws_action_chord chords[WS_ACTION_MAX_SEQUENCE];
+    int num = command_get_chords(args + 1, argc - 1, chords);
+    if (num < 0) {
+        return num;
+    }
+
+    return ws_action_unbind(ws_value_string_get(args),
+                            ws_value_string_len(args), chords, (size_t) num);
+}
 
+static int
+command_mode(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc != 1) || (ws_value_get_type(args) != WS_VALUE_TYPE_STRING)) {
+        return -EINVAL;
+    }
+    return ws_action_set_mode(ws_value_string_get(args),
+                              ws_value_string_len(args));
+}
@@ -28,6 +28,235 @@
 #ifndef __WS_ACTION_MANAGER_H__
 #define __WS_ACTION_MANAGER_H__
 
+/**
+ * @file manager.h
+ *
+ * @brief Actions registered by scripts
+ *
+ * An action is a named piece of script, e.g. the commands to run when a key
+ * is pressed. The body of an action is opaque to the action manager, it is
+ * stored and handed back as it was registered.
+ *
+ * Actions are kept sorted by name. Their names and bodies are either copied
+ * when they are registered or, for actions restored from a snapshot, borrowed
+ * from memory which outlives the action manager.
+ *
+ * Actions are bound to keys: a binding maps a sequence of chords, i.e.
+ * modifier masks and keysyms, within a mode to the name of an action. The
+ * bindings are compiled into a trie whose edges live in one open addressed
+ * hash table and whose nodes refer to the actions directly, so a key event is
+ * resolved with a single hash lookup. The trie is rebuilt lazily with the
+ * first key event after bindings or actions changed.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+
+/**
+ * Maximum number of chords in a key sequence
+ */
+#define WS_ACTION_MAX_SEQUENCE 8
+
+/**
+ * Action registered by a script
+ */
+struct ws_action {
+    char const* name; //!< Name of the action, not 0-terminated
+    size_t name_len; //!< Length of the name
+    char const* body; //!< Body of the action, not 0-terminated
+    size_t body_len; //!< Length of the body
+    bool owned; //!< Whether `name` and `body` were copied
+};
+
+/**
+ * Key chord
+ *
+ * The modifier mask is compared as is, so lock modifiers should be masked out
+ * by the caller.
+ */
+struct ws_action_chord {
+    uint32_t modifiers; //!< Mask of the active modifiers
+    uint32_t keysym; //!< The keysym
+};
+
+/**
+ * Result of resolving a key event
+ */
+enum ws_action_key_result {
+    WS_ACTION_KEY_NONE = 0, //!< No binding, the sequence was reset
+    WS_ACTION_KEY_PENDING, //!< The key continues a sequence
+    WS_ACTION_KEY_MATCH, //!< The key completed a sequence
+};
+
+/**
+ * Initialize the action manager
+ *
+ * Registers the commands `action_register` (taking a name and a body, both
+ * strings), `action_unregister` (taking a name), `action_bind` (taking a mode,
+ * the name of an action and pairs of modifier masks and keysyms),
+ * `action_unbind` (taking a mode and pairs of modifier masks and keysyms) and
+ * `action_mode` (taking a mode).
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_action_manager_init(void);
+
+/**
+ * Deinitialize the action manager
+ *
+ * Unregisters all actions and removes all bindings.
+ */
+void
+ws_action_manager_deinit(void);
 
+/**
+ * Register an action
+ *
+ * The name and the body are copied. An action with the same name is
+ * replaced.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_action_register(
+    char const* name, //!< Name of the action
+    size_t name_len, //!< Length of the name, not 0
+    char const* body, //!< Body of the action
+    size_t body_len //!< Length of the body
+)
+__ws_nonnull__(1);
+
+/**
+ * Register an action without copying it
+ *
+ * Like ws_action_register(), but the name and the body are borrowed. They
+ * must stay valid as long as the action manager is initialized.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_action_register_borrowed(
+    char const* name, //!< Name of the action
+    size_t name_len, //!< Length of the name, not 0
+    char const* body, //!< Body of the action
+    size_t body_len //!< Length of the body
+)
+__ws_nonnull__(1);
+
+/**
+ * Unregister an action
+ *
+ * @return 0 on success, -ENOENT if there is no such action
+ */
+int
+ws_action_unregister(
+    char const* name, //!< Name of the action
+    size_t name_len //!< Length of the name
+)
+__ws_nonnull__(1);
+
+/**
+ * Find an action by name
+ *
+ * The action is valid until actions are registered or unregistered.
+ *
+ * @return The action or NULL if there is no such action
+ */
+struct ws_action const*
+ws_action_find(
+    char const* name, //!< Name of the action
+    size_t name_len //!< Length of the name
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the number of registered actions
+ *
+ * @return The number of actions
+ */
+size_t
+ws_action_count(void);
+
+/**
+ * Get an action by position
+ *
+ * Actions are ordered by name.
+ *
+ * @return The action or NULL if `index` is out of range
+ */
+struct ws_action const*
+ws_action_at(
+    size_t index //!< Position of the action
+);
+
+/**
+ * Bind a key sequence to an action
+ *
+ * The action is referred to by name, it does not need to be registered yet.
+ * Binding a sequence which is already bound replaces the binding. A sequence
+ * which is a prefix of another sequence of the same mode, or the other way
+ * round, is rejected, as one of them could never be completed.
+ *
+ * @return 0 on success, -EEXIST if the sequence conflicts with another one,
+ *         another negative error number otherwise
+ */
+int
+ws_action_bind(
+    char const* mode, //!< Name of the mode, empty for the default mode
+    size_t mode_len, //!< Length of the name of the mode
+    struct ws_action_chord const* chords, //!< The key sequence
+    size_t num_chords, //!< Number of chords, 1 to WS_ACTION_MAX_SEQUENCE
+    char const* action, //!< Name of the action
+    size_t action_len //!< Length of the name of the action
+)
+__ws_nonnull__(1, 3, 5);
+
+/**
+ * Remove the binding of a key sequence
+ *
+ * @return 0 on success, -ENOENT if the sequence is not bound
+ */
+int
+ws_action_unbind(
+    char const* mode, //!< Name of the mode, empty for the default mode
+    size_t mode_len, //!< Length of the name of the mode
+    struct ws_action_chord const* chords, //!< The key sequence
+    size_t num_chords //!< Number of chords
+)
+__ws_nonnull__(1, 3);
+
+/**
+ * Switch the mode key events are resolved in
+ *
+ * Resets a pending key sequence.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_action_set_mode(
+    char const* mode, //!< Name of the mode, empty for the default mode
+    size_t mode_len //!< Length of the name of the mode
+)
+__ws_nonnull__(1);
+
+/**
+ * Resolve a key event
+ *
+ * Advances the pending key sequence of the current mode by `chord`. If the
+ * sequence is completed, `action` is set to the bound action, or to NULL if
+ * no action with the bound name is registered, and the sequence is reset.
+ *
+ * @return How the key was resolved
+ */
+enum ws_action_key_result
+ws_action_key(
+    struct ws_action_chord chord, //!< The chord pressed
+    struct ws_action const** action //!< Output: the bound action
+)
+__ws_nonnull__(2);
 
 #endif // __WS_ACTION_MANAGER_H__
@@ -25,5 +25,1405 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wayland-server.h>
+
 #include "command/processor.h"
+#include "logger/module.h"
+#include "objects/stack.h"
+#include "objects/string.h"
+#include "util/arena.h"
+#include "util/arithmetical.h"
+#include "util/clock.h"
+#include "util/epoch.h"
+#include "util/histogram.h"
+#include "values/value.h"
+
+/**
+ * Size of the chunks allocated for scratch memory
+ */
+#define PROCESSOR_ARENA_CHUNK_SIZE (16 * 1024)
+
+/**
+ * Initial capacity of the argument stack
+ */
+#define PROCESSOR_STACK_CAP 32
+
+/**
+ * Maximum number of transaction hooks
+ */
+#define PROCESSOR_MAX_HOOKS 8
+
+/**
+ * Number of compiled programs kept in the cache
+ */
+#define PROCESSOR_CACHE_SIZE 64
+
+/**
+ * Number of buckets of the cache's hash table, must be a power of two
+ */
+#define PROCESSOR_CACHE_BUCKETS 128
+
+/**
+ * Maximum number of arguments of a compiled program
+ *
+ * Commands with more arguments are executed without compiling them.
+ */
+#define PROCESSOR_PROGRAM_MAX_ARGS 32
+
+/**
+ * Marks the end of a list of cache entries
+ */
+#define PROCESSOR_CACHE_NIL UINT16_MAX
+
+/**
+ * Maximum number of latency histograms
+ */
+#define PROCESSOR_MAX_HISTOGRAMS 16
+
+/**
+ * Maximum length of a line of the latency summary, excluding the name
+ */
+#define PROCESSOR_LATENCY_LINE_MAX 160
+
+/**
+ * Maximum number of worker threads
+ */
+#define PROCESSOR_MAX_WORKERS 16
+
+/**
+ * Size of the chunks allocated for the memory of a query
+ */
+#define PROCESSOR_QUERY_CHUNK_SIZE (4 * 1024)
+
+/**
+ * Instructions of a compiled program
+ */
+enum program_op {
+    OP_PUSH_ARG = 0, //!< Move the argument `operand` onto the stack
+    OP_RESET_RESULT, //!< Reset the result to nil
+    OP_CALL, //!< Call the command with the top `operand` values of the stack
+};
+
+/**
+ * A single instruction
+ */
+struct program_insn {
+    uint8_t op; //!< The operation, an `enum program_op`
+    uint8_t operand; //!< Operand of the operation
+};
+
+/**
+ * A compiled command
+ */
+struct program {
+    ws_command_func func; //!< The resolved command
+    unsigned int flags; //!< Flags of the command
+    size_t len; //!< Number of instructions
+    struct program_insn insns[PROCESSOR_PROGRAM_MAX_ARGS + 2]; //!< The code
+};
+
+/**
+ * Entry of the program cache
+ */
+struct cache_entry {
+    uint64_t hash; //!< Hash of the normalized command
+    char* key; //!< The normalized command, NULL if the entry is unused
+    size_t key_len; //!< Length of the normalized command
+    uint16_t chain; //!< Next entry in the same bucket
+    uint16_t newer; //!< Next entry in LRU order, towards the newest
+    uint16_t older; //!< Next entry in LRU order, towards the oldest
+    struct program program; //!< The compiled command
+};
+
+/**
+ * A registered command
+ */
+struct registered_command {
+    struct ws_command command; //!< The command
+    struct ws_string_interned const* name; //!< Interned name of the command
+};
+
+/**
+ * A command submitted to the workers
+ *
+ * Queries are recycled, so the memory of their arenas is reused.
+ */
+struct ws_command_query {
+    struct ws_command_query* next; //!< Next query in the same list
+    ws_command_func func; //!< The command
+    ws_command_query_done done; //!< Called once the command was executed
+    void* data; //!< Passed to `done`
+    bool cancelled; //!< Whether `done` is not to be called
+    struct ws_arena arena; //!< Arguments and scratch memory of the command
+    struct ws_value* args; //!< The arguments
+    size_t argc; //!< Number of arguments
+    struct ws_value result; //!< Result of the command
+    int status; //!< Status of the command
+};
+
+/**
+ * A worker thread
+ */
+struct worker {
+    pthread_t thread; //!< The thread
+    struct ws_epoch_reader reader; //!< Critical sections of the thread
+};
+
+/**
+ * A registered latency histogram
+ */
+struct registered_histogram {
+    char const* name; //!< Name of the histogram
+    struct ws_histogram const* histogram; //!< The histogram
+};
+
+/**
+ * Internal state of the command processor
+ */
+static struct {
+    struct registered_command* commands; //!< Registered commands
+    size_t num_commands; //!< Number of registered commands
+    size_t cap_commands; //!< Capacity of `commands`
+    struct ws_arena arena; //!< Scratch memory of the current batch
+    struct ws_stack stack; //!< Argument stack of the current batch
+    struct ws_command_transaction_hooks hooks[PROCESSOR_MAX_HOOKS]; //!< Hooks
+    size_t num_hooks; //!< Number of transaction hooks
+    struct ws_command_processor_stats stats; //!< Statistics
+    struct registered_histogram histograms[PROCESSOR_MAX_HISTOGRAMS]; //!< Latencies
+    size_t num_histograms; //!< Number of latency histograms
+    struct ws_histogram batch_latency; //!< Time spent executing batches
+    uint64_t batch_start; //!< Start of the current batch
+    struct ws_command_snapshot_hook snapshots[PROCESSOR_MAX_HOOKS]; //!< Hooks
+    size_t num_snapshots; //!< Number of snapshot hooks
+    struct {
+        struct worker threads[PROCESSOR_MAX_WORKERS]; //!< The workers
+        size_t num; //!< Number of workers running
+        pthread_mutex_t lock; //!< Protects the lists shared with the workers
+        pthread_cond_t wakeup; //!< Signalled when queries are queued
+        bool stopping; //!< Whether the workers are to exit
+        struct ws_command_query* pending; //!< Queries to execute, oldest first
+        struct ws_command_query* pending_last; //!< Query queued last
+        struct ws_command_query* done; //!< Queries executed, newest first
+        struct ws_command_query* free; //!< Queries to recycle, main thread only
+        int fd; //!< Event file descriptor signalling executed queries
+        struct wl_event_source* source; //!< Source of `fd` in the event loop
+    } workers; //!< Worker threads executing queries
+    struct {
+        struct cache_entry entries[PROCESSOR_CACHE_SIZE]; //!< The programs
+        uint16_t buckets[PROCESSOR_CACHE_BUCKETS]; //!< Hash table
+        uint16_t newest; //!< Most recently used entry
+        uint16_t oldest; //!< Least recently used entry
+    } cache; //!< Cache of compiled programs
+} processor;
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Find a registered command by name
+ *
+ * @return The command or NULL if there is no such command
+ */
+static struct ws_command const*
+find_command(
+    char const* name, //!< Name of the command, not necessarily 0-terminated
+    size_t name_len //!< Length of the name
+);
+
+/**
+ * Normalize a command
+ *
+ * The normalized command consists of the name and the number of arguments,
+ * which is all a compiled program depends on. The normalized command is
+ * written to `buf` if it is large enough.
+ *
+ * @return The length of the normalized command
+ */
+static size_t
+normalize(
+    struct ws_command_call const* call, //!< The command
+    char* buf, //!< Output: the normalized command, may be NULL
+    size_t size, //!< Size of `buf`
+    uint64_t* hash //!< Output: hash of the normalized command
+);
+
+/**
+ * Compile a command
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+compile(
+    struct ws_command_call const* call, //!< The command
+    struct program* program //!< Output: the compiled command
+);
+
+/**
+ * Run a compiled command
+ *
+ * @return The status of the command
+ */
+static int
+run(
+    struct program const* program, //!< The compiled command
+    struct ws_command_call const* call, //!< Arguments to bind
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Execute a command without compiling it
+ *
+ * Used for commands with too many arguments for a program.
+ *
+ * @return The status of the command
+ */
+static int
+exec_uncompiled(
+    struct ws_command_call const* call, //!< The command
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Look up the compiled program for a command, compiling it if necessary
+ *
+ * @return The program or NULL on error, in which case `res` is set
+ */
+static struct program const*
+cache_lookup(
+    struct ws_command_call const* call, //!< The command
+    int* res //!< Output: error number
+);
+
+/**
+ * Mark a cache entry as the most recently used one
+ */
+static void
+cache_touch(
+    uint16_t index //!< Index of the entry
+);
+
+/**
+ * Remove a cache entry from its bucket and the LRU list
+ */
+static void
+cache_unlink(
+    uint16_t index //!< Index of the entry
+);
+
+/**
+ * Clear the cache
+ */
+static void
+cache_clear(void);
+
+/**
+ * Find a registered latency histogram by name
+ *
+ * @return The histogram or NULL if there is no such histogram
+ */
+static struct ws_histogram const*
+find_histogram(
+    char const* name, //!< Name of the histogram, not necessarily 0-terminated
+    size_t name_len //!< Length of the name
+);
+
+/**
+ * Command querying latency histograms
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_latency(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Call the snapshot hooks
+ */
+static void
+publish_snapshots(void);
+
+/**
+ * Main function of a worker thread
+ *
+ * @return NULL
+ */
+static void*
+worker_main(
+    void* data //!< The worker
+);
+
+/**
+ * Event loop callback: call the `done` functions of the queries executed
+ *
+ * @return 0
+ */
+static int
+workers_complete(
+    int fd, //!< The event file descriptor
+    uint32_t mask, //!< Events on the file descriptor
+    void* data //!< Unused
+);
+
+/**
+ * Get a query to fill in, recycling a previous one if possible
+ *
+ * @return The query or NULL if it could not be allocated
+ */
+static struct ws_command_query*
+query_get(void);
+
+/**
+ * Release the memory used by a query and put it up for recycling
+ */
+static void
+query_release(
+    struct ws_command_query* query //!< The query
+);
+
+/**
+ * Copy the arguments of a command into a query
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+query_copy_args(
+    struct ws_command_query* query, //!< The query
+    struct ws_command_call const* call //!< The command
+);
+
+/**
+ * Built-in commands
+ */
+static struct ws_command const processor_commands[] = {
+    {
+        .name = "latency",
+        .func = command_latency,
+        .flags = WS_COMMAND_QUERY,
+    },
+};
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_command_processor_init(void)
+{
+    processor.commands = NULL;
+    processor.num_commands = 0;
+    processor.cap_commands = 0;
+    ws_arena_init(&processor.arena, PROCESSOR_ARENA_CHUNK_SIZE);
+    processor.num_hooks = 0;
+    processor.num_snapshots = 0;
+    memset(&processor.stats, 0, sizeof(processor.stats));
+    memset(&processor.workers, 0, sizeof(processor.workers));
+    processor.workers.fd = -1;
+
+    size_t i;
+    for (i = 0; i < PROCESSOR_CACHE_BUCKETS; ++i) {
+        processor.cache.buckets[i] = PROCESSOR_CACHE_NIL;
+    }
+    for (i = 0; i < PROCESSOR_CACHE_SIZE; ++i) {
+        processor.cache.entries[i].key = NULL;
+    }
+    processor.cache.newest = PROCESSOR_CACHE_NIL;
+    processor.cache.oldest = PROCESSOR_CACHE_NIL;
+
+    processor.num_histograms = 0;
+    ws_histogram_init(&processor.batch_latency);
+    int res = ws_command_processor_add_histogram("batch",
+                                                 &processor.batch_latency);
+    if (res < 0) {
+        return res;
+    }
+
+    size_t num = sizeof(processor_commands) / sizeof(*processor_commands);
+    for (i = 0; i < num; ++i) {
+        res = ws_command_register(processor_commands + i);
+        if (res < 0) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+void
+ws_command_processor_deinit(void)
+{
+    ws_command_processor_stop_workers();
+    while (processor.workers.free) {
+        struct ws_command_query* query = processor.workers.free;
+        processor.workers.free = query->next;
+        ws_arena_deinit(&query->arena);
+        free(query);
+    }
+
+    free(processor.commands);
+    processor.commands = NULL;
+    processor.num_commands = 0;
+    processor.cap_commands = 0;
+    ws_arena_deinit(&processor.arena);
+    cache_clear();
+    processor.num_histograms = 0;
+}
+
+int
+ws_command_register(
+    struct ws_command const* command
+) {
+    if (find_command(command->name, strlen(command->name))) {
+        return -EEXIST;
+    }
+
+    struct ws_string_interned const* name;
+    name = ws_string_intern(command->name, strlen(command->name));
+    if (!name) {
+        return -ENOMEM;
+    }
+
+    if (processor.num_commands == processor.cap_commands) {
+        size_t cap = processor.cap_commands ? processor.cap_commands * 2 : 16;
+        struct registered_command* commands;
+        commands = realloc(processor.commands, cap * sizeof(*commands));
+        if (!commands) {
+            return -ENOMEM;
+        }
+        processor.commands = commands;
+        processor.cap_commands = cap;
+    }
+
+    processor.commands[processor.num_commands].command = *command;
+    processor.commands[processor.num_commands].name = name;
+    ++processor.num_commands;
+    return 0;
+}
+
+int
+ws_command_processor_add_transaction_hooks(
+    struct ws_command_transaction_hooks const* hooks
+) {
+    if (processor.num_hooks >= PROCESSOR_MAX_HOOKS) {
+        return -ENOSPC;
+    }
+    processor.hooks[processor.num_hooks++] = *hooks;
+    return 0;
+}
+
+int
+ws_command_processor_add_snapshot_hook(
+    struct ws_command_snapshot_hook const* hook
+) {
+    if (processor.num_snapshots >= PROCESSOR_MAX_HOOKS) {
+        return -ENOSPC;
+    }
+    processor.snapshots[processor.num_snapshots++] = *hook;
+    return 0;
+}
+
+int
+ws_command_processor_add_histogram(
+    char const* name,
+    struct ws_histogram const* histogram
+) {
+    if (find_histogram(name, strlen(name))) {
+        return -EEXIST;
+    }
+    if (processor.num_histograms >= PROCESSOR_MAX_HISTOGRAMS) {
+        return -ENOSPC;
+    }
+
+    struct registered_histogram* entry;
+    entry = processor.histograms + processor.num_histograms++;
+    entry->name = name;
+    entry->histogram = histogram;
+    return 0;
+}
+
+struct ws_arena*
+ws_command_processor_begin_batch(void)
+{
+    processor.batch_start = ws_clock_now();
+
+    // the stack lives in the arena, so it is recreated for every batch
+    if (ws_stack_init(&processor.stack, &processor.arena,
+                      PROCESSOR_STACK_CAP) < 0) {
+        ws_stack_deinit(&processor.stack);
+        ws_arena_reset(&processor.arena);
+        return NULL;
+    }
+    return &processor.arena;
+}
+
+int
+ws_command_processor_exec(
+    struct ws_command_call const* call,
+    struct ws_value* result
+) {
+    int res;
+
+    if (call->argc > PROCESSOR_PROGRAM_MAX_ARGS) {
+        res = exec_uncompiled(call, result);
+    } else {
+        struct program const* program = cache_lookup(call, &res);
+        if (program) {
+            res = run(program, call, result);
+        }
+    }
+
+    if (res < 0) {
+        WS_LOG(WS_LOG_MODULE_COMMAND, WS_LOG_DEBUG, "%.*s (%zu args): %s",
+               (int) call->name_len, call->name, call->argc, strerror(-res));
+    } else {
+        WS_LOG(WS_LOG_MODULE_COMMAND, WS_LOG_TRACE, "%.*s (%zu args): ok",
+               (int) call->name_len, call->name, call->argc);
+    }
+    return res;
+}
+
+int
+ws_command_processor_exec_transaction(
+    struct ws_command_call const* calls,
+    size_t num,
+    struct ws_value* results,
+    int* statuses
+) {
+    size_t i;
+    for (i = 0; i < processor.num_hooks; ++i) {
+        if (processor.hooks[i].begin) {
+            processor.hooks[i].begin(processor.hooks[i].data);
+        }
+    }
+
+    int res = 0;
+    for (i = 0; i < num; ++i) {
+        if (res < 0) {
+            statuses[i] = -ECANCELED;
+            continue;
+        }
+        statuses[i] = ws_command_processor_exec(calls + i, results + i);
+        res = statuses[i];
+    }
+
+    for (i = 0; i < processor.num_hooks; ++i) {
+        void (*hook)(void*);
+        hook = (res < 0) ? processor.hooks[i].abort : processor.hooks[i].commit;
+        if (hook) {
+            hook(processor.hooks[i].data);
+        }
+    }
+
+    return res;
+}
+
+size_t
+ws_command_processor_end_batch(void)
+{
+    ws_stack_deinit(&processor.stack);
+
+    size_t used = ws_arena_reset(&processor.arena);
+    ws_histogram_record(&processor.batch_latency,
+                        ws_clock_now() - processor.batch_start);
+    processor.stats.batches++;
+    processor.stats.last_batch_bytes = used;
+    if (used > processor.stats.peak_batch_bytes) {
+        processor.stats.peak_batch_bytes = used;
+    }
+    return used;
+}
+
+int
+ws_command_processor_start_workers(
+    struct wl_event_loop* loop,
+    size_t num
+) {
+    if (processor.workers.fd >= 0) {
+        return -EALREADY;
+    }
+    if (!num) {
+        return 0;
+    }
+    num = WS_MIN(num, (size_t) PROCESSOR_MAX_WORKERS);
+
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    int res = pthread_mutex_init(&processor.workers.lock, NULL);
+    if (res != 0) {
+        close(fd);
+        return -res;
+    }
+    res = pthread_cond_init(&processor.workers.wakeup, NULL);
+    if (res != 0) {
+        pthread_mutex_destroy(&processor.workers.lock);
+        close(fd);
+        return -res;
+    }
+
+    processor.workers.fd = fd;
+    processor.workers.stopping = false;
+    processor.workers.source = wl_event_loop_add_fd(loop, fd,
+                                                    WL_EVENT_READABLE,
+                                                    workers_complete, NULL);
+    if (!processor.workers.source) {
+        ws_command_processor_stop_workers();
+        return -ENOMEM;
+    }
+
+    while (processor.workers.num < num) {
+        struct worker* worker;
+        worker = processor.workers.threads + processor.workers.num;
+        res = ws_epoch_register(&worker->reader);
+        if (res < 0) {
+            ws_command_processor_stop_workers();
+            return res;
+        }
+
+        res = pthread_create(&worker->thread, NULL, worker_main, worker);
+        if (res != 0) {
+            ws_epoch_unregister(&worker->reader);
+            ws_command_processor_stop_workers();
+            return -res;
+        }
+        ++processor.workers.num;
+    }
+
+    WS_LOG(WS_LOG_MODULE_COMMAND, WS_LOG_INFO, "started %zu query workers",
+           processor.workers.num);
+    return 0;
+}
+
+void
+ws_command_processor_stop_workers(void)
+{
+    if (processor.workers.fd < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&processor.workers.lock);
+    processor.workers.stopping = true;
+    pthread_cond_broadcast(&processor.workers.wakeup);
+    pthread_mutex_unlock(&processor.workers.lock);
+
+    while (processor.workers.num) {
+        struct worker* worker;
+        worker = processor.workers.threads + --processor.workers.num;
+        pthread_join(worker->thread, NULL);
+        ws_epoch_unregister(&worker->reader);
+    }
+
+    // queries nobody got to complete as cancelled, after those executed
+    struct ws_command_query* pending = processor.workers.pending;
+    processor.workers.pending = NULL;
+    processor.workers.pending_last = NULL;
+    workers_complete(processor.workers.fd, 0, NULL);
+    while (pending) {
+        struct ws_command_query* query = pending;
+        pending = query->next;
+        if (!query->cancelled) {
+            ws_value_nil_init(&query->result);
+            query->done(query->data, -ECANCELED, &query->result);
+        }
+        query_release(query);
+    }
+
+    if (processor.workers.source) {
+        wl_event_source_remove(processor.workers.source);
+        processor.workers.source = NULL;
+    }
+    close(processor.workers.fd);
+    processor.workers.fd = -1;
+    pthread_cond_destroy(&processor.workers.wakeup);
+    pthread_mutex_destroy(&processor.workers.lock);
+    ws_epoch_collect();
+}
+
+int
+ws_command_processor_submit(
+    struct ws_command_call const* call,
+    ws_command_query_done done,
+    void* data,
+    struct ws_command_query** query
+) {
+    if (!processor.workers.num) {
+        return -EOPNOTSUPP;
+    }
+
+    // unknown commands are reported by ws_command_processor_exec()
+    struct ws_command const* command = find_command(call->name,
+                                                    call->name_len);
+    if (!command || !(command->flags & WS_COMMAND_QUERY)) {
+        return -EOPNOTSUPP;
+    }
+
+    // named values refer to memory of the batch, which is gone by the time
+    // the worker gets to the query
+    size_t i;
+    for (i = 0; i < call->argc; ++i) {
+        if (ws_value_get_type(call->args + i) == WS_VALUE_TYPE_NAMED) {
+            return -EOPNOTSUPP;
+        }
+    }
+
+    struct ws_command_query* self = query_get();
+    if (!self) {
+        return -ENOMEM;
+    }
+    self->func = command->func;
+    self->done = done;
+    self->data = data;
+    self->cancelled = false;
+    int res = query_copy_args(self, call);
+    if (res < 0) {
+        query_release(self);
+        return res;
+    }
+
+    publish_snapshots();
+
+    self->next = NULL;
+    pthread_mutex_lock(&processor.workers.lock);
+    if (processor.workers.pending_last) {
+        processor.workers.pending_last->next = self;
+    } else {
+        processor.workers.pending = self;
+    }
+    processor.workers.pending_last = self;
+    pthread_cond_signal(&processor.workers.wakeup);
+    pthread_mutex_unlock(&processor.workers.lock);
+
+    ++processor.stats.queries;
+    WS_LOG(WS_LOG_MODULE_COMMAND, WS_LOG_TRACE, "%.*s (%zu args): submitted",
+           (int) call->name_len, call->name, call->argc);
+    *query = self;
+    return 0;
+}
+
+void
+ws_command_processor_cancel(
+    struct ws_command_query* query
+) {
+    query->cancelled = true;
+}
+
+void
+ws_command_processor_get_stats(
+    struct ws_command_processor_stats* stats
+) {
+    *stats = processor.stats;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static struct ws_command const*
+find_command(
+    char const* name,
+    size_t name_len
+) {
+    // a name which was never interned is not the name of any command
+    struct ws_string_interned const* interned;
+    interned = ws_string_intern_find(name, name_len);
+    if (!interned) {
+        return NULL;
+    }
+
+    size_t i;
+    for (i = 0; i < processor.num_commands; ++i) {
+        if (processor.commands[i].name == interned) {
+            return &processor.commands[i].command;
+        }
+    }
+    return NULL;
+}
+
+static size_t
+normalize(
+    struct ws_command_call const* call,
+    char* buf,
+    size_t size,
+    uint64_t* hash
+) {
+    // FNV-1a
+    uint64_t h = UINT64_C(14695981039346656037);
+    size_t len = 0;
+
+#define NORMALIZE_PUT(c_) do { \
+        unsigned char c = (unsigned char) (c_); \
+        h = (h ^ c) * UINT64_C(1099511628211); \
+        if (len < size) { \
+            buf[len] = (char) c; \
+        } \
+        ++len; \
+    } while (0)
+
+    size_t i;
+    for (i = 0; i < call->name_len; ++i) {
+        NORMALIZE_PUT(call->name[i]);
+    }
+    NORMALIZE_PUT('\0');
+
+    // the types of the arguments do not matter, the command checks them
+    NORMALIZE_PUT(call->argc);
+
+#undef NORMALIZE_PUT
+
+    *hash = h;
+    return len;
+}
+
+static int
+compile(
+    struct ws_command_call const* call,
+    struct program* program
+) {
+    struct ws_command const* command = find_command(call->name,
+                                                    call->name_len);
+    if (!command) {
+        return -ENOENT;
+    }
+
+    program->func = command->func;
+    program->flags = command->flags;
+    program->len = 0;
+
+    // arguments are moved onto the stack in order, so the command sees them
+    // as an array
+    size_t i;
+    for (i = 0; i < call->argc; ++i) {
+        program->insns[program->len++] = (struct program_insn) {
+            .op = OP_PUSH_ARG,
+            .operand = (uint8_t) i,
+        };
+    }
+    program->insns[program->len++] = (struct program_insn) {
+        .op = OP_RESET_RESULT,
+    };
+    program->insns[program->len++] = (struct program_insn) {
+        .op = OP_CALL,
+        .operand = (uint8_t) call->argc,
+    };
+    return 0;
+}
+
+static int
+run(
+    struct program const* program,
+    struct ws_command_call const* call,
+    struct ws_value* result
+) {
+    struct ws_command_ctx ctx = {
+        .arena = &processor.arena,
+    };
+    size_t pushed = 0;
+    int res = 0;
+
+    size_t pc;
+    for (pc = 0; pc < program->len; ++pc) {
+        struct program_insn insn = program->insns[pc];
+        switch (insn.op) {
+        case OP_PUSH_ARG:
+            res = ws_stack_push(&processor.stack, call->args + insn.operand);
+            if (res < 0) {
+                goto out;
+            }
+            ++pushed;
+            break;
+
+        case OP_RESET_RESULT:
+            ws_value_deinit(result);
+            ws_value_nil_init(result);
+            break;
+
+        case OP_CALL:
+            if (program->flags & WS_COMMAND_QUERY) {
+                publish_snapshots();
+            }
+            res = program->func(&ctx,
+                                ws_stack_top_n(&processor.stack, insn.operand),
+                                insn.operand, result);
+            break;
+
+        default:
+            res = -EINVAL;
+            goto out;
+        }
+    }
+
+out:
+    ws_stack_drop(&processor.stack, pushed);
+    return res;
+}
+
+static int
+exec_uncompiled(
+    struct ws_command_call const* call,
+    struct ws_value* result
+) {
+    struct ws_command const* command = find_command(call->name,
+                                                    call->name_len);
+    if (!command) {
+        return -ENOENT;
+    }
+
+    size_t i;
+    for (i = 0; i < call->argc; ++i) {
+        int res = ws_stack_push(&processor.stack, call->args + i);
+        if (res < 0) {
+            ws_stack_drop(&processor.stack, i);
+            return res;
+        }
+    }
+
+    struct ws_command_ctx ctx = {
+        .arena = &processor.arena,
+    };
+
+    if (command->flags & WS_COMMAND_QUERY) {
+        publish_snapshots();
+    }
+
+    ws_value_deinit(result);
+    ws_value_nil_init(result);
+    int res = command->func(&ctx, ws_stack_top_n(&processor.stack, call->argc),
+                            call->argc, result);
+
+    ws_stack_drop(&processor.stack, call->argc);
+    return res;
+}
+
+static struct program const*
+cache_lookup(
+    struct ws_command_call const* call,
+    int* res
+) {
+    char key[256];
+    uint64_t hash;
+    size_t key_len = normalize(call, key, sizeof(key), &hash);
+
+    uint16_t* bucket = processor.cache.buckets +
+                       (hash & (PROCESSOR_CACHE_BUCKETS - 1));
+    uint16_t index;
+    for (index = *bucket; index != PROCESSOR_CACHE_NIL;
+         index = processor.cache.entries[index].chain) {
+        struct cache_entry* entry = processor.cache.entries + index;
+        if ((entry->hash != hash) || (entry->key_len != key_len)) {
+            continue;
+        }
+
+        // rare: keys which did not fit `key` are normalized again
+        char* cmp = key;
+        if (key_len > sizeof(key)) {
+            cmp = ws_arena_alloc(&processor.arena, key_len);
+            if (!cmp) {
+                *res = -ENOMEM;
+                return NULL;
+            }
+            normalize(call, cmp, key_len, &hash);
+        }
+        if (memcmp(entry->key, cmp, key_len) == 0) {
+            ++processor.stats.cache_hits;
+            cache_touch(index);
+            return &entry->program;
+        }
+    }
+
+    ++processor.stats.cache_misses;
+
+    // nothing is evicted for commands which can not be compiled, e.g. unknown
+    // ones
+    struct program program;
+    *res = compile(call, &program);
+    if (*res < 0) {
+        return NULL;
+    }
+    char* entry_key = malloc(key_len);
+    if (!entry_key) {
+        *res = -ENOMEM;
+        return NULL;
+    }
+    if (key_len > sizeof(key)) {
+        normalize(call, entry_key, key_len, &hash);
+    } else {
+        memcpy(entry_key, key, key_len);
+    }
+
+    // use a free entry or evict the least recently used one
+    for (index = 0; index < PROCESSOR_CACHE_SIZE; ++index) {
+        if (!processor.cache.entries[index].key) {
+            break;
+        }
+    }
+    if (index == PROCESSOR_CACHE_SIZE) {
+        index = processor.cache.oldest;
+        cache_unlink(index);
+    }
+    WS_LOG(WS_LOG_MODULE_COMMAND, WS_LOG_TRACE,
+           "compiled %.*s (%zu args) into cache entry %u",
+           (int) call->name_len, call->name, call->argc, (unsigned) index);
+
+    struct cache_entry* entry = processor.cache.entries + index;
+    entry->program = program;
+    entry->key = entry_key;
+    entry->key_len = key_len;
+    entry->hash = hash;
+
+    entry->chain = *bucket;
+    *bucket = index;
+    entry->older = PROCESSOR_CACHE_NIL;
+    entry->newer = PROCESSOR_CACHE_NIL;
+    cache_touch(index);
+    return &entry->program;
+}
+
+static void
+cache_touch(
+    uint16_t index
+) {
+    struct cache_entry* entry = processor.cache.entries + index;
+    if (processor.cache.newest == index) {
+        return;
+    }
+
+    // unlink from the LRU list, if linked at all
+    if (entry->newer != PROCESSOR_CACHE_NIL) {
+        processor.cache.entries[entry->newer].older = entry->older;
+    }
+    if (entry->older != PROCESSOR_CACHE_NIL) {
+        processor.cache.entries[entry->older].newer = entry->newer;
+    }
+    if (processor.cache.oldest == index) {
+        processor.cache.oldest = entry->newer;
+    }
+
+    entry->newer = PROCESSOR_CACHE_NIL;
+    entry->older = processor.cache.newest;
+    if (processor.cache.newest != PROCESSOR_CACHE_NIL) {
+        processor.cache.entries[processor.cache.newest].newer = index;
+    }
+    processor.cache.newest = index;
+    if (processor.cache.oldest == PROCESSOR_CACHE_NIL) {
+        processor.cache.oldest = index;
+    }
+}
+
+static void
+cache_unlink(
+    uint16_t index
+) {
+    struct cache_entry* entry = processor.cache.entries + index;
+
+    uint16_t* link = processor.cache.buckets +
+                     (entry->hash & (PROCESSOR_CACHE_BUCKETS - 1));
+    while (*link != index) {
+        link = &processor.cache.entries[*link].chain;
+    }
+    *link = entry->chain;
+
+    if (entry->newer != PROCESSOR_CACHE_NIL) {
+        processor.cache.entries[entry->newer].older = entry->older;
+    } else {
+        processor.cache.newest = entry->older;
+    }
+    if (entry->older != PROCESSOR_CACHE_NIL) {
+        processor.cache.entries[entry->older].newer = entry->newer;
+    } else {
+        processor.cache.oldest = entry->newer;
+    }
+
+    free(entry->key);
+    entry->key = NULL;
+}
+
+static void
+cache_clear(void)
+{
+    size_t i;
+    for (i = 0; i < PROCESSOR_CACHE_SIZE; ++i) {
+        free(processor.cache.entries[i].key);
+        processor.cache.entries[i].key = NULL;
+    }
+    for (i = 0; i < PROCESSOR_CACHE_BUCKETS; ++i) {
+        processor.cache.buckets[i] = PROCESSOR_CACHE_NIL;
+    }
+    processor.cache.newest = PROCESSOR_CACHE_NIL;
+    processor.cache.oldest = PROCESSOR_CACHE_NIL;
+}
+
+static struct ws_histogram const*
+find_histogram(
+    char const* name,
+    size_t name_len
+) {
+    size_t i;
+    for (i = 0; i < processor.num_histograms; ++i) {
+        char const* candidate = processor.histograms[i].name;
+        if ((strncmp(candidate, name, name_len) == 0) &&
+                (candidate[name_len] == '\0')) {
+            return processor.histograms[i].histogram;
+        }
+    }
+    return NULL;
+}
+
+static int
+command_latency(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if (argc == 2) {
+        if ((ws_value_get_type(args) != WS_VALUE_TYPE_STRING) ||
+                (ws_value_get_type(args + 1) != WS_VALUE_TYPE_INT)) {
+            return -EINVAL;
+        }
+
+        int64_t percentile = ws_value_int_get(args + 1);
+        if ((percentile < 0) || (percentile > 100)) {
+            return -EINVAL;
+        }
+
+        struct ws_histogram const* histogram;
+        histogram = find_histogram(ws_value_string_get(args),
+                                   ws_value_string_len(args));
+        if (!histogram) {
+            return -ENOENT;
+        }
+
+        uint64_t ns = ws_histogram_percentile(histogram, (double) percentile);
+        ws_value_deinit(result);
+        ws_value_int_init(result, ns > INT64_MAX ? INT64_MAX : (int64_t) ns);
+        return 0;
+    }
+
+    if (argc != 0) {
+        return -EINVAL;
+    }
+
+    // one line per histogram, percentiles in microseconds
+    size_t size = 1;
+    size_t i;
+    for (i = 0; i < processor.num_histograms; ++i) {
+        size += strlen(processor.histograms[i].name) +
+                PROCESSOR_LATENCY_LINE_MAX;
+    }
+
+    char* summary = ws_arena_alloc(ctx->arena, size);
+    if (!summary) {
+        return -ENOMEM;
+    }
+
+    size_t len = 0;
+    summary[0] = '\0';
+    for (i = 0; i < processor.num_histograms; ++i) {
+        struct ws_histogram const* histogram = processor.histograms[i].histogram;
+        int n = snprintf(summary + len, size - len,
+                         "%s: n=%llu p50=%lluus p90=%lluus p99=%lluus "
+                         "p99.9=%lluus max=%lluus\n", processor.histograms[i].name,
+                         (unsigned long long) ws_histogram_count(histogram),
+                         (unsigned long long)
+                            ws_histogram_percentile(histogram, 50) / 1000,
+                         (unsigned long long)
+                            ws_histogram_percentile(histogram, 90) / 1000,
+                         (unsigned long long)
+                            ws_histogram_percentile(histogram, 99) / 1000,
+                         (unsigned long long)
+                            ws_histogram_percentile(histogram, 99.9) / 1000,
+                         (unsigned long long)
+                            ws_histogram_percentile(histogram, 100) / 1000);
+        if (n < 0) {
+            return -EIO;
+        }
+        len += WS_MIN((size_t) n, size - len - 1);
+    }
+
+    ws_value_deinit(result);
+    ws_value_string_init(result);
+    ws_value_string_set_borrowed(result, summary, len);
+    return 0;
+}
+
+static void
+publish_snapshots(void)
+{
+    size_t i;
+    for (i = 0; i < processor.num_snapshots; ++i) {
+        processor.snapshots[i].publish(processor.snapshots[i].data);
+    }
+}
+
+static void*
+worker_main(
+    void* data
+) {
+    struct worker* worker = data;
+
+    pthread_mutex_lock(&processor.workers.lock);
+    for (;;) {
+        while (!processor.workers.pending && !processor.workers.stopping) {
+            pthread_cond_wait(&processor.workers.wakeup,
+                              &processor.workers.lock);
+        }
+        if (processor.workers.stopping) {
+            break;
+        }
+
+        struct ws_command_query* query = processor.workers.pending;
+        processor.workers.pending = query->next;
+        if (!processor.workers.pending) {
+            processor.workers.pending_last = NULL;
+        }
+        pthread_mutex_unlock(&processor.workers.lock);
+
+        struct ws_command_ctx ctx = {
+            .arena = &query->arena,
+        };
+        ws_value_nil_init(&query->result);
+        ws_epoch_enter(&worker->reader);
+        query->status = query->func(&ctx, query->args, query->argc,
+                                    &query->result);
+        ws_epoch_exit(&worker->reader);
+
+        pthread_mutex_lock(&processor.workers.lock);
+        query->next = processor.workers.done;
+        processor.workers.done = query;
+
+        // only fails if the counter would overflow, which it can not
+        uint64_t one = 1;
+        ssize_t len = write(processor.workers.fd, &one, sizeof(one));
+        (void) len;
+    }
+    pthread_mutex_unlock(&processor.workers.lock);
+    return NULL;
+}
+
+static int
+workers_complete(
+    int fd,
+    uint32_t mask,
+    void* data
+) {
+    uint64_t count;
+    ssize_t len = read(fd, &count, sizeof(count));
+    (void) len;
+
+    pthread_mutex_lock(&processor.workers.lock);
+    struct ws_command_query* done = processor.workers.done;
+    processor.workers.done = NULL;
+    pthread_mutex_unlock(&processor.workers.lock);
+
+    // report in the order the queries were executed
+    struct ws_command_query* ordered = NULL;
+    while (done) {
+        struct ws_command_query* query = done;
+        done = query->next;
+        query->next = ordered;
+        ordered = query;
+    }
+
+    while (ordered) {
+        struct ws_command_query* query = ordered;
+        ordered = query->next;
+        if (!query->cancelled) {
+            query->done(query->data, query->status, &query->result);
+        }
+        query_release(query);
+    }
+
+    // the workers left the critical sections the results were made in
+    ws_epoch_collect();
+    return 0;
+}
+
+static struct ws_command_query*
+query_get(void)
+{
+    struct ws_command_query* query = processor.workers.free;
+    if (query) {
+        processor.workers.free = query->next;
+        return query;
+    }
+
+    query = calloc(1, sizeof(*query));
+    if (query) {
+        ws_arena_init(&query->arena, PROCESSOR_QUERY_CHUNK_SIZE);
+    }
+    return query;
+}
+
+static void
+query_release(
+    struct ws_command_query* query
+) {
+    ws_value_deinit(&query->result);
+    ws_arena_reset(&query->arena);
+    query->args = NULL;
+    query->argc = 0;
+    query->next = processor.workers.free;
+    processor.workers.free = query;
+}
+
+static int
+query_copy_args(
+    struct ws_command_query* query,
+    struct ws_command_call const* call
+) {
+    ws_value_init(&query->result);
+    query->argc = call->argc;
+    if (!call->argc) {
+        query->args = NULL;
+        return 0;
+    }
+
+    query->args = ws_arena_alloc(&query->arena,
+                                 call->argc * sizeof(*query->args));
+    if (!query->args) {
+        return -ENOMEM;
+    }
+
+    // strings are copied into the arena, anything else is copied bitwise
+    size_t i;
+    for (i = 0; i < call->argc; ++i) {
+        struct ws_value* arg = query->args + i;
+        ws_value_init(arg);
+        if (ws_value_get_type(call->args + i) != WS_VALUE_TYPE_STRING) {
+            ws_value_copy(arg, call->args + i);
+            continue;
+        }
 
+        size_t len = ws_value_string_len(call->args + i);
+        char* str = ws_arena_strndup(&query->arena,
+                                     ws_value_string_get(call->args + i), len);
+        if (!str) {
+            return -ENOMEM;
+        }
+        ws_value_string_init(arg);
+        ws_value_string_set_borrowed(arg, str, len);
+    }
+    return 0;
+}
@@ -28,6 +28,352 @@
 #ifndef __WS_COMMAND_PROCESSOR_H__
 #define __WS_COMMAND_PROCESSOR_H__
 
+/**
+ * @file processor.h
+ *
+ * @brief Command processor
+ *
+ * The command processor executes commands sent by clients. Commands are
+ * registered by the modules implementing them and looked up by name.
+ *
+ * Commands are executed in batches. All scratch memory needed while executing
+ * a batch, e.g. intermediate values, temporary arrays and strings or the
+ * argument stack, is allocated from an arena which is reset in one go once the
+ * batch is done. Thus, executing commands does not call malloc() once the
+ * arena has grown to the size of a typical batch.
+ *
+ * Before a command is executed, it is compiled into a short program for the
+ * argument stack: the command name is resolved and the arguments are turned
+ * into a sequence of instructions. Programs are kept in an LRU cache keyed by
+ * a hash of the normalized command, i.e. the name and the number of
+ * arguments. Scripts send the same commands over and over, so most commands
+ * only bind their new argument values to a cached program.
+ *
+ * Several commands may be executed as a transaction. Modules interested in
+ * transactions, e.g. to defer changes until all commands are done, register
+ * transaction hooks.
+ *
+ * Modules may also register latency histograms (see util/histogram.h). The
+ * built-in `latency` command queries them:
+ *
+ * - `["latency"]` returns a string summarizing all histograms,
+ * - `["latency", "<name>", <percentile>]` returns the given percentile of the
+ *   named histogram in nanoseconds, the percentile being an integer between 0
+ *   and 100.
+ *
+ * The processor itself registers the histogram `batch`, holding the time
+ * spent executing each batch of commands.
+ *
+ * Commands flagged with WS_COMMAND_QUERY only read state. Once workers were
+ * started with ws_command_processor_start_workers(), callers may submit such
+ * commands with ws_command_processor_submit() to be executed by a pool of
+ * threads, so heavy introspection does not compete with the compositor for
+ * the main thread. A query must not touch anything owned by the main thread
+ * except data published for readers with epoch based reclamation (see
+ * util/epoch.h), workers execute queries inside a critical section. Before a
+ * query is executed, by a worker or by the main thread, the snapshot hooks
+ * are called on the main thread, letting modules publish the state changed
+ * since.
+ */
+
+#include <stddef.h>
+
+#include "util/attributes.h"
+#include "values/value.h"
+
+struct wl_event_loop;
+struct ws_arena;
+struct ws_command_query;
+struct ws_histogram;
+
+/**
+ * Flag of a command which only reads state and may be executed by a worker
+ */
+#define WS_COMMAND_QUERY (1u << 0)
+
+/**
+ * Context passed to a command while it is executed
+ */
+struct ws_command_ctx {
+    struct ws_arena* arena; //!< Scratch memory, valid until the end of the batch
+};
+
+/**
+ * Function implementing a command
+ *
+ * The arguments are owned by the processor and must not be deinitialized by
+ * the command. The result is initialized by the processor as nil and may be
+ * overwritten by the command. Memory referenced by the result (e.g. borrowed
+ * strings) may be allocated from the arena in `ctx`.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+typedef int (*ws_command_func)(
+    struct ws_command_ctx* ctx, //!< Execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command definition
+ */
+struct ws_command {
+    char const* name; //!< Name of the command
+    ws_command_func func; //!< Function implementing the command
+    unsigned int flags; //!< Flags of the command, e.g. WS_COMMAND_QUERY
+};
+
+/**
+ * Function called on the main thread once a query submitted was executed
+ *
+ * The result is owned by the processor and only valid during the call.
+ */
+typedef void (*ws_command_query_done)(
+    void* data, //!< Data passed to ws_command_processor_submit()
+    int status, //!< Status of the command
+    struct ws_value const* result //!< Result of the command
+);
+
+/**
+ * Invocation of a command, as received from a client
+ */
+struct ws_command_call {
+    char const* name; //!< Name of the command, not necessarily 0-terminated
+    size_t name_len; //!< Length of the name
+    struct ws_value* args; //!< The arguments
+    size_t argc; //!< Number of arguments
+};
+
+/**
+ * Hooks called around transactions
+ */
+struct ws_command_transaction_hooks {
+    void (*begin)(void* data); //!< Called before the first command
+    void (*commit)(void* data); //!< Called after all commands succeeded
+    void (*abort)(void* data); //!< Called after a command failed
+    void* data; //!< Passed to the hooks
+};
+
+/**
+ * Hook called before a query is handed to a worker
+ */
+struct ws_command_snapshot_hook {
+    void (*publish)(void* data); //!< Publishes the state changed, if any
+    void* data; //!< Passed to the hook
+};
+
+/**
+ * Statistics of the command processor
+ */
+struct ws_command_processor_stats {
+    size_t batches; //!< Number of batches executed
+    size_t last_batch_bytes; //!< Scratch memory used by the last batch
+    size_t peak_batch_bytes; //!< Scratch memory used by the biggest batch
+    size_t cache_hits; //!< Commands executed with a cached program
+    size_t cache_misses; //!< Commands which had to be compiled
+    size_t queries; //!< Commands submitted to the workers
+};
+
+/**
+ * Initialize the command processor
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_command_processor_init(void);
+
+/**
+ * Deinitialize the command processor
+ */
+void
+ws_command_processor_deinit(void);
+
+/**
+ * Register a command
+ *
+ * The definition is copied, the name however must stay valid as long as the
+ * processor is initialized.
+ *
+ * @return 0 on success, -EEXIST if a command with the same name is already
+ *         registered, another negative error number otherwise
+ */
+int
+ws_command_register(
+    struct ws_command const* command //!< The command to register
+)
+__ws_nonnull__(1);
+
+/**
+ * Register transaction hooks
+ *
+ * The hooks are copied.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_command_processor_add_transaction_hooks(
+    struct ws_command_transaction_hooks const* hooks //!< The hooks
+)
+__ws_nonnull__(1);
+
+/**
+ * Register a snapshot hook
+ *
+ * The hook is copied.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_command_processor_add_snapshot_hook(
+    struct ws_command_snapshot_hook const* hook //!< The hook
+)
+__ws_nonnull__(1);
+
+/**
+ * Register a latency histogram
+ *
+ * The histogram is queried by the `latency` command. It must stay valid as long
+ * as the processor is initialized, the name as well.
+ *
+ * @return 0 on success, -EEXIST if a histogram with the same name is already
+ *         registered, another negative error number otherwise
+ */
+int
+ws_command_processor_add_histogram(
+    char const* name, //!< Name of the histogram
+    struct ws_histogram const* histogram //!< The histogram
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Begin a batch of commands
+ *
+ * If the batch can not be begun, ws_command_processor_end_batch() must not be
+ * called.
+ *
+ * @return The arena holding the scratch memory of the batch, NULL if memory
+ *         for the batch could not be allocated. Callers may use the arena for
+ *         the arguments they pass to ws_command_processor_exec().
+ */
+struct ws_arena*
+ws_command_processor_begin_batch(void);
+
+/**
+ * Execute a command
+ *
+ * May only be called between ws_command_processor_begin_batch() and
+ * ws_command_processor_end_batch(). The arguments are consumed: they are
+ * moved onto the argument stack and left uninitialized.
+ *
+ * `result` must be initialized. It is valid until the end of the batch.
+ *
+ * @return 0 on success, -ENOENT if there is no such command, another negative
+ *         error number otherwise
+ */
+int
+ws_command_processor_exec(
+    struct ws_command_call const* call, //!< The command to execute
+    struct ws_value* result //!< Output: result of the command
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Execute commands as a transaction
+ *
+ * Like ws_command_processor_exec(), but the transaction hooks are called
+ * around the commands. The commands are executed in order. If a command
+ * fails, the remaining commands are not executed, their status is set to
+ * -ECANCELED and the transaction is aborted.
+ *
+ * @return 0 if the transaction was committed, the status of the failing
+ *         command otherwise
+ */
+int
+ws_command_processor_exec_transaction(
+    struct ws_command_call const* calls, //!< The commands to execute
+    size_t num, //!< Number of commands
+    struct ws_value* results, //!< Output: results, one per command
+    int* statuses //!< Output: status of each command
+)
+__ws_nonnull__(1, 3, 4);
+
+/**
+ * End a batch of commands
+ *
+ * Releases all scratch memory allocated during the batch.
+ *
+ * @return Number of bytes of scratch memory used by the batch
+ */
+size_t
+ws_command_processor_end_batch(void);
+
+/**
+ * Start the worker threads executing queries
+ *
+ * Completed queries are reported from the event loop given. Passing 0 workers
+ * is valid and leaves all commands to the main thread.
+ *
+ * @return 0 on success, -EALREADY if workers were already started, another
+ *         negative error number otherwise
+ */
+int
+ws_command_processor_start_workers(
+    struct wl_event_loop* loop, //!< The event loop of the main thread
+    size_t num //!< Number of workers
+)
+__ws_nonnull__(1);
+
+/**
+ * Stop the worker threads
+ *
+ * Queries not executed yet complete with -ECANCELED. Does nothing if no
+ * workers were started.
+ */
+void
+ws_command_processor_stop_workers(void);
 
+/**
+ * Submit a command to be executed by a worker
+ *
+ * Only commands flagged with WS_COMMAND_QUERY without named arguments are
+ * executed by workers, the arguments are copied. `done` is called from the
+ * event loop once the command was executed, unless the query was cancelled.
+ *
+ * May be called while a batch is executed, but not from a transaction.
+ *
+ * @return 0 if the command was submitted, -EOPNOTSUPP if it has to be
+ *         executed with ws_command_processor_exec() instead, another negative
+ *         error number otherwise
+ */
+int
+ws_command_processor_submit(
+    struct ws_command_call const* call, //!< The command to execute
+    ws_command_query_done done, //!< Called once the command was executed
+    void* data, //!< Passed to `done`
+    struct ws_command_query** query //!< Output: handle of the query
+)
+__ws_nonnull__(1, 2, 4);
+
+/**
+ * Cancel a query
+ *
+ * The query may still be executed, but its `done` function is not called.
+ * The handle is invalid afterwards.
+ */
+void
+ws_command_processor_cancel(
+    struct ws_command_query* query //!< The query to cancel
+)
+__ws_nonnull__(1);
+
+/**
+ * Get statistics of the command processor
+ */
+void
+ws_command_processor_get_stats(
+    struct ws_command_processor_stats* stats //!< Output: the statistics
+)
+__ws_nonnull__(1);
 
 #endif // __WS_COMMAND_PROCESSOR_H__
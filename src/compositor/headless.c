@@ -0,0 +1,342 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "compositor/headless.h"
+#include "compositor/module.h"
+#include "compositor/software.h"
+#include "util/clock.h"
+
+/**
+ * A headless output
+ */
+struct headless_output {
+    struct ws_output* output; //!< The output
+    struct wl_event_source* timer; //!< Timer driving the output
+    uint64_t period; //!< Duration of a frame in nanoseconds
+    uint64_t next; //!< Time of the next frame in nanoseconds
+    struct ws_headless_stats stats; //!< Statistics
+};
+
+/**
+ * State of the headless backend
+ */
+static struct {
+    struct wl_event_loop* loop; //!< The event loop
+    struct headless_output outputs[WS_HEADLESS_MAX_OUTPUTS]; //!< The outputs
+    size_t num_outputs; //!< Number of outputs
+    int32_t next_x; //!< Horizontal position of the next output
+} headless;
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Timer callback presenting a frame of an output
+ *
+ * @return 0
+ */
+static int
+headless_tick(
+    void* data //!< The headless output
+);
+
+/**
+ * Arm the timer of an output for its next frame
+ */
+static void
+headless_arm(
+    struct headless_output* self, //!< The output
+    uint64_t now //!< Current time in nanoseconds
+);
+
+/**
+ * Remove the outputs added last
+ */
+static void
+headless_truncate(
+    size_t num, //!< Number of outputs to keep
+    int32_t next_x //!< Horizontal position of the next output afterwards
+);
+
+/**
+ * Parse the description of an output
+ *
+ * @return Whether the description is valid, `*end` is set to the next one
+ */
+static bool
+parse_output(
+    char const* spec, //!< The description, e.g. `1920x1080@60`
+    long* width, //!< Output: horizontal resolution
+    long* height, //!< Output: vertical resolution
+    long* refresh, //!< Output: refresh rate in Hz
+    char const** end //!< Output: start of the next description
+);
+
+/**
+ * Parse a positive decimal number
+ *
+ * @return The number or 0 if there is none, `*end` is set to the first
+ *         character after it
+ */
+static long
+parse_number(
+    char const* str, //!< The string
+    char const** end //!< Output: end of the number
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_headless_init(
+    struct wl_event_loop* loop
+) {
+    headless.loop = loop;
+    headless.num_outputs = 0;
+    headless.next_x = 0;
+    ws_software_init();
+    return 0;
+}
+
+void
+ws_headless_deinit(void)
+{
+    headless_truncate(0, 0);
+}
+
+struct ws_output*
+ws_headless_add_output(
+    int32_t width,
+    int32_t height,
+    uint32_t refresh
+) {
+    if ((width <= 0) || (width > WS_HEADLESS_MAX_SIZE) ||
+        (height <= 0) || (height > WS_HEADLESS_MAX_SIZE) ||
+        !refresh || (refresh > WS_HEADLESS_MAX_REFRESH) ||
+        (headless.num_outputs >= WS_HEADLESS_MAX_OUTPUTS)) {
+        return NULL;
+    }
+
+    struct headless_output* self = headless.outputs + headless.num_outputs;
+    struct ws_geometry geometry = {
+        .x = headless.next_x,
+        .y = 0,
+        .width = width,
+        .height = height,
+    };
+    self->output = ws_software_output_new(&geometry);
+    if (!self->output) {
+        return NULL;
+    }
+
+    self->timer = wl_event_loop_add_timer(headless.loop, headless_tick, self);
+    if (!self->timer) {
+        ws_output_destroy(self->output);
+        return NULL;
+    }
+
+    self->period = WS_CLOCK_NS_PER_SEC / refresh;
+    self->stats.frames = 0;
+    self->stats.missed = 0;
+
+    uint64_t now = ws_clock_now();
+    self->next = now + self->period;
+    headless_arm(self, now);
+
+    ++headless.num_outputs;
+    headless.next_x += width;
+    return self->output;
+}
+
+int
+ws_headless_add_outputs(
+    char const* spec
+) {
+    long width;
+    long height;
+    long refresh;
+
+    // the whole spec is checked first, so an invalid one adds no outputs
+    size_t num = 0;
+    char const* cur = spec;
+    while (*cur) {
+        if (!parse_output(cur, &width, &height, &refresh, &cur)) {
+            return -EINVAL;
+        }
+        ++num;
+    }
+    if (num > WS_HEADLESS_MAX_OUTPUTS - headless.num_outputs) {
+        return -ENOSPC;
+    }
+
+    size_t first = headless.num_outputs;
+    int32_t first_x = headless.next_x;
+    cur = spec;
+    while (*cur) {
+        parse_output(cur, &width, &height, &refresh, &cur);
+        if (!ws_headless_add_output((int32_t) width, (int32_t) height,
+                                    (uint32_t) refresh)) {
+            headless_truncate(first, first_x);
+            return -ENOMEM;
+        }
+    }
+
+    return (int) num;
+}
+
+int
+ws_headless_get_stats(
+    struct ws_output const* output,
+    struct ws_headless_stats* stats
+) {
+    size_t i;
+    for (i = 0; i < headless.num_outputs; ++i) {
+        if (headless.outputs[i].output == output) {
+            *stats = headless.outputs[i].stats;
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static int
+headless_tick(
+    void* data
+) {
+    struct headless_output* self = data;
+    uint64_t now = ws_clock_now();
+
+    // ticks which are late by whole frames skip them, like a real display
+    if (now >= self->next + self->period) {
+        uint64_t late = (now - self->next) / self->period;
+        self->stats.missed += late;
+        self->next += late * self->period;
+    }
+    self->next += self->period;
+    ++self->stats.frames;
+
+    ws_compositor_frame_done(self->output, (uint32_t) (now / WS_CLOCK_NS_PER_MS));
+    headless_arm(self, now);
+    return 0;
+}
+
+static void
+headless_arm(
+    struct headless_output* self,
+    uint64_t now
+) {
+    // timers have millisecond resolution and 0 disarms them, round up
+    uint64_t delay = (self->next > now) ? self->next - now : 0;
+    int ms = (int) ((delay + WS_CLOCK_NS_PER_MS - 1) / WS_CLOCK_NS_PER_MS);
+    wl_event_source_timer_update(self->timer, ms ? ms : 1);
+}
+
+static void
+headless_truncate(
+    size_t num,
+    int32_t next_x
+) {
+    while (headless.num_outputs > num) {
+        struct headless_output* output;
+        output = headless.outputs + --headless.num_outputs;
+        wl_event_source_remove(output->timer);
+        ws_output_destroy(output->output);
+    }
+    headless.next_x = next_x;
+}
+
+static bool
+parse_output(
+    char const* spec,
+    long* width,
+    long* height,
+    long* refresh,
+    char const** end
+) {
+    char const* cur = spec;
+    *width = parse_number(cur, &cur);
+    if (!*width || (*width > WS_HEADLESS_MAX_SIZE) || (*cur++ != 'x')) {
+        return false;
+    }
+    *height = parse_number(cur, &cur);
+    if (!*height || (*height > WS_HEADLESS_MAX_SIZE)) {
+        return false;
+    }
+
+    *refresh = WS_HEADLESS_DEFAULT_REFRESH;
+    if (*cur == '@') {
+        *refresh = parse_number(cur + 1, &cur);
+        if (!*refresh || (*refresh > WS_HEADLESS_MAX_REFRESH)) {
+            return false;
+        }
+    }
+
+    // a separator must be followed by another description
+    if (*cur == ',') {
+        if (!*++cur) {
+            return false;
+        }
+    } else if (*cur) {
+        return false;
+    }
+
+    *end = cur;
+    return true;
+}
+
+static long
+parse_number(
+    char const* str,
+    char const** end
+) {
+    long num = 0;
+    while ((*str >= '0') && (*str <= '9')) {
+        num = num * 10 + (*str++ - '0');
+        if (num > INT32_MAX) {
+            num = 0;
+            break;
+        }
+    }
+    *end = str;
+    return num;
+}
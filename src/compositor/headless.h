@@ -0,0 +1,145 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_COMPOSITOR_HEADLESS_H__
+#define __WS_COMPOSITOR_HEADLESS_H__
+
+/**
+ * @file headless.h
+ *
+ * @brief Headless backend: virtual outputs without DRM or EGL
+ *
+ * The headless backend creates virtual outputs of arbitrary resolution and
+ * refresh rate. They are rendered by the software renderer (see software.h)
+ * and driven by a timer of the event loop instead of a vertical blank: each
+ * tick presents a frame, i.e. calls the frame callbacks of the windows on the
+ * output. This makes it possible to run many simulated clients against the
+ * real compositor on machines without display hardware.
+ *
+ * Outputs may be described by a string of comma separated modes like
+ * `1920x1080@60,1280x720@144`, where the refresh rate is optional and
+ * defaults to WS_HEADLESS_DEFAULT_REFRESH. Outputs are placed side by side.
+ */
+
+#include <stdint.h>
+#include <wayland-server.h>
+
+#include "util/attributes.h"
+
+/**
+ * Refresh rate of outputs which do not specify one, in Hz
+ */
+#define WS_HEADLESS_DEFAULT_REFRESH 60
+
+/**
+ * Maximum number of headless outputs
+ */
+#define WS_HEADLESS_MAX_OUTPUTS 64
+
+/**
+ * Maximum width and height of a headless output, in pixels
+ */
+#define WS_HEADLESS_MAX_SIZE 16384
+
+/**
+ * Maximum refresh rate of a headless output, in Hz
+ */
+#define WS_HEADLESS_MAX_REFRESH 1000
+
+struct ws_output;
+
+/**
+ * Statistics of a headless output
+ */
+struct ws_headless_stats {
+    uint64_t frames; //!< Number of frames presented
+    uint64_t missed; //!< Number of ticks which were late by a whole frame
+};
+
+/**
+ * Initialize the headless backend
+ *
+ * The compositor must be initialized before.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_headless_init(
+    struct wl_event_loop* loop //!< The event loop driving the outputs
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize the headless backend, destroying all its outputs
+ */
+void
+ws_headless_deinit(void);
+
+/**
+ * Add a virtual output
+ *
+ * The output is placed right of the outputs added before. Its size must not
+ * exceed `WS_HEADLESS_MAX_SIZE` and its refresh rate `WS_HEADLESS_MAX_REFRESH`.
+ *
+ * @return The output or NULL on error
+ */
+struct ws_output*
+ws_headless_add_output(
+    int32_t width, //!< Horizontal resolution
+    int32_t height, //!< Vertical resolution
+    uint32_t refresh //!< Refresh rate in Hz
+);
+
+/**
+ * Add virtual outputs described by a string
+ *
+ * Outputs are separated by `,`. Either all outputs described are added or
+ * none.
+ *
+ * @return The number of outputs added, -EINVAL if the string is not valid,
+ *         -ENOSPC if there are too many outputs, another negative error
+ *         number otherwise
+ */
+int
+ws_headless_add_outputs(
+    char const* spec //!< The outputs, e.g. `1920x1080@60,1280x720`
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the statistics of a headless output
+ *
+ * @return 0 on success, -ENOENT if the output is not a headless output
+ */
+int
+ws_headless_get_stats(
+    struct ws_output const* output, //!< The output
+    struct ws_headless_stats* stats //!< Output: the statistics
+)
+__ws_nonnull__(1, 2);
+
+#endif // __WS_COMPOSITOR_HEADLESS_H__
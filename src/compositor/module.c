@@ -25,5 +25,1127 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "command/processor.h"
 #include "compositor/module.h"
+#include "logger/module.h"
+#include "util/arena.h"
+#include "util/arithmetical.h"
+#include "util/clock.h"
+#include "util/histogram.h"
+#include "values/int.h"
+#include "values/object_id.h"
+#include "values/value.h"
+
+struct ws_object_type const WS_OBJECT_TYPE_WINDOW = {
+    .name = "window",
+};
+
+struct ws_object_type const WS_OBJECT_TYPE_OUTPUT = {
+    .name = "output",
+};
+
+/**
+ * Number of frames presented between two logs of the latencies
+ */
+#define COMPOSITOR_LATENCY_LOG_FRAMES 600
+
+/**
+ * Maximum number of listeners
+ */
+#define COMPOSITOR_LISTENERS 4
+
+/**
+ * Maximum length of a line of the `windows` query
+ */
+#define COMPOSITOR_WINDOW_LINE_MAX 80
+
+/**
+ * Names of the latency histograms, indexed by `enum ws_compositor_latency`
+ */
+static char const* const compositor_latency_names[] = {
+    [WS_COMPOSITOR_LATENCY_COMMIT_TO_DAMAGE] = "commit-to-damage",
+    [WS_COMPOSITOR_LATENCY_DAMAGE_TO_RENDER] = "damage-to-render",
+    [WS_COMPOSITOR_LATENCY_RENDER_TO_PRESENT] = "render-to-present",
+    [WS_COMPOSITOR_LATENCY_FRAME_CALLBACKS] = "frame-callbacks",
+};
+
+/**
+ * Internal state of the compositor
+ */
+static struct {
+    struct wl_event_loop* loop; //!< Event loop of the display
+    struct wl_event_source* repaint; //!< Scheduled repaint, if any
+    struct wl_list windows; //!< All windows, bottom to top
+    struct wl_list outputs; //!< All outputs
+    struct ws_window* focus; //!< The focused window
+    struct ws_window* pending_focus; //!< Window to focus on commit
+    bool focus_dirty; //!< Whether `pending_focus` is to be applied
+    unsigned int depth; //!< Nesting depth of transactions
+    struct ws_compositor_stats stats; //!< Statistics
+    struct ws_histogram latency[WS_COMPOSITOR_LATENCY_NUM]; //!< Frame latencies
+    uint64_t scheduled; //!< Time the pending repaint was scheduled
+    uint64_t presented; //!< Frames presented since latencies were last logged
+    struct ws_compositor_listener listeners[COMPOSITOR_LISTENERS]; //!< Hooks
+    size_t num_listeners; //!< Number of listeners
+    _Atomic(struct ws_compositor_snapshot*) snapshot; //!< Published last
+    uint64_t generation; //!< Incremented on changes visible to queries
+    uint64_t published; //!< Generation of `snapshot`
+} compositor;
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Repaint all outputs
+ */
+static void
+compositor_repaint(
+    void* data //!< Unused
+);
+
+/**
+ * Damage an area on all outputs showing it
+ *
+ * The repaint is not scheduled.
+ */
+static void
+compositor_damage(
+    struct ws_geometry const* rect //!< Damaged area, global coordinates
+);
+
+/**
+ * Damage the area of a window on all outputs showing it and schedule a repaint
+ */
+static void
+compositor_damage_window(
+    struct ws_window const* window //!< The window, may be NULL
+);
+
+/**
+ * Apply all pending changes
+ */
+static void
+compositor_apply(void);
+
+/**
+ * Report an event to all listeners
+ */
+static void
+compositor_notify(
+    enum ws_compositor_event event, //!< The event
+    struct ws_object* subject //!< Window or output, may be NULL
+);
+
+/**
+ * Snapshot hook: publish a snapshot if anything changed since the last one
+ */
+static void
+compositor_publish(
+    void* data //!< Unused
+);
+
+/**
+ * Destroy a retired snapshot
+ */
+static void
+snapshot_destroy(
+    struct ws_epoch_node* node //!< Node of the snapshot
+);
+
+/**
+ * Log the latency histograms
+ */
+static void
+compositor_log_latency(
+    enum ws_log_level level //!< Level of the messages
+);
+
+/**
+ * Transaction hook: begin
+ */
+static void
+compositor_hook_begin(
+    void* data //!< Unused
+);
+
+/**
+ * Transaction hook: commit
+ */
+static void
+compositor_hook_commit(
+    void* data //!< Unused
+);
+
+/**
+ * Transaction hook: abort
+ */
+static void
+compositor_hook_abort(
+    void* data //!< Unused
+);
+
+/**
+ * Extract a window and two integers from the arguments of a command
+ *
+ * @return The window or NULL if the arguments are not valid
+ */
+static struct ws_window*
+command_get_args(
+    struct ws_value* args, //!< Arguments of the command
+    size_t argc, //!< Number of arguments
+    int32_t* a, //!< Output: the first integer, NULL if none is expected
+    int32_t* b //!< Output: the second integer
+);
+
+/**
+ * Command: move a window
+ *
+ * Arguments: window, x, y
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_move(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< Arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: the result
+);
+
+/**
+ * Command: resize a window
+ *
+ * Arguments: window, width, height
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_resize(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< Arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: the result
+);
+
+/**
+ * Command: focus a window
+ *
+ * Arguments: window
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_focus(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< Arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: the result
+);
+
+/**
+ * Query: list the windows
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_windows(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< Arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: the result
+);
+
+/**
+ * Query: get the focused window
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_focused(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< Arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: the result
+);
+
+/**
+ * Commands provided by the compositor
+ */
+static struct ws_command const compositor_commands[] = {
+    { .name = "move", .func = command_move },
+    { .name = "resize", .func = command_resize },
+    { .name = "focus", .func = command_focus },
+    {
+        .name = "windows",
+        .func = command_windows,
+        .flags = WS_COMMAND_QUERY,
+    },
+    {
+        .name = "focused",
+        .func = command_focused,
+        .flags = WS_COMMAND_QUERY,
+    },
+};
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_compositor_init(
+    struct wl_display* display
+) {
+    compositor.loop = wl_display_get_event_loop(display);
+    compositor.repaint = NULL;
+    wl_list_init(&compositor.windows);
+    wl_list_init(&compositor.outputs);
+    compositor.focus = NULL;
+    compositor.pending_focus = NULL;
+    compositor.focus_dirty = false;
+    compositor.depth = 0;
+    memset(&compositor.stats, 0, sizeof(compositor.stats));
+    compositor.scheduled = 0;
+    compositor.presented = 0;
+    compositor.num_listeners = 0;
+    atomic_store(&compositor.snapshot, NULL);
+    compositor.generation = 1;
+    compositor.published = 0;
+
+    size_t i;
+    for (i = 0; i < WS_COMPOSITOR_LATENCY_NUM; ++i) {
+        ws_histogram_init(compositor.latency + i);
+        int res = ws_command_processor_add_histogram(
+            compositor_latency_names[i],
+            compositor.latency + i
+        );
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    for (i = 0; i < sizeof(compositor_commands) / sizeof(*compositor_commands);
+         ++i) {
+        int res = ws_command_register(compositor_commands + i);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    struct ws_command_snapshot_hook snapshot_hook = {
+        .publish = compositor_publish,
+        .data = NULL,
+    };
+    int res = ws_command_processor_add_snapshot_hook(&snapshot_hook);
+    if (res < 0) {
+        return res;
+    }
+
+    struct ws_command_transaction_hooks hooks = {
+        .begin = compositor_hook_begin,
+        .commit = compositor_hook_commit,
+        .abort = compositor_hook_abort,
+        .data = NULL,
+    };
+    return ws_command_processor_add_transaction_hooks(&hooks);
+}
+
+void
+ws_compositor_deinit(void)
+{
+    compositor_log_latency(WS_LOG_INFO);
+
+    while (!wl_list_empty(&compositor.windows)) {
+        struct ws_window* window;
+        window = wl_container_of(compositor.windows.next, window, link);
+        ws_window_destroy(window);
+    }
+    while (!wl_list_empty(&compositor.outputs)) {
+        struct ws_output* output;
+        output = wl_container_of(compositor.outputs.next, output, link);
+        ws_output_destroy(output);
+    }
+
+    if (compositor.repaint) {
+        wl_event_source_remove(compositor.repaint);
+        compositor.repaint = NULL;
+    }
+
+    struct ws_compositor_snapshot* snapshot;
+    snapshot = atomic_exchange(&compositor.snapshot, NULL);
+    if (snapshot) {
+        ws_epoch_retire(&snapshot->node, snapshot_destroy);
+        ws_epoch_collect();
+    }
+}
+
+struct ws_window*
+ws_window_new(void)
+{
+    return ws_window_new_with_id(0);
+}
+
+struct ws_window*
+ws_window_new_with_id(
+    uint64_t id
+) {
+    struct ws_window* self = calloc(1, sizeof(*self));
+    if (!self) {
+        return NULL;
+    }
+
+    int res = id ? ws_object_init_id(&self->obj, &WS_OBJECT_TYPE_WINDOW, id)
+                 : ws_object_init(&self->obj, &WS_OBJECT_TYPE_WINDOW);
+    if (res < 0) {
+        free(self);
+        return NULL;
+    }
+
+    ws_region_init(&self->damage);
+    wl_list_init(&self->frame_callbacks);
+    wl_list_insert(compositor.windows.prev, &self->link);
+    compositor_notify(WS_COMPOSITOR_EVENT_WINDOW_MAP, &self->obj);
+    return self;
+}
+
+void
+ws_window_destroy(
+    struct ws_window* self
+) {
+    compositor_notify(WS_COMPOSITOR_EVENT_WINDOW_UNMAP, &self->obj);
+    if (compositor.focus == self) {
+        compositor.focus = NULL;
+        compositor_notify(WS_COMPOSITOR_EVENT_FOCUS, NULL);
+    }
+    if (compositor.pending_focus == self) {
+        compositor.pending_focus = NULL;
+    }
+
+    while (!wl_list_empty(&self->frame_callbacks)) {
+        struct wl_list* link = self->frame_callbacks.next;
+        wl_list_remove(link);
+        wl_list_init(link);
+    }
+
+    compositor_damage_window(self);
+    wl_list_remove(&self->link);
+    ws_object_deinit(&self->obj);
+    free(self);
+}
+
+void
+ws_window_set_geometry(
+    struct ws_window* self,
+    struct ws_geometry const* geometry
+) {
+    self->pending = *geometry;
+    self->dirty = true;
+
+    if (!compositor.depth) {
+        compositor_apply();
+    }
+}
+
+void
+ws_window_set_configure(
+    struct ws_window* self,
+    struct ws_window_configure* configure
+) {
+    self->configure = configure;
+}
+
+void
+ws_window_attach_image(
+    struct ws_window* self,
+    struct ws_image const* image
+) {
+    self->buffer = NULL;
+    if (image) {
+        self->contents = *image;
+    } else {
+        memset(&self->contents, 0, sizeof(self->contents));
+    }
+
+    struct ws_geometry all = { 0, 0, self->geometry.width,
+                               self->geometry.height };
+    ws_window_damage(self, &all);
+}
+
+int
+ws_window_attach_shm(
+    struct ws_window* self,
+    struct wl_shm_buffer* buffer
+) {
+    uint32_t format = wl_shm_buffer_get_format(buffer);
+    if ((format != WL_SHM_FORMAT_ARGB8888) &&
+            (format != WL_SHM_FORMAT_XRGB8888)) {
+        return -EINVAL;
+    }
+
+    struct ws_image image = {
+        .pixels = wl_shm_buffer_get_data(buffer),
+        .width = wl_shm_buffer_get_width(buffer),
+        .height = wl_shm_buffer_get_height(buffer),
+        .stride = wl_shm_buffer_get_stride(buffer),
+        .opaque = (format == WL_SHM_FORMAT_XRGB8888),
+    };
+    ws_window_attach_image(self, &image);
+    self->buffer = buffer;
+    return 0;
+}
+
+void
+ws_window_damage(
+    struct ws_window* self,
+    struct ws_geometry const* rect
+) {
+    struct ws_geometry bounds = {
+        .x = 0,
+        .y = 0,
+        .width = self->geometry.width,
+        .height = self->geometry.height,
+    };
+    struct ws_geometry clipped;
+    if (!ws_geometry_intersect(rect, &bounds, &clipped)) {
+        return;
+    }
+
+    ws_region_add(&self->damage, &clipped);
+    ws_compositor_schedule_repaint();
+}
+
+void
+ws_window_request_frame(
+    struct ws_window* self,
+    struct ws_frame_callback* callback
+) {
+    wl_list_insert(self->frame_callbacks.prev, &callback->link);
+}
+
+struct ws_geometry const*
+ws_window_get_geometry(
+    struct ws_window const* self
+) {
+    return self->dirty ? &self->pending : &self->geometry;
+}
+
+struct ws_window*
+ws_compositor_next_window(
+    struct ws_window const* prev
+) {
+    struct wl_list const* link = prev ? &prev->link : &compositor.windows;
+    if (link->next == &compositor.windows) {
+        return NULL;
+    }
+
+    struct ws_window* window;
+    return wl_container_of(link->next, window, link);
+}
+
+struct ws_output*
+ws_output_new(
+    struct ws_geometry const* geometry,
+    struct ws_output_impl const* impl,
+    void* data
+) {
+    struct ws_output* self = calloc(1, sizeof(*self));
+    if (!self) {
+        return NULL;
+    }
+
+    if (ws_object_init(&self->obj, &WS_OBJECT_TYPE_OUTPUT) < 0) {
+        free(self);
+        return NULL;
+    }
+
+    self->geometry = *geometry;
+    self->impl = impl;
+    self->data = data;
+    ws_region_init(&self->damage);
+    wl_list_insert(compositor.outputs.prev, &self->link);
+    compositor_notify(WS_COMPOSITOR_EVENT_OUTPUT_NEW, &self->obj);
+
+    struct ws_geometry all = { 0, 0, geometry->width, geometry->height };
+    ws_output_damage(self, &all);
+    return self;
+}
+
+void
+ws_output_destroy(
+    struct ws_output* self
+) {
+    compositor_notify(WS_COMPOSITOR_EVENT_OUTPUT_DESTROY, &self->obj);
+    if (self->impl->destroy) {
+        self->impl->destroy(self->data);
+    }
+    wl_list_remove(&self->link);
+    ws_object_deinit(&self->obj);
+    free(self);
+}
+
+void
+ws_output_damage(
+    struct ws_output* self,
+    struct ws_geometry const* rect
+) {
+    struct ws_geometry bounds = {
+        .x = 0,
+        .y = 0,
+        .width = self->geometry.width,
+        .height = self->geometry.height,
+    };
+    ws_region_add_clipped(&self->damage, rect, &bounds);
+    ws_compositor_schedule_repaint();
+}
+
+void
+ws_compositor_frame_done(
+    struct ws_output* output,
+    uint32_t time
+) {
+    uint64_t start = ws_clock_now();
+    if (output->rendered) {
+        ws_histogram_record(
+            compositor.latency + WS_COMPOSITOR_LATENCY_RENDER_TO_PRESENT,
+            start - output->rendered
+        );
+        output->rendered = 0;
+
+        if (++compositor.presented >= COMPOSITOR_LATENCY_LOG_FRAMES) {
+            compositor.presented = 0;
+            compositor_log_latency(WS_LOG_DEBUG);
+        }
+    }
+
+    bool dispatched = false;
+    struct ws_window* window;
+    wl_list_for_each(window, &compositor.windows, link) {
+        struct ws_geometry visible;
+        if (wl_list_empty(&window->frame_callbacks) ||
+                !ws_geometry_intersect(&window->geometry, &output->geometry,
+                                       &visible)) {
+            continue;
+        }
+
+        // callbacks may request new frames, which are for the next frame
+        struct wl_list pending;
+        wl_list_init(&pending);
+        wl_list_insert_list(&pending, &window->frame_callbacks);
+        wl_list_init(&window->frame_callbacks);
+
+        while (!wl_list_empty(&pending)) {
+            struct ws_frame_callback* callback;
+            callback = wl_container_of(pending.next, callback, link);
+            wl_list_remove(&callback->link);
+            wl_list_init(&callback->link);
+            callback->done(callback, time);
+        }
+        dispatched = true;
+    }
+
+    if (dispatched) {
+        ws_histogram_record(
+            compositor.latency + WS_COMPOSITOR_LATENCY_FRAME_CALLBACKS,
+            ws_clock_now() - start
+        );
+    }
+}
+
+void
+ws_compositor_focus(
+    struct ws_window* window
+) {
+    compositor.pending_focus = window;
+    compositor.focus_dirty = true;
+
+    if (!compositor.depth) {
+        compositor_apply();
+    }
+}
+
+struct ws_window*
+ws_compositor_get_focus(void)
+{
+    return compositor.focus;
+}
+
+void
+ws_compositor_begin(void)
+{
+    ++compositor.depth;
+}
+
+void
+ws_compositor_commit(void)
+{
+    if (compositor.depth && --compositor.depth) {
+        return;
+    }
+
+    ++compositor.stats.commits;
+    WS_LOG(WS_LOG_MODULE_COMPOSITOR, WS_LOG_TRACE, "commit #%llu",
+           (unsigned long long) compositor.stats.commits);
+    compositor_apply();
+}
+
+void
+ws_compositor_abort(void)
+{
+    if (compositor.depth && --compositor.depth) {
+        return;
+    }
+
+    ++compositor.stats.aborts;
+    WS_LOG(WS_LOG_MODULE_COMPOSITOR, WS_LOG_DEBUG, "abort #%llu",
+           (unsigned long long) compositor.stats.aborts);
+
+    struct ws_window* window;
+    wl_list_for_each(window, &compositor.windows, link) {
+        window->dirty = false;
+    }
+    compositor.pending_focus = NULL;
+    compositor.focus_dirty = false;
+}
+
+void
+ws_compositor_schedule_repaint(void)
+{
+    if (compositor.repaint || !compositor.loop) {
+        return;
+    }
+
+    compositor.repaint = wl_event_loop_add_idle(compositor.loop,
+                                                compositor_repaint, NULL);
+    compositor.scheduled = ws_clock_now();
+}
+
+struct ws_compositor_stats const*
+ws_compositor_get_stats(void)
+{
+    return &compositor.stats;
+}
+
+struct ws_histogram const*
+ws_compositor_get_latency(
+    enum ws_compositor_latency stage
+) {
+    return compositor.latency + stage;
+}
+
+int
+ws_compositor_add_listener(
+    struct ws_compositor_listener const* listener
+) {
+    if (compositor.num_listeners >= COMPOSITOR_LISTENERS) {
+        return -ENOSPC;
+    }
+    compositor.listeners[compositor.num_listeners++] = *listener;
+    return 0;
+}
+
+struct ws_compositor_snapshot const*
+ws_compositor_get_snapshot(void)
+{
+    return atomic_load(&compositor.snapshot);
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static void
+compositor_repaint(
+    void* data
+) {
+    // idle sources are removed after they were dispatched
+    compositor.repaint = NULL;
+    ++compositor.stats.frames;
+
+    uint64_t start = ws_clock_now();
+    ws_histogram_record(
+        compositor.latency + WS_COMPOSITOR_LATENCY_COMMIT_TO_DAMAGE,
+        start - compositor.scheduled
+    );
+
+    // move the damage of the windows to the outputs
+    struct ws_window* window;
+    wl_list_for_each(window, &compositor.windows, link) {
+        size_t i;
+        for (i = 0; i < window->damage.num; ++i) {
+            struct ws_geometry rect = window->damage.rects[i];
+            rect.x += window->geometry.x;
+            rect.y += window->geometry.y;
+            compositor_damage(&rect);
+        }
+        ws_region_clear(&window->damage);
+    }
+
+    struct ws_output* output;
+    wl_list_for_each(output, &compositor.outputs, link) {
+        if (ws_region_is_empty(&output->damage)) {
+            continue;
+        }
+
+        compositor.stats.output_repaints++;
+        compositor.stats.repainted_pixels += ws_region_area(&output->damage);
+        compositor.stats.output_pixels += (uint64_t) output->geometry.width *
+                                          (uint64_t) output->geometry.height;
+
+        output->impl->repaint(output, &output->damage, output->data);
+        ws_region_clear(&output->damage);
+
+        output->rendered = ws_clock_now();
+        ws_histogram_record(
+            compositor.latency + WS_COMPOSITOR_LATENCY_DAMAGE_TO_RENDER,
+            output->rendered - start
+        );
+        WS_LOG(WS_LOG_MODULE_COMPOSITOR, WS_LOG_TRACE,
+               "frame %llu: output %llu redrawn in %lluus",
+               (unsigned long long) compositor.stats.frames,
+               (unsigned long long) ws_object_get_id(&output->obj),
+               (unsigned long long) (output->rendered - start) / 1000);
+    }
+}
+
+static void
+compositor_damage(
+    struct ws_geometry const* rect
+) {
+    struct ws_output* output;
+    wl_list_for_each(output, &compositor.outputs, link) {
+        ws_region_add_clipped(&output->damage, rect, &output->geometry);
+    }
+}
+
+static void
+compositor_damage_window(
+    struct ws_window const* window
+) {
+    if (window) {
+        compositor_damage(&window->geometry);
+        ws_compositor_schedule_repaint();
+    }
+}
+
+static void
+compositor_apply(void)
+{
+    struct ws_window* window;
+    wl_list_for_each(window, &compositor.windows, link) {
+        if (!window->dirty) {
+            continue;
+        }
+        window->dirty = false;
+        if (memcmp(&window->geometry, &window->pending,
+                   sizeof(window->geometry)) == 0) {
+            continue;
+        }
+        bool resized = (window->geometry.width != window->pending.width) ||
+                       (window->geometry.height != window->pending.height);
+
+        // both the area uncovered and the area covered now are damaged
+        compositor_damage_window(window);
+        window->geometry = window->pending;
+        compositor_damage_window(window);
+
+        // a window only moved is repainted without its client redrawing it
+        if (resized && window->configure) {
+            ++compositor.stats.configures;
+            window->configure->configure(window->configure, window,
+                                         window->geometry.width,
+                                         window->geometry.height);
+        }
+        compositor_notify(WS_COMPOSITOR_EVENT_GEOMETRY, &window->obj);
+    }
+
+    if (compositor.focus_dirty) {
+        bool changed = compositor.focus != compositor.pending_focus;
+        if (changed) {
+            // focused windows look different, e.g. their borders
+            compositor_damage_window(compositor.focus);
+            compositor_damage_window(compositor.pending_focus);
+        }
+        compositor.focus = compositor.pending_focus;
+        compositor.pending_focus = NULL;
+        compositor.focus_dirty = false;
+        if (changed) {
+            compositor_notify(WS_COMPOSITOR_EVENT_FOCUS,
+                              compositor.focus ? &compositor.focus->obj
+                                               : NULL);
+        }
+    }
+}
+
+static void
+compositor_notify(
+    enum ws_compositor_event event,
+    struct ws_object* subject
+) {
+    // every change visible to scripts is visible to queries as well
+    ++compositor.generation;
+
+    size_t i;
+    for (i = 0; i < compositor.num_listeners; ++i) {
+        compositor.listeners[i].event(event, subject,
+                                      compositor.listeners[i].data);
+    }
+}
+
+static void
+compositor_publish(
+    void* data
+) {
+    if (compositor.published == compositor.generation) {
+        return;
+    }
+
+    size_t num = (size_t) wl_list_length(&compositor.windows);
+    struct ws_compositor_snapshot* snapshot;
+    snapshot = malloc(sizeof(*snapshot) + num * sizeof(*snapshot->windows));
+    if (!snapshot) {
+        // queries keep seeing the previous snapshot
+        WS_LOG(WS_LOG_MODULE_COMPOSITOR, WS_LOG_WARNING,
+               "could not allocate a snapshot of %zu windows", num);
+        return;
+    }
+
+    snapshot->focus = 0;
+    if (compositor.focus) {
+        snapshot->focus = ws_object_get_id(&compositor.focus->obj);
+    }
+    snapshot->num_windows = 0;
+    struct ws_window* window;
+    wl_list_for_each(window, &compositor.windows, link) {
+        struct ws_compositor_snapshot_window* entry;
+        entry = snapshot->windows + snapshot->num_windows++;
+        entry->id = ws_object_get_id(&window->obj);
+        entry->geometry = window->geometry;
+    }
+
+    struct ws_compositor_snapshot* old;
+    old = atomic_exchange(&compositor.snapshot, snapshot);
+    if (old) {
+        ws_epoch_retire(&old->node, snapshot_destroy);
+    }
+    compositor.published = compositor.generation;
+}
+
+static void
+snapshot_destroy(
+    struct ws_epoch_node* node
+) {
+    struct ws_compositor_snapshot* snapshot;
+    snapshot = wl_container_of(node, snapshot, node);
+    free(snapshot);
+}
+
+static void
+compositor_log_latency(
+    enum ws_log_level level
+) {
+    if (!WS_LOG_ENABLED(WS_LOG_MODULE_COMPOSITOR, level)) {
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < WS_COMPOSITOR_LATENCY_NUM; ++i) {
+        if (ws_histogram_count(compositor.latency + i)) {
+            ws_log_histogram(WS_LOG_MODULE_COMPOSITOR, level,
+                             compositor_latency_names[i],
+                             compositor.latency + i);
+        }
+    }
+}
+
+static void
+compositor_hook_begin(
+    void* data
+) {
+    ws_compositor_begin();
+}
+
+static void
+compositor_hook_commit(
+    void* data
+) {
+    ws_compositor_commit();
+}
+
+static void
+compositor_hook_abort(
+    void* data
+) {
+    ws_compositor_abort();
+}
+
+static struct ws_window*
+command_get_args(
+    struct ws_value* args,
+    size_t argc,
+    int32_t* a,
+    int32_t* b
+) {
+    if (argc != (a ? 3u : 1u)) {
+        return NULL;
+    }
+    if (ws_value_get_type(args) != WS_VALUE_TYPE_OBJECT_ID) {
+        return NULL;
+    }
+
+    if (a) {
+        if ((ws_value_get_type(args + 1) != WS_VALUE_TYPE_INT) ||
+                (ws_value_get_type(args + 2) != WS_VALUE_TYPE_INT)) {
+            return NULL;
+        }
+
+        int64_t first = ws_value_int_get(args + 1);
+        int64_t second = ws_value_int_get(args + 2);
+        if ((first < INT32_MIN) || (first > INT32_MAX) ||
+                (second < INT32_MIN) || (second > INT32_MAX)) {
+            return NULL;
+        }
+        *a = (int32_t) first;
+        *b = (int32_t) second;
+    }
+
+    struct ws_object* obj;
+    obj = ws_value_object_id_get_object(args, &WS_OBJECT_TYPE_WINDOW);
+    if (!obj) {
+        return NULL;
+    }
+
+    struct ws_window* window;
+    return wl_container_of(obj, window, obj);
+}
+
+static int
+command_move(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    int32_t x;
+    int32_t y;
+    struct ws_window* window = command_get_args(args, argc, &x, &y);
+    if (!window) {
+        return -EINVAL;
+    }
+
+    struct ws_geometry geometry = *ws_window_get_geometry(window);
+    geometry.x = x;
+    geometry.y = y;
+    ws_window_set_geometry(window, &geometry);
+    return 0;
+}
+
+static int
+command_resize(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    int32_t width;
+    int32_t height;
+    struct ws_window* window = command_get_args(args, argc, &width, &height);
+    if (!window || (width <= 0) || (height <= 0)) {
+        return -EINVAL;
+    }
+
+    struct ws_geometry geometry = *ws_window_get_geometry(window);
+    geometry.width = width;
+    geometry.height = height;
+    ws_window_set_geometry(window, &geometry);
+    return 0;
+}
+
+static int
+command_focus(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    struct ws_window* window = command_get_args(args, argc, NULL, NULL);
+    if (!window) {
+        return -EINVAL;
+    }
+
+    ws_compositor_focus(window);
+    return 0;
+}
+
+static int
+command_windows(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if (argc != 0) {
+        return -EINVAL;
+    }
+
+    struct ws_compositor_snapshot const* snapshot;
+    snapshot = ws_compositor_get_snapshot();
+    size_t num = snapshot ? snapshot->num_windows : 0;
+    size_t size = num * COMPOSITOR_WINDOW_LINE_MAX + 1;
+    char* list = ws_arena_alloc(ctx->arena, size);
+    if (!list) {
+        return -ENOMEM;
+    }
+
+    size_t len = 0;
+    size_t i;
+    for (i = 0; i < num; ++i) {
+        struct ws_compositor_snapshot_window const* window;
+        window = snapshot->windows + i;
+        int n = snprintf(list + len, size - len, "%llu %d %d %d %d\n",
+                         (unsigned long long) window->id,
+                         (int) window->geometry.x, (int) window->geometry.y,
+                         (int) window->geometry.width,
+                         (int) window->geometry.height);
+        if (n < 0) {
+            return -EIO;
+        }
+        len += WS_MIN((size_t) n, size - len - 1);
+    }
+
+    ws_value_deinit(result);
+    ws_value_string_init(result);
+    ws_value_string_set_borrowed(result, list, len);
+    return 0;
+}
+
+static int
+command_focused(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if (argc != 0) {
+        return -EINVAL;
+    }
 
+    struct ws_compositor_snapshot const* snapshot;
+    snapshot = ws_compositor_get_snapshot();
+    if (snapshot && snapshot->focus) {
+        ws_value_deinit(result);
+        ws_value_object_id_init(result, snapshot->focus);
+    }
+    return 0;
+}
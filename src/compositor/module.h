@@ -28,6 +28,564 @@
 #ifndef __WS_COMPOSITOR_MODULE_H__
 #define __WS_COMPOSITOR_MODULE_H__
 
+/**
+ * @file module.h
+ *
+ * @brief Compositor: windows, outputs, focus and repainting
+ *
+ * Windows and outputs are objects (see objects/object.h), so scripts refer to
+ * them by object ID. Changes to windows schedule a repaint, which is done from
+ * an idle callback of the event loop, so any number of changes within one
+ * dispatch result in a single frame.
+ *
+ * Repaints are damage-tracked. Each window accumulates the damage of its
+ * contents, and each output accumulates the damage in its area, e.g. caused by
+ * windows being moved, resized, focused or destroyed. On repaint, the damage
+ * of the windows is moved to the outputs they are shown on, and each output is
+ * asked to redraw only its damaged region. Outputs without damage are not
+ * redrawn at all.
+ *
+ * Clients pace their drawing with frame callbacks: a callback requested for a
+ * window is called once an output showing the window presented its next
+ * frame, as reported by the backend driving the output with
+ * ws_compositor_frame_done().
+ *
+ * Layout scripts typically resubmit the geometry of every window of a
+ * workspace, even if only a few windows changed. The compositor compares the
+ * geometry applied with the current one: windows whose geometry did not
+ * change are neither damaged nor reported to listeners. A window whose size
+ * changed is configured, i.e. the configure hook installed by the shell of its
+ * client (see ws_window_set_configure()) is called, so the client redraws its
+ * contents at the new size. A window which only moved is repainted from its
+ * current contents, its client is not involved.
+ *
+ * Changes made while a transaction is open are only recorded as pending. They
+ * are applied all at once when the transaction is committed, or discarded if
+ * it is aborted. The compositor registers itself for the transactions of the
+ * command processor, so a transaction sent by a script never shows up
+ * half-done on screen.
+ *
+ * Queries (see command/processor.h) do not look at the windows themselves but
+ * at an immutable snapshot of the windows and the focus, which may be read
+ * from worker threads. The compositor publishes a new snapshot before a query
+ * is executed if anything changed since the last one, the old snapshot is
+ * retired with epoch based reclamation (see util/epoch.h). The compositor
+ * provides the queries
+ *
+ * - `["windows"]`, returning a string with a line `<id> <x> <y> <width>
+ *   <height>` per window, bottom to top,
+ * - `["focused"]`, returning the focused window or nil.
+ *
+ * The latency of each frame is recorded per stage of the pipeline in lock-free
+ * histograms (see util/histogram.h), which are registered with the command
+ * processor under the names given in `enum ws_compositor_latency`. A frame
+ * goes through the stages
+ *
+ * - commit to damage: from the first change after the previous repaint to the
+ *   start of the repaint collecting the damage,
+ * - damage to render: from the start of the repaint to the end of an output's
+ *   redraw,
+ * - render to present: from the end of an output's redraw to the backend
+ *   reporting the frame as presented,
+ * - frame callbacks: the time spent calling the frame callbacks afterwards.
+ *
+ * Listeners registered with ws_compositor_add_listener() are told about the
+ * changes visible to scripts, see `enum ws_compositor_event`. Changes made
+ * within a transaction are reported when they are applied on commit.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server.h>
+
+#include "compositor/region.h"
+#include "objects/object.h"
+#include "util/attributes.h"
+#include "util/epoch.h"
+
+struct ws_histogram;
+struct ws_output;
+struct ws_window;
+struct wl_shm_buffer;
+
+/**
+ * Image in memory
+ *
+ * Pixels are 32 bit ARGB in native byte order with premultiplied alpha, which
+ * is what `WL_SHM_FORMAT_ARGB8888` is. Opaque images ignore the alpha
+ * channel (`WL_SHM_FORMAT_XRGB8888`).
+ */
+struct ws_image {
+    uint32_t* pixels; //!< The pixels, NULL if there is no image
+    int32_t width; //!< Width in pixels
+    int32_t height; //!< Height in pixels
+    int32_t stride; //!< Distance between two rows in bytes
+    bool opaque; //!< Whether the alpha channel is to be ignored
+};
+
+/**
+ * Implementation of an output, provided by a backend
+ */
+struct ws_output_impl {
+    /**
+     * Redraw the damaged region of an output
+     */
+    void (*repaint)(
+        struct ws_output* output, //!< The output to redraw
+        struct ws_region const* damage, //!< Damaged region, output coordinates
+        void* data //!< Data passed to ws_output_new()
+    );
+
+    /**
+     * Release the backend's data of an output, may be NULL
+     */
+    void (*destroy)(
+        void* data //!< Data passed to ws_output_new()
+    );
+};
+
+/**
+ * Frame callback of a window
+ *
+ * The callback is owned by whoever requested it. It is unlinked before it is
+ * called and when the window is destroyed. Callbacks may request new frame
+ * callbacks, but must not destroy windows.
+ */
+struct ws_frame_callback {
+    struct wl_list link; //!< Link in the window's list of callbacks
+    /**
+     * Called when the window was presented
+     */
+    void (*done)(
+        struct ws_frame_callback* self, //!< The callback
+        uint32_t time //!< Presentation time in milliseconds
+    );
+};
+
+/**
+ * Configure hook of a window
+ *
+ * The hook is owned by whoever installed it, usually the shell the window's
+ * client uses. It must not change windows.
+ */
+struct ws_window_configure {
+    /**
+     * Called when the size of the window changed
+     */
+    void (*configure)(
+        struct ws_window_configure* self, //!< The hook
+        struct ws_window* window, //!< The window
+        int32_t width, //!< The new width
+        int32_t height //!< The new height
+    );
+};
+
+/**
+ * A window
+ */
+struct ws_window {
+    struct ws_object obj; //!< Object base
+    struct wl_list link; //!< Link in the window list, in stacking order
+    struct ws_geometry geometry; //!< Current geometry
+    struct ws_geometry pending; //!< Geometry to apply on commit
+    bool dirty; //!< Whether `pending` differs from `geometry`
+    struct ws_region damage; //!< Damaged contents, window coordinates
+    struct ws_image contents; //!< Contents of the window
+    struct wl_shm_buffer* buffer; //!< SHM buffer holding `contents`, if any
+    struct wl_list frame_callbacks; //!< Pending frame callbacks
+    struct ws_window_configure* configure; //!< Configure hook, may be NULL
+};
+
+/**
+ * An output
+ */
+struct ws_output {
+    struct ws_object obj; //!< Object base
+    struct wl_list link; //!< Link in the output list
+    struct ws_geometry geometry; //!< Area of the output in global coordinates
+    struct ws_region damage; //!< Damaged region, output coordinates
+    struct ws_output_impl const* impl; //!< Implementation of the output
+    void* data; //!< Passed to the implementation
+    uint64_t rendered; //!< End of the last redraw not yet presented, or 0
+};
+
+/**
+ * Stages of the frame pipeline with a latency histogram
+ */
+enum ws_compositor_latency {
+    WS_COMPOSITOR_LATENCY_COMMIT_TO_DAMAGE = 0, //!< "commit-to-damage"
+    WS_COMPOSITOR_LATENCY_DAMAGE_TO_RENDER, //!< "damage-to-render"
+    WS_COMPOSITOR_LATENCY_RENDER_TO_PRESENT, //!< "render-to-present"
+    WS_COMPOSITOR_LATENCY_FRAME_CALLBACKS, //!< "frame-callbacks"
+    WS_COMPOSITOR_LATENCY_NUM, //!< Number of stages
+};
+
+/**
+ * Events reported to listeners
+ */
+enum ws_compositor_event {
+    WS_COMPOSITOR_EVENT_WINDOW_MAP = 0, //!< A window was created
+    WS_COMPOSITOR_EVENT_WINDOW_UNMAP, //!< A window is about to be destroyed
+    WS_COMPOSITOR_EVENT_FOCUS, //!< The focus changed, the subject may be NULL
+    WS_COMPOSITOR_EVENT_GEOMETRY, //!< The geometry of a window changed
+    WS_COMPOSITOR_EVENT_OUTPUT_NEW, //!< An output was created
+    WS_COMPOSITOR_EVENT_OUTPUT_DESTROY, //!< An output is about to be destroyed
+    WS_COMPOSITOR_EVENT_NUM, //!< Number of events
+};
+
+/**
+ * Listener for compositor events
+ */
+struct ws_compositor_listener {
+    /**
+     * Called for each event
+     *
+     * The subject is the window or output the event is about. The listener
+     * must not change windows or outputs.
+     */
+    void (*event)(
+        enum ws_compositor_event event, //!< The event
+        struct ws_object* subject, //!< Window or output, may be NULL
+        void* data //!< Data of the listener
+    );
+    void* data; //!< Passed to `event`
+};
+
+/**
+ * Statistics of the compositor
+ */
+struct ws_compositor_stats {
+    uint64_t frames; //!< Number of frames repainted
+    uint64_t commits; //!< Number of transactions committed
+    uint64_t aborts; //!< Number of transactions aborted
+    uint64_t output_repaints; //!< Number of outputs redrawn
+    uint64_t repainted_pixels; //!< Number of pixels redrawn
+    uint64_t output_pixels; //!< Pixels of the outputs redrawn, in total
+    uint64_t configures; //!< Number of windows configured
+};
+
+/**
+ * Window in a snapshot
+ */
+struct ws_compositor_snapshot_window {
+    uint64_t id; //!< Object ID of the window
+    struct ws_geometry geometry; //!< Geometry of the window
+};
+
+/**
+ * Snapshot of the state visible to queries
+ */
+struct ws_compositor_snapshot {
+    struct ws_epoch_node node; //!< Node for retiring the snapshot
+    uint64_t focus; //!< Object ID of the focused window, 0 if none
+    size_t num_windows; //!< Number of windows
+    struct ws_compositor_snapshot_window windows[]; //!< Windows, bottom to top
+};
+
+/**
+ * Object type of windows
+ */
+extern struct ws_object_type const WS_OBJECT_TYPE_WINDOW;
+
+/**
+ * Object type of outputs
+ */
+extern struct ws_object_type const WS_OBJECT_TYPE_OUTPUT;
+
+/**
+ * Initialize the compositor
+ *
+ * Registers the window commands and the transaction hooks with the command
+ * processor, which must be initialized before.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_compositor_init(
+    struct wl_display* display //!< The display to composite for
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize the compositor, destroying all windows
+ */
+void
+ws_compositor_deinit(void);
+
+/**
+ * Create a window
+ *
+ * The window is placed on top of all other windows.
+ *
+ * @return The new window or NULL on error
+ */
+struct ws_window*
+ws_window_new(void);
+
+/**
+ * Create a window with a given object ID
+ *
+ * Like ws_window_new(), but the window is registered under `id` (see
+ * ws_object_init_id()), e.g. to restore a window from a snapshot. An `id` of
+ * 0 assigns a new ID.
+ *
+ * @return The new window or NULL on error
+ */
+struct ws_window*
+ws_window_new_with_id(
+    uint64_t id //!< The object ID
+);
+
+/**
+ * Destroy a window
+ */
+void
+ws_window_destroy(
+    struct ws_window* self //!< The window to destroy
+)
+__ws_nonnull__(1);
+
+/**
+ * Set the geometry of a window
+ *
+ * Within a transaction, the geometry is applied on commit.
+ */
+void
+ws_window_set_geometry(
+    struct ws_window* self, //!< The window
+    struct ws_geometry const* geometry //!< The new geometry
+)
+__ws_nonnull__(1, 2);
 
+/**
+ * Install the configure hook of a window
+ *
+ * The hook is called whenever a new geometry with a different size is applied
+ * to the window, but not if the window is only moved.
+ */
+void
+ws_window_set_configure(
+    struct ws_window* self, //!< The window
+    struct ws_window_configure* configure //!< The hook, NULL for none
+)
+__ws_nonnull__(1);
+
+/**
+ * Damage the contents of a window
+ *
+ * The damaged part is redrawn with the next repaint, which is scheduled.
+ */
+void
+ws_window_damage(
+    struct ws_window* self, //!< The window
+    struct ws_geometry const* rect //!< Damaged part, window coordinates
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Set the contents of a window to an image
+ *
+ * The image is referenced, not copied. The whole window is damaged.
+ */
+void
+ws_window_attach_image(
+    struct ws_window* self, //!< The window
+    struct ws_image const* image //!< The new contents, NULL for none
+)
+__ws_nonnull__(1);
+
+/**
+ * Set the contents of a window to a wl_shm buffer
+ *
+ * The buffer is referenced, not copied. The whole window is damaged.
+ *
+ * @return 0 on success, -EINVAL if the format of the buffer is not supported
+ */
+int
+ws_window_attach_shm(
+    struct ws_window* self, //!< The window
+    struct wl_shm_buffer* buffer //!< The new contents
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Request a frame callback for a window
+ *
+ * The callback is called with the next frame presented on an output showing
+ * the window.
+ */
+void
+ws_window_request_frame(
+    struct ws_window* self, //!< The window
+    struct ws_frame_callback* callback //!< The callback, `done` must be set
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Get the geometry of a window, including pending changes
+ *
+ * @return The geometry the window has after the current transaction
+ */
+struct ws_geometry const*
+ws_window_get_geometry(
+    struct ws_window const* self //!< The window
+)
+__ws_nonnull__(1);
+
+/**
+ * Iterate over the windows, bottom to top
+ *
+ * Pass NULL to get the bottom-most window.
+ *
+ * @return The window above `prev` or NULL if there is none
+ */
+struct ws_window*
+ws_compositor_next_window(
+    struct ws_window const* prev //!< The previous window or NULL
+);
+
+/**
+ * Create an output
+ *
+ * The whole output is damaged initially.
+ *
+ * @return The new output or NULL on error
+ */
+struct ws_output*
+ws_output_new(
+    struct ws_geometry const* geometry, //!< Area of the output
+    struct ws_output_impl const* impl, //!< Implementation of the output
+    void* data //!< Passed to the implementation
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Destroy an output
+ *
+ * The `destroy` function of the implementation is called.
+ */
+void
+ws_output_destroy(
+    struct ws_output* self //!< The output to destroy
+)
+__ws_nonnull__(1);
+
+/**
+ * Damage a region of an output
+ *
+ * The repaint is scheduled.
+ */
+void
+ws_output_damage(
+    struct ws_output* self, //!< The output
+    struct ws_geometry const* rect //!< Damaged part, output coordinates
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Report that an output presented a frame
+ *
+ * Called by backends, e.g. on vertical blank. Calls the frame callbacks of the
+ * windows shown on the output.
+ */
+void
+ws_compositor_frame_done(
+    struct ws_output* output, //!< The output
+    uint32_t time //!< Presentation time in milliseconds
+)
+__ws_nonnull__(1);
+
+/**
+ * Focus a window
+ *
+ * Within a transaction, the focus changes on commit.
+ */
+void
+ws_compositor_focus(
+    struct ws_window* window //!< The window to focus, may be NULL
+);
+
+/**
+ * Get the focused window
+ *
+ * @return The focused window or NULL
+ */
+struct ws_window*
+ws_compositor_get_focus(void);
+
+/**
+ * Begin a transaction
+ *
+ * Transactions nest, changes are applied when the outermost transaction is
+ * committed.
+ */
+void
+ws_compositor_begin(void);
+
+/**
+ * Commit a transaction
+ */
+void
+ws_compositor_commit(void);
+
+/**
+ * Abort a transaction, discarding all pending changes
+ */
+void
+ws_compositor_abort(void);
+
+/**
+ * Schedule a repaint
+ *
+ * The repaint is done once the event loop is idle. Scheduling a repaint again
+ * before that does nothing.
+ */
+void
+ws_compositor_schedule_repaint(void);
+
+/**
+ * Get the statistics of the compositor
+ *
+ * @return The statistics
+ */
+struct ws_compositor_stats const*
+ws_compositor_get_stats(void);
+
+/**
+ * Get the latency histogram of a stage of the frame pipeline
+ *
+ * Samples are in nanoseconds.
+ *
+ * @return The histogram
+ */
+struct ws_histogram const*
+ws_compositor_get_latency(
+    enum ws_compositor_latency stage //!< The stage
+);
+
+/**
+ * Register a listener for compositor events
+ *
+ * The listener is copied. It can not be removed again.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_compositor_add_listener(
+    struct ws_compositor_listener const* listener //!< The listener
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the snapshot published last
+ *
+ * Worker threads may only call this function inside a critical section (see
+ * util/epoch.h), which is the case for queries. The snapshot stays valid until
+ * the section is left.
+ *
+ * @return The snapshot or NULL if none was published yet
+ */
+struct ws_compositor_snapshot const*
+ws_compositor_get_snapshot(void);
 
 #endif // __WS_COMPOSITOR_MODULE_H__
@@ -0,0 +1,337 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compositor/region.h"
+#include "util/arithmetical.h"
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Compute the bounding box of two rectangles
+ */
+static void
+bounding_box(
+    struct ws_geometry const* a, //!< The first rectangle
+    struct ws_geometry const* b, //!< The second rectangle
+    struct ws_geometry* result //!< Output: the bounding box
+);
+
+/**
+ * Check whether a rectangle contains another one
+ *
+ * @return true if `outer` contains `inner`, false otherwise
+ */
+static bool
+contains(
+    struct ws_geometry const* outer, //!< The outer rectangle
+    struct ws_geometry const* inner //!< The inner rectangle
+);
+
+/**
+ * Compute the area of a rectangle
+ *
+ * @return The area
+ */
+static uint64_t
+area(
+    struct ws_geometry const* rect //!< The rectangle
+);
+
+/**
+ * Sort intervals by their start
+ *
+ * Insertion sort, regions have few rectangles.
+ */
+static void
+sort_intervals(
+    int64_t* starts, //!< Starts of the intervals
+    int64_t* ends, //!< Ends of the intervals, may be NULL
+    size_t num //!< Number of intervals
+);
+
+/**
+ * Compute the height a region covers within a vertical strip
+ *
+ * @return The total height of the parts of the strip covered
+ */
+static uint64_t
+strip_height(
+    struct ws_region const* region, //!< The region
+    int64_t left, //!< Left edge of the strip
+    int64_t right //!< Right edge of the strip, no rectangle edge in between
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+bool
+ws_geometry_is_empty(
+    struct ws_geometry const* self
+) {
+    return (self->width <= 0) || (self->height <= 0);
+}
+
+bool
+ws_geometry_intersect(
+    struct ws_geometry const* a,
+    struct ws_geometry const* b,
+    struct ws_geometry* result
+) {
+    int64_t x1 = WS_MAX(a->x, b->x);
+    int64_t y1 = WS_MAX(a->y, b->y);
+    int64_t x2 = WS_MIN((int64_t) a->x + a->width, (int64_t) b->x + b->width);
+    int64_t y2 = WS_MIN((int64_t) a->y + a->height, (int64_t) b->y + b->height);
+
+    if ((x2 <= x1) || (y2 <= y1)) {
+        *result = (struct ws_geometry) { 0, 0, 0, 0 };
+        return false;
+    }
+
+    *result = (struct ws_geometry) {
+        .x = (int32_t) x1,
+        .y = (int32_t) y1,
+        .width = (int32_t) (x2 - x1),
+        .height = (int32_t) (y2 - y1),
+    };
+    return true;
+}
+
+void
+ws_region_init(
+    struct ws_region* self
+) {
+    self->num = 0;
+}
+
+void
+ws_region_add(
+    struct ws_region* self,
+    struct ws_geometry const* rect
+) {
+    if (ws_geometry_is_empty(rect)) {
+        return;
+    }
+
+    // drop rectangles covered by the new one, skip it if it is covered itself
+    size_t i = 0;
+    while (i < self->num) {
+        if (contains(self->rects + i, rect)) {
+            return;
+        }
+        if (contains(rect, self->rects + i)) {
+            self->rects[i] = self->rects[--self->num];
+            continue;
+        }
+        ++i;
+    }
+
+    if (self->num < WS_REGION_MAX_RECTS) {
+        self->rects[self->num++] = *rect;
+        return;
+    }
+
+    // out of rectangles, merge with the one growing the least
+    size_t best = 0;
+    uint64_t best_growth = UINT64_MAX;
+    for (i = 0; i < self->num; ++i) {
+        struct ws_geometry box;
+        bounding_box(self->rects + i, rect, &box);
+        uint64_t growth = area(&box) - area(self->rects + i);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    bounding_box(self->rects + best, rect, self->rects + best);
+}
+
+void
+ws_region_add_clipped(
+    struct ws_region* self,
+    struct ws_geometry const* rect,
+    struct ws_geometry const* clip
+) {
+    struct ws_geometry clipped;
+    if (!ws_geometry_intersect(rect, clip, &clipped)) {
+        return;
+    }
+
+    clipped.x -= clip->x;
+    clipped.y -= clip->y;
+    ws_region_add(self, &clipped);
+}
+
+void
+ws_region_clear(
+    struct ws_region* self
+) {
+    self->num = 0;
+}
+
+bool
+ws_region_is_empty(
+    struct ws_region const* self
+) {
+    return !self->num;
+}
+
+uint64_t
+ws_region_area(
+    struct ws_region const* self
+) {
+    // sweep over the strips between the vertical edges of the rectangles,
+    // within each strip the rectangles are merged along the y axis
+    int64_t edges[2 * WS_REGION_MAX_RECTS];
+    size_t num_edges = 0;
+    size_t i;
+    for (i = 0; i < self->num; ++i) {
+        struct ws_geometry const* rect = self->rects + i;
+        if (!ws_geometry_is_empty(rect)) {
+            edges[num_edges++] = rect->x;
+            edges[num_edges++] = (int64_t) rect->x + rect->width;
+        }
+    }
+    sort_intervals(edges, NULL, num_edges);
+
+    uint64_t sum = 0;
+    for (i = 1; i < num_edges; ++i) {
+        if (edges[i] > edges[i - 1]) {
+            sum += (uint64_t) (edges[i] - edges[i - 1]) *
+                   strip_height(self, edges[i - 1], edges[i]);
+        }
+    }
+    return sum;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static void
+bounding_box(
+    struct ws_geometry const* a,
+    struct ws_geometry const* b,
+    struct ws_geometry* result
+) {
+    int64_t x1 = WS_MIN(a->x, b->x);
+    int64_t y1 = WS_MIN(a->y, b->y);
+    int64_t x2 = WS_MAX((int64_t) a->x + a->width, (int64_t) b->x + b->width);
+    int64_t y2 = WS_MAX((int64_t) a->y + a->height, (int64_t) b->y + b->height);
+
+    *result = (struct ws_geometry) {
+        .x = (int32_t) x1,
+        .y = (int32_t) y1,
+        .width = (int32_t) WS_MIN(x2 - x1, INT32_MAX),
+        .height = (int32_t) WS_MIN(y2 - y1, INT32_MAX),
+    };
+}
+
+static bool
+contains(
+    struct ws_geometry const* outer,
+    struct ws_geometry const* inner
+) {
+    return (inner->x >= outer->x) && (inner->y >= outer->y) &&
+           ((int64_t) inner->x + inner->width <=
+            (int64_t) outer->x + outer->width) &&
+           ((int64_t) inner->y + inner->height <=
+            (int64_t) outer->y + outer->height);
+}
+
+static uint64_t
+area(
+    struct ws_geometry const* rect
+) {
+    return (uint64_t) rect->width * (uint64_t) rect->height;
+}
+
+static void
+sort_intervals(
+    int64_t* starts,
+    int64_t* ends,
+    size_t num
+) {
+    size_t i;
+    for (i = 1; i < num; ++i) {
+        int64_t start = starts[i];
+        int64_t end = ends ? ends[i] : 0;
+        size_t k = i;
+        while (k && (starts[k - 1] > start)) {
+            starts[k] = starts[k - 1];
+            if (ends) {
+                ends[k] = ends[k - 1];
+            }
+            --k;
+        }
+        starts[k] = start;
+        if (ends) {
+            ends[k] = end;
+        }
+    }
+}
+
+static uint64_t
+strip_height(
+    struct ws_region const* region,
+    int64_t left,
+    int64_t right
+) {
+    int64_t starts[WS_REGION_MAX_RECTS];
+    int64_t ends[WS_REGION_MAX_RECTS];
+    size_t num = 0;
+    size_t i;
+    for (i = 0; i < region->num; ++i) {
+        struct ws_geometry const* rect = region->rects + i;
+        if (!ws_geometry_is_empty(rect) && (rect->x <= left) &&
+                ((int64_t) rect->x + rect->width >= right)) {
+            starts[num] = rect->y;
+            ends[num] = (int64_t) rect->y + rect->height;
+            ++num;
+        }
+    }
+    sort_intervals(starts, ends, num);
+
+    uint64_t height = 0;
+    int64_t covered = INT64_MIN;
+    for (i = 0; i < num; ++i) {
+        int64_t start = WS_MAX(starts[i], covered);
+        if (ends[i] > start) {
+            height += (uint64_t) (ends[i] - start);
+            covered = ends[i];
+        }
+    }
+    return height;
+}
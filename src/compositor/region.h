@@ -0,0 +1,162 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_COMPOSITOR_REGION_H__
+#define __WS_COMPOSITOR_REGION_H__
+
+/**
+ * @file region.h
+ *
+ * @brief Rectangles and damage regions
+ *
+ * A region is a small set of rectangles covering an area. It is used to
+ * accumulate damage, i.e. the parts of a window or an output which have to be
+ * redrawn. The number of rectangles is bounded: once it is exhausted, the new
+ * rectangle is merged with the rectangle which grows the least by doing so. A
+ * region thus covers at least the area added to it, but possibly more.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+
+/**
+ * Maximum number of rectangles of a region
+ */
+#define WS_REGION_MAX_RECTS 16
+
+/**
+ * Position and size of a rectangular area
+ */
+struct ws_geometry {
+    int32_t x; //!< Horizontal position
+    int32_t y; //!< Vertical position
+    int32_t width; //!< Width
+    int32_t height; //!< Height
+};
+
+/**
+ * Region made of rectangles
+ */
+struct ws_region {
+    struct ws_geometry rects[WS_REGION_MAX_RECTS]; //!< The rectangles
+    size_t num; //!< Number of rectangles
+};
+
+/**
+ * Check whether a rectangle is empty
+ *
+ * @return true if the rectangle has no area, false otherwise
+ */
+bool
+ws_geometry_is_empty(
+    struct ws_geometry const* self //!< The rectangle
+)
+__ws_nonnull__(1);
+
+/**
+ * Intersect two rectangles
+ *
+ * @return true if the intersection is not empty, false otherwise
+ */
+bool
+ws_geometry_intersect(
+    struct ws_geometry const* a, //!< The first rectangle
+    struct ws_geometry const* b, //!< The second rectangle
+    struct ws_geometry* result //!< Output: the intersection
+)
+__ws_nonnull__(1, 2, 3);
+
+/**
+ * Initialize an empty region
+ */
+void
+ws_region_init(
+    struct ws_region* self //!< The region to initialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Add a rectangle to a region
+ */
+void
+ws_region_add(
+    struct ws_region* self, //!< The region
+    struct ws_geometry const* rect //!< The rectangle to add
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Add the part of a rectangle inside a clip rectangle to a region
+ *
+ * The clipped rectangle is moved by `-clip->x`, `-clip->y`, i.e. into the
+ * coordinate space of the clip rectangle.
+ */
+void
+ws_region_add_clipped(
+    struct ws_region* self, //!< The region
+    struct ws_geometry const* rect, //!< The rectangle to add
+    struct ws_geometry const* clip //!< The clip rectangle
+)
+__ws_nonnull__(1, 2, 3);
+
+/**
+ * Remove all rectangles from a region
+ */
+void
+ws_region_clear(
+    struct ws_region* self //!< The region
+)
+__ws_nonnull__(1);
+
+/**
+ * Check whether a region is empty
+ *
+ * @return true if the region covers no area, false otherwise
+ */
+bool
+ws_region_is_empty(
+    struct ws_region const* self //!< The region
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the area of a region
+ *
+ * Rectangles of a region may overlap, overlapping parts are counted once.
+ *
+ * @return The area covered by the rectangles
+ */
+uint64_t
+ws_region_area(
+    struct ws_region const* self //!< The region
+)
+__ws_nonnull__(1);
+
+#endif // __WS_COMPOSITOR_REGION_H__
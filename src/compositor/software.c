@@ -0,0 +1,540 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <wayland-server.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SOFTWARE_X86 1
+#endif
+
+#include "compositor/module.h"
+#include "compositor/region.h"
+#include "compositor/software.h"
+#include "util/arithmetical.h"
+#include "util/attributes.h"
+
+/**
+ * Function blending a span of pixels onto another one
+ */
+typedef void (*blend_func)(
+    uint32_t* dst, //!< The destination pixels
+    uint32_t const* src, //!< The source pixels, premultiplied
+    size_t len //!< Number of pixels
+);
+
+/**
+ * State of the software renderer
+ */
+static struct {
+    blend_func blend; //!< Blending implementation in use
+    char const* impl; //!< Name of the implementation
+} software;
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Output implementation: redraw the damaged region
+ */
+static void
+output_repaint(
+    struct ws_output* output, //!< The output
+    struct ws_region const* damage, //!< The damaged region
+    void* data //!< The framebuffer
+);
+
+/**
+ * Output implementation: release the framebuffer
+ */
+static void
+output_destroy(
+    void* data //!< The framebuffer
+);
+
+/**
+ * Redraw a rectangle of an image
+ */
+static void
+render_rect(
+    struct ws_image* target, //!< The image to render into
+    struct ws_geometry const* area, //!< Area of the image, global coordinates
+    struct ws_geometry const* rect, //!< Rectangle to redraw, image coordinates
+    uint32_t background //!< Background color
+);
+
+/**
+ * Draw the part of a window inside a rectangle
+ */
+static void
+render_window(
+    struct ws_image* target, //!< The image to render into
+    struct ws_geometry const* area, //!< Area of the image, global coordinates
+    struct ws_geometry const* rect, //!< Rectangle to redraw, image coordinates
+    struct ws_window const* window //!< The window to draw
+);
+
+/**
+ * Get a row of an image
+ *
+ * @return The first pixel of the row
+ */
+static uint32_t*
+image_row(
+    struct ws_image const* image, //!< The image
+    int32_t y //!< The row
+);
+
+/**
+ * Fill a span of pixels with a color
+ */
+static void
+span_fill(
+    uint32_t* dst, //!< The pixels to fill
+    uint32_t color, //!< The color
+    size_t len //!< Number of pixels
+);
+
+/**
+ * Copy a span of opaque pixels, setting the alpha channel
+ */
+static void
+span_copy_opaque(
+    uint32_t* dst, //!< The destination pixels
+    uint32_t const* src, //!< The source pixels, alpha ignored
+    size_t len //!< Number of pixels
+);
+
+/**
+ * Blend a span of pixels, portable implementation
+ */
+static void
+blend_scalar(
+    uint32_t* dst, //!< The destination pixels
+    uint32_t const* src, //!< The source pixels, premultiplied
+    size_t len //!< Number of pixels
+);
+
+#ifdef SOFTWARE_X86
+
+/**
+ * Blend a span of pixels, four at a time
+ */
+static void
+blend_sse2(
+    uint32_t* dst, //!< The destination pixels
+    uint32_t const* src, //!< The source pixels, premultiplied
+    size_t len //!< Number of pixels
+)
+__ws_target__("sse2");
+
+/**
+ * Blend a span of pixels, eight at a time
+ */
+static void
+blend_avx2(
+    uint32_t* dst, //!< The destination pixels
+    uint32_t const* src, //!< The source pixels, premultiplied
+    size_t len //!< Number of pixels
+)
+__ws_target__("avx2");
+
+#endif // SOFTWARE_X86
+
+/**
+ * Implementation of software outputs
+ */
+static struct ws_output_impl const software_output_impl = {
+    .repaint = output_repaint,
+    .destroy = output_destroy,
+};
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+void
+ws_software_init(void)
+{
+    if (software.blend) {
+        return;
+    }
+
+    software.blend = blend_scalar;
+    software.impl = "scalar";
+
+#ifdef SOFTWARE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        software.blend = blend_avx2;
+        software.impl = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        software.blend = blend_sse2;
+        software.impl = "sse2";
+    }
+#endif
+}
+
+char const*
+ws_software_get_impl(void)
+{
+    ws_software_init();
+    return software.impl;
+}
+
+struct ws_output*
+ws_software_output_new(
+    struct ws_geometry const* geometry
+) {
+    ws_software_init();
+
+    if ((geometry->width <= 0) || (geometry->height <= 0)) {
+        return NULL;
+    }
+
+    struct ws_image* framebuffer = malloc(sizeof(*framebuffer));
+    if (!framebuffer) {
+        return NULL;
+    }
+
+    // rows are aligned to 64 bytes, so spans start on cache lines
+    size_t stride = WS_ALIGN_UP((size_t) geometry->width * 4, (size_t) 64);
+    framebuffer->pixels = aligned_alloc(64, stride * geometry->height);
+    if (!framebuffer->pixels) {
+        free(framebuffer);
+        return NULL;
+    }
+    framebuffer->width = geometry->width;
+    framebuffer->height = geometry->height;
+    framebuffer->stride = (int32_t) stride;
+    framebuffer->opaque = true;
+
+    struct ws_output* output = ws_output_new(geometry, &software_output_impl,
+                                             framebuffer);
+    if (!output) {
+        output_destroy(framebuffer);
+    }
+    return output;
+}
+
+struct ws_image const*
+ws_software_output_get_image(
+    struct ws_output const* output
+) {
+    if (output->impl != &software_output_impl) {
+        return NULL;
+    }
+    return output->data;
+}
+
+void
+ws_software_render(
+    struct ws_image* target,
+    struct ws_geometry const* area,
+    struct ws_region const* damage,
+    uint32_t background
+) {
+    ws_software_init();
+
+    struct ws_geometry bounds = { 0, 0, target->width, target->height };
+
+    size_t i;
+    for (i = 0; i < damage->num; ++i) {
+        struct ws_geometry rect;
+        if (ws_geometry_intersect(damage->rects + i, &bounds, &rect)) {
+            render_rect(target, area, &rect, background);
+        }
+    }
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static void
+output_repaint(
+    struct ws_output* output,
+    struct ws_region const* damage,
+    void* data
+) {
+    ws_software_render(data, &output->geometry, damage,
+                       WS_SOFTWARE_BACKGROUND);
+}
+
+static void
+output_destroy(
+    void* data
+) {
+    struct ws_image* framebuffer = data;
+    free(framebuffer->pixels);
+    free(framebuffer);
+}
+
+static void
+render_rect(
+    struct ws_image* target,
+    struct ws_geometry const* area,
+    struct ws_geometry const* rect,
+    uint32_t background
+) {
+    int32_t y;
+    for (y = rect->y; y < rect->y + rect->height; ++y) {
+        span_fill(image_row(target, y) + rect->x, background,
+                  (size_t) rect->width);
+    }
+
+    struct ws_window* window = NULL;
+    while ((window = ws_compositor_next_window(window))) {
+        if (!window->contents.pixels) {
+            continue;
+        }
+
+        if (window->buffer) {
+            wl_shm_buffer_begin_access(window->buffer);
+        }
+        render_window(target, area, rect, window);
+        if (window->buffer) {
+            wl_shm_buffer_end_access(window->buffer);
+        }
+    }
+}
+
+static void
+render_window(
+    struct ws_image* target,
+    struct ws_geometry const* area,
+    struct ws_geometry const* rect,
+    struct ws_window const* window
+) {
+    struct ws_image const* contents = &window->contents;
+
+    // the part of the window covered by its contents, image coordinates
+    struct ws_geometry visible = {
+        .x = window->geometry.x - area->x,
+        .y = window->geometry.y - area->y,
+        .width = WS_MIN(window->geometry.width, contents->width),
+        .height = WS_MIN(window->geometry.height, contents->height),
+    };
+    struct ws_geometry clip;
+    if (!ws_geometry_intersect(&visible, rect, &clip)) {
+        return;
+    }
+
+    int32_t src_x = clip.x - visible.x;
+    int32_t src_y = clip.y - visible.y;
+
+    int32_t row;
+    for (row = 0; row < clip.height; ++row) {
+        uint32_t* dst = image_row(target, clip.y + row) + clip.x;
+        uint32_t const* src = image_row(contents, src_y + row) + src_x;
+        if (contents->opaque) {
+            span_copy_opaque(dst, src, (size_t) clip.width);
+        } else {
+            software.blend(dst, src, (size_t) clip.width);
+        }
+    }
+}
+
+static uint32_t*
+image_row(
+    struct ws_image const* image,
+    int32_t y
+) {
+    return (uint32_t*) ((char*) image->pixels + (size_t) y * image->stride);
+}
+
+static void
+span_fill(
+    uint32_t* dst,
+    uint32_t color,
+    size_t len
+) {
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        dst[i] = color;
+    }
+}
+
+static void
+span_copy_opaque(
+    uint32_t* dst,
+    uint32_t const* src,
+    size_t len
+) {
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        dst[i] = src[i] | 0xff000000u;
+    }
+}
+
+static void
+blend_scalar(
+    uint32_t* dst,
+    uint32_t const* src,
+    size_t len
+) {
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        uint32_t s = src[i];
+        uint32_t alpha = s >> 24;
+        if (alpha == 0xff) {
+            dst[i] = s;
+            continue;
+        }
+        if (!s) {
+            continue;
+        }
+
+        // dst * (255 - alpha) / 255 for two channels at a time, rounded
+        uint32_t d = dst[i];
+        uint32_t inv = 0xff - alpha;
+        uint32_t rb = (d & 0x00ff00ffu) * inv + 0x00800080u;
+        rb = ((rb + ((rb >> 8) & 0x00ff00ffu)) >> 8) & 0x00ff00ffu;
+        uint32_t ag = ((d >> 8) & 0x00ff00ffu) * inv + 0x00800080u;
+        ag = ((ag + ((ag >> 8) & 0x00ff00ffu)) >> 8) & 0x00ff00ffu;
+
+        // add src saturating per channel, like the SIMD versions, in case a
+        // channel exceeds the alpha it should be premultiplied with
+        rb += s & 0x00ff00ffu;
+        rb = (rb | (((rb >> 8) & 0x00010001u) * 0xff)) & 0x00ff00ffu;
+        ag += (s >> 8) & 0x00ff00ffu;
+        ag = (ag | (((ag >> 8) & 0x00010001u) * 0xff)) & 0x00ff00ffu;
+        dst[i] = rb | (ag << 8);
+    }
+}
+
+#ifdef SOFTWARE_X86
+
+static void
+blend_sse2(
+    uint32_t* dst,
+    uint32_t const* src,
+    size_t len
+) {
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const c255 = _mm_set1_epi16(0xff);
+    __m128i const c128 = _mm_set1_epi16(0x80);
+
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m128i s = _mm_loadu_si128((__m128i const*) (src + i));
+
+        // all transparent: nothing to do, all opaque: plain copy
+        __m128i alpha = _mm_srli_epi32(s, 24);
+        int opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(alpha,
+                                                       _mm_set1_epi32(0xff)));
+        if (opaque == 0xffff) {
+            _mm_storeu_si128((__m128i*) (dst + i), s);
+            continue;
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff) {
+            continue;
+        }
+
+        __m128i d = _mm_loadu_si128((__m128i const*) (dst + i));
+
+        // 255 - alpha in every 16 bit channel of the pixel
+        __m128i inv = _mm_sub_epi16(c255,
+                                    _mm_or_si128(alpha,
+                                                 _mm_slli_epi32(alpha, 16)));
+        __m128i inv_lo = _mm_unpacklo_epi32(inv, inv);
+        __m128i inv_hi = _mm_unpackhi_epi32(inv, inv);
+
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv_lo);
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv_hi);
+        lo = _mm_add_epi16(lo, c128);
+        hi = _mm_add_epi16(hi, c128);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        __m128i res = _mm_adds_epu8(_mm_packus_epi16(lo, hi), s);
+        _mm_storeu_si128((__m128i*) (dst + i), res);
+    }
+
+    blend_scalar(dst + i, src + i, len - i);
+}
+
+static void
+blend_avx2(
+    uint32_t* dst,
+    uint32_t const* src,
+    size_t len
+) {
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const c255 = _mm256_set1_epi16(0xff);
+    __m256i const c128 = _mm256_set1_epi16(0x80);
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        __m256i s = _mm256_loadu_si256((__m256i const*) (src + i));
+
+        __m256i alpha = _mm256_srli_epi32(s, 24);
+        __m256i opaque = _mm256_cmpeq_epi32(alpha, _mm256_set1_epi32(0xff));
+        if (_mm256_movemask_epi8(opaque) == -1) {
+            _mm256_storeu_si256((__m256i*) (dst + i), s);
+            continue;
+        }
+        if (_mm256_testz_si256(s, s)) {
+            continue;
+        }
+
+        __m256i d = _mm256_loadu_si256((__m256i const*) (dst + i));
+
+        // unpacking works per 128 bit lane, packing reverts it the same way
+        __m256i inv = _mm256_sub_epi16(c255,
+                                       _mm256_or_si256(alpha,
+                                                       _mm256_slli_epi32(alpha,
+                                                                         16)));
+        __m256i inv_lo = _mm256_unpacklo_epi32(inv, inv);
+        __m256i inv_hi = _mm256_unpackhi_epi32(inv, inv);
+
+        __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), inv_lo);
+        __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), inv_hi);
+        lo = _mm256_add_epi16(lo, c128);
+        hi = _mm256_add_epi16(hi, c128);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)),
+                               8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)),
+                               8);
+
+        __m256i res = _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), s);
+        _mm256_storeu_si256((__m256i*) (dst + i), res);
+    }
+
+    blend_sse2(dst + i, src + i, len - i);
+}
+
+#endif // SOFTWARE_X86
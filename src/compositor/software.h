@@ -0,0 +1,110 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_COMPOSITOR_SOFTWARE_H__
+#define __WS_COMPOSITOR_SOFTWARE_H__
+
+/**
+ * @file software.h
+ *
+ * @brief Software rendering backend
+ *
+ * The software renderer composites the contents of the windows (e.g. wl_shm
+ * buffers) on the CPU into offscreen images, so the compositor runs without a
+ * GPU, e.g. in VMs and CI, and renders deterministically.
+ *
+ * Only the damaged region of an output is redrawn: each damaged rectangle is
+ * filled with the background and the windows intersecting it are blended on
+ * top, bottom to top, with premultiplied alpha ("over" operator). Opaque
+ * windows are copied. Blending uses AVX2 or SSE2 if the CPU supports it, the
+ * implementation is selected once at runtime.
+ */
+
+#include <stdint.h>
+
+#include "compositor/module.h"
+#include "compositor/region.h"
+#include "util/attributes.h"
+
+/**
+ * Background color of software outputs, opaque black
+ */
+#define WS_SOFTWARE_BACKGROUND 0xff000000u
+
+/**
+ * Select the blending implementation for the CPU
+ *
+ * Called by ws_software_output_new(), calling it again does nothing.
+ */
+void
+ws_software_init(void);
+
+/**
+ * Get the name of the blending implementation in use
+ *
+ * @return "avx2", "sse2" or "scalar"
+ */
+char const*
+ws_software_get_impl(void);
+
+/**
+ * Create an output rendered into an offscreen image
+ *
+ * @return The output or NULL on error
+ */
+struct ws_output*
+ws_software_output_new(
+    struct ws_geometry const* geometry //!< Area of the output
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the image a software output is rendered into
+ *
+ * @return The image or NULL if the output is not a software output
+ */
+struct ws_image const*
+ws_software_output_get_image(
+    struct ws_output const* output //!< The output
+)
+__ws_nonnull__(1);
+
+/**
+ * Render the windows into an image
+ *
+ * Only the damaged region is redrawn.
+ */
+void
+ws_software_render(
+    struct ws_image* target, //!< The image to render into
+    struct ws_geometry const* area, //!< Area of the image, global coordinates
+    struct ws_region const* damage, //!< Region to redraw, image coordinates
+    uint32_t background //!< Background color, premultiplied ARGB
+)
+__ws_nonnull__(1, 2, 3);
+
+#endif // __WS_COMPOSITOR_SOFTWARE_H__
@@ -25,5 +25,1427 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wayland-server.h>
+
+#include "command/processor.h"
+#include "compositor/module.h"
 #include "connection/manager.h"
+#include "logger/module.h"
+#include "util/arena.h"
+#include "util/arithmetical.h"
+#include "util/debug.h"
+#include "values/int.h"
+#include "values/nil.h"
+#include "values/object_id.h"
+#include "values/value.h"
+
+/**
+ * Size of the receive buffer of a connection, limits the size of a message
+ */
+#define CONNECTION_RECV_BUF_SIZE (64 * 1024)
+
+/**
+ * Maximum length of the handshake line
+ */
+#define CONNECTION_HANDSHAKE_MAX 32
+
+/**
+ * Prefix of the handshake line
+ */
+#define CONNECTION_HANDSHAKE_PREFIX "waysome "
+
+/**
+ * Number of bytes a connection may read per wakeup
+ */
+#define CONNECTION_READ_BUDGET (4 * CONNECTION_RECV_BUF_SIZE)
+
+/**
+ * Maximum number of epoll events handled per wakeup
+ */
+#define MANAGER_MAX_EVENTS 64
+
+/**
+ * Backlog of the listening socket
+ */
+#define MANAGER_BACKLOG 128
+
+/**
+ * Maximum number of events queued per connection
+ */
+#define CONNECTION_EVENT_QUEUE 256
+
+/**
+ * Number of bytes of responses waiting to be sent above which a connection is
+ * not read from
+ */
+#define CONNECTION_SEND_MAX (1024 * 1024)
+
+/**
+ * Maximum number of buffers sent with a single system call
+ */
+#define CONNECTION_IOV_MAX 64
+
+/**
+ * Maximum number of arguments of an event
+ */
+#define EVENT_MAX_ARGS 5
+
+/**
+ * Encoded event, shared by all connections it is queued on
+ */
+struct ws_connection_event {
+    unsigned int refs; //!< Number of references
+    enum ws_compositor_event event; //!< The event
+    uint64_t subject; //!< ID of the window or output, 0 if none
+    size_t len; //!< Length of the encoded event
+    char data[]; //!< The encoded event
+};
+
+/**
+ * Names of the policies, indexed by `enum ws_connection_policy`
+ */
+static char const* const policy_names[] = {
+    [WS_CONNECTION_POLICY_COALESCE] = "coalesce",
+    [WS_CONNECTION_POLICY_DROP] = "drop",
+    [WS_CONNECTION_POLICY_DISCONNECT] = "disconnect",
+};
+
+/**
+ * Names of the events, indexed by `enum ws_compositor_event`
+ */
+static char const* const event_names[] = {
+    [WS_COMPOSITOR_EVENT_WINDOW_MAP] = "window_map",
+    [WS_COMPOSITOR_EVENT_WINDOW_UNMAP] = "window_unmap",
+    [WS_COMPOSITOR_EVENT_FOCUS] = "focus",
+    [WS_COMPOSITOR_EVENT_GEOMETRY] = "geometry",
+    [WS_COMPOSITOR_EVENT_OUTPUT_NEW] = "output_new",
+    [WS_COMPOSITOR_EVENT_OUTPUT_DESTROY] = "output_destroy",
+};
+
+/**
+ * Internal state of the connection manager
+ */
+static struct {
+    struct wl_event_loop* loop; //!< Event loop of the compositor
+    struct wl_event_source* source; //!< Event source of the epoll instance
+    struct wl_event_source* idle; //!< Idle source continuing connections
+    int epoll_fd; //!< The epoll instance
+    int listen_fd; //!< The listening socket
+    struct sockaddr_un addr; //!< Address of the listening socket
+    struct wl_list connections; //!< All connections
+    struct wl_list pending; //!< Connections which exceeded their budget
+    struct wl_event_source* flush; //!< Idle source sending queued events
+    struct ws_connection* current; //!< Connection whose commands are executed
+    uint32_t subscriptions; //!< Union of the subscriptions of all connections
+    bool listening; //!< Whether the compositor listener was registered
+} manager = {
+    .epoll_fd = -1,
+    .listen_fd = -1,
+};
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Create the listening socket
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+manager_listen(
+    char const* name //!< Name of the socket
+);
+
+/**
+ * Callback for the epoll instance
+ *
+ * @return 0
+ */
+static int
+manager_dispatch(
+    int fd, //!< The epoll instance
+    uint32_t mask, //!< Events on the epoll instance
+    void* data //!< Unused
+);
+
+/**
+ * Idle callback continuing connections which exceeded their budget
+ */
+static void
+manager_dispatch_pending(
+    void* data //!< Unused
+);
+
+/**
+ * Accept all pending clients
+ */
+static void
+manager_accept(void);
+
+/**
+ * Handle input of a connection, closing or deferring it if necessary
+ */
+static void
+manager_handle_input(
+    struct ws_connection* conn //!< The connection
+);
+
+/**
+ * Close a connection and release all its resources
+ */
+static void
+manager_close(
+    struct ws_connection* conn //!< The connection
+);
+
+/**
+ * Compositor listener publishing an event to the subscribed connections
+ */
+static void
+manager_publish(
+    enum ws_compositor_event event, //!< The event
+    struct ws_object* subject, //!< Window or output, may be NULL
+    void* data //!< Unused
+);
+
+/**
+ * Idle callback sending the queued events
+ */
+static void
+manager_dispatch_flush(
+    void* data //!< Unused
+);
+
+/**
+ * Resume reading from a throttled connection if its responses were sent
+ *
+ * @return Whether the connection was throttled and should be read from
+ */
+static bool
+manager_unthrottle(
+    struct ws_connection* conn //!< The connection
+);
+
+/**
+ * Recompute the union of all subscriptions
+ */
+static void
+manager_update_subscriptions(void);
+
+/**
+ * Command replacing the subscriptions of the current connection
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_subscribe(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command selecting the policy of the current connection
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_backpressure(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Commands of the connection manager
+ */
+static struct ws_command const connection_commands[] = {
+    { .name = "subscribe", .func = command_subscribe },
+    { .name = "backpressure", .func = command_backpressure },
+};
+
+/**
+ * Encode an event
+ *
+ * @return The event with one reference, or NULL on error
+ */
+static struct ws_connection_event*
+event_new(
+    enum ws_serialize_format format, //!< Format to encode in
+    enum ws_compositor_event event, //!< The event
+    uint64_t subject, //!< ID of the window or output, 0 if none
+    struct ws_value const* args, //!< Arguments of the event
+    size_t argc //!< Number of arguments
+);
+
+/**
+ * Drop a reference to an event, freeing it with the last one
+ */
+static void
+event_unref(
+    struct ws_connection_event* event //!< The event, may be NULL
+);
+
+/**
+ * Get the arguments of an event
+ *
+ * @return Number of arguments
+ */
+static size_t
+event_get_args(
+    enum ws_compositor_event event, //!< The event
+    struct ws_object* subject, //!< Window or output, may be NULL
+    struct ws_value* args //!< Output: EVENT_MAX_ARGS arguments
+);
+
+/**
+ * Queue an event on a connection
+ *
+ * Coalesces the event with an event still queued if the policy of the
+ * connection says so.
+ *
+ * @return 0 on success, -ENOBUFS if the queue is full
+ */
+static int
+connection_queue_event(
+    struct ws_connection* self, //!< The connection
+    struct ws_connection_event* event //!< The event, a reference is taken
+);
+
+/**
+ * Account bytes written to the oldest queued event
+ *
+ * Removes the event from the queue if it was written completely.
+ *
+ * @return Whether the event was written completely
+ */
+static bool
+connection_consume_event(
+    struct ws_connection* self, //!< The connection
+    size_t* written //!< In/output: number of bytes written, not consumed yet
+);
+
+/**
+ * Remove the slots of coalesced events from the front of the event queue
+ */
+static void
+connection_skip_coalesced(
+    struct ws_connection* self //!< The connection
+);
+
+
+/**
+ * Release all queued events
+ */
+static void
+connection_clear_events(
+    struct ws_connection* self //!< The connection
+);
+
+/**
+ * Read the handshake from the receive buffer and answer it
+ *
+ * @return 1 if the handshake was completed, 0 if more data is needed, a
+ *         negative error number otherwise
+ */
+static int
+connection_handshake(
+    struct ws_connection* self //!< The connection
+);
+
+/**
+ * Execute all complete messages in the receive buffer as one batch
+ *
+ * Stops after a message submitted to the workers of the command processor.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+connection_process(
+    struct ws_connection* self //!< The connection
+);
+
+/**
+ * Queue the response to a query and continue with the messages after it
+ */
+static void
+connection_query_done(
+    void* data, //!< The connection
+    int status, //!< Status of the query
+    struct ws_value const* result //!< Result of the query
+);
+
+/**
+ * Append a response to the send buffer
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+connection_queue_response(
+    struct ws_connection* self, //!< The connection
+    int status, //!< Status of the command
+    struct ws_value const* result //!< Result of the command
+);
+
+/**
+ * Append raw data to the send buffer
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+connection_queue_raw(
+    struct ws_connection* self, //!< The connection
+    char const* data, //!< The data
+    size_t len //!< Length of the data
+);
+
+/**
+ * Make sure the send buffer can hold additional data
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+connection_reserve(
+    struct ws_connection* self, //!< The connection
+    size_t len //!< Number of additional bytes
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_connection_init(
+    struct ws_connection* self,
+    int fd
+) {
+    wl_list_init(&self->link);
+    wl_list_init(&self->pending_link);
+    self->pending = false;
+    self->fd = fd;
+    self->handshake_done = false;
+    self->format = WS_SERIALIZE_FORMAT_TEXT;
+    self->out.data = NULL;
+    self->out.len = 0;
+    self->out.cap = 0;
+    self->throttled = false;
+    self->query = NULL;
+    self->subscriptions = 0;
+    self->policy = WS_CONNECTION_POLICY_COALESCE;
+    memset(&self->events, 0, sizeof(self->events));
+    self->event_offset = 0;
+    self->events_dropped = 0;
+    self->closing = false;
+    return ws_serialize_parser_init(&self->parser, CONNECTION_RECV_BUF_SIZE);
+}
+
+void
+ws_connection_deinit(
+    struct ws_connection* self
+) {
+    if (self->query) {
+        ws_command_processor_cancel(self->query);
+        self->query = NULL;
+    }
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
+    ws_serialize_parser_deinit(&self->parser);
+    free(self->out.data);
+    self->out.data = NULL;
+    self->out.len = 0;
+    self->out.cap = 0;
+    connection_clear_events(self);
+    ws_queue_deinit(&self->events);
+    self->subscriptions = 0;
+}
+
+int
+ws_connection_handle_input(
+    struct ws_connection* self,
+    size_t budget
+) {
+    bool drained = false;
+    bool eof = false;
+    int res;
+
+    while (!drained && !eof && budget && !self->query && !self->closing) {
+        if (self->out.len >= CONNECTION_SEND_MAX) {
+            // the client does not read its responses, stop reading requests
+            res = ws_connection_flush(self);
+            if (res < 0) {
+                return res;
+            }
+            if (self->out.len >= CONNECTION_SEND_MAX) {
+                self->throttled = true;
+                break;
+            }
+        }
+
+        size_t avail;
+        char* space = ws_serialize_parser_get_space(&self->parser, &avail);
+        if (space) {
+            ssize_t len = read(self->fd, space, WS_MIN(avail, budget));
+            if (len < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                    return -errno;
+                }
+                drained = true;
+            } else if (len == 0) {
+                eof = true;
+            } else {
+                ws_serialize_parser_advance(&self->parser, len);
+                drained = (size_t) len < WS_MIN(avail, budget);
+                budget -= len;
+            }
+        }
+
+        if (!self->handshake_done) {
+            res = connection_handshake(self);
+            if (res <= 0) {
+                if (res < 0) {
+                    return res;
+                }
+                if (!space) {
+                    // buffer full without a complete handshake line
+                    return -EPROTO;
+                }
+                continue;
+            }
+        }
+
+        res = connection_process(self);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    res = ws_connection_flush(self);
+    if (res < 0) {
+        return res;
+    }
+    if (eof) {
+        return -ECONNRESET;
+    }
+    if (self->throttled || self->query) {
+        return 2;
+    }
+    return drained ? 0 : 1;
+}
+
+int
+ws_connection_manager_init(
+    struct wl_event_loop* loop,
+    char const* name
+) {
+    manager.loop = loop;
+    wl_list_init(&manager.connections);
+    wl_list_init(&manager.pending);
+
+    manager.current = NULL;
+    manager.subscriptions = 0;
+
+    size_t i;
+    for (i = 0; i < sizeof(connection_commands) / sizeof(*connection_commands);
+         ++i) {
+        int res = ws_command_register(connection_commands + i);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    if (!manager.listening) {
+        struct ws_compositor_listener listener = {
+            .event = manager_publish,
+            .data = NULL,
+        };
+        int res = ws_compositor_add_listener(&listener);
+        if (res < 0) {
+            return res;
+        }
+        manager.listening = true;
+    }
+
+    manager.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (manager.epoll_fd < 0) {
+        return -errno;
+    }
+
+    int res = manager_listen(name);
+    if (res < 0) {
+        goto cleanup_epoll;
+    }
+
+    // the listening socket is identified by a NULL pointer
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLET,
+        .data.ptr = NULL,
+    };
+    if (epoll_ctl(manager.epoll_fd, EPOLL_CTL_ADD, manager.listen_fd,
+                  &event) < 0) {
+        res = -errno;
+        goto cleanup_listen;
+    }
+
+    manager.source = wl_event_loop_add_fd(loop, manager.epoll_fd,
+                                          WL_EVENT_READABLE, manager_dispatch,
+                                          NULL);
+    if (!manager.source) {
+        res = -ENOMEM;
+        goto cleanup_listen;
+    }
+
+    return 0;
+
+cleanup_listen:
+    close(manager.listen_fd);
+    manager.listen_fd = -1;
+    unlink(manager.addr.sun_path);
+
+cleanup_epoll:
+    close(manager.epoll_fd);
+    manager.epoll_fd = -1;
+    return res;
+}
+
+void
+ws_connection_manager_deinit(void)
+{
+    struct ws_connection* conn;
+    struct ws_connection* tmp;
+    wl_list_for_each_safe(conn, tmp, &manager.connections, link) {
+        manager_close(conn);
+    }
+
+    // the compositor listener stays registered but publishes nothing
+    manager.subscriptions = 0;
+
+    if (manager.idle) {
+        wl_event_source_remove(manager.idle);
+        manager.idle = NULL;
+    }
+    if (manager.flush) {
+        wl_event_source_remove(manager.flush);
+        manager.flush = NULL;
+    }
+    if (manager.source) {
+        wl_event_source_remove(manager.source);
+        manager.source = NULL;
+    }
+    if (manager.listen_fd >= 0) {
+        close(manager.listen_fd);
+        manager.listen_fd = -1;
+        unlink(manager.addr.sun_path);
+    }
+    if (manager.epoll_fd >= 0) {
+        close(manager.epoll_fd);
+        manager.epoll_fd = -1;
+    }
+}
+
+int
+ws_connection_flush(
+    struct ws_connection* self
+) {
+    for (;;) {
+        // an event partially sent goes first, so responses queued meanwhile
+        // can not end up in the middle of it
+        struct iovec iov[CONNECTION_IOV_MAX];
+        int num = 0;
+        size_t pos = 0;
+        size_t total = 0;
+        if (self->event_offset) {
+            struct ws_connection_event* event = *ws_queue_at(&self->events, 0);
+            iov[num].iov_base = event->data + self->event_offset;
+            iov[num].iov_len = event->len - self->event_offset;
+            total += iov[num++].iov_len;
+            pos = 1;
+        }
+        if (self->out.len) {
+            iov[num].iov_base = self->out.data;
+            iov[num].iov_len = self->out.len;
+            total += iov[num++].iov_len;
+        }
+        size_t queued = ws_queue_len(&self->events);
+        for (; (pos < queued) && (num < CONNECTION_IOV_MAX); ++pos) {
+            struct ws_connection_event* event;
+            event = *ws_queue_at(&self->events, pos);
+            if (event) {
+                iov[num].iov_base = event->data;
+                iov[num].iov_len = event->len;
+                total += iov[num++].iov_len;
+            }
+        }
+        if (!num) {
+            // only coalesced events left, if any
+            connection_skip_coalesced(self);
+            return 0;
+        }
+
+        // sendmsg() rather than writev(), a closed peer must not raise SIGPIPE
+        struct msghdr msg = {
+            .msg_iov = iov,
+            .msg_iovlen = num,
+        };
+        ssize_t len = sendmsg(self->fd, &msg, MSG_NOSIGNAL);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return 0;
+            }
+            return -errno;
+        }
+
+        // consume in the order of the buffers written
+        size_t written = (size_t) len;
+        if (self->event_offset && !connection_consume_event(self, &written)) {
+            return 0;
+        }
+        if (self->out.len) {
+            size_t done = WS_MIN(written, self->out.len);
+            memmove(self->out.data, self->out.data + done,
+                    self->out.len - done);
+            self->out.len -= done;
+            written -= done;
+        }
+        connection_skip_coalesced(self);
+        while (written && connection_consume_event(self, &written)) {
+            connection_skip_coalesced(self);
+        }
+
+        if ((size_t) len < total) {
+            // the socket is full, EPOLLOUT continues
+            return 0;
+        }
+    }
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static int
+manager_listen(
+    char const* name
+) {
+    char const* dir = getenv("XDG_RUNTIME_DIR");
+    if (!dir) {
+        return -ENOENT;
+    }
+
+    manager.addr.sun_family = AF_UNIX;
+    int len = snprintf(manager.addr.sun_path, sizeof(manager.addr.sun_path),
+                       "%s/%s", dir, name);
+    if ((len < 0) || ((size_t) len >= sizeof(manager.addr.sun_path))) {
+        manager.addr.sun_path[0] = '\0';
+        return -ENAMETOOLONG;
+    }
+
+    manager.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+                               SOCK_CLOEXEC, 0);
+    if (manager.listen_fd < 0) {
+        return -errno;
+    }
+
+    // a stale socket from a previous instance would make bind() fail
+    unlink(manager.addr.sun_path);
+
+    if ((bind(manager.listen_fd, (struct sockaddr*) &manager.addr,
+              sizeof(manager.addr)) < 0) ||
+            (listen(manager.listen_fd, MANAGER_BACKLOG) < 0)) {
+        int res = -errno;
+        close(manager.listen_fd);
+        manager.listen_fd = -1;
+        return res;
+    }
+
+    return 0;
+}
+
+static int
+manager_dispatch(
+    int fd,
+    uint32_t mask,
+    void* data
+) {
+    struct epoll_event events[MANAGER_MAX_EVENTS];
+
+    // more events than we fetch here keep the epoll instance readable, so the
+    // event loop will call us again
+    int num = epoll_wait(manager.epoll_fd, events, MANAGER_MAX_EVENTS, 0);
+
+    int i;
+    for (i = 0; i < num; ++i) {
+        struct ws_connection* conn = events[i].data.ptr;
+        if (!conn) {
+            manager_accept();
+            continue;
+        }
+
+        bool input = events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP |
+                                         EPOLLERR);
+        if (events[i].events & EPOLLOUT) {
+            if (ws_connection_flush(conn) < 0) {
+                manager_close(conn);
+                continue;
+            }
+            input |= manager_unthrottle(conn);
+        }
+
+        if (input) {
+            manager_handle_input(conn);
+        }
+    }
+
+    return 0;
+}
+
+static void
+manager_dispatch_pending(
+    void* data
+) {
+    manager.idle = NULL;
+
+    // connections deferred again are put on a fresh list for the next round
+    struct wl_list pending;
+    wl_list_init(&pending);
+    wl_list_insert_list(&pending, &manager.pending);
+    wl_list_init(&manager.pending);
+
+    struct ws_connection* conn;
+    struct ws_connection* tmp;
+    wl_list_for_each_safe(conn, tmp, &pending, pending_link) {
+        wl_list_remove(&conn->pending_link);
+        wl_list_init(&conn->pending_link);
+        conn->pending = false;
+        manager_handle_input(conn);
+    }
+}
+
+static void
+manager_accept(void)
+{
+    for (;;) {
+        int fd = accept4(manager.listen_fd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // EAGAIN: all pending clients accepted, anything else: retry on
+            // the next wakeup
+            return;
+        }
+
+        struct ws_connection* conn = malloc(sizeof(*conn));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        if (ws_connection_init(conn, fd) < 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+
+        struct epoll_event event = {
+            .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+            .data.ptr = conn,
+        };
+        if (epoll_ctl(manager.epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            ws_connection_deinit(conn);
+            free(conn);
+            continue;
+        }
+
+        wl_list_insert(&manager.connections, &conn->link);
+    }
+}
+
+static void
+manager_handle_input(
+    struct ws_connection* conn
+) {
+    if (conn->closing) {
+        manager_close(conn);
+        return;
+    }
+    if (conn->pending || conn->throttled || conn->query) {
+        // will be continued from the idle callback, once the responses were
+        // sent or once the query completed anyway
+        return;
+    }
+
+    int res = ws_connection_handle_input(conn, CONNECTION_READ_BUDGET);
+    if ((res < 0) || conn->closing) {
+        manager_close(conn);
+        return;
+    }
+
+    if (res == 1) {
+        // edge-triggered: there will be no further event for the data left
+        conn->pending = true;
+        wl_list_insert(manager.pending.prev, &conn->pending_link);
+        if (!manager.idle) {
+            manager.idle = wl_event_loop_add_idle(manager.loop,
+                                                  manager_dispatch_pending,
+                                                  NULL);
+        }
+    }
+}
+
+static void
+manager_close(
+    struct ws_connection* conn
+) {
+    bool subscribed = conn->subscriptions != 0;
+    wl_list_remove(&conn->link);
+    wl_list_remove(&conn->pending_link);
+    ws_connection_deinit(conn);
+    free(conn);
+
+    if (subscribed) {
+        manager_update_subscriptions();
+    }
+}
+
+static void
+manager_publish(
+    enum ws_compositor_event event,
+    struct ws_object* subject,
+    void* data
+) {
+    uint32_t bit = WS_CONNECTION_EVENT_MASK(event);
+    if (WS_LIKELY(!(manager.subscriptions & bit))) {
+        return;
+    }
+
+    struct ws_value args[EVENT_MAX_ARGS];
+    size_t argc = event_get_args(event, subject, args);
+    uint64_t id = subject ? ws_object_get_id(subject) : 0;
+
+    // encoded lazily, once per format in use
+    struct ws_connection_event* encoded[2] = { NULL, NULL };
+
+    struct ws_connection* conn;
+    struct ws_connection* tmp;
+    wl_list_for_each_safe(conn, tmp, &manager.connections, link) {
+        if (conn->closing || !(conn->subscriptions & bit)) {
+            continue;
+        }
+
+        struct ws_connection_event** shared = encoded + conn->format;
+        if (!*shared) {
+            *shared = event_new(conn->format, event, id, args, argc);
+            if (!*shared) {
+                continue;
+            }
+        }
+
+        if (connection_queue_event(conn, *shared) == 0) {
+            continue;
+        }
+
+        if (conn->policy == WS_CONNECTION_POLICY_DISCONNECT) {
+            WS_LOG(WS_LOG_MODULE_CONNECTION, WS_LOG_WARNING,
+                   "event queue of connection %d full, disconnecting",
+                   conn->fd);
+            // events are published while commands are executed, possibly
+            // by this very connection, so it is closed once they are done
+            conn->closing = true;
+        } else if (!conn->events_dropped++) {
+            WS_LOG(WS_LOG_MODULE_CONNECTION, WS_LOG_WARNING,
+                   "event queue of connection %d full, dropping events",
+                   conn->fd);
+        }
+    }
+
+    event_unref(encoded[0]);
+    event_unref(encoded[1]);
+
+    size_t i;
+    for (i = 0; i < argc; ++i) {
+        ws_value_deinit(args + i);
+    }
+
+    if (!manager.flush) {
+        manager.flush = wl_event_loop_add_idle(manager.loop,
+                                               manager_dispatch_flush, NULL);
+    }
+}
+
+static void
+manager_dispatch_flush(
+    void* data
+) {
+    manager.flush = NULL;
+
+    struct ws_connection* conn;
+    struct ws_connection* tmp;
+    wl_list_for_each_safe(conn, tmp, &manager.connections, link) {
+        if (conn->closing) {
+            manager_close(conn);
+            continue;
+        }
+        if (!ws_queue_len(&conn->events)) {
+            continue;
+        }
+        if (ws_connection_flush(conn) < 0) {
+            manager_close(conn);
+        } else if (manager_unthrottle(conn)) {
+            manager_handle_input(conn);
+        }
+    }
+}
+
+static bool
+manager_unthrottle(
+    struct ws_connection* conn
+) {
+    if (!conn->throttled || (conn->out.len >= CONNECTION_SEND_MAX)) {
+        return false;
+    }
+
+    conn->throttled = false;
+    return true;
+}
+
+static void
+manager_update_subscriptions(void)
+{
+    manager.subscriptions = 0;
+
+    struct ws_connection* conn;
+    wl_list_for_each(conn, &manager.connections, link) {
+        manager.subscriptions |= conn->subscriptions;
+    }
+}
+
+static int
+command_subscribe(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc != 1) || (ws_value_get_type(args) != WS_VALUE_TYPE_INT)) {
+        return -EINVAL;
+    }
+
+    int64_t mask = ws_value_int_get(args);
+    uint32_t all = WS_CONNECTION_EVENT_MASK(WS_COMPOSITOR_EVENT_NUM) - 1;
+    if ((mask < 0) || (mask & ~(int64_t) all)) {
+        return -EINVAL;
+    }
+    if (!manager.current) {
+        return -ENOTCONN;
+    }
+
+    if (mask && !manager.current->events.entries) {
+        int res = ws_queue_init(&manager.current->events,
+                                CONNECTION_EVENT_QUEUE);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    manager.current->subscriptions = (uint32_t) mask;
+    manager_update_subscriptions();
+    return 0;
+}
+
+static int
+command_backpressure(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc != 1) || (ws_value_get_type(args) != WS_VALUE_TYPE_STRING)) {
+        return -EINVAL;
+    }
+    if (!manager.current) {
+        return -ENOTCONN;
+    }
+
+    char const* name = ws_value_string_get(args);
+    size_t len = ws_value_string_len(args);
+    size_t i;
+    for (i = 0; i < sizeof(policy_names) / sizeof(*policy_names); ++i) {
+        if ((strlen(policy_names[i]) == len) &&
+                (memcmp(policy_names[i], name, len) == 0)) {
+            manager.current->policy = (enum ws_connection_policy) i;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+static struct ws_connection_event*
+event_new(
+    enum ws_serialize_format format,
+    enum ws_compositor_event event,
+    uint64_t subject,
+    struct ws_value const* args,
+    size_t argc
+) {
+    char const* name = event_names[event];
+    size_t len = ws_serialize_encode_event(format, NULL, 0, name, args, argc);
+
+    struct ws_connection_event* self = malloc(sizeof(*self) + len);
+    if (!self) {
+        return NULL;
+    }
+
+    self->refs = 1;
+    self->event = event;
+    self->subject = subject;
+    self->len = ws_serialize_encode_event(format, self->data, len, name, args,
+                                          argc);
+    return self;
+}
+
+static void
+event_unref(
+    struct ws_connection_event* event
+) {
+    if (event && !--event->refs) {
+        free(event);
+    }
+}
+
+static size_t
+event_get_args(
+    enum ws_compositor_event event,
+    struct ws_object* subject,
+    struct ws_value* args
+) {
+    if (!subject) {
+        ws_value_nil_init(args);
+        return 1;
+    }
+
+    ws_value_object_id_init(args, ws_object_get_id(subject));
+
+    struct ws_geometry const* geometry = NULL;
+    if (event == WS_COMPOSITOR_EVENT_GEOMETRY) {
+        struct ws_window* window;
+        window = wl_container_of(subject, window, obj);
+        geometry = &window->geometry;
+    } else if (event == WS_COMPOSITOR_EVENT_OUTPUT_NEW) {
+        struct ws_output* output;
+        output = wl_container_of(subject, output, obj);
+        geometry = &output->geometry;
+    }
+    if (!geometry) {
+        return 1;
+    }
+
+    ws_value_int_init(args + 1, geometry->x);
+    ws_value_int_init(args + 2, geometry->y);
+    ws_value_int_init(args + 3, geometry->width);
+    ws_value_int_init(args + 4, geometry->height);
+    return 5;
+}
+
+static int
+connection_queue_event(
+    struct ws_connection* self,
+    struct ws_connection_event* event
+) {
+    struct ws_queue* queue = &self->events;
+
+    // only the latest geometry of a window and the latest focus matter, older
+    // ones not yet started to be sent are superseded
+    if ((self->policy == WS_CONNECTION_POLICY_COALESCE) &&
+            ws_queue_len(queue) &&
+            ((event->event == WS_COMPOSITOR_EVENT_GEOMETRY) ||
+             (event->event == WS_COMPOSITOR_EVENT_FOCUS))) {
+        size_t first = self->event_offset ? 1 : 0;
+        size_t pos;
+        for (pos = ws_queue_len(queue); pos-- > first;) {
+            struct ws_connection_event** slot;
+            slot = (struct ws_connection_event**) ws_queue_at(queue, pos);
+            if (*slot && ((*slot)->event == event->event) &&
+                    ((event->event == WS_COMPOSITOR_EVENT_FOCUS) ||
+                     ((*slot)->subject == event->subject))) {
+                event_unref(*slot);
+                *slot = NULL;
+                break;
+            }
+        }
+    }
+
+    if (ws_queue_full(queue) && !ws_queue_compact(queue)) {
+        return -ENOBUFS;
+    }
+
+    int res = ws_queue_push(queue, event);
+    if (res == 0) {
+        ++event->refs;
+    }
+    return res;
+}
+
+static bool
+connection_consume_event(
+    struct ws_connection* self,
+    size_t* written
+) {
+    struct ws_connection_event* event = *ws_queue_at(&self->events, 0);
+    size_t rest = event->len - self->event_offset;
+    if (*written < rest) {
+        self->event_offset += *written;
+        *written = 0;
+        return false;
+    }
+
+    *written -= rest;
+    self->event_offset = 0;
+    event_unref(event);
+    ws_queue_pop(&self->events, NULL);
+    return true;
+}
+
+static void
+connection_skip_coalesced(
+    struct ws_connection* self
+) {
+    while (ws_queue_len(&self->events) && !*ws_queue_at(&self->events, 0)) {
+        ws_queue_pop(&self->events, NULL);
+    }
+}
+
+static void
+connection_clear_events(
+    struct ws_connection* self
+) {
+    void* event;
+    while (ws_queue_pop(&self->events, &event) == 0) {
+        event_unref(event);
+    }
+    self->event_offset = 0;
+}
+
+static int
+connection_handshake(
+    struct ws_connection* self
+) {
+    size_t len;
+    char const* data = ws_serialize_parser_peek(&self->parser, &len);
+
+    char const* newline;
+    newline = memchr(data, '\n', WS_MIN(len, CONNECTION_HANDSHAKE_MAX));
+    if (!newline) {
+        return (len < CONNECTION_HANDSHAKE_MAX) ? 0 : -EPROTO;
+    }
+
+    size_t line_len = newline - data;
+    size_t prefix_len = sizeof(CONNECTION_HANDSHAKE_PREFIX) - 1;
+    char const* format = data + prefix_len;
+    size_t format_len = 0;
+
+    if ((line_len >= prefix_len) &&
+            (memcmp(data, CONNECTION_HANDSHAKE_PREFIX, prefix_len) == 0)) {
+        format_len = line_len - prefix_len;
+    }
+
+    if ((format_len == 4) && (memcmp(format, "text", 4) == 0)) {
+        self->format = WS_SERIALIZE_FORMAT_TEXT;
+    } else if ((format_len == 6) && (memcmp(format, "binary", 6) == 0)) {
+        self->format = WS_SERIALIZE_FORMAT_BINARY;
+    } else {
+        static char const error[] = CONNECTION_HANDSHAKE_PREFIX "error\n";
+        connection_queue_raw(self, error, sizeof(error) - 1);
+        ws_connection_flush(self);
+        return -EPROTO;
+    }
+
+    // acknowledge by echoing the handshake line
+    int res = connection_queue_raw(self, data, line_len + 1);
+    if (res < 0) {
+        return res;
+    }
+
+    ws_serialize_parser_skip(&self->parser, line_len + 1);
+    ws_serialize_parser_set_format(&self->parser, self->format);
+    self->handshake_done = true;
+    return 1;
+}
+
+static int
+connection_process(
+    struct ws_connection* self
+) {
+    struct ws_arena* arena = ws_command_processor_begin_batch();
+    if (!arena) {
+        return -ENOMEM;
+    }
+
+    struct ws_serialize_message msg;
+    int res;
+
+    manager.current = self;
+
+    while ((res = ws_serialize_parser_next(&self->parser, arena, &msg)) > 0) {
+        struct ws_value single_result;
+        int single_status;
+        struct ws_value* results = &single_result;
+        int* statuses = &single_status;
+
+        if (msg.transaction) {
+            results = ws_arena_alloc(arena, msg.num * sizeof(*results));
+            statuses = ws_arena_alloc(arena, msg.num * sizeof(*statuses));
+            if (!results || !statuses) {
+                res = -ENOMEM;
+                break;
+            }
+        }
+
+        size_t i;
+        for (i = 0; i < msg.num; ++i) {
+            ws_value_init(results + i);
+        }
+
+        if (msg.transaction) {
+            ws_command_processor_exec_transaction(msg.calls, msg.num, results,
+                                                  statuses);
+        } else {
+            single_status = ws_command_processor_submit(msg.calls,
+                                                        connection_query_done,
+                                                        self, &self->query);
+            if (single_status == 0) {
+                // the messages after the query wait for its response
+                break;
+            }
+            if (single_status == -EOPNOTSUPP) {
+                single_status = ws_command_processor_exec(msg.calls, results);
+            }
+        }
+
+        // the results may reference scratch memory, encode them right away
+        for (i = 0; i < msg.num; ++i) {
+            if (res > 0) {
+                res = connection_queue_response(self, statuses[i],
+                                                results + i);
+            }
+            ws_value_deinit(results + i);
+        }
+        if ((res < 0) || self->closing) {
+            break;
+        }
+    }
+
+    ws_command_processor_end_batch();
+    manager.current = NULL;
+
+    if (res < 0) {
+        return res;
+    }
+    return ws_serialize_parser_release(&self->parser);
+}
+
+static void
+connection_query_done(
+    void* data,
+    int status,
+    struct ws_value const* result
+) {
+    struct ws_connection* self = data;
+    self->query = NULL;
+
+    int res = connection_queue_response(self, status, result);
+    if (res < 0) {
+        manager_close(self);
+        return;
+    }
+
+    // reads the messages which arrived meanwhile and sends the response
+    manager_handle_input(self);
+}
+
+static int
+connection_queue_response(
+    struct ws_connection* self,
+    int status,
+    struct ws_value const* result
+) {
+    size_t avail = self->out.cap - self->out.len;
+    size_t len = ws_serialize_encode_response(self->format,
+                                              self->out.data + self->out.len,
+                                              avail, status, result);
+    if (len > avail) {
+        int res = connection_reserve(self, len);
+        if (res < 0) {
+            return res;
+        }
+        ws_serialize_encode_response(self->format,
+                                     self->out.data + self->out.len, len,
+                                     status, result);
+    }
+
+    self->out.len += len;
+    return 0;
+}
+
+static int
+connection_queue_raw(
+    struct ws_connection* self,
+    char const* data,
+    size_t len
+) {
+    int res = connection_reserve(self, len);
+    if (res < 0) {
+        return res;
+    }
+
+    memcpy(self->out.data + self->out.len, data, len);
+    self->out.len += len;
+    return 0;
+}
+
+static int
+connection_reserve(
+    struct ws_connection* self,
+    size_t len
+) {
+    if (self->out.cap - self->out.len >= len) {
+        return 0;
+    }
+
+    size_t cap = WS_MAX(self->out.cap * 2, self->out.len + len);
+    char* data = realloc(self->out.data, cap);
+    if (!data) {
+        return -ENOMEM;
+    }
 
+    self->out.data = data;
+    self->out.cap = cap;
+    return 0;
+}
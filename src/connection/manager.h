@@ -28,6 +28,200 @@
 #ifndef __WS_CONNECTION_MANAGER_H__
 #define __WS_CONNECTION_MANAGER_H__
 
+/**
+ * @file manager.h
+ *
+ * @brief Connections of scripting clients
+ *
+ * A client starts a connection with a handshake selecting the wire format. It
+ * sends a single line `waysome <format>`, where `<format>` is either `text` or
+ * `binary`. The compositor answers with the same line if it accepts the
+ * format, or with `waysome error` before closing the connection. Afterwards,
+ * the client sends messages in the selected format and receives one response
+ * per command in the same format (see serialize/module.h). The responses to
+ * the commands of a transaction are sent in the order of the commands.
+ *
+ * Queries outside of transactions are submitted to the workers of the command
+ * processor rather than executed right away. Until the response to a query
+ * was queued, the connection is not read from, so responses are always sent
+ * in the order of the commands, while the compositor goes on serving other
+ * connections.
+ *
+ * The connection manager accepts clients on a UNIX socket and watches all
+ * client sockets with a single, edge-triggered epoll instance which itself is
+ * registered in the compositor's event loop. Each wakeup drains every ready
+ * socket and executes the messages received in batches. All sockets are
+ * non-blocking and each connection has a read budget per wakeup, so a busy
+ * client can not stall the compositor: connections which exceed their budget
+ * are continued from an idle callback.
+ *
+ * Clients receive compositor events (see `enum ws_compositor_event`) after
+ * subscribing to them with the command `subscribe`, which takes a mask of
+ * WS_CONNECTION_EVENT_MASK() bits and replaces the previous subscriptions.
+ * The events are sent as (see serialize/module.h)
+ *
+ * - `["window_map", #window]`
+ * - `["window_unmap", #window]`
+ * - `["focus", #window]`, or `["focus", null]` if no window is focused
+ * - `["geometry", #window, x, y, width, height]`
+ * - `["output_new", #output, x, y, width, height]`
+ * - `["output_destroy", #output]`
+ *
+ * Each event is encoded once per wire format into a reference counted buffer
+ * which is queued on every subscribed connection and sent from there with
+ * scatter/gather I/O, so fanning out an event does not copy it. Queued events
+ * are sent from an idle callback, i.e. once per dispatch of the event loop.
+ *
+ * The memory a connection may pin is bounded. Its event queue holds at most
+ * 256 events, and what happens if a client does not keep up is up to the
+ * client, which selects a policy by passing its name to the command
+ * `backpressure` (see `enum ws_connection_policy`). Responses are throttled
+ * instead: once more than 1 MiB of responses wait to be sent, the connection
+ * is not read from until the client received them.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-util.h>
+
+#include "objects/queue.h"
+#include "serialize/module.h"
+#include "util/attributes.h"
+
+struct wl_event_loop;
+struct ws_command_query;
+struct ws_connection_event;
+
+/**
+ * Bit of an event in a subscription mask
+ */
+#define WS_CONNECTION_EVENT_MASK(event) (1u << (event))
+
+/**
+ * What to do with events for a client which does not keep up
+ */
+enum ws_connection_policy {
+    /**
+     * "coalesce": while events are queued, a new geometry event replaces a
+     * queued one of the same window and a new focus event replaces a queued
+     * one, so the client only gets the latest state; events which still do
+     * not fit are dropped
+     */
+    WS_CONNECTION_POLICY_COALESCE = 0,
+    WS_CONNECTION_POLICY_DROP, //!< "drop": drop events which do not fit
+    WS_CONNECTION_POLICY_DISCONNECT, //!< "disconnect": close the connection
+};
+
+/**
+ * Connection type
+ */
+struct ws_connection {
+    struct wl_list link; //!< Link in the list of all connections
+    struct wl_list pending_link; //!< Link in the list of pending connections
+    bool pending; //!< Whether the connection exceeded its read budget
+    int fd; //!< The socket
+    bool handshake_done; //!< Whether the format was negotiated
+    enum ws_serialize_format format; //!< Format negotiated in the handshake
+    struct ws_serialize_parser parser; //!< Parser owning the receive buffer
+    struct {
+        char* data; //!< Pending outgoing data
+        size_t len; //!< Number of bytes pending
+        size_t cap; //!< Capacity of the buffer
+    } out; //!< Send buffer
+    bool throttled; //!< Whether reading waits for responses to be sent
+    struct ws_command_query* query; //!< Query executed by a worker, if any
+    uint32_t subscriptions; //!< Mask of the events subscribed to
+    enum ws_connection_policy policy; //!< Policy if the event queue is full
+    struct ws_queue events; //!< Queued events, NULL entries were coalesced
+    size_t event_offset; //!< Number of bytes of the oldest event already sent
+    size_t events_dropped; //!< Number of events dropped
+    bool closing; //!< Whether the connection is to be closed by the manager
+};
+
+/**
+ * Initialize a connection
+ *
+ * The connection takes over the socket, which should be non-blocking.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_connection_init(
+    struct ws_connection* self, //!< The connection to initialize
+    int fd //!< The socket of the connection
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize a connection
+ *
+ * Closes the socket.
+ */
+void
+ws_connection_deinit(
+    struct ws_connection* self //!< The connection to deinitialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Handle incoming data on a connection
+ *
+ * Reads data available on the socket until either the socket is drained or
+ * `budget` bytes were read, executes the commands received and sends the
+ * responses.
+ *
+ * Reading stops early if too many responses wait to be sent, in which case
+ * the connection is marked as throttled, or once a query was submitted to a
+ * worker.
+ *
+ * @return 0 if the socket was drained, 1 if the budget was exhausted before,
+ *         2 if the connection was throttled or waits for a query, a negative
+ *         error number if the connection should be closed
+ */
+int
+ws_connection_handle_input(
+    struct ws_connection* self, //!< The connection
+    size_t budget //!< Maximum number of bytes to read
+)
+__ws_nonnull__(1);
 
+/**
+ * Send pending outgoing data
+ *
+ * Sends the responses and the queued events.
+ *
+ * @return 0 on success, a negative error number if the connection should be
+ *         closed
+ */
+int
+ws_connection_flush(
+    struct ws_connection* self //!< The connection
+)
+__ws_nonnull__(1);
+
+/**
+ * Initialize the connection manager
+ *
+ * Creates the socket `name` in `$XDG_RUNTIME_DIR` and starts accepting
+ * clients. Registers the command `subscribe` and a compositor listener, so
+ * the command processor and the compositor must be initialized before.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_connection_manager_init(
+    struct wl_event_loop* loop, //!< Event loop of the compositor
+    char const* name //!< Name of the socket
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Deinitialize the connection manager
+ *
+ * Closes all connections and removes the socket.
+ */
+void
+ws_connection_manager_deinit(void);
 
 #endif // __WS_CONNECTION_MANAGER_H__
@@ -25,5 +25,851 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include "logger/module.h"
+#include "util/arithmetical.h"
+#include "util/clock.h"
+#include "util/histogram.h"
+
+/**
+ * Number of records in the ring buffer of a thread, must be a power of two
+ */
+#define LOGGER_RING_SIZE 1024
+
+/**
+ * Maximum number of arguments stored in a record
+ */
+#define LOGGER_MAX_ARGS 12
+
+/**
+ * Space for copies of string arguments in a record
+ */
+#define LOGGER_STRING_SPACE 136
+
+/**
+ * Maximum length of a formatted message, including the prefix
+ */
+#define LOGGER_LINE_MAX 1024
+
+/**
+ * Interval in which the background thread polls the ring buffers
+ */
+#define LOGGER_POLL_NS (10 * WS_CLOCK_NS_PER_MS)
+
+/**
+ * Mask with the bits of all modules set
+ */
+#define LOGGER_ALL_MODULES ((UINT32_C(1) << WS_LOG_MODULE_NUM) - 1)
+
+_Atomic uint32_t ws_log_masks[WS_LOG_LEVEL_NUM] = {
+    [WS_LOG_ERROR] = LOGGER_ALL_MODULES,
+    [WS_LOG_WARNING] = LOGGER_ALL_MODULES,
+    [WS_LOG_INFO] = LOGGER_ALL_MODULES,
+    [WS_LOG_DEBUG] = 0,
+    [WS_LOG_TRACE] = 0,
+};
+
+/**
+ * Names of the log levels, indexed by `enum ws_log_level`
+ */
+static char const* const level_names[] = {
+    [WS_LOG_ERROR] = "error",
+    [WS_LOG_WARNING] = "warning",
+    [WS_LOG_INFO] = "info",
+    [WS_LOG_DEBUG] = "debug",
+    [WS_LOG_TRACE] = "trace",
+};
+
+/**
+ * Names of the modules, indexed by `enum ws_log_module`
+ */
+static char const* const module_names[] = {
+    [WS_LOG_MODULE_MAIN] = "main",
+    [WS_LOG_MODULE_COMMAND] = "command",
+    [WS_LOG_MODULE_COMPOSITOR] = "compositor",
+    [WS_LOG_MODULE_CONNECTION] = "connection",
+    [WS_LOG_MODULE_STORAGE] = "storage",
+    [WS_LOG_MODULE_SESSION] = "session",
+    [WS_LOG_MODULE_ACTION] = "action",
+};
+
+/**
+ * Types of arguments, as consumed from the argument list
+ */
+enum arg_type {
+    ARG_NONE = 0, //!< The conversion takes no argument, e.g. `%%`
+    ARG_INT, //!< int, including char and short
+    ARG_UINT, //!< unsigned int, including unsigned char and short
+    ARG_LONG, //!< long
+    ARG_ULONG, //!< unsigned long
+    ARG_LLONG, //!< long long
+    ARG_ULLONG, //!< unsigned long long
+    ARG_SIZE, //!< size_t
+    ARG_PTRDIFF, //!< ptrdiff_t
+    ARG_INTMAX, //!< intmax_t
+    ARG_UINTMAX, //!< uintmax_t
+    ARG_DOUBLE, //!< double, including float
+    ARG_LDOUBLE, //!< long double, stored as double
+    ARG_PTR, //!< void*
+    ARG_STRING, //!< char const*, copied into the record
+};
+
+/**
+ * Conversion specification of a format string
+ */
+struct spec {
+    char const* begin; //!< Start of the specification, the `%`
+    size_t len; //!< Length of the specification
+    unsigned stars; //!< Number of `*` for width and precision
+    int precision; //!< Literal precision, -1 if none, -2 if given by `*`
+    enum arg_type type; //!< Type of the argument
+};
+
+/**
+ * Argument stored in a record
+ */
+union arg {
+    intmax_t i; //!< Signed integers
+    uintmax_t u; //!< Unsigned integers
+    double d; //!< Floating point numbers
+    void const* p; //!< Pointers
+    struct {
+        uint16_t offset; //!< Offset of the copy in the record's strings
+        uint16_t len; //!< Length of the copy
+        bool null; //!< Whether the string was NULL
+    } s; //!< Strings
+};
+
+/**
+ * Record of a message
+ */
+struct record {
+    uint64_t time; //!< Time the message was logged
+    char const* fmt; //!< The format string
+    uint8_t level; //!< Level of the message
+    uint8_t module; //!< Module logging the message
+    uint8_t num_args; //!< Number of arguments stored
+    uint16_t strings_len; //!< Bytes used in `strings`
+    union arg args[LOGGER_MAX_ARGS]; //!< The arguments
+    char strings[LOGGER_STRING_SPACE]; //!< Copies of string arguments
+};
+
+/**
+ * Ring buffer of a thread
+ *
+ * The ring is a single-producer single-consumer queue: only the owning thread
+ * advances `head` and only the background thread advances `tail`.
+ */
+struct ring {
+    struct ring* next; //!< Next ring in the list of all rings
+    _Atomic size_t head; //!< Number of records written
+    _Atomic size_t tail; //!< Number of records consumed
+    _Atomic uint64_t dropped; //!< Number of records dropped
+    uint64_t dropped_reported; //!< Number of drops reported, consumer only
+    struct record records[LOGGER_RING_SIZE]; //!< The records
+};
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Look up a name in a table of names
+ *
+ * @return The index of the name or -1 if it is not in the table
+ */
+static int
+find_name(
+    char const* const* names, //!< The table
+    size_t num, //!< Number of names in the table
+    char const* name, //!< The name, not necessarily 0-terminated
+    size_t len //!< Length of the name
+);
+
+/**
+ * Get the ring buffer of the calling thread, creating it if necessary
+ *
+ * @return The ring or NULL if it could not be allocated
+ */
+static struct ring*
+local_ring(void);
+
+/**
+ * Parse the next conversion specification of a format string
+ *
+ * @return Pointer to the `%` of the specification or NULL if there is none
+ */
+static char const*
+parse_spec(
+    char const* fmt, //!< The format string
+    struct spec* spec //!< Output: the specification
+);
+
+/**
+ * Store the arguments of a message in a record
+ */
+static void
+record_args(
+    struct record* record, //!< The record, `fmt` must be set
+    va_list args //!< The arguments
+);
+
+/**
+ * Format a record
+ *
+ * @return The length of the formatted message
+ */
+static size_t
+format_record(
+    struct record const* record, //!< The record
+    char* buf, //!< Output: the message
+    size_t size //!< Size of `buf`
+);
+
+/**
+ * Format a single conversion with arguments stored in a record
+ *
+ * @return What snprintf() returns
+ */
+static int
+format_spec(
+    struct spec const* spec, //!< The conversion
+    struct record const* record, //!< The record holding the arguments
+    size_t* arg, //!< In/Output: index of the next argument
+    char* buf, //!< Output: the formatted conversion
+    size_t size //!< Size of `buf`
+);
+
+/**
+ * Format and write all pending records
+ */
+static void
+drain(void);
+
+/**
+ * Main function of the background thread
+ *
+ * @return NULL
+ */
+static void*
+logger_thread(
+    void* data //!< Unused
+);
+
+/**
+ * Logger state
+ */
+static struct {
+    _Atomic bool running; //!< Whether the logger is initialized
+    _Atomic unsigned generation; //!< Incremented on each initialization
+    _Atomic(struct ring*) rings; //!< Ring buffers of all threads
+    uint64_t start; //!< Time of initialization
+    FILE* file; //!< The log file
+    pthread_t thread; //!< The background thread
+} logger;
+
+/**
+ * Ring buffer of the current thread
+ */
+static _Thread_local struct ring* thread_ring;
+
+/**
+ * Generation of the logger `thread_ring` belongs to
+ */
+static _Thread_local unsigned thread_generation;
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_logger_init(
+    char const* path
+) {
+    if (atomic_load(&logger.running)) {
+        return -EALREADY;
+    }
+
+    logger.file = stderr;
+    if (path) {
+        logger.file = fopen(path, "a");
+        if (!logger.file) {
+            return -errno;
+        }
+    }
+
+    logger.start = ws_clock_now();
+    atomic_fetch_add(&logger.generation, 1);
+    atomic_store(&logger.running, true);
+
+    int res = pthread_create(&logger.thread, NULL, logger_thread, NULL);
+    if (res != 0) {
+        atomic_store(&logger.running, false);
+        if (logger.file != stderr) {
+            fclose(logger.file);
+        }
+        return -res;
+    }
+    return 0;
+}
+
+void
+ws_logger_deinit(void)
+{
+    if (!atomic_exchange(&logger.running, false)) {
+        return;
+    }
+
+    // the thread drains the rings one last time before it exits
+    pthread_join(logger.thread, NULL);
+
+    // threads still holding a ring notice the generation changed
+    atomic_fetch_add(&logger.generation, 1);
+    struct ring* ring = atomic_exchange(&logger.rings, NULL);
+    while (ring) {
+        struct ring* next = ring->next;
+        free(ring);
+        ring = next;
+    }
+
+    if (logger.file != stderr) {
+        fclose(logger.file);
+    }
+    logger.file = NULL;
+}
+
+void
+ws_logger_set_level(
+    enum ws_log_level level
+) {
+    size_t i;
+    for (i = 0; i < WS_LOG_MODULE_NUM; ++i) {
+        ws_logger_set_module_level((enum ws_log_module) i, level);
+    }
+}
+
+void
+ws_logger_set_module_level(
+    enum ws_log_module module,
+    enum ws_log_level level
+) {
+    uint32_t bit = UINT32_C(1) << module;
+    size_t i;
+    for (i = 0; i < WS_LOG_LEVEL_NUM; ++i) {
+        if (i <= (size_t) level) {
+            atomic_fetch_or_explicit(ws_log_masks + i, bit,
+                                     memory_order_relaxed);
+        } else {
+            atomic_fetch_and_explicit(ws_log_masks + i, ~bit,
+                                      memory_order_relaxed);
+        }
+    }
+}
+
+int
+ws_logger_configure(
+    char const* spec
+) {
+    while (*spec) {
+        size_t len = strcspn(spec, ",");
+        char const* eq = memchr(spec, '=', len);
+
+        char const* level_str = eq ? eq + 1 : spec;
+        int level = find_name(level_names, WS_LOG_LEVEL_NUM, level_str,
+                              (size_t) (spec + len - level_str));
+        if (level < 0) {
+            return -EINVAL;
+        }
+
+        if (eq) {
+            int module = find_name(module_names, WS_LOG_MODULE_NUM, spec,
+                                   (size_t) (eq - spec));
+            if (module < 0) {
+                return -EINVAL;
+            }
+            ws_logger_set_module_level((enum ws_log_module) module,
+                                       (enum ws_log_level) level);
+        } else {
+            ws_logger_set_level((enum ws_log_level) level);
+        }
+
+        spec += len;
+        if (*spec == ',') {
+            ++spec;
+        }
+    }
+    return 0;
+}
+
+void
+ws_log(
+    enum ws_log_module module,
+    enum ws_log_level level,
+    char const* fmt,
+    ...
+) {
+    if (!WS_LOG_ENABLED(module, level) ||
+            !atomic_load_explicit(&logger.running, memory_order_relaxed)) {
+        return;
+    }
+
+    struct ring* ring = local_ring();
+    if (!ring) {
+        return;
+    }
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= LOGGER_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct record* record = ring->records + (head & (LOGGER_RING_SIZE - 1));
+    record->time = ws_clock_now();
+    record->fmt = fmt;
+    record->level = (uint8_t) level;
+    record->module = (uint8_t) module;
+
+    va_list args;
+    va_start(args, fmt);
+    record_args(record, args);
+    va_end(args);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void
+ws_log_histogram(
+    enum ws_log_module module,
+    enum ws_log_level level,
+    char const* name,
+    struct ws_histogram const* histogram
+) {
+    if (!WS_LOG_ENABLED(module, level)) {
+        return;
+    }
+
+    ws_log(module, level,
+           "%s: n=%llu mean=%lluus p50=%lluus p90=%lluus p99=%lluus "
+           "p99.9=%lluus max=%lluus", name,
+           (unsigned long long) ws_histogram_count(histogram),
+           (unsigned long long) ws_histogram_mean(histogram) / 1000,
+           (unsigned long long) ws_histogram_percentile(histogram, 50) / 1000,
+           (unsigned long long) ws_histogram_percentile(histogram, 90) / 1000,
+           (unsigned long long) ws_histogram_percentile(histogram, 99) / 1000,
+           (unsigned long long) ws_histogram_percentile(histogram, 99.9) / 1000,
+           (unsigned long long) ws_histogram_percentile(histogram, 100) / 1000);
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static int
+find_name(
+    char const* const* names,
+    size_t num,
+    char const* name,
+    size_t len
+) {
+    size_t i;
+    for (i = 0; i < num; ++i) {
+        if ((strncmp(names[i], name, len) == 0) && (names[i][len] == '\0')) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+static struct ring*
+local_ring(void)
+{
+    unsigned generation = atomic_load_explicit(&logger.generation,
+                                               memory_order_acquire);
+    if (thread_ring && (thread_generation == generation)) {
+        return thread_ring;
+    }
+
+    // first message of this thread, the only allocation it will ever do
+    struct ring* ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        return NULL;
+    }
+
+    ring->next = atomic_load(&logger.rings);
+    while (!atomic_compare_exchange_weak(&logger.rings, &ring->next, ring)) {
+    }
+
+    thread_ring = ring;
+    thread_generation = generation;
+    return ring;
+}
+
+static char const*
+parse_spec(
+    char const* fmt,
+    struct spec* spec
+) {
+    char const* begin = strchr(fmt, '%');
+    if (!begin) {
+        return NULL;
+    }
+
+    char const* cur = begin + 1;
+    spec->stars = 0;
+    spec->precision = -1;
+
+    // flags and width
+    while (*cur && strchr("-+ #0123456789*'", *cur)) {
+        if (*cur == '*') {
+            ++spec->stars;
+        }
+        ++cur;
+    }
+
+    // precision, which bounds how much of a string is read
+    if (*cur == '.') {
+        ++cur;
+        if (*cur == '*') {
+            ++spec->stars;
+            spec->precision = -2;
+            ++cur;
+        } else {
+            spec->precision = 0;
+            while (*cur >= '0' && *cur <= '9') {
+                if (spec->precision <= (INT_MAX - 9) / 10) {
+                    spec->precision = spec->precision * 10 + (*cur - '0');
+                }
+                ++cur;
+            }
+        }
+    }
+
+    // length modifier
+    enum { LEN_NONE, LEN_L, LEN_LL, LEN_Z, LEN_T, LEN_J, LEN_BIG_L } length;
+    length = LEN_NONE;
+    while (*cur && strchr("hlLzjtq", *cur)) {
+        switch (*cur) {
+        case 'l':   length = (length == LEN_L) ? LEN_LL : LEN_L; break;
+        case 'q':   length = LEN_LL;                            break;
+        case 'z':   length = LEN_Z;                             break;
+        case 't':   length = LEN_T;                             break;
+        case 'j':   length = LEN_J;                             break;
+        case 'L':   length = LEN_BIG_L;                         break;
+        default:                                                break;
+        }
+        ++cur;
+    }
+
+    char conversion = *cur;
+    if (conversion) {
+        ++cur;
+    }
+
+    switch (conversion) {
+    case 'd':
+    case 'i':
+    case 'c':
+        switch (length) {
+        case LEN_L:     spec->type = ARG_LONG;      break;
+        case LEN_LL:    spec->type = ARG_LLONG;     break;
+        case LEN_Z:     spec->type = ARG_SIZE;      break;
+        case LEN_T:     spec->type = ARG_PTRDIFF;   break;
+        case LEN_J:     spec->type = ARG_INTMAX;    break;
+        default:        spec->type = ARG_INT;       break;
+        }
+        break;
+
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        switch (length) {
+        case LEN_L:     spec->type = ARG_ULONG;     break;
+        case LEN_LL:    spec->type = ARG_ULLONG;    break;
+        case LEN_Z:     spec->type = ARG_SIZE;      break;
+        case LEN_T:     spec->type = ARG_PTRDIFF;   break;
+        case LEN_J:     spec->type = ARG_UINTMAX;   break;
+        default:        spec->type = ARG_UINT;      break;
+        }
+        break;
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        spec->type = (length == LEN_BIG_L) ? ARG_LDOUBLE : ARG_DOUBLE;
+        break;
+
+    case 'p':
+        spec->type = ARG_PTR;
+        break;
+
+    case 's':
+        spec->type = ARG_STRING;
+        break;
+
+    default:
+        // `%%`, and `%n` which is not supported
+        spec->type = ARG_NONE;
+        spec->stars = 0;
+        break;
+    }
+
+    spec->begin = begin;
+    spec->len = (size_t) (cur - begin);
+    return begin;
+}
+
+static void
+record_args(
+    struct record* record,
+    va_list args
+) {
+    record->num_args = 0;
+    record->strings_len = 0;
+
+    char const* fmt = record->fmt;
+    struct spec spec;
+    while (parse_spec(fmt, &spec)) {
+        fmt = spec.begin + spec.len;
+        if (record->num_args + spec.stars + 1 > LOGGER_MAX_ARGS) {
+            // the consumer stops formatting where the arguments run out
+            return;
+        }
+
+        unsigned i;
+        for (i = 0; i < spec.stars; ++i) {
+            record->args[record->num_args++].i = va_arg(args, int);
+        }
+
+        union arg* arg = record->args + record->num_args;
+        switch (spec.type) {
+        case ARG_NONE:      continue;
+        case ARG_INT:       arg->i = va_arg(args, int);                 break;
+        case ARG_UINT:      arg->u = va_arg(args, unsigned int);        break;
+        case ARG_LONG:      arg->i = va_arg(args, long);                break;
+        case ARG_ULONG:     arg->u = va_arg(args, unsigned long);       break;
+        case ARG_LLONG:     arg->i = va_arg(args, long long);           break;
+        case ARG_ULLONG:    arg->u = va_arg(args, unsigned long long);  break;
+        case ARG_SIZE:      arg->u = va_arg(args, size_t);              break;
+        case ARG_PTRDIFF:   arg->i = va_arg(args, ptrdiff_t);           break;
+        case ARG_INTMAX:    arg->i = va_arg(args, intmax_t);            break;
+        case ARG_UINTMAX:   arg->u = va_arg(args, uintmax_t);           break;
+        case ARG_DOUBLE:    arg->d = va_arg(args, double);              break;
+        case ARG_LDOUBLE:   arg->d = (double) va_arg(args, long double); break;
+        case ARG_PTR:       arg->p = va_arg(args, void*);               break;
+        case ARG_STRING: {
+            char const* str = va_arg(args, char const*);
+            size_t len = 0;
+            if (str) {
+                // a precision may mean the string is not 0-terminated
+                size_t space = LOGGER_STRING_SPACE - record->strings_len;
+                int precision = spec.precision;
+                if (precision == -2) {
+                    precision = (int) record->args[record->num_args - 1].i;
+                }
+                if (precision >= 0) {
+                    space = WS_MIN(space, (size_t) precision);
+                }
+                len = strnlen(str, space);
+                memcpy(record->strings + record->strings_len, str, len);
+            }
+            arg->s.offset = record->strings_len;
+            arg->s.len = (uint16_t) len;
+            arg->s.null = !str;
+            record->strings_len += (uint16_t) len;
+            break;
+        }
+        }
+        ++record->num_args;
+    }
+}
+
+static size_t
+format_record(
+    struct record const* record,
+    char* buf,
+    size_t size
+) {
+    uint64_t elapsed = record->time - logger.start;
+    int res = snprintf(buf, size, "[%5llu.%06llu] %s %s: ",
+                       (unsigned long long) (elapsed / WS_CLOCK_NS_PER_SEC),
+                       (unsigned long long) (elapsed % WS_CLOCK_NS_PER_SEC /
+                                             1000),
+                       level_names[record->level],
+                       module_names[record->module]);
+    size_t len = (res > 0) ? WS_MIN((size_t) res, size - 1) : 0;
+
+    char const* fmt = record->fmt;
+    size_t arg = 0;
+    struct spec spec;
+    while (len + 1 < size) {
+        char const* next = parse_spec(fmt, &spec);
+        size_t literal = next ? (size_t) (next - fmt) : strlen(fmt);
+        literal = WS_MIN(literal, size - 1 - len);
+        memcpy(buf + len, fmt, literal);
+        len += literal;
+        if (!next) {
+            break;
+        }
+        fmt = spec.begin + spec.len;
+
+        res = format_spec(&spec, record, &arg, buf + len, size - len);
+        if (res < 0) {
+            break;
+        }
+        len += WS_MIN((size_t) res, size - 1 - len);
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+static int
+format_spec(
+    struct spec const* spec,
+    struct record const* record,
+    size_t* arg,
+    char* buf,
+    size_t size
+) {
+    if (spec->type == ARG_NONE) {
+        // only `%%` produces output
+        if (spec->begin[spec->len - 1] != '%') {
+            return 0;
+        }
+        return snprintf(buf, size, "%%");
+    }
+    if (*arg + spec->stars + 1 > record->num_args) {
+        return -1;
+    }
+
+    char fmt[32];
+    if (spec->len >= sizeof(fmt)) {
+        return -1;
+    }
+    memcpy(fmt, spec->begin, spec->len);
+    fmt[spec->len] = '\0';
+
+    int stars[2] = { 0, 0 };
+    unsigned i;
+    for (i = 0; i < spec->stars && i < 2; ++i) {
+        stars[i] = (int) record->args[(*arg)++].i;
+    }
+    union arg const* a = record->args + (*arg)++;
+
+    // pass the stored argument with the type the conversion expects
+#define FORMAT_ARG(value) \
+    ((spec->stars == 0) ? snprintf(buf, size, fmt, value) : \
+     (spec->stars == 1) ? snprintf(buf, size, fmt, stars[0], value) : \
+                          snprintf(buf, size, fmt, stars[0], stars[1], value))
+
+    switch (spec->type) {
+    case ARG_INT:       return FORMAT_ARG((int) a->i);
+    case ARG_UINT:      return FORMAT_ARG((unsigned int) a->u);
+    case ARG_LONG:      return FORMAT_ARG((long) a->i);
+    case ARG_ULONG:     return FORMAT_ARG((unsigned long) a->u);
+    case ARG_LLONG:     return FORMAT_ARG((long long) a->i);
+    case ARG_ULLONG:    return FORMAT_ARG((unsigned long long) a->u);
+    case ARG_SIZE:      return FORMAT_ARG((size_t) a->u);
+    case ARG_PTRDIFF:   return FORMAT_ARG((ptrdiff_t) a->i);
+    case ARG_INTMAX:    return FORMAT_ARG(a->i);
+    case ARG_UINTMAX:   return FORMAT_ARG(a->u);
+    case ARG_DOUBLE:    return FORMAT_ARG(a->d);
+    case ARG_LDOUBLE:   return FORMAT_ARG((long double) a->d);
+    case ARG_PTR:       return FORMAT_ARG(a->p);
+    case ARG_STRING: {
+        // the copy is not 0-terminated, so it is printed with a precision
+        if (a->s.null) {
+            return snprintf(buf, size, "(null)");
+        }
+        char copy[LOGGER_STRING_SPACE + 1];
+        memcpy(copy, record->strings + a->s.offset, a->s.len);
+        copy[a->s.len] = '\0';
+        return FORMAT_ARG(copy);
+    }
+    default:
+        return -1;
+    }
+
+#undef FORMAT_ARG
+}
+
+static void
+drain(void)
+{
+    char line[LOGGER_LINE_MAX];
+    bool written = false;
+
+    struct ring* ring = atomic_load(&logger.rings);
+    for (; ring; ring = ring->next) {
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        for (; tail != head; ++tail) {
+            struct record const* record;
+            record = ring->records + (tail & (LOGGER_RING_SIZE - 1));
+            size_t len = format_record(record, line, sizeof(line) - 1);
+            line[len++] = '\n';
+            fwrite(line, 1, len, logger.file);
+            written = true;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+        uint64_t dropped = atomic_load_explicit(&ring->dropped,
+                                                memory_order_relaxed);
+        if (dropped != ring->dropped_reported) {
+            fprintf(logger.file, "logger: %llu messages dropped\n",
+                    (unsigned long long) (dropped - ring->dropped_reported));
+            ring->dropped_reported = dropped;
+            written = true;
+        }
+    }
+
+    if (written) {
+        fflush(logger.file);
+    }
+}
+
+static void*
+logger_thread(
+    void* data
+) {
+    struct timespec interval = {
+        .tv_sec = 0,
+        .tv_nsec = (long) LOGGER_POLL_NS,
+    };
 
+    while (atomic_load(&logger.running)) {
+        drain();
+        nanosleep(&interval, NULL);
+    }
+    drain();
+    return NULL;
+}
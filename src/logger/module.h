@@ -28,6 +28,191 @@
 #ifndef __WS_LOGGER_MODULE_H__
 #define __WS_LOGGER_MODULE_H__
 
+/**
+ * @file module.h
+ *
+ * @brief Logger
+ *
+ * Logging is asynchronous. ws_log() does not format the message and does not
+ * perform any system call. It only writes a fixed-size binary record holding
+ * the time, the level, the format string and the raw arguments into a ring
+ * buffer owned by the calling thread. Strings passed for `%s` are copied into
+ * the record (and truncated if the record is full), reading no further than
+ * the precision if one is given, all other arguments are stored by value. A background thread polls the ring buffers of all threads,
+ * formats the records and writes them to the log file.
+ *
+ * Hence, format strings must be string literals, or at least stay valid until
+ * the logger is deinitialized. The format is checked at compile time by
+ * `__ws_format__`. All conversions of printf() are supported except for `%n`.
+ *
+ * If a ring buffer is full, records are dropped rather than blocking the
+ * thread logging them. The number of records dropped is logged once there is
+ * room again.
+ *
+ * Messages are prefixed with the time since the logger was initialized, their
+ * level and the module logging them. Each module has its own level at runtime:
+ * messages less severe than the level of their module are dropped. Levels less
+ * severe than WS_LOG_MAX_LEVEL (see util/debug.h) are removed at compile time.
+ *
+ * Code should log through WS_LOG(), which checks whether the message is
+ * enabled before evaluating the arguments. While a message is disabled, the
+ * check is a single load and a branch hinted as not taken, so logging may stay
+ * compiled into hot paths such as the frame path.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+#include "util/debug.h"
+
+struct ws_histogram;
+
+/**
+ * Log levels, most severe first
+ */
+enum ws_log_level {
+    WS_LOG_ERROR = 0,
+    WS_LOG_WARNING,
+    WS_LOG_INFO,
+    WS_LOG_DEBUG,
+    WS_LOG_TRACE,
+    WS_LOG_LEVEL_NUM, //!< Number of levels
+};
+
+/**
+ * Modules which log messages
+ */
+enum ws_log_module {
+    WS_LOG_MODULE_MAIN = 0, //!< "main"
+    WS_LOG_MODULE_COMMAND, //!< "command"
+    WS_LOG_MODULE_COMPOSITOR, //!< "compositor"
+    WS_LOG_MODULE_CONNECTION, //!< "connection"
+    WS_LOG_MODULE_STORAGE, //!< "storage"
+    WS_LOG_MODULE_SESSION, //!< "session"
+    WS_LOG_MODULE_ACTION, //!< "action"
+    WS_LOG_MODULE_NUM, //!< Number of modules
+};
+
+/**
+ * Modules enabled per level, one bit per `enum ws_log_module`
+ *
+ * Use WS_LOG_ENABLED() rather than accessing the masks directly.
+ */
+extern _Atomic uint32_t ws_log_masks[WS_LOG_LEVEL_NUM];
+
+/**
+ * Check whether messages of a module and level are logged
+ *
+ * Evaluates to a constant 0 for levels removed at compile time.
+ */
+#define WS_LOG_ENABLED(module, level) \
+    (((level) <= WS_LOG_MAX_LEVEL) && \
+     WS_UNLIKELY(atomic_load_explicit(&ws_log_masks[(level)], \
+                                      memory_order_relaxed) & \
+                 (UINT32_C(1) << (module))))
+
+/**
+ * Log a message if it is enabled
+ *
+ * The arguments are only evaluated if the message is enabled.
+ */
+#define WS_LOG(module, level, ...) \
+    do { \
+        if (WS_LOG_ENABLED((module), (level))) { \
+            ws_log((module), (level), __VA_ARGS__); \
+        } \
+    } while (0)
 
+/**
+ * Initialize the logger
+ *
+ * Starts the background thread. Messages logged while the logger is not
+ * initialized are discarded.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_logger_init(
+    char const* path //!< File to append the log to, NULL for stderr
+);
+
+/**
+ * Deinitialize the logger
+ *
+ * Writes out all pending messages and stops the background thread. Other
+ * threads must not log while the logger is deinitialized.
+ */
+void
+ws_logger_deinit(void);
+
+/**
+ * Set the log level of all modules
+ *
+ * Messages less severe than `level` are dropped.
+ */
+void
+ws_logger_set_level(
+    enum ws_log_level level //!< The least severe level still logged
+);
+
+/**
+ * Set the log level of a module
+ *
+ * Messages of the module less severe than `level` are dropped.
+ */
+void
+ws_logger_set_module_level(
+    enum ws_log_module module, //!< The module
+    enum ws_log_level level //!< The least severe level still logged
+);
+
+/**
+ * Configure the log levels from a string
+ *
+ * The string is a comma separated list of entries, each either a level
+ * setting the level of all modules (e.g. `debug`) or a module and a level
+ * separated by `=` (e.g. `compositor=trace`). Entries are applied in order.
+ *
+ * @return 0 on success, -EINVAL if the string is malformed, in which case the
+ *         entries before the malformed one are applied
+ */
+int
+ws_logger_configure(
+    char const* spec //!< The levels
+)
+__ws_nonnull__(1);
+
+/**
+ * Log a message
+ *
+ * A newline is appended to the message. Safe to call from any thread. Prefer
+ * WS_LOG(), which avoids the call if the message is disabled.
+ */
+void
+ws_log(
+    enum ws_log_module module, //!< Module logging the message
+    enum ws_log_level level, //!< Level of the message
+    char const* fmt, //!< printf-like format string
+    ...
+)
+__ws_nonnull__(3)
+__ws_format__(printf, 3, 4);
+
+/**
+ * Log a summary of a latency histogram
+ *
+ * Logs the number of samples, the mean, the 50th, 90th, 99th and 99.9th
+ * percentile and the maximum. The samples are taken to be nanoseconds and are
+ * logged as microseconds. The percentiles are computed by the calling thread.
+ */
+void
+ws_log_histogram(
+    enum ws_log_module module, //!< Module logging the message
+    enum ws_log_level level, //!< Level of the message
+    char const* name, //!< Name of the histogram
+    struct ws_histogram const* histogram //!< The histogram
+)
+__ws_nonnull__(3, 4);
 
 #endif // __WS_LOGGER_MODULE_H__
@@ -25,10 +25,214 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-server.h>
+
+#include "action/manager.h"
+#include "command/processor.h"
+#include "compositor/headless.h"
+#include "compositor/module.h"
+#include "connection/manager.h"
+#include "logger/module.h"
+#include "objects/object.h"
+#include "objects/string.h"
+#include "session/manager.h"
+#include "storage/module.h"
+
+/**
+ * Name of the socket scripting clients connect to
+ */
+#define WS_SCRIPT_SOCKET_NAME "waysome-script"
+
+/**
+ * Environment variable selecting the headless backend
+ *
+ * The value describes the virtual outputs, see compositor/headless.h.
+ */
+#define WS_HEADLESS_ENV "WAYSOME_HEADLESS"
+
+/**
+ * Environment variable naming the log file
+ *
+ * The log is written to stderr if the variable is not set.
+ */
+#define WS_LOG_FILE_ENV "WAYSOME_LOG_FILE"
+
+/**
+ * Environment variable selecting the log levels
+ *
+ * See ws_logger_configure() for the syntax, e.g. `info,compositor=trace`.
+ */
+#define WS_LOG_LEVELS_ENV "WAYSOME_LOG"
+
+/**
+ * Environment variable naming the storage file
+ *
+ * Nothing is stored persistently if the variable is not set.
+ */
+#define WS_STORAGE_ENV "WAYSOME_STORAGE"
+
+/**
+ * Environment variable naming a session snapshot to restore at startup
+ *
+ * A missing file is not an error, which allows pointing the variable at the
+ * location snapshots are written to unconditionally.
+ */
+#define WS_RESTORE_ENV "WAYSOME_RESTORE"
+
+/**
+ * Environment variable selecting the number of threads executing queries
+ *
+ * Setting it to 0 executes all commands on the main thread.
+ */
+#define WS_QUERY_WORKERS_ENV "WAYSOME_QUERY_WORKERS"
+
+/**
+ * Number of threads executing queries if not configured otherwise
+ */
+#define WS_QUERY_WORKERS_DEFAULT 2
+
 int
 main(
     int argc,
     char** argv
 ) {
-    return 0;
+    int retval = EXIT_FAILURE;
+    int res;
+
+    res = ws_logger_init(getenv(WS_LOG_FILE_ENV));
+    if (res < 0) {
+        fprintf(stderr, "Could not initialize the logger: %s\n",
+                strerror(-res));
+        return EXIT_FAILURE;
+    }
+
+    char const* log_levels = getenv(WS_LOG_LEVELS_ENV);
+    if (log_levels && (ws_logger_configure(log_levels) < 0)) {
+        fprintf(stderr, "Invalid log levels \"%s\"\n", log_levels);
+    }
+
+    struct wl_display* display = wl_display_create();
+    if (!display) {
+        fprintf(stderr, "Could not create the wayland display\n");
+        goto cleanup_logger;
+    }
+
+    res = ws_command_processor_init();
+    if (res < 0) {
+        fprintf(stderr, "Could not initialize the command processor: %s\n",
+                strerror(-res));
+        goto cleanup_display;
+    }
+
+    res = ws_compositor_init(display);
+    if (res < 0) {
+        fprintf(stderr, "Could not initialize the compositor: %s\n",
+                strerror(-res));
+        goto cleanup_processor;
+    }
+
+    res = ws_action_manager_init();
+    if (res < 0) {
+        fprintf(stderr, "Could not initialize the action manager: %s\n",
+                strerror(-res));
+        goto cleanup_compositor;
+    }
+
+    res = ws_session_manager_init();
+    if (res < 0) {
+        fprintf(stderr, "Could not initialize the session manager: %s\n",
+                strerror(-res));
+        goto cleanup_compositor;
+    }
+
+    char const* restore_path = getenv(WS_RESTORE_ENV);
+    if (restore_path) {
+        res = ws_session_manager_restore(restore_path);
+        if ((res < 0) && (res != -ENOENT)) {
+            fprintf(stderr, "Could not restore the session \"%s\": %s\n",
+                    restore_path, strerror(-res));
+            goto cleanup_compositor;
+        }
+    }
+
+    char const* headless_spec = getenv(WS_HEADLESS_ENV);
+    if (headless_spec) {
+        ws_headless_init(wl_display_get_event_loop(display));
+        res = ws_headless_add_outputs(headless_spec);
+        if (res < 0) {
+            fprintf(stderr, "Could not create headless outputs \"%s\": %s\n",
+                    headless_spec, strerror(-res));
+            goto cleanup_compositor;
+        }
+    }
+
+    res = ws_storage_register_commands();
+    if (res < 0) {
+        fprintf(stderr, "Could not register the storage commands: %s\n",
+                strerror(-res));
+        goto cleanup_compositor;
+    }
+
+    char const* storage_path = getenv(WS_STORAGE_ENV);
+    if (storage_path) {
+        res = ws_storage_init(wl_display_get_event_loop(display),
+                              storage_path);
+        if (res < 0) {
+            fprintf(stderr, "Could not open the storage \"%s\": %s\n",
+                    storage_path, strerror(-res));
+            goto cleanup_compositor;
+        }
+    }
+
+    size_t query_workers = WS_QUERY_WORKERS_DEFAULT;
+    char const* query_workers_spec = getenv(WS_QUERY_WORKERS_ENV);
+    if (query_workers_spec) {
+        query_workers = strtoul(query_workers_spec, NULL, 10);
+    }
+    res = ws_command_processor_start_workers(
+        wl_display_get_event_loop(display),
+        query_workers
+    );
+    if (res < 0) {
+        fprintf(stderr, "Could not start the query workers: %s\n",
+                strerror(-res));
+        goto cleanup_compositor;
+    }
+
+    res = ws_connection_manager_init(wl_display_get_event_loop(display),
+                                     WS_SCRIPT_SOCKET_NAME);
+    if (res < 0) {
+        fprintf(stderr, "Could not initialize the connection manager: %s\n",
+                strerror(-res));
+        goto cleanup_compositor;
+    }
+
+    wl_display_run(display);
+    retval = EXIT_SUCCESS;
+
+    ws_connection_manager_deinit();
+
+cleanup_compositor:
+    ws_command_processor_stop_workers();
+    ws_storage_deinit();
+    ws_headless_deinit();
+    ws_action_manager_deinit();
+    ws_session_manager_deinit();
+    ws_compositor_deinit();
+    ws_object_registry_deinit();
+
+cleanup_processor:
+    ws_command_processor_deinit();
+
+cleanup_display:
+    wl_display_destroy(display);
+    ws_string_intern_deinit();
+
+cleanup_logger:
+    ws_logger_deinit();
+    return retval;
 }
@@ -25,5 +25,155 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "objects/array.h"
+#include "util/arena.h"
+
+/**
+ * Capacity allocated on the first push, if none was requested at init
+ */
+#define ARRAY_MIN_CAP 8
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Resize the storage of an array
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+array_reserve(
+    struct ws_array* self, //!< The array
+    size_t cap //!< The new capacity, must be at least `self->len`
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_array_init(
+    struct ws_array* self,
+    struct ws_arena* arena,
+    size_t cap
+) {
+    self->values = NULL;
+    self->len = 0;
+    self->cap = 0;
+    self->arena = arena;
+    return cap ? array_reserve(self, cap) : 0;
+}
+
+void
+ws_array_deinit(
+    struct ws_array* self
+) {
+    ws_array_clear(self);
+    if (!self->arena) {
+        free(self->values);
+    }
+    self->values = NULL;
+    self->cap = 0;
+}
+
+int
+ws_array_push(
+    struct ws_array* self,
+    struct ws_value* value
+) {
+    if (self->len == self->cap) {
+        size_t cap = self->cap ? self->cap * 2 : ARRAY_MIN_CAP;
+        int res = array_reserve(self, cap);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    self->values[self->len++] = *value;
+    ws_value_init(value);
+    return 0;
+}
+
+int
+ws_array_pop(
+    struct ws_array* self,
+    struct ws_value* dest
+) {
+    if (!self->len) {
+        return -ENOENT;
+    }
+
+    *dest = self->values[--self->len];
+    return 0;
+}
+
+struct ws_value*
+ws_array_get(
+    struct ws_array const* self,
+    size_t index
+) {
+    if (index >= self->len) {
+        return NULL;
+    }
+    return self->values + index;
+}
+
+size_t
+ws_array_len(
+    struct ws_array const* self
+) {
+    return self->len;
+}
+
+void
+ws_array_clear(
+    struct ws_array* self
+) {
+    while (self->len) {
+        ws_value_deinit(self->values + --self->len);
+    }
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static int
+array_reserve(
+    struct ws_array* self,
+    size_t cap
+) {
+    if (cap > SIZE_MAX / sizeof(*self->values)) {
+        return -ENOMEM;
+    }
+
+    struct ws_value* values;
+    if (self->arena) {
+        // arena memory cannot be resized, the old storage is simply abandoned
+        values = ws_arena_alloc(self->arena, cap * sizeof(*values));
+        if (values && self->len) {
+            memcpy(values, self->values, self->len * sizeof(*values));
+        }
+    } else {
+        values = realloc(self->values, cap * sizeof(*values));
+    }
+    if (!values) {
+        return -ENOMEM;
+    }
 
+    self->values = values;
+    self->cap = cap;
+    return 0;
+}
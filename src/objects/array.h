@@ -28,7 +28,118 @@
 #ifndef __WS_OBJECTS_ARRAY_H__
 #define __WS_OBJECTS_ARRAY_H__
 
+/**
+ * @file array.h
+ *
+ * @brief Growable array of values
+ *
+ * The array owns the values stored in it. Its storage may either come from
+ * the heap or from an arena. Arena backed arrays never free their storage,
+ * the memory is released together with the arena.
+ */
+
+#include <stddef.h>
+
+#include "util/attributes.h"
+#include "values/value.h"
+
+struct ws_arena;
+
+/**
+ * Array type
+ */
+struct ws_array {
+    struct ws_value* values; //!< The values
+    size_t len; //!< Number of values stored in the array
+    size_t cap; //!< Number of values the storage can hold
+    struct ws_arena* arena; //!< Arena to allocate from, NULL for the heap
+};
 
+/**
+ * Initialize an array
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_array_init(
+    struct ws_array* self, //!< The array to initialize
+    struct ws_arena* arena, //!< Arena to allocate from or NULL
+    size_t cap //!< Initial capacity, may be 0
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize an array
+ *
+ * Deinitializes all values stored in the array and releases the storage.
+ */
+void
+ws_array_deinit(
+    struct ws_array* self //!< The array to deinitialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Append a value to an array
+ *
+ * The value is moved into the array: the array takes over all resources held
+ * by `value`, which is left uninitialized.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_array_push(
+    struct ws_array* self, //!< The array
+    struct ws_value* value //!< The value to move into the array
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Remove the last value from an array
+ *
+ * The value is moved out of the array into `dest`, which must not be
+ * initialized.
+ *
+ * @return 0 on success, -ENOENT if the array is empty
+ */
+int
+ws_array_pop(
+    struct ws_array* self, //!< The array
+    struct ws_value* dest //!< Destination of the value
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Get a value from an array
+ *
+ * @return The value at `index` or NULL if the index is out of bounds
+ */
+struct ws_value*
+ws_array_get(
+    struct ws_array const* self, //!< The array
+    size_t index //!< Index of the value
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the number of values stored in an array
+ *
+ * @return The number of values
+ */
+size_t
+ws_array_len(
+    struct ws_array const* self //!< The array
+)
+__ws_nonnull__(1);
+
+/**
+ * Remove all values from an array, keeping the storage
+ */
+void
+ws_array_clear(
+    struct ws_array* self //!< The array
+)
+__ws_nonnull__(1);
 
 #endif // __WS_OBJECTS_ARRAY_H__
 
@@ -25,5 +25,275 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdlib.h>
+
 #include "objects/object.h"
 
+/**
+ * Marks the end of the free list
+ */
+#define SLOT_NONE UINT32_MAX
+
+/**
+ * Slot of the registry
+ *
+ * The generation of a slot is odd while it is in use and even while it is
+ * free. IDs are only handed out with odd generations, so IDs never resolve
+ * through a free slot.
+ */
+struct slot {
+    uint32_t generation; //!< Generation of the slot
+    uint32_t index; //!< Dense index if in use, next free slot otherwise
+};
+
+/**
+ * The object registry
+ */
+static struct {
+    struct slot* slots; //!< Sparse array, indexed by the lower half of IDs
+    size_t num_slots; //!< Number of slots
+    uint32_t free_head; //!< First free slot, SLOT_NONE if there is none
+    struct ws_object** objects; //!< Dense array of registered objects
+    size_t len; //!< Number of registered objects
+    size_t cap; //!< Capacity of `objects` and `slots`
+} registry = {
+    .free_head = SLOT_NONE,
+};
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Grow the arrays of the registry
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+registry_grow(void);
+
+/**
+ * Register an object in a free slot
+ */
+static void
+registry_occupy(
+    struct ws_object* self, //!< The object
+    struct ws_object_type const* type, //!< Type of the object
+    uint32_t index //!< Index of the slot, its generation already odd
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_object_init(
+    struct ws_object* self,
+    struct ws_object_type const* type
+) {
+    uint32_t index = registry.free_head;
+    if (index == SLOT_NONE) {
+        if (registry.num_slots == registry.cap) {
+            int res = registry_grow();
+            if (res < 0) {
+                return res;
+            }
+        }
+        if (registry.num_slots >= SLOT_NONE) {
+            return -ENOSPC;
+        }
+
+        index = (uint32_t) registry.num_slots++;
+        registry.slots[index].generation = 0;
+    } else {
+        registry.free_head = registry.slots[index].index;
+    }
+
+    ++registry.slots[index].generation;
+    registry_occupy(self, type, index);
+    return 0;
+}
+
+int
+ws_object_init_id(
+    struct ws_object* self,
+    struct ws_object_type const* type,
+    uint64_t id
+) {
+    uint32_t index = (uint32_t) id;
+    uint32_t generation = (uint32_t) (id >> 32);
+    if (!(generation & 1) || (generation >= UINT32_MAX - 1) ||
+            (index == SLOT_NONE)) {
+        return -EINVAL;
+    }
+
+    // create the slots up to the one requested, all of them free
+    while (registry.num_slots <= index) {
+        if (registry.num_slots == registry.cap) {
+            int res = registry_grow();
+            if (res < 0) {
+                return res;
+            }
+        }
+        uint32_t fresh = (uint32_t) registry.num_slots++;
+        registry.slots[fresh].generation = 0;
+        registry.slots[fresh].index = registry.free_head;
+        registry.free_head = fresh;
+    }
+
+    struct slot* slot = registry.slots + index;
+    if ((slot->generation & 1) || (slot->generation > generation)) {
+        return -EEXIST;
+    }
+
+    // unlink the slot from the free list
+    uint32_t* link = &registry.free_head;
+    while (*link != index) {
+        if (*link == SLOT_NONE) {
+            // retired slots are not on the free list
+            return -EEXIST;
+        }
+        link = &registry.slots[*link].index;
+    }
+    *link = slot->index;
+
+    slot->generation = generation;
+    registry_occupy(self, type, index);
+    return 0;
+}
+
+void
+ws_object_deinit(
+    struct ws_object* self
+) {
+    if (!self->id) {
+        return;
+    }
+
+    // move the last object into the gap to keep the dense array dense
+    struct ws_object* last = registry.objects[--registry.len];
+    registry.objects[self->dense_index] = last;
+    last->dense_index = self->dense_index;
+    registry.slots[(uint32_t) last->id].index = self->dense_index;
+
+    uint32_t index = (uint32_t) self->id;
+    struct slot* slot = registry.slots + index;
+    ++slot->generation;
+    if (slot->generation != UINT32_MAX - 1) {
+        slot->index = registry.free_head;
+        registry.free_head = index;
+    }
+    // else: all generations were used, the slot is retired
+
+    self->id = 0;
+}
+
+uint64_t
+ws_object_get_id(
+    struct ws_object const* self
+) {
+    return self->id;
+}
+
+struct ws_object*
+ws_object_find(
+    uint64_t id,
+    struct ws_object_type const* type
+) {
+    uint32_t index = (uint32_t) id;
+    if (index >= registry.num_slots) {
+        return NULL;
+    }
+
+    // free slots have an even generation and their index links the free
+    // list, so IDs with an even generation never refer to an object
+    uint32_t generation = (uint32_t) (id >> 32);
+    struct slot const* slot = registry.slots + index;
+    if (!(generation & 1) || (slot->generation != generation)) {
+        return NULL;
+    }
+
+    struct ws_object* object = registry.objects[slot->index];
+    if (type && (object->type != type)) {
+        return NULL;
+    }
+    return object;
+}
+
+size_t
+ws_object_count(void)
+{
+    return registry.len;
+}
+
+struct ws_object*
+ws_object_at(
+    size_t index
+) {
+    if (index >= registry.len) {
+        return NULL;
+    }
+    return registry.objects[index];
+}
+
+void
+ws_object_registry_deinit(void)
+{
+    free(registry.slots);
+    free(registry.objects);
+    registry.slots = NULL;
+    registry.num_slots = 0;
+    registry.free_head = SLOT_NONE;
+    registry.objects = NULL;
+    registry.len = 0;
+    registry.cap = 0;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static void
+registry_occupy(
+    struct ws_object* self,
+    struct ws_object_type const* type,
+    uint32_t index
+) {
+    struct slot* slot = registry.slots + index;
+    slot->index = (uint32_t) registry.len;
+
+    registry.objects[registry.len] = self;
+    self->type = type;
+    self->id = ((uint64_t) slot->generation << 32) | index;
+    self->dense_index = (uint32_t) registry.len;
+    ++registry.len;
+}
+
+static int
+registry_grow(void)
+{
+    size_t cap = registry.cap ? registry.cap * 2 : 64;
+
+    struct slot* slots = realloc(registry.slots, cap * sizeof(*slots));
+    if (!slots) {
+        return -ENOMEM;
+    }
+    registry.slots = slots;
+
+    struct ws_object** objects;
+    objects = realloc(registry.objects, cap * sizeof(*objects));
+    if (!objects) {
+        return -ENOMEM;
+    }
+    registry.objects = objects;
+
+    registry.cap = cap;
+    return 0;
+}
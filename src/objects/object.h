@@ -28,6 +28,139 @@
 #ifndef __WS_OBJECTS_OBJECT_H__
 #define __WS_OBJECTS_OBJECT_H__
 
+/**
+ * @file object.h
+ *
+ * @brief Object base type and object registry
+ *
+ * Everything a client may refer to by an object ID (windows, outputs, ...)
+ * embeds a `struct ws_object`. Initializing the object registers it and
+ * assigns it an ID, which clients receive as object ID values.
+ *
+ * The registry is a slot map: the registered objects are kept in a dense
+ * array, and a sparse array of slots maps IDs to positions in the dense array.
+ * The lower 32 bits of an ID are the index of its slot, the upper 32 bits are
+ * the generation of the slot. Whenever an object is unregistered, the
+ * generation of its slot changes, so IDs of dead objects held by clients never
+ * resolve to an object registered later in the same slot. Resolving an ID is a
+ * bounds check and a generation compare.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+
+/**
+ * Object type descriptor
+ *
+ * Types are compared by identity, each type has exactly one descriptor.
+ */
+struct ws_object_type {
+    char const* name; //!< Name of the type
+};
+
+/**
+ * Object base type
+ */
+struct ws_object {
+    struct ws_object_type const* type; //!< Type of the object
+    uint64_t id; //!< ID of the object, 0 if not registered
+    uint32_t dense_index; //!< Position in the registry's dense array
+};
+
+/**
+ * Initialize an object and register it
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_object_init(
+    struct ws_object* self, //!< The object to initialize
+    struct ws_object_type const* type //!< Type of the object
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Initialize an object and register it under a given ID
+ *
+ * Used to recreate objects with the IDs they had before, e.g. when restoring
+ * a snapshot of the session state, so IDs held by scripts stay valid. The ID
+ * must be one handed out by ws_object_init() before.
+ *
+ * @return 0 on success, -EINVAL if the ID was never valid, -EEXIST if it is
+ *         in use or was superseded by a later generation, another negative
+ *         error number otherwise
+ */
+int
+ws_object_init_id(
+    struct ws_object* self, //!< The object to initialize
+    struct ws_object_type const* type, //!< Type of the object
+    uint64_t id //!< The ID
+)
+__ws_nonnull__(1, 2);
 
+/**
+ * Deinitialize an object and unregister it
+ *
+ * Afterwards, the ID of the object does not resolve to it anymore.
+ */
+void
+ws_object_deinit(
+    struct ws_object* self //!< The object to deinitialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the ID of an object
+ *
+ * @return The ID of the object
+ */
+uint64_t
+ws_object_get_id(
+    struct ws_object const* self //!< The object
+)
+__ws_nonnull__(1);
+
+/**
+ * Find an object by its ID
+ *
+ * @return The object or NULL if no object with the ID exists or if it is not
+ *         of the type requested
+ */
+struct ws_object*
+ws_object_find(
+    uint64_t id, //!< The ID of the object
+    struct ws_object_type const* type //!< Required type or NULL for any type
+);
+
+/**
+ * Get the number of registered objects
+ *
+ * @return The number of registered objects
+ */
+size_t
+ws_object_count(void);
+
+/**
+ * Get a registered object by position
+ *
+ * Positions are 0 to ws_object_count() - 1. Registering or unregistering an
+ * object may change the positions of other objects.
+ *
+ * @return The object at the position or NULL if the position is out of range
+ */
+struct ws_object*
+ws_object_at(
+    size_t index //!< Position of the object
+);
+
+/**
+ * Release the memory of the object registry
+ *
+ * All objects should be deinitialized before.
+ */
+void
+ws_object_registry_deinit(void);
 
 #endif // __WS_OBJECTS_OBJECT_H__
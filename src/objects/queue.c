@@ -25,5 +25,119 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
 #include "objects/queue.h"
 
+int
+ws_queue_init(
+    struct ws_queue* self,
+    size_t cap
+) {
+    if (!cap || (cap > (SIZE_MAX >> 1) / sizeof(*self->entries))) {
+        return -EINVAL;
+    }
+
+    size_t size = 1;
+    while (size < cap) {
+        size <<= 1;
+    }
+
+    self->entries = calloc(size, sizeof(*self->entries));
+    if (!self->entries) {
+        return -ENOMEM;
+    }
+    self->mask = size - 1;
+    self->head = 0;
+    self->len = 0;
+    return 0;
+}
+
+void
+ws_queue_deinit(
+    struct ws_queue* self
+) {
+    free(self->entries);
+    self->entries = NULL;
+    self->mask = 0;
+    self->head = 0;
+    self->len = 0;
+}
+
+int
+ws_queue_push(
+    struct ws_queue* self,
+    void* entry
+) {
+    if (ws_queue_full(self)) {
+        return -ENOBUFS;
+    }
+
+    self->entries[(self->head + self->len) & self->mask] = entry;
+    ++self->len;
+    return 0;
+}
+
+int
+ws_queue_pop(
+    struct ws_queue* self,
+    void** entry
+) {
+    if (!self->len) {
+        return -ENOENT;
+    }
+
+    if (entry) {
+        *entry = self->entries[self->head];
+    }
+    self->head = (self->head + 1) & self->mask;
+    --self->len;
+    return 0;
+}
+
+void**
+ws_queue_at(
+    struct ws_queue const* self,
+    size_t pos
+) {
+    if (pos >= self->len) {
+        return NULL;
+    }
+    return self->entries + ((self->head + pos) & self->mask);
+}
+
+size_t
+ws_queue_compact(
+    struct ws_queue* self
+) {
+    size_t kept = 0;
+    size_t pos;
+    for (pos = 0; pos < self->len; ++pos) {
+        void* entry = self->entries[(self->head + pos) & self->mask];
+        if (entry) {
+            self->entries[(self->head + kept++) & self->mask] = entry;
+        }
+    }
+
+    size_t removed = self->len - kept;
+    self->len = kept;
+    return removed;
+}
+
+size_t
+ws_queue_len(
+    struct ws_queue const* self
+) {
+    return self->len;
+}
+
+bool
+ws_queue_full(
+    struct ws_queue const* self
+) {
+    // a zero initialized queue has no storage at all
+    return !self->entries || (self->len > self->mask);
+}
+
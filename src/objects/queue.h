@@ -28,6 +28,131 @@
 #ifndef __WS_OBJECTS_QUEUE_H__
 #define __WS_OBJECTS_QUEUE_H__
 
+/**
+ * @file queue.h
+ *
+ * @brief Bounded ring buffer of pointers
+ *
+ * A first-in first-out queue with a fixed capacity, which is rounded up to a
+ * power of 2 so positions wrap with a mask. The queue does not own the
+ * entries. Entries may be NULL, e.g. to mark an entry which was removed from
+ * the middle of the queue without moving the others; ws_queue_compact()
+ * removes such entries.
+ *
+ * A zero initialized queue is valid and has a capacity of 0.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "util/attributes.h"
+
+/**
+ * Queue type
+ */
+struct ws_queue {
+    void** entries; //!< Storage of the entries
+    size_t mask; //!< Capacity minus 1, the capacity is a power of 2
+    size_t head; //!< Position of the oldest entry
+    size_t len; //!< Number of entries
+};
+
+/**
+ * Initialize a queue
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_queue_init(
+    struct ws_queue* self, //!< The queue to initialize
+    size_t cap //!< Minimum capacity, not 0
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize a queue
+ *
+ * Releases the storage, but not the entries.
+ */
+void
+ws_queue_deinit(
+    struct ws_queue* self //!< The queue to deinitialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Append an entry to a queue
+ *
+ * @return 0 on success, -ENOBUFS if the queue is full
+ */
+int
+ws_queue_push(
+    struct ws_queue* self, //!< The queue
+    void* entry //!< The entry
+)
+__ws_nonnull__(1);
 
+/**
+ * Remove the oldest entry from a queue
+ *
+ * @return 0 on success, -ENOENT if the queue is empty
+ */
+int
+ws_queue_pop(
+    struct ws_queue* self, //!< The queue
+    void** entry //!< Output: the entry, may be NULL
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the slot of an entry
+ *
+ * The slot may be used to replace the entry. It is valid until the queue is
+ * modified.
+ *
+ * @return The slot of the entry `pos` positions after the oldest one, or NULL
+ *         if there are not enough entries
+ */
+void**
+ws_queue_at(
+    struct ws_queue const* self, //!< The queue
+    size_t pos //!< Position of the entry, 0 being the oldest
+)
+__ws_nonnull__(1);
+
+/**
+ * Remove all NULL entries from a queue
+ *
+ * The order of the other entries is preserved.
+ *
+ * @return Number of entries removed
+ */
+size_t
+ws_queue_compact(
+    struct ws_queue* self //!< The queue
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the number of entries in a queue
+ *
+ * @return The number of entries
+ */
+size_t
+ws_queue_len(
+    struct ws_queue const* self //!< The queue
+)
+__ws_nonnull__(1);
+
+/**
+ * Check whether a queue is full
+ *
+ * @return Whether no further entry can be pushed
+ */
+bool
+ws_queue_full(
+    struct ws_queue const* self //!< The queue
+)
+__ws_nonnull__(1);
 
 #endif // __WS_OBJECTS_QUEUE_H__
@@ -27,3 +27,76 @@
 
 #include "objects/stack.h"
 
+int
+ws_stack_init(
+    struct ws_stack* self,
+    struct ws_arena* arena,
+    size_t cap
+) {
+    return ws_array_init(&self->array, arena, cap);
+}
+
+void
+ws_stack_deinit(
+    struct ws_stack* self
+) {
+    ws_array_deinit(&self->array);
+}
+
+int
+ws_stack_push(
+    struct ws_stack* self,
+    struct ws_value* value
+) {
+    return ws_array_push(&self->array, value);
+}
+
+int
+ws_stack_pop(
+    struct ws_stack* self,
+    struct ws_value* dest
+) {
+    return ws_array_pop(&self->array, dest);
+}
+
+void
+ws_stack_drop(
+    struct ws_stack* self,
+    size_t num
+) {
+    struct ws_value value;
+    while (num-- && (ws_array_pop(&self->array, &value) == 0)) {
+        ws_value_deinit(&value);
+    }
+}
+
+struct ws_value*
+ws_stack_peek(
+    struct ws_stack const* self,
+    size_t depth
+) {
+    size_t len = ws_array_len(&self->array);
+    if (depth >= len) {
+        return NULL;
+    }
+    return ws_array_get(&self->array, len - depth - 1);
+}
+
+struct ws_value*
+ws_stack_top_n(
+    struct ws_stack const* self,
+    size_t num
+) {
+    size_t len = ws_array_len(&self->array);
+    if (num > len) {
+        return NULL;
+    }
+    return self->array.values + (len - num);
+}
+
+size_t
+ws_stack_size(
+    struct ws_stack const* self
+) {
+    return ws_array_len(&self->array);
+}
@@ -28,6 +28,133 @@
 #ifndef __WS_OBJECTS_STACK_H__
 #define __WS_OBJECTS_STACK_H__
 
+/**
+ * @file stack.h
+ *
+ * @brief Value stack
+ *
+ * A stack of values, built on top of `struct ws_array`. Like the array, the
+ * stack owns the values pushed onto it and may be backed by an arena.
+ */
+
+#include <stddef.h>
+
+#include "objects/array.h"
+#include "util/attributes.h"
+#include "values/value.h"
+
+struct ws_arena;
+
+/**
+ * Stack type
+ */
+struct ws_stack {
+    struct ws_array array; //!< Storage of the stack, the top is the last value
+};
+
+/**
+ * Initialize a stack
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_stack_init(
+    struct ws_stack* self, //!< The stack to initialize
+    struct ws_arena* arena, //!< Arena to allocate from or NULL
+    size_t cap //!< Initial capacity, may be 0
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize a stack
+ *
+ * Deinitializes all values on the stack and releases the storage.
+ */
+void
+ws_stack_deinit(
+    struct ws_stack* self //!< The stack to deinitialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Push a value onto a stack
+ *
+ * The value is moved onto the stack, it is left uninitialized.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_stack_push(
+    struct ws_stack* self, //!< The stack
+    struct ws_value* value //!< The value to move onto the stack
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Pop a value from a stack
+ *
+ * The value is moved into `dest`, which must not be initialized.
+ *
+ * @return 0 on success, -ENOENT if the stack is empty
+ */
+int
+ws_stack_pop(
+    struct ws_stack* self, //!< The stack
+    struct ws_value* dest //!< Destination of the value
+)
+__ws_nonnull__(1, 2);
 
+/**
+ * Drop values from the top of a stack
+ *
+ * The values are deinitialized. If there are less than `num` values on the
+ * stack, the stack is emptied.
+ */
+void
+ws_stack_drop(
+    struct ws_stack* self, //!< The stack
+    size_t num //!< Number of values to drop
+)
+__ws_nonnull__(1);
+
+/**
+ * Get a value from the top of a stack
+ *
+ * @return The value `depth` positions below the top of the stack (0 being the
+ *         top itself) or NULL if there are not enough values on the stack
+ */
+struct ws_value*
+ws_stack_peek(
+    struct ws_stack const* self, //!< The stack
+    size_t depth //!< Distance from the top of the stack
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the topmost values of a stack as an array
+ *
+ * The values are returned in the order in which they were pushed. The pointer
+ * is invalidated by the next push.
+ *
+ * @return Pointer to the topmost `num` values or NULL if there are not enough
+ *         values on the stack
+ */
+struct ws_value*
+ws_stack_top_n(
+    struct ws_stack const* self, //!< The stack
+    size_t num //!< Number of values
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the number of values on a stack
+ *
+ * @return The number of values on the stack
+ */
+size_t
+ws_stack_size(
+    struct ws_stack const* self //!< The stack
+)
+__ws_nonnull__(1);
 
 #endif // __WS_OBJECTS_STACK_H__
@@ -25,5 +25,293 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "objects/string.h"
+#include "util/arena.h"
+#include "util/hash.h"
+
+/**
+ * Minimum capacity of the intern table
+ */
+#define INTERN_MIN_CAP 256
+
+/**
+ * The intern table
+ *
+ * Open addressing with linear probing, the table is at most half full.
+ */
+static struct {
+    struct ws_string_interned** entries; //!< The slots, NULL if empty
+    size_t cap; //!< Number of slots, a power of two
+    size_t len; //!< Number of interned strings
+} intern;
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Find the slot of a string in the intern table
+ *
+ * @return The slot holding the string or the empty slot it belongs into
+ */
+static struct ws_string_interned**
+intern_slot(
+    char const* str, //!< The string
+    size_t len, //!< Length of the string
+    uint64_t hash //!< Hash of the string
+);
+
+/**
+ * Double the capacity of the intern table
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+intern_grow(void);
+
+/**
+ * Replace the buffer of a string by a new one holding `a` followed by `b`
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+string_rebuild(
+    struct ws_string* self, //!< The string
+    char const* a, //!< First part, may be NULL if `a_len` is 0
+    size_t a_len, //!< Length of the first part
+    char const* b, //!< Second part, may be NULL if `b_len` is 0
+    size_t b_len //!< Length of the second part
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+void
+ws_string_init(
+    struct ws_string* self,
+    struct ws_arena* arena
+) {
+    self->str = NULL;
+    self->len = 0;
+    self->arena = arena;
+}
+
+void
+ws_string_deinit(
+    struct ws_string* self
+) {
+    if (!self->arena) {
+        free(self->str);
+    }
+    self->str = NULL;
+    self->len = 0;
+}
+
+int
+ws_string_set(
+    struct ws_string* self,
+    char const* str,
+    size_t len
+) {
+    return string_rebuild(self, str, len, NULL, 0);
+}
+
+int
+ws_string_append(
+    struct ws_string* self,
+    char const* str,
+    size_t len
+) {
+    return string_rebuild(self, self->str, self->len, str, len);
+}
+
+char const*
+ws_string_raw(
+    struct ws_string const* self
+) {
+    return self->str ? self->str : "";
+}
+
+size_t
+ws_string_len(
+    struct ws_string const* self
+) {
+    return self->len;
+}
+
+struct ws_string_interned const*
+ws_string_intern_string(
+    struct ws_string const* self
+) {
+    return ws_string_intern(ws_string_raw(self), self->len);
+}
+
+struct ws_string_interned const*
+ws_string_intern(
+    char const* str,
+    size_t len
+) {
+    if ((intern.len + 1) * 2 > intern.cap) {
+        if (intern_grow() < 0) {
+            return NULL;
+        }
+    }
+
+    uint64_t hash = ws_string_hash(str, len);
+    struct ws_string_interned** slot = intern_slot(str, len, hash);
+    if (*slot) {
+        return *slot;
+    }
+
+    struct ws_string_interned* entry = malloc(sizeof(*entry) + len + 1);
+    if (!entry) {
+        return NULL;
+    }
+    entry->hash = hash;
+    entry->len = len;
+    if (len) {
+        memcpy(entry->str, str, len);
+    }
+    entry->str[len] = '\0';
+
+    *slot = entry;
+    ++intern.len;
+    return entry;
+}
+
+struct ws_string_interned const*
+ws_string_intern_find(
+    char const* str,
+    size_t len
+) {
+    if (!intern.len) {
+        return NULL;
+    }
+    return *intern_slot(str, len, ws_string_hash(str, len));
+}
+
+void
+ws_string_intern_deinit(void)
+{
+    size_t i;
+    for (i = 0; i < intern.cap; ++i) {
+        free(intern.entries[i]);
+    }
+    free(intern.entries);
+    intern.entries = NULL;
+    intern.cap = 0;
+    intern.len = 0;
+}
+
+uint64_t
+ws_string_hash(
+    char const* str,
+    size_t len
+) {
+    // FNV-1a, finished with the finalizer of MurmurHash3 so the low bits are
+    // usable as table index
+    uint64_t h = UINT64_C(14695981039346656037);
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        h = (h ^ (unsigned char) str[i]) * UINT64_C(1099511628211);
+    }
+
+    return ws_hash_mix64(h);
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static struct ws_string_interned**
+intern_slot(
+    char const* str,
+    size_t len,
+    uint64_t hash
+) {
+    size_t mask = intern.cap - 1;
+    size_t i = hash & mask;
+    while (intern.entries[i]) {
+        struct ws_string_interned* entry = intern.entries[i];
+        if ((entry->hash == hash) && (entry->len == len) &&
+                (memcmp(entry->str, str, len) == 0)) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return intern.entries + i;
+}
+
+static int
+intern_grow(void)
+{
+    size_t cap = intern.cap ? intern.cap * 2 : INTERN_MIN_CAP;
+    struct ws_string_interned** entries = calloc(cap, sizeof(*entries));
+    if (!entries) {
+        return -ENOMEM;
+    }
+
+    size_t i;
+    for (i = 0; i < intern.cap; ++i) {
+        struct ws_string_interned* entry = intern.entries[i];
+        if (!entry) {
+            continue;
+        }
+
+        size_t k = entry->hash & (cap - 1);
+        while (entries[k]) {
+            k = (k + 1) & (cap - 1);
+        }
+        entries[k] = entry;
+    }
+
+    free(intern.entries);
+    intern.entries = entries;
+    intern.cap = cap;
+    return 0;
+}
+
+static int
+string_rebuild(
+    struct ws_string* self,
+    char const* a,
+    size_t a_len,
+    char const* b,
+    size_t b_len
+) {
+    size_t len = a_len + b_len;
+    char* buf;
+    if (self->arena) {
+        buf = ws_arena_alloc(self->arena, len + 1);
+    } else {
+        buf = malloc(len + 1);
+    }
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    if (a_len) {
+        memcpy(buf, a, a_len);
+    }
+    if (b_len) {
+        memcpy(buf + a_len, b, b_len);
+    }
+    buf[len] = '\0';
 
+    ws_string_deinit(self);
+    self->str = buf;
+    self->len = len;
+    return 0;
+}
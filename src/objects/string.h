@@ -28,6 +28,170 @@
 #ifndef __WS_OBJECTS_STRING_H__
 #define __WS_OBJECTS_STRING_H__
 
+/**
+ * @file string.h
+ *
+ * @brief String object
+ *
+ * A string object holds a 0-terminated string and its length. The memory may
+ * either be owned by the string itself or come from an arena, in which case it
+ * is released together with the arena.
+ *
+ * Strings which are compared over and over, like command names, property keys,
+ * app-ids and tag names, may be interned. The global intern table stores each
+ * distinct string exactly once, together with its hash. Two interned strings
+ * are equal if and only if they are the same pointer. Interned strings live
+ * until the intern table is released with ws_string_intern_deinit(), so only
+ * identifiers from a bounded set should be interned.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+
+struct ws_arena;
+
+/**
+ * Interned string
+ */
+struct ws_string_interned {
+    uint64_t hash; //!< Hash of the string, see ws_string_hash()
+    size_t len; //!< Length of the string
+    char str[]; //!< The 0-terminated string
+};
+
+/**
+ * String type
+ */
+struct ws_string {
+    char* str; //!< The 0-terminated string
+    size_t len; //!< Length of the string
+    struct ws_arena* arena; //!< Arena to allocate from, NULL for the heap
+};
+
+/**
+ * Initialize an empty string
+ */
+void
+ws_string_init(
+    struct ws_string* self, //!< The string to initialize
+    struct ws_arena* arena //!< Arena to allocate from or NULL
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize a string
+ *
+ * Releases the memory held by the string, if it was not allocated from an
+ * arena.
+ */
+void
+ws_string_deinit(
+    struct ws_string* self //!< The string to deinitialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Set the contents of a string
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_string_set(
+    struct ws_string* self, //!< The string
+    char const* str, //!< The new contents, not necessarily 0-terminated
+    size_t len //!< Length of the new contents
+)
+__ws_nonnull__(1);
+
+/**
+ * Append to a string
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_string_append(
+    struct ws_string* self, //!< The string
+    char const* str, //!< The string to append, not necessarily 0-terminated
+    size_t len //!< Length of the string to append
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the raw 0-terminated string
+ *
+ * @return The raw string, never NULL
+ */
+char const*
+ws_string_raw(
+    struct ws_string const* self //!< The string
+)
+__ws_nonnull__(1);
 
+/**
+ * Get the length of a string
+ *
+ * @return The length of the string
+ */
+size_t
+ws_string_len(
+    struct ws_string const* self //!< The string
+)
+__ws_nonnull__(1);
+
+/**
+ * Intern the contents of a string
+ *
+ * @return The interned string or NULL on error
+ */
+struct ws_string_interned const*
+ws_string_intern_string(
+    struct ws_string const* self //!< The string
+)
+__ws_nonnull__(1);
+
+/**
+ * Intern a string
+ *
+ * @return The interned string or NULL on error
+ */
+struct ws_string_interned const*
+ws_string_intern(
+    char const* str, //!< The string, not necessarily 0-terminated
+    size_t len //!< Length of the string
+);
+
+/**
+ * Look up an interned string without interning it
+ *
+ * A string which was never interned can not be equal to any interned string,
+ * so lookups of arbitrary input (e.g. received from clients) should use this
+ * function rather than ws_string_intern().
+ *
+ * @return The interned string or NULL if the string was never interned
+ */
+struct ws_string_interned const*
+ws_string_intern_find(
+    char const* str, //!< The string, not necessarily 0-terminated
+    size_t len //!< Length of the string
+);
+
+/**
+ * Release all interned strings
+ */
+void
+ws_string_intern_deinit(void);
+
+/**
+ * Compute the hash of a string
+ *
+ * @return The hash of the string
+ */
+uint64_t
+ws_string_hash(
+    char const* str, //!< The string, not necessarily 0-terminated
+    size_t len //!< Length of the string
+);
 
 #endif // __WS_OBJECTS_STRING_H__
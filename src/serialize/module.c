@@ -25,5 +25,1580 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "serialize/module.h"
+#include "util/arena.h"
+#include "util/arithmetical.h"
+
+/**
+ * States of the parser
+ */
+enum parser_state {
+    STATE_MESSAGE = 0, //!< Between messages, expecting '['
+    STATE_MESSAGE_FIRST, //!< Expecting a command name or a transaction
+    STATE_COMMAND, //!< Inside a transaction, expecting '['
+    STATE_AFTER_COMMAND, //!< Inside a transaction, expecting ',' or ']'
+    STATE_NAME, //!< Expecting the command name
+    STATE_AFTER_ELEMENT, //!< Expecting ',' or ']'
+    STATE_ARGUMENT, //!< Expecting an argument
+    STATE_KEY, //!< Expecting the key of a named value
+    STATE_COLON, //!< Expecting the ':' of a named value
+    STATE_NAMED_VALUE, //!< Expecting the value of a named value
+    STATE_NAMED_END, //!< Expecting the '}' of a named value
+    STATE_STRING, //!< Inside a string
+    STATE_ESCAPE, //!< Inside a string, after a backslash
+    STATE_UNICODE, //!< Inside a unicode escape sequence
+    STATE_NUMBER, //!< Inside a number
+    STATE_OBJECT_ID, //!< Inside an object ID
+    STATE_LITERAL, //!< Inside a literal (true, false, null)
+};
+
+/**
+ * Things a token may be parsed into
+ */
+enum parser_target {
+    TARGET_NAME, //!< The command name
+    TARGET_ARGUMENT, //!< An argument
+    TARGET_KEY, //!< The key of a named value
+    TARGET_NAMED_VALUE, //!< The value of a named value
+};
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Parse the next message in the text format
+ *
+ * @return 1 if a message was parsed, 0 if more data is needed, a negative
+ *         error number otherwise
+ */
+static int
+parser_next_text(
+    struct ws_serialize_parser* self, //!< The parser
+    struct ws_arena* arena, //!< Arena to allocate the commands from
+    struct ws_serialize_message* msg //!< Output: the parsed message
+);
+
+/**
+ * Parse the next message in the binary format
+ *
+ * @return 1 if a message was parsed, 0 if more data is needed, a negative
+ *         error number otherwise
+ */
+static int
+parser_next_binary(
+    struct ws_serialize_parser* self, //!< The parser
+    struct ws_arena* arena, //!< Arena to allocate the commands from
+    struct ws_serialize_message* msg //!< Output: the parsed message
+);
+
+/**
+ * Decode a command in the binary format
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+decode_command(
+    struct ws_serialize_parser* self, //!< The parser
+    unsigned char const* cursor, //!< Start of the command
+    unsigned char const* end //!< End of the command
+);
+
+/**
+ * Decode a value in the binary format
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+decode_value(
+    unsigned char const** cursor, //!< Cursor, advanced past the value
+    unsigned char const* end, //!< End of the data
+    struct ws_value* value, //!< Output: the value
+    struct ws_value* named //!< Storage for the value of a named value, may be
+                           //!< NULL if named values are not allowed
+);
+
+/**
+ * Begin parsing a scalar value at the current position
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+parser_begin_scalar(
+    struct ws_serialize_parser* self, //!< The parser
+    char c //!< The first character of the value
+);
+
+/**
+ * Begin parsing a string at the current position, which holds the quote
+ */
+static void
+parser_begin_string(
+    struct ws_serialize_parser* self //!< The parser
+);
+
+/**
+ * Consume characters of a string
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+parser_string(
+    struct ws_serialize_parser* self //!< The parser
+);
+
+/**
+ * Consume one character of an escape sequence
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+parser_escape(
+    struct ws_serialize_parser* self, //!< The parser
+    char c //!< The character
+);
+
+/**
+ * Consume one character of a unicode escape sequence
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+parser_unicode(
+    struct ws_serialize_parser* self, //!< The parser
+    char c //!< The character
+);
+
+/**
+ * Consume one character of a number or an object ID
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+parser_number(
+    struct ws_serialize_parser* self, //!< The parser
+    char c //!< The character
+);
+
+/**
+ * Consume one character of a literal
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+parser_literal(
+    struct ws_serialize_parser* self, //!< The parser
+    char c //!< The character
+);
+
+/**
+ * Begin a new command of the current message
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+parser_begin_command(
+    struct ws_serialize_parser* self //!< The parser
+);
+
+/**
+ * Complete the current command of the current message
+ */
+static void
+parser_end_command(
+    struct ws_serialize_parser* self //!< The parser
+);
+
+/**
+ * Append an argument to the current command
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+parser_push_arg(
+    struct ws_serialize_parser* self, //!< The parser
+    struct ws_value const* value, //!< The argument
+    struct ws_value const* named //!< Value of a named argument, may be NULL
+);
+
+/**
+ * Store a completed token
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+parser_finish_token(
+    struct ws_serialize_parser* self, //!< The parser
+    struct ws_value* value //!< The value of the token
+);
+
+/**
+ * Hand out a completed message
+ *
+ * @return 1 on success, a negative error number otherwise
+ */
+static int
+parser_finish_message(
+    struct ws_serialize_parser* self, //!< The parser
+    struct ws_arena* arena, //!< Arena to allocate the commands from
+    struct ws_serialize_message* msg //!< Output: the parsed message
+);
+
+/**
+ * Adjust a borrowed string after the receive buffer was compacted
+ */
+static void
+rebase_value(
+    struct ws_value* value, //!< The value to adjust
+    size_t shift //!< Number of bytes the data was moved towards the front
+);
+
+/**
+ * Destination of encoded data
+ */
+struct writer {
+    char* buf; //!< The buffer to write to
+    size_t size; //!< Size of the buffer
+    size_t len; //!< Number of bytes needed so far
+};
+
+/**
+ * Write raw data
+ */
+static void
+writer_put(
+    struct writer* self, //!< The writer
+    void const* data, //!< The data to write
+    size_t len //!< Length of the data
+);
+
+/**
+ * Write an integer in little endian byte order
+ */
+static void
+writer_put_le(
+    struct writer* self, //!< The writer
+    uint64_t num, //!< The integer to write
+    size_t len //!< Number of bytes to write
+);
+
+/**
+ * Encode a value in the text format
+ */
+static void
+encode_text(
+    struct writer* self, //!< The writer
+    struct ws_value const* value //!< The value to encode
+);
+
+/**
+ * Encode a string in the text format
+ */
+static void
+encode_text_string(
+    struct writer* self, //!< The writer
+    char const* str, //!< The string
+    size_t len //!< Length of the string
+);
+
+/**
+ * Encode a value in the binary format
+ */
+static void
+encode_binary(
+    struct writer* self, //!< The writer
+    struct ws_value const* value //!< The value to encode
+);
+
+/**
+ * Read a little endian integer
+ *
+ * @return The integer
+ */
+static uint64_t
+read_le(
+    unsigned char const* data, //!< The data to read from
+    size_t len //!< Number of bytes to read
+);
+
+/**
+ * Write a code point as UTF-8
+ *
+ * @return Number of bytes written
+ */
+static size_t
+write_utf8(
+    char* dest, //!< Destination, must hold at least 4 bytes
+    unsigned int code //!< The code point
+);
+
+/**
+ * Check whether a character is whitespace
+ *
+ * @return true if the character is whitespace, false otherwise
+ */
+static bool
+is_space(
+    char c //!< The character
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_serialize_parser_init(
+    struct ws_serialize_parser* self,
+    size_t bufsize
+) {
+    memset(self, 0, sizeof(*self));
+    self->buf = malloc(bufsize);
+    if (!self->buf) {
+        return -ENOMEM;
+    }
+    self->size = bufsize;
+    self->state = STATE_MESSAGE;
+    return 0;
+}
+
+void
+ws_serialize_parser_deinit(
+    struct ws_serialize_parser* self
+) {
+    free(self->buf);
+    free(self->calls);
+    free(self->args);
+    free(self->named);
+    self->buf = NULL;
+    self->calls = NULL;
+    self->args = NULL;
+    self->named = NULL;
+    self->size = 0;
+    self->fill = 0;
+}
+
+void
+ws_serialize_parser_set_format(
+    struct ws_serialize_parser* self,
+    enum ws_serialize_format format
+) {
+    self->format = format;
+}
+
+char const*
+ws_serialize_parser_peek(
+    struct ws_serialize_parser const* self,
+    size_t* len
+) {
+    *len = self->fill - self->pos;
+    return self->buf + self->pos;
+}
+
+void
+ws_serialize_parser_skip(
+    struct ws_serialize_parser* self,
+    size_t len
+) {
+    self->pos += WS_MIN(len, self->fill - self->pos);
+}
+
+char*
+ws_serialize_parser_get_space(
+    struct ws_serialize_parser* self,
+    size_t* avail
+) {
+    *avail = self->size - self->fill;
+    return *avail ? self->buf + self->fill : NULL;
+}
+
+void
+ws_serialize_parser_advance(
+    struct ws_serialize_parser* self,
+    size_t len
+) {
+    self->fill += len;
+}
+
+int
+ws_serialize_parser_next(
+    struct ws_serialize_parser* self,
+    struct ws_arena* arena,
+    struct ws_serialize_message* msg
+) {
+    if (self->format == WS_SERIALIZE_FORMAT_BINARY) {
+        return parser_next_binary(self, arena, msg);
+    }
+    return parser_next_text(self, arena, msg);
+}
+
+size_t
+ws_serialize_encode_response(
+    enum ws_serialize_format format,
+    char* buf,
+    size_t size,
+    int status,
+    struct ws_value const* result
+) {
+    struct writer writer = {
+        .buf = buf,
+        .size = size,
+        .len = 0,
+    };
+
+    struct ws_value status_value;
+    ws_value_int_init(&status_value, status);
+
+    if (format == WS_SERIALIZE_FORMAT_BINARY) {
+        // the length is patched in once the body is encoded
+        writer_put_le(&writer, 0, 4);
+        encode_binary(&writer, &status_value);
+        encode_binary(&writer, result);
+
+        size_t body = writer.len - 4;
+        if (writer.len <= size) {
+            struct writer header = { .buf = buf, .size = 4, .len = 0 };
+            writer_put_le(&header, body, 4);
+        }
+    } else {
+        writer_put(&writer, "[", 1);
+        encode_text(&writer, &status_value);
+        writer_put(&writer, ", ", 2);
+        encode_text(&writer, result);
+        writer_put(&writer, "]\n", 2);
+    }
+
+    return writer.len;
+}
+
+size_t
+ws_serialize_encode_event(
+    enum ws_serialize_format format,
+    char* buf,
+    size_t size,
+    char const* name,
+    struct ws_value const* args,
+    size_t argc
+) {
+    struct writer writer = {
+        .buf = buf,
+        .size = size,
+        .len = 0,
+    };
+
+    size_t name_len = strlen(name);
+    size_t i;
+    if (format == WS_SERIALIZE_FORMAT_BINARY) {
+        // the length is patched in once the body is encoded
+        unsigned char tag = WS_SERIALIZE_TAG_STRING;
+        writer_put_le(&writer, 0, 4);
+        writer_put(&writer, &tag, 1);
+        writer_put_le(&writer, name_len, 4);
+        writer_put(&writer, name, name_len);
+        for (i = 0; i < argc; ++i) {
+            encode_binary(&writer, args + i);
+        }
+
+        size_t body = writer.len - 4;
+        if (writer.len <= size) {
+            struct writer header = { .buf = buf, .size = 4, .len = 0 };
+            writer_put_le(&header, body, 4);
+        }
+    } else {
+        writer_put(&writer, "[", 1);
+        encode_text_string(&writer, name, name_len);
+        for (i = 0; i < argc; ++i) {
+            writer_put(&writer, ", ", 2);
+            encode_text(&writer, args + i);
+        }
+        writer_put(&writer, "]\n", 2);
+    }
+
+    return writer.len;
+}
+
+int
+ws_serialize_parser_release(
+    struct ws_serialize_parser* self
+) {
+    // keep the message currently being parsed, drop everything before it
+    size_t keep = (self->state == STATE_MESSAGE) ? self->pos : self->msg_start;
+    if (keep == 0) {
+        return (self->fill == self->size) ? -EMSGSIZE : 0;
+    }
+
+    memmove(self->buf, self->buf + keep, self->fill - keep);
+    self->fill -= keep;
+    self->pos -= keep;
+
+    if (self->state == STATE_MESSAGE) {
+        return 0;
+    }
+
+    self->msg_start -= keep;
+    self->token.start -= keep;
+    self->token.write -= keep;
+    if (self->name) {
+        self->name -= keep;
+    }
+    if (self->key) {
+        self->key -= keep;
+    }
+
+    size_t i;
+    for (i = 0; i < self->num_calls; ++i) {
+        self->calls[i].name -= keep;
+    }
+    for (i = 0; i < self->argc; ++i) {
+        rebase_value(self->args + i, keep);
+        if (ws_value_get_type(self->args + i) == WS_VALUE_TYPE_NAMED) {
+            rebase_value(self->named + i, keep);
+        }
+    }
+    return 0;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static int
+parser_next_text(
+    struct ws_serialize_parser* self,
+    struct ws_arena* arena,
+    struct ws_serialize_message* msg
+) {
+    int res = 0;
+    while ((self->pos < self->fill) && (res == 0)) {
+        char c = self->buf[self->pos];
+
+        switch (self->state) {
+        case STATE_MESSAGE:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == '[') {
+                self->msg_start = self->pos++;
+                self->num_calls = 0;
+                self->argc = 0;
+                self->state = STATE_MESSAGE_FIRST;
+            } else {
+                res = -EINVAL;
+            }
+            break;
+
+        case STATE_MESSAGE_FIRST:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == '"') {
+                self->transaction = false;
+                res = parser_begin_command(self);
+            } else if (c == '[') {
+                ++self->pos;
+                self->transaction = true;
+                res = parser_begin_command(self);
+            } else {
+                res = -EINVAL;
+            }
+            break;
+
+        case STATE_COMMAND:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == '[') {
+                ++self->pos;
+                res = parser_begin_command(self);
+            } else {
+                res = -EINVAL;
+            }
+            break;
+
+        case STATE_AFTER_COMMAND:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == ',') {
+                ++self->pos;
+                self->state = STATE_COMMAND;
+            } else if (c == ']') {
+                ++self->pos;
+                self->state = STATE_MESSAGE;
+                return parser_finish_message(self, arena, msg);
+            } else {
+                res = -EINVAL;
+            }
+            break;
+
+        case STATE_NAME:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == '"') {
+                self->target = TARGET_NAME;
+                parser_begin_string(self);
+            } else {
+                res = -EINVAL;
+            }
+            break;
+
+        case STATE_AFTER_ELEMENT:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == ',') {
+                ++self->pos;
+                self->state = STATE_ARGUMENT;
+            } else if (c == ']') {
+                ++self->pos;
+                parser_end_command(self);
+                if (self->transaction) {
+                    self->state = STATE_AFTER_COMMAND;
+                    break;
+                }
+                self->state = STATE_MESSAGE;
+                return parser_finish_message(self, arena, msg);
+            } else {
+                res = -EINVAL;
+            }
+            break;
+
+        case STATE_ARGUMENT:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == '{') {
+                ++self->pos;
+                self->state = STATE_KEY;
+            } else {
+                self->target = TARGET_ARGUMENT;
+                res = parser_begin_scalar(self, c);
+            }
+            break;
+
+        case STATE_KEY:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == '"') {
+                self->target = TARGET_KEY;
+                parser_begin_string(self);
+            } else {
+                res = -EINVAL;
+            }
+            break;
+
+        case STATE_COLON:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == ':') {
+                ++self->pos;
+                self->state = STATE_NAMED_VALUE;
+            } else {
+                res = -EINVAL;
+            }
+            break;
+
+        case STATE_NAMED_VALUE:
+            if (is_space(c)) {
+                ++self->pos;
+            } else {
+                self->target = TARGET_NAMED_VALUE;
+                res = parser_begin_scalar(self, c);
+            }
+            break;
+
+        case STATE_NAMED_END:
+            if (is_space(c)) {
+                ++self->pos;
+            } else if (c == '}') {
+                ++self->pos;
+                self->state = STATE_AFTER_ELEMENT;
+            } else {
+                res = -EINVAL;
+            }
+            break;
+
+        case STATE_STRING:
+            res = parser_string(self);
+            break;
+
+        case STATE_ESCAPE:
+            res = parser_escape(self, c);
+            break;
+
+        case STATE_UNICODE:
+            res = parser_unicode(self, c);
+            break;
+
+        case STATE_NUMBER:
+        case STATE_OBJECT_ID:
+            res = parser_number(self, c);
+            break;
+
+        case STATE_LITERAL:
+            res = parser_literal(self, c);
+            break;
+
+        default:
+            res = -EINVAL;
+            break;
+        }
+    }
+
+    return res;
+}
+
+static int
+parser_next_binary(
+    struct ws_serialize_parser* self,
+    struct ws_arena* arena,
+    struct ws_serialize_message* msg
+) {
+    size_t avail = self->fill - self->pos;
+    if (avail < 4) {
+        return 0;
+    }
+
+    unsigned char const* data = (unsigned char const*) self->buf + self->pos;
+    uint64_t len = read_le(data, 4);
+    if (len > self->size - 4) {
+        return -EMSGSIZE;
+    }
+    if (avail - 4 < len) {
+        // the message is parsed as a whole once it was received completely
+        return 0;
+    }
+
+    unsigned char const* cursor = data + 4;
+    unsigned char const* end = cursor + len;
+    int res;
+
+    self->num_calls = 0;
+    self->argc = 0;
+    self->transaction = (cursor < end) &&
+                        (*cursor == WS_SERIALIZE_TAG_TRANSACTION);
+
+    if (!self->transaction) {
+        res = decode_command(self, cursor, end);
+        if (res < 0) {
+            return res;
+        }
+    } else {
+        ++cursor;
+        while (cursor < end) {
+            if (end - cursor < 4) {
+                return -EINVAL;
+            }
+            uint64_t cmd_len = read_le(cursor, 4);
+            cursor += 4;
+            if (cmd_len > (uint64_t) (end - cursor)) {
+                return -EINVAL;
+            }
+
+            res = decode_command(self, cursor, cursor + cmd_len);
+            if (res < 0) {
+                return res;
+            }
+            cursor += cmd_len;
+        }
+    }
+
+    self->pos += 4 + len;
+    return parser_finish_message(self, arena, msg);
+}
+
+static int
+decode_command(
+    struct ws_serialize_parser* self,
+    unsigned char const* cursor,
+    unsigned char const* end
+) {
+    int res = parser_begin_command(self);
+    if (res < 0) {
+        return res;
+    }
+
+    struct ws_value name;
+    res = decode_value(&cursor, end, &name, NULL);
+    if (res < 0) {
+        return res;
+    }
+    if (ws_value_get_type(&name) != WS_VALUE_TYPE_STRING) {
+        return -EINVAL;
+    }
+    self->name = ws_value_string_get(&name);
+    self->name_len = ws_value_string_len(&name);
+
+    while (cursor < end) {
+        struct ws_value value;
+        struct ws_value named;
+        res = decode_value(&cursor, end, &value, &named);
+        if (res < 0) {
+            return res;
+        }
+        res = parser_push_arg(self, &value, &named);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    parser_end_command(self);
+    return 0;
+}
+
+static int
+decode_value(
+    unsigned char const** cursor,
+    unsigned char const* end,
+    struct ws_value* value,
+    struct ws_value* named
+) {
+    unsigned char const* cur = *cursor;
+    if (cur >= end) {
+        return -EINVAL;
+    }
+
+    unsigned char tag = *cur++;
+    size_t avail = end - cur;
+    switch (tag) {
+    case WS_SERIALIZE_TAG_NIL:
+        ws_value_nil_init(value);
+        break;
+
+    case WS_SERIALIZE_TAG_BOOL:
+        if (avail < 1) {
+            return -EINVAL;
+        }
+        ws_value_bool_init(value, *cur++ != 0);
+        break;
+
+    case WS_SERIALIZE_TAG_INT:
+        if (avail < 8) {
+            return -EINVAL;
+        }
+        ws_value_int_init(value, (int64_t) read_le(cur, 8));
+        cur += 8;
+        break;
+
+    case WS_SERIALIZE_TAG_OBJECT_ID:
+        if (avail < 8) {
+            return -EINVAL;
+        }
+        ws_value_object_id_init(value, read_le(cur, 8));
+        cur += 8;
+        break;
+
+    case WS_SERIALIZE_TAG_STRING:
+    case WS_SERIALIZE_TAG_NAMED:
+        {
+            if (avail < 4) {
+                return -EINVAL;
+            }
+            uint64_t len = read_le(cur, 4);
+            cur += 4;
+            if (len > avail - 4) {
+                return -EINVAL;
+            }
+
+            char const* str = (char const*) cur;
+            cur += len;
+
+            if (tag == WS_SERIALIZE_TAG_STRING) {
+                ws_value_string_init(value);
+                ws_value_string_set_borrowed(value, str, len);
+                break;
+            }
+
+            // named values may not be nested
+            if (!named) {
+                return -EINVAL;
+            }
+            int res = decode_value(&cur, end, named, NULL);
+            if (res < 0) {
+                return res;
+            }
+            ws_value_named_init(value, str, len, named);
+            break;
+        }
+
+    default:
+        return -EINVAL;
+    }
+
+    *cursor = cur;
+    return 0;
+}
+
+
+static int
+parser_begin_scalar(
+    struct ws_serialize_parser* self,
+    char c
+) {
+    switch (c) {
+    case '"':
+        parser_begin_string(self);
+        return 0;
+
+    case '#':
+        ++self->pos;
+        self->token.num = 0;
+        self->token.negative = false;
+        self->token.matched = 0;
+        self->state = STATE_OBJECT_ID;
+        return 0;
+
+    case 't':
+        self->token.literal = "true";
+        break;
+
+    case 'f':
+        self->token.literal = "false";
+        break;
+
+    case 'n':
+        self->token.literal = "null";
+        break;
+
+    default:
+        if ((c != '-') && ((c < '0') || (c > '9'))) {
+            return -EINVAL;
+        }
+        self->token.num = 0;
+        self->token.negative = (c == '-');
+        self->token.matched = 0;
+        self->state = STATE_NUMBER;
+        if (self->token.negative) {
+            ++self->pos;
+        }
+        return 0;
+    }
+
+    self->token.matched = 0;
+    self->state = STATE_LITERAL;
+    return 0;
+}
+
+static void
+parser_begin_string(
+    struct ws_serialize_parser* self
+) {
+    ++self->pos;
+    self->token.start = self->pos;
+    self->token.write = self->pos;
+    self->token.high = 0;
+    self->state = STATE_STRING;
+}
+
+static int
+parser_string(
+    struct ws_serialize_parser* self
+) {
+    char* buf = self->buf;
+    size_t pos = self->pos;
+    size_t write = self->token.write;
+    int res = 0;
+
+    while (pos < self->fill) {
+        char c = buf[pos];
+
+        if (self->token.high && (c != '\\')) {
+            // a high surrogate must be followed by a low surrogate
+            res = -EINVAL;
+            break;
+        }
+
+        if (c == '"') {
+            ++pos;
+            struct ws_value value;
+            ws_value_string_init(&value);
+            ws_value_string_set_borrowed(&value, buf + self->token.start,
+                                         write - self->token.start);
+            self->pos = pos;
+            self->token.write = write;
+            return parser_finish_token(self, &value);
+        }
+
+        if (c == '\\') {
+            ++pos;
+            self->state = STATE_ESCAPE;
+            break;
+        }
+
+        if ((unsigned char) c < 0x20) {
+            res = -EINVAL;
+            break;
+        }
+
+        // only move data around once an escape sequence was resolved
+        if (write != pos) {
+            buf[write] = c;
+        }
+        ++write;
+        ++pos;
+    }
+
+    self->pos = pos;
+    self->token.write = write;
+    return res;
+}
+
+static int
+parser_escape(
+    struct ws_serialize_parser* self,
+    char c
+) {
+    char unescaped;
+    switch (c) {
+    case '"':   unescaped = '"';    break;
+    case '\\':  unescaped = '\\';   break;
+    case '/':   unescaped = '/';    break;
+    case 'b':   unescaped = '\b';   break;
+    case 'f':   unescaped = '\f';   break;
+    case 'n':   unescaped = '\n';   break;
+    case 'r':   unescaped = '\r';   break;
+    case 't':   unescaped = '\t';   break;
+    case 'u':
+        ++self->pos;
+        self->token.code = 0;
+        self->token.matched = 0;
+        self->state = STATE_UNICODE;
+        return 0;
+    default:
+        return -EINVAL;
+    }
+
+    if (self->token.high) {
+        return -EINVAL;
+    }
+
+    self->buf[self->token.write++] = unescaped;
+    ++self->pos;
+    self->state = STATE_STRING;
+    return 0;
+}
+
+static int
+parser_unicode(
+    struct ws_serialize_parser* self,
+    char c
+) {
+    unsigned int digit;
+    if ((c >= '0') && (c <= '9')) {
+        digit = c - '0';
+    } else if ((c >= 'a') && (c <= 'f')) {
+        digit = c - 'a' + 10;
+    } else if ((c >= 'A') && (c <= 'F')) {
+        digit = c - 'A' + 10;
+    } else {
+        return -EINVAL;
+    }
+
+    ++self->pos;
+    self->token.code = (self->token.code << 4) | digit;
+    if (++self->token.matched < 4) {
+        return 0;
+    }
+
+    unsigned int code = self->token.code;
+    bool is_high = (code >= 0xD800) && (code <= 0xDBFF);
+    bool is_low = (code >= 0xDC00) && (code <= 0xDFFF);
+
+    if (self->token.high) {
+        if (!is_low) {
+            return -EINVAL;
+        }
+        code = 0x10000 + ((self->token.high - 0xD800) << 10) + (code - 0xDC00);
+        self->token.high = 0;
+    } else if (is_high) {
+        self->token.high = code;
+        self->state = STATE_STRING;
+        return 0;
+    } else if (is_low) {
+        return -EINVAL;
+    }
+
+    // the escape sequence is always longer than its UTF-8 representation
+    self->token.write += write_utf8(self->buf + self->token.write, code);
+    self->state = STATE_STRING;
+    return 0;
+}
+
+static int
+parser_number(
+    struct ws_serialize_parser* self,
+    char c
+) {
+    if ((c >= '0') && (c <= '9')) {
+        uint64_t limit;
+        if (self->state == STATE_OBJECT_ID) {
+            limit = UINT64_MAX;
+        } else if (self->token.negative) {
+            limit = (uint64_t) INT64_MAX + 1;
+        } else {
+            limit = INT64_MAX;
+        }
+
+        unsigned int digit = c - '0';
+        if (self->token.num > (limit - digit) / 10) {
+            return -EINVAL;
+        }
+        self->token.num = self->token.num * 10 + digit;
+        ++self->token.matched;
+        ++self->pos;
+        return 0;
+    }
+
+    // the number ended, the current character is not part of it
+    if (!self->token.matched) {
+        return -EINVAL;
+    }
+
+    struct ws_value value;
+    if (self->state == STATE_OBJECT_ID) {
+        ws_value_object_id_init(&value, self->token.num);
+    } else if (self->token.negative) {
+        // avoid overflowing when negating INT64_MIN
+        ws_value_int_init(&value, -(int64_t) (self->token.num - 1) - 1);
+    } else {
+        ws_value_int_init(&value, (int64_t) self->token.num);
+    }
+    return parser_finish_token(self, &value);
+}
+
+static int
+parser_literal(
+    struct ws_serialize_parser* self,
+    char c
+) {
+    if (c != self->token.literal[self->token.matched]) {
+        return -EINVAL;
+    }
+    ++self->pos;
+    if (self->token.literal[++self->token.matched] != '\0') {
+        return 0;
+    }
+
+    struct ws_value value;
+    switch (self->token.literal[0]) {
+    case 't':
+        ws_value_bool_init(&value, true);
+        break;
+    case 'f':
+        ws_value_bool_init(&value, false);
+        break;
+    default:
+        ws_value_nil_init(&value);
+        break;
+    }
+    return parser_finish_token(self, &value);
+}
+
+static int
+parser_finish_token(
+    struct ws_serialize_parser* self,
+    struct ws_value* value
+) {
+    bool is_string = ws_value_get_type(value) == WS_VALUE_TYPE_STRING;
+
+    switch (self->target) {
+    case TARGET_NAME:
+        self->name = ws_value_string_get(value);
+        self->name_len = ws_value_string_len(value);
+        self->state = STATE_AFTER_ELEMENT;
+        return 0;
+
+    case TARGET_ARGUMENT:
+        self->state = STATE_AFTER_ELEMENT;
+        return parser_push_arg(self, value, NULL);
+
+    case TARGET_KEY:
+        if (!is_string) {
+            return -EINVAL;
+        }
+        self->key = ws_value_string_get(value);
+        self->key_len = ws_value_string_len(value);
+        self->state = STATE_COLON;
+        return 0;
+
+    case TARGET_NAMED_VALUE:
+        {
+            struct ws_value named;
+            ws_value_named_init(&named, self->key, self->key_len, value);
+            self->key = NULL;
+            self->state = STATE_NAMED_END;
+            return parser_push_arg(self, &named, value);
+        }
+    }
+
+    return -EINVAL;
+}
+
+static int
+parser_begin_command(
+    struct ws_serialize_parser* self
+) {
+    if (self->num_calls >= WS_SERIALIZE_MAX_COMMANDS) {
+        return -E2BIG;
+    }
+
+    if (self->num_calls == self->cap_calls) {
+        size_t cap = self->cap_calls ? self->cap_calls * 2 : 4;
+        struct ws_command_call* calls;
+        calls = realloc(self->calls, cap * sizeof(*calls));
+        if (!calls) {
+            return -ENOMEM;
+        }
+        self->calls = calls;
+        self->cap_calls = cap;
+    }
+
+    self->name = NULL;
+    self->name_len = 0;
+    self->cmd_start = self->argc;
+    self->state = STATE_NAME;
+    return 0;
+}
+
+static void
+parser_end_command(
+    struct ws_serialize_parser* self
+) {
+    struct ws_command_call* call = self->calls + self->num_calls++;
+    call->name = self->name;
+    call->name_len = self->name_len;
+    call->args = NULL;
+    call->argc = self->argc - self->cmd_start;
+    self->name = NULL;
+}
+
+static int
+parser_push_arg(
+    struct ws_serialize_parser* self,
+    struct ws_value const* value,
+    struct ws_value const* named
+) {
+    if (self->argc - self->cmd_start >= WS_SERIALIZE_MAX_ARGS) {
+        return -E2BIG;
+    }
+
+    if (self->argc == self->cap_args) {
+        size_t cap = self->cap_args ? self->cap_args * 2
+                                    : WS_SERIALIZE_MAX_ARGS;
+        struct ws_value* args = realloc(self->args, cap * sizeof(*args));
+        if (!args) {
+            return -ENOMEM;
+        }
+        self->args = args;
+
+        struct ws_value* named = realloc(self->named, cap * sizeof(*named));
+        if (!named) {
+            return -ENOMEM;
+        }
+        self->named = named;
+        self->cap_args = cap;
+    }
+
+    // the value of a named argument is linked up in parser_finish_message()
+    self->args[self->argc] = *value;
+    if (ws_value_get_type(value) == WS_VALUE_TYPE_NAMED) {
+        self->named[self->argc] = *named;
+    }
+    ++self->argc;
+    return 0;
+}
+
+static int
+parser_finish_message(
+    struct ws_serialize_parser* self,
+    struct ws_arena* arena,
+    struct ws_serialize_message* msg
+) {
+    struct ws_command_call* calls;
+    calls = ws_arena_alloc(arena, self->num_calls * sizeof(*calls));
+    if (!calls) {
+        return -ENOMEM;
+    }
+
+    struct ws_value* args = NULL;
+    if (self->argc) {
+        args = ws_arena_alloc(arena, self->argc * sizeof(*args));
+        if (!args) {
+            return -ENOMEM;
+        }
+        memcpy(args, self->args, self->argc * sizeof(*args));
+    }
+
+    size_t i;
+    for (i = 0; i < self->argc; ++i) {
+        if (ws_value_get_type(args + i) != WS_VALUE_TYPE_NAMED) {
+            continue;
+        }
+
+        // the value of a named argument has to move with the arguments
+        struct ws_value* value = ws_arena_alloc(arena, sizeof(*value));
+        if (!value) {
+            return -ENOMEM;
+        }
+        *value = self->named[i];
+
+        size_t len;
+        char const* name = ws_value_named_get_name(args + i, &len);
+        ws_value_named_init(args + i, name, len, value);
+    }
+
+    size_t offset = 0;
+    for (i = 0; i < self->num_calls; ++i) {
+        calls[i] = self->calls[i];
+        calls[i].args = args ? args + offset : NULL;
+        offset += calls[i].argc;
+    }
+
+    msg->calls = calls;
+    msg->num = self->num_calls;
+    msg->transaction = self->transaction;
+
+    self->num_calls = 0;
+    self->argc = 0;
+    return 1;
+}
+
+static void
+rebase_value(
+    struct ws_value* value,
+    size_t shift
+) {
+    switch (ws_value_get_type(value)) {
+    case WS_VALUE_TYPE_STRING:
+        ws_value_string_set_borrowed(value, ws_value_string_get(value) - shift,
+                                     ws_value_string_len(value));
+        break;
+
+    case WS_VALUE_TYPE_NAMED:
+        {
+            size_t len;
+            char const* name = ws_value_named_get_name(value, &len);
+            ws_value_named_init(value, name - shift, len,
+                                ws_value_named_get_value(value));
+            break;
+        }
+
+    default:
+        break;
+    }
+}
+
+static void
+writer_put(
+    struct writer* self,
+    void const* data,
+    size_t len
+) {
+    if (self->len < self->size) {
+        memcpy(self->buf + self->len, data, WS_MIN(len, self->size - self->len));
+    }
+    self->len += len;
+}
+
+static void
+writer_put_le(
+    struct writer* self,
+    uint64_t num,
+    size_t len
+) {
+    unsigned char data[8];
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        data[i] = (unsigned char) (num >> (8 * i));
+    }
+    writer_put(self, data, len);
+}
+
+static void
+encode_text(
+    struct writer* self,
+    struct ws_value const* value
+) {
+    char num[32];
+
+    switch (ws_value_get_type(value)) {
+    case WS_VALUE_TYPE_BOOL:
+        if (ws_value_bool_get(value)) {
+            writer_put(self, "true", 4);
+        } else {
+            writer_put(self, "false", 5);
+        }
+        break;
+
+    case WS_VALUE_TYPE_INT:
+        writer_put(self, num, snprintf(num, sizeof(num), "%" PRId64,
+                                       ws_value_int_get(value)));
+        break;
+
+    case WS_VALUE_TYPE_OBJECT_ID:
+        writer_put(self, num, snprintf(num, sizeof(num), "#%" PRIu64,
+                                       ws_value_object_id_get(value)));
+        break;
+
+    case WS_VALUE_TYPE_STRING:
+        encode_text_string(self, ws_value_string_get(value),
+                           ws_value_string_len(value));
+        break;
+
+    case WS_VALUE_TYPE_NAMED:
+        {
+            size_t len;
+            char const* name = ws_value_named_get_name(value, &len);
+            writer_put(self, "{", 1);
+            encode_text_string(self, name, len);
+            writer_put(self, ": ", 2);
+            encode_text(self, ws_value_named_get_value(value));
+            writer_put(self, "}", 1);
+            break;
+        }
+
+    default:
+        writer_put(self, "null", 4);
+        break;
+    }
+}
+
+static void
+encode_text_string(
+    struct writer* self,
+    char const* str,
+    size_t len
+) {
+    writer_put(self, "\"", 1);
+
+    size_t start = 0;
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        unsigned char c = str[i];
+        if ((c >= 0x20) && (c != '"') && (c != '\\')) {
+            continue;
+        }
+
+        writer_put(self, str + start, i - start);
+        start = i + 1;
+
+        char esc[8];
+        if ((c == '"') || (c == '\\')) {
+            esc[0] = '\\';
+            esc[1] = c;
+            writer_put(self, esc, 2);
+        } else {
+            writer_put(self, esc, snprintf(esc, sizeof(esc), "\\u%04x", c));
+        }
+    }
+    writer_put(self, str + start, len - start);
+
+    writer_put(self, "\"", 1);
+}
+
+static void
+encode_binary(
+    struct writer* self,
+    struct ws_value const* value
+) {
+    unsigned char tag;
+
+    switch (ws_value_get_type(value)) {
+    case WS_VALUE_TYPE_BOOL:
+        tag = WS_SERIALIZE_TAG_BOOL;
+        writer_put(self, &tag, 1);
+        writer_put_le(self, ws_value_bool_get(value) ? 1 : 0, 1);
+        break;
+
+    case WS_VALUE_TYPE_INT:
+        tag = WS_SERIALIZE_TAG_INT;
+        writer_put(self, &tag, 1);
+        writer_put_le(self, (uint64_t) ws_value_int_get(value), 8);
+        break;
+
+    case WS_VALUE_TYPE_OBJECT_ID:
+        tag = WS_SERIALIZE_TAG_OBJECT_ID;
+        writer_put(self, &tag, 1);
+        writer_put_le(self, ws_value_object_id_get(value), 8);
+        break;
+
+    case WS_VALUE_TYPE_STRING:
+        {
+            size_t len = ws_value_string_len(value);
+            tag = WS_SERIALIZE_TAG_STRING;
+            writer_put(self, &tag, 1);
+            writer_put_le(self, len, 4);
+            writer_put(self, ws_value_string_get(value), len);
+            break;
+        }
+
+    case WS_VALUE_TYPE_NAMED:
+        {
+            size_t len;
+            char const* name = ws_value_named_get_name(value, &len);
+            tag = WS_SERIALIZE_TAG_NAMED;
+            writer_put(self, &tag, 1);
+            writer_put_le(self, len, 4);
+            writer_put(self, name, len);
+            encode_binary(self, ws_value_named_get_value(value));
+            break;
+        }
+
+    default:
+        tag = WS_SERIALIZE_TAG_NIL;
+        writer_put(self, &tag, 1);
+        break;
+    }
+}
+
+static uint64_t
+read_le(
+    unsigned char const* data,
+    size_t len
+) {
+    uint64_t num = 0;
+    while (len--) {
+        num = (num << 8) | data[len];
+    }
+    return num;
+}
+
+static size_t
+write_utf8(
+    char* dest,
+    unsigned int code
+) {
+    if (code < 0x80) {
+        dest[0] = (char) code;
+        return 1;
+    }
+    if (code < 0x800) {
+        dest[0] = (char) (0xC0 | (code >> 6));
+        dest[1] = (char) (0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        dest[0] = (char) (0xE0 | (code >> 12));
+        dest[1] = (char) (0x80 | ((code >> 6) & 0x3F));
+        dest[2] = (char) (0x80 | (code & 0x3F));
+        return 3;
+    }
+    dest[0] = (char) (0xF0 | (code >> 18));
+    dest[1] = (char) (0x80 | ((code >> 12) & 0x3F));
+    dest[2] = (char) (0x80 | ((code >> 6) & 0x3F));
+    dest[3] = (char) (0x80 | (code & 0x3F));
+    return 4;
+}
 
+static bool
+is_space(
+    char c
+) {
+    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
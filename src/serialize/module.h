@@ -28,6 +28,303 @@
 #ifndef __WS_SERIALIZE_MODULE_H__
 #define __WS_SERIALIZE_MODULE_H__
 
+/**
+ * @file module.h
+ *
+ * @brief Wire format of the scripting API
+ *
+ * Clients send commands as messages. In the text format, a message is an
+ * array holding the name of the command followed by its arguments:
+ *
+ *     ["move", #12, {"workspace": 3}]
+ *
+ * Arguments may be `null`, `true`, `false`, integers, strings, object IDs
+ * (written as `#` followed by the ID) and named values, written as objects
+ * with a single member. Messages may be separated by arbitrary whitespace.
+ *
+ * A message may also hold an array of commands, which are then executed as a
+ * transaction:
+ *
+ *     [["move", #12, 0, 0], ["resize", #12, 800, 600], ["focus", #12]]
+ *
+ * The binary format maps 1:1 onto the value types. A message is a 32 bit
+ * length of the body followed by the body, which holds the command name and
+ * the arguments as encoded values. A value is a tag byte (see
+ * `enum ws_serialize_tag`) followed by its payload:
+ *
+ * - nil: no payload
+ * - bool: one byte, 0 or 1
+ * - int: 64 bit signed integer
+ * - string: 32 bit length followed by the bytes
+ * - object ID: 64 bit unsigned integer
+ * - named: 32 bit length of the name, the name, and the (unnamed) value
+ *
+ * All integers are little endian. No textual conversion takes place.
+ *
+ * A transaction is a message whose body starts with the tag
+ * WS_SERIALIZE_TAG_TRANSACTION, followed by the commands, each encoded like
+ * the body of a message including the 32 bit length.
+ *
+ * Responses use the same format as requests, except that a response holds
+ * exactly two values: the status (0 or a negative error number) as integer
+ * and the result of the command. Each command of a transaction gets its own
+ * response.
+ *
+ * Clients may also receive events they subscribed to (see
+ * connection/manager.h). An event is encoded like a request: the name of the
+ * event as string followed by its arguments. Clients tell events and
+ * responses apart by the type of the first value.
+ *
+ * The parser works directly on the receive buffer of a connection. Strings are
+ * not copied but referenced as borrowed string values pointing into the
+ * buffer. Escape sequences are resolved in place. The parser keeps its state
+ * between reads, so partially received messages are never scanned twice.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "command/processor.h"
+#include "util/attributes.h"
+#include "values/value.h"
+
+struct ws_arena;
+
+/**
+ * Maximum number of arguments of a single command
+ */
+#define WS_SERIALIZE_MAX_ARGS 32
+
+/**
+ * Maximum number of commands in a transaction
+ */
+#define WS_SERIALIZE_MAX_COMMANDS 256
+
+/**
+ * Wire formats
+ */
+enum ws_serialize_format {
+    WS_SERIALIZE_FORMAT_TEXT = 0, //!< Human readable, JSON like format
+    WS_SERIALIZE_FORMAT_BINARY, //!< Compact binary format
+};
+
+/**
+ * Tags of values in the binary format
+ */
+enum ws_serialize_tag {
+    WS_SERIALIZE_TAG_NIL = 1, //!< Nil value
+    WS_SERIALIZE_TAG_BOOL = 2, //!< Boolean value
+    WS_SERIALIZE_TAG_INT = 3, //!< Integer value
+    WS_SERIALIZE_TAG_STRING = 4, //!< String value
+    WS_SERIALIZE_TAG_OBJECT_ID = 5, //!< Object ID value
+    WS_SERIALIZE_TAG_NAMED = 6, //!< Named value
+    WS_SERIALIZE_TAG_TRANSACTION = 7, //!< Start of a transaction
+};
+
+/**
+ * A parsed message
+ */
+struct ws_serialize_message {
+    struct ws_command_call* calls; //!< The commands
+    size_t num; //!< Number of commands
+    bool transaction; //!< Whether the commands form a transaction
+};
+
+/**
+ * Incremental parser for messages
+ *
+ * The parser owns the receive buffer. Data is read into the space returned by
+ * ws_serialize_parser_get_space() and then handed to the parser via
+ * ws_serialize_parser_advance().
+ *
+ * Do not access the members directly.
+ */
+struct ws_serialize_parser {
+    char* buf; //!< The receive buffer
+    size_t size; //!< Size of the receive buffer
+    size_t fill; //!< Number of bytes in the buffer
+    size_t pos; //!< Offset of the next byte to parse
+    size_t msg_start; //!< Offset of the message currently being parsed
+    enum ws_serialize_format format; //!< Format of the messages
+    int state; //!< Current state of the state machine
+    int target; //!< What the current token is parsed into
+    struct {
+        size_t start; //!< Offset of the first byte of the token
+        size_t write; //!< Write offset for in-place unescaping
+        uint64_t num; //!< Accumulated number
+        bool negative; //!< Whether the number is negative
+        char const* literal; //!< Literal being matched
+        unsigned int matched; //!< Number of characters matched/digits read
+        unsigned int code; //!< Code point of a unicode escape
+        unsigned int high; //!< Pending high surrogate of a unicode escape
+    } token; //!< State of the current token
+    char const* name; //!< Name of the command currently being parsed
+    size_t name_len; //!< Length of the command name
+    char const* key; //!< Key of the named value currently being parsed
+    size_t key_len; //!< Length of the key
+    bool transaction; //!< Whether the current message is a transaction
+    struct ws_command_call* calls; //!< Commands parsed so far, without args
+    size_t num_calls; //!< Number of commands parsed so far
+    size_t cap_calls; //!< Capacity of `calls`
+    struct ws_value* args; //!< Arguments of all commands parsed so far
+    struct ws_value* named; //!< Values of named arguments, parallel to `args`
+    size_t argc; //!< Number of arguments parsed so far
+    size_t cap_args; //!< Capacity of `args` and `named`
+    size_t cmd_start; //!< Index of the first argument of the current command
+};
+
+/**
+ * Initialize a parser
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_serialize_parser_init(
+    struct ws_serialize_parser* self, //!< The parser to initialize
+    size_t bufsize //!< Size of the receive buffer, limits the message size
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize a parser
+ */
+void
+ws_serialize_parser_deinit(
+    struct ws_serialize_parser* self //!< The parser to deinitialize
+)
+__ws_nonnull__(1);
 
+/**
+ * Set the format of the messages to parse
+ *
+ * Must only be called between messages. Initially, the text format is used.
+ */
+void
+ws_serialize_parser_set_format(
+    struct ws_serialize_parser* self, //!< The parser
+    enum ws_serialize_format format //!< The format
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the data which was not parsed yet
+ *
+ * Allows looking at raw data, e.g. a handshake preceding the messages.
+ *
+ * @return Pointer to the unparsed data
+ */
+char const*
+ws_serialize_parser_peek(
+    struct ws_serialize_parser const* self, //!< The parser
+    size_t* len //!< Output: number of bytes available
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Skip unparsed raw data
+ *
+ * Must only be called between messages.
+ */
+void
+ws_serialize_parser_skip(
+    struct ws_serialize_parser* self, //!< The parser
+    size_t len //!< Number of bytes to skip
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the free space in the receive buffer
+ *
+ * @return Pointer to the free space or NULL if the buffer is full
+ */
+char*
+ws_serialize_parser_get_space(
+    struct ws_serialize_parser* self, //!< The parser
+    size_t* avail //!< Output: number of bytes available
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Tell the parser that data was written into the receive buffer
+ */
+void
+ws_serialize_parser_advance(
+    struct ws_serialize_parser* self, //!< The parser
+    size_t len //!< Number of bytes written into the free space
+)
+__ws_nonnull__(1);
+
+/**
+ * Parse the next message
+ *
+ * The commands and their arguments are allocated from `arena`. Strings
+ * reference the receive buffer and stay valid until
+ * ws_serialize_parser_release() is called.
+ *
+ * @return 1 if a message was parsed, 0 if more data is needed, -EINVAL if the
+ *         data is malformed, -E2BIG if the message has too many commands or
+ *         arguments, -EMSGSIZE if the message does not fit into the receive
+ *         buffer
+ */
+int
+ws_serialize_parser_next(
+    struct ws_serialize_parser* self, //!< The parser
+    struct ws_arena* arena, //!< Arena to allocate the commands from
+    struct ws_serialize_message* msg //!< Output: the parsed message
+)
+__ws_nonnull__(1, 2, 3);
+
+/**
+ * Release all messages returned by the parser
+ *
+ * Strings of all messages returned so far become invalid. The receive buffer
+ * is compacted, making room for more data.
+ *
+ * @return 0 on success, -EMSGSIZE if the buffer is full with an incomplete
+ *         message
+ */
+int
+ws_serialize_parser_release(
+    struct ws_serialize_parser* self //!< The parser
+)
+__ws_nonnull__(1);
+
+/**
+ * Encode a response
+ *
+ * Like snprintf(), the function never writes more than `size` bytes but
+ * returns the number of bytes the complete response needs. The response was
+ * written completely if the returned value is not bigger than `size`.
+ *
+ * @return Number of bytes needed for the response
+ */
+size_t
+ws_serialize_encode_response(
+    enum ws_serialize_format format, //!< Format to use
+    char* buf, //!< Buffer to write to, may be NULL if `size` is 0
+    size_t size, //!< Size of the buffer
+    int status, //!< Status of the command
+    struct ws_value const* result //!< Result of the command
+)
+__ws_nonnull__(5);
+
+/**
+ * Encode an event
+ *
+ * Works like ws_serialize_encode_response().
+ *
+ * @return Number of bytes needed for the event
+ */
+size_t
+ws_serialize_encode_event(
+    enum ws_serialize_format format, //!< Format to use
+    char* buf, //!< Buffer to write to, may be NULL if `size` is 0
+    size_t size, //!< Size of the buffer
+    char const* name, //!< Name of the event
+    struct ws_value const* args, //!< Arguments of the event
+    size_t argc //!< Number of arguments
+)
+__ws_nonnull__(4);
 
 #endif // __WS_SERIALIZE_MODULE_H__
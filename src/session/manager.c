@@ -25,5 +25,1285 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "action/manager.h"
+#include "command/processor.h"
+#include "compositor/module.h"
+#include "logger/module.h"
 #include "session/manager.h"
+#include "session/tree.h"
+#include "util/arena.h"
+#include "util/arithmetical.h"
+#include "util/clock.h"
+#include "util/crc32.h"
+#include "util/epoch.h"
+#include "values/value.h"
+
+struct ws_object_type const WS_OBJECT_TYPE_SESSION = {
+    .name = "session",
+};
+
+/**
+ * Magic number at the start of an image
+ */
+#define IMAGE_MAGIC "WSSNAP01"
+
+/**
+ * Version of the image format
+ */
+#define IMAGE_VERSION 1
+
+/**
+ * Suffix of the temporary file a snapshot is written to
+ */
+#define IMAGE_TMP_SUFFIX ".tmp"
+
+/**
+ * Maximum length of a line of the `session_tree` query
+ */
+#define TREE_LINE_MAX 112
+
+/**
+ * Section of an image
+ */
+struct image_section {
+    uint64_t offset; //!< Offset of the section from the start of the image
+    uint64_t count; //!< Number of records, or bytes for the string pool
+};
+
+/**
+ * Header of an image
+ */
+struct image_header {
+    char magic[8]; //!< IMAGE_MAGIC
+    uint32_t version; //!< IMAGE_VERSION
+    uint32_t crc; //!< Checksum of the image, computed with `crc` being 0
+    uint64_t size; //!< Size of the image
+    uint64_t focus; //!< ID of the focused window, 0 if none
+    struct image_section sessions; //!< Array of `struct image_session`
+    struct image_section windows; //!< Array of `struct image_window`
+    struct image_section actions; //!< Array of `struct image_action`
+    struct image_section strings; //!< String pool
+};
+
+/**
+ * String in the string pool of an image
+ */
+struct image_string {
+    uint32_t offset; //!< Offset into the string pool
+    uint32_t len; //!< Length of the string
+};
+
+/**
+ * Session in an image
+ */
+struct image_session {
+    uint64_t id; //!< Object ID of the session
+    struct image_string name; //!< Name of the session
+};
+
+/**
+ * Window in an image, in stacking order from the bottom
+ */
+struct image_window {
+    uint64_t id; //!< Object ID of the window
+    uint64_t session; //!< Object ID of the session, 0 if none
+    int32_t x; //!< Horizontal position
+    int32_t y; //!< Vertical position
+    int32_t width; //!< Width
+    int32_t height; //!< Height
+    uint32_t workspace; //!< Workspace
+    uint32_t assigned; //!< Whether the window was assigned
+};
+
+/**
+ * Action in an image
+ */
+struct image_action {
+    struct image_string name; //!< Name of the action
+    struct image_string body; //!< Body of the action
+};
+
+/**
+ * Assignment of a window to a session and a workspace
+ */
+struct assignment {
+    uint64_t window; //!< Object ID of the window
+    uint64_t session; //!< Object ID of the session, 0 if none
+    uint32_t workspace; //!< The workspace
+};
+
+/**
+ * Internal state of the session manager
+ */
+static struct {
+    struct wl_list sessions; //!< All sessions
+    struct assignment* assignments; //!< Assignments, sorted by window ID
+    size_t num_assignments; //!< Number of assignments
+    size_t cap_assignments; //!< Capacity of `assignments`
+    void* image; //!< Mapping of the image restored from, if any
+    size_t image_size; //!< Size of the image
+    _Atomic(struct ws_session_tree*) tree; //!< The tree published last
+    bool listening; //!< Whether the compositor listener was registered
+} manager;
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Create a session with a given ID and name
+ *
+ * @return The session or NULL on error
+ */
+static struct ws_session*
+session_create(
+    uint64_t id, //!< Object ID, 0 for a new one
+    char const* name, //!< Name of the session
+    size_t name_len, //!< Length of the name
+    bool copy //!< Whether to copy the name
+);
+
+/**
+ * Find the assignment of a window
+ *
+ * @return Whether the window has an assignment
+ */
+static bool
+assignment_find(
+    uint64_t window, //!< Object ID of the window
+    size_t* pos //!< Output: position of the assignment or where it would be
+);
+
+/**
+ * Assign a window by ID
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+assignment_set(
+    uint64_t window, //!< Object ID of the window
+    uint64_t session, //!< Object ID of the session, 0 if none
+    uint32_t workspace //!< The workspace
+);
+
+/**
+ * Get the place of a window in the tree
+ */
+static void
+tree_location(
+    uint64_t window, //!< Object ID of the window
+    uint64_t* session, //!< Output: object ID of the session, 0 if none
+    uint32_t* workspace //!< Output: the workspace
+);
+
+/**
+ * Move a window within the tree, if it is part of it
+ */
+static void
+tree_move(
+    uint64_t window, //!< Object ID of the window
+    uint64_t session, //!< Object ID of the session it was held by
+    uint32_t workspace //!< Workspace it was held by
+);
+
+/**
+ * Publish a new version of the tree
+ *
+ * The version published before is retired. If `tree` is NULL, i.e. creating
+ * the new version failed, the previous version stays.
+ */
+static void
+tree_publish(
+    struct ws_session_tree* tree //!< The new version, may be NULL
+);
+
+/**
+ * Destroy a retired version of the tree
+ */
+static void
+tree_destroy(
+    struct ws_epoch_node* node //!< Node of the version
+);
+
+/**
+ * Compositor listener keeping the tree up to date
+ */
+static void
+tree_event(
+    enum ws_compositor_event event, //!< The event
+    struct ws_object* subject, //!< Window or output, may be NULL
+    void* data //!< Unused
+);
+
+/**
+ * Check whether a string of an image lies within its string pool
+ *
+ * @return Whether the string is valid
+ */
+static bool
+image_string_valid(
+    struct image_header const* header, //!< Header of the image
+    struct image_string str //!< The string
+);
+
+/**
+ * Check whether a section of an image lies within the image
+ *
+ * @return Whether the section is valid
+ */
+static bool
+image_section_valid(
+    struct image_header const* header, //!< Header of the image
+    struct image_section section, //!< The section
+    size_t record_size //!< Size of a record of the section
+);
+
+/**
+ * Check the structure of an image
+ *
+ * @return Whether the image is valid
+ */
+static bool
+image_valid(
+    void const* image, //!< The image
+    size_t size //!< Size of the image
+);
+
+/**
+ * Write a whole buffer to a new file, replacing the file at `path`
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+write_file(
+    char const* path, //!< Path of the file
+    void const* data, //!< The data
+    size_t size //!< Size of the data
+);
+
+/**
+ * Get a window argument of a command
+ *
+ * @return The window or NULL if the argument is not a window
+ */
+static struct ws_window*
+command_get_window(
+    struct ws_value const* arg //!< The argument
+);
+
+/**
+ * Command creating a session
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_new(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command assigning a window
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_assign(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command querying the workspace of a window
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_workspace(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command writing a snapshot
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_snapshot(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Query: list the tree of sessions, workspaces and windows
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_tree(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Commands of the session manager
+ */
+static struct ws_command const session_commands[] = {
+    { .name = "session_new", .func = command_new },
+    { .name = "session_assign", .func = command_assign },
+    { .name = "session_workspace", .func = command_workspace },
+    { .name = "session_snapshot", .func = command_snapshot },
+    {
+        .name = "session_tree",
+        .func = command_tree,
+        .flags = WS_COMMAND_QUERY,
+    },
+};
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_session_manager_init(void)
+{
+    wl_list_init(&manager.sessions);
+    manager.assignments = NULL;
+    manager.num_assignments = 0;
+    manager.cap_assignments = 0;
+    manager.image = NULL;
+    manager.image_size = 0;
+
+    struct ws_session_tree* tree = ws_session_tree_new();
+    if (!tree) {
+        return -ENOMEM;
+    }
+    atomic_store(&manager.tree, tree);
+
+    size_t i;
+    for (i = 0; i < sizeof(session_commands) / sizeof(*session_commands);
+         ++i) {
+        int res = ws_command_register(session_commands + i);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    if (!manager.listening) {
+        struct ws_compositor_listener listener = {
+            .event = tree_event,
+            .data = NULL,
+        };
+        int res = ws_compositor_add_listener(&listener);
+        if (res < 0) {
+            return res;
+        }
+        manager.listening = true;
+    }
+    return 0;
+}
+
+void
+ws_session_manager_deinit(void)
+{
+    // tolerate being called without a preceding initialization
+    if (!manager.sessions.next) {
+        return;
+    }
+
+    // retired first, so destroying the sessions does not touch it
+    struct ws_session_tree* tree = atomic_exchange(&manager.tree, NULL);
+    if (tree) {
+        ws_epoch_retire(&tree->retire, tree_destroy);
+        ws_epoch_collect();
+    }
+
+    while (!wl_list_empty(&manager.sessions)) {
+        struct ws_session* session;
+        session = wl_container_of(manager.sessions.next, session, link);
+        ws_session_destroy(session);
+    }
+
+    free(manager.assignments);
+    manager.assignments = NULL;
+    manager.num_assignments = 0;
+    manager.cap_assignments = 0;
+
+    if (manager.image) {
+        munmap(manager.image, manager.image_size);
+        manager.image = NULL;
+        manager.image_size = 0;
+    }
+    manager.sessions.next = NULL;
+    manager.sessions.prev = NULL;
+}
+
+struct ws_session*
+ws_session_new(
+    char const* name,
+    size_t name_len
+) {
+    return session_create(0, name, name_len, true);
+}
+
+void
+ws_session_destroy(
+    struct ws_session* self
+) {
+    // windows of the session keep their workspace, but lose the session
+    uint64_t id = ws_object_get_id(&self->obj);
+    size_t i;
+    for (i = 0; i < manager.num_assignments; ++i) {
+        struct assignment* assignment = manager.assignments + i;
+        if (assignment->session == id) {
+            assignment->session = 0;
+            tree_move(assignment->window, id, assignment->workspace);
+        }
+    }
+
+    wl_list_remove(&self->link);
+    ws_object_deinit(&self->obj);
+    if (self->owned) {
+        free((char*) self->name);
+    }
+    free(self);
+}
+
+int
+ws_session_assign(
+    struct ws_window const* window,
+    struct ws_session* session,
+    uint32_t workspace
+) {
+    return assignment_set(ws_object_get_id(&window->obj),
+                          session ? ws_object_get_id(&session->obj) : 0,
+                          workspace);
+}
+
+int
+ws_session_get_assignment(
+    struct ws_window const* window,
+    struct ws_session** session,
+    uint32_t* workspace
+) {
+    size_t pos;
+    if (!assignment_find(ws_object_get_id(&window->obj), &pos)) {
+        return -ENOENT;
+    }
+
+    struct assignment const* assignment = manager.assignments + pos;
+    struct ws_object* obj = ws_object_find(assignment->session,
+                                           &WS_OBJECT_TYPE_SESSION);
+    *session = obj ? wl_container_of(obj, *session, obj) : NULL;
+    *workspace = assignment->workspace;
+    return 0;
+}
+
+int
+ws_session_manager_snapshot(
+    char const* path
+) {
+    uint64_t start = ws_clock_now();
+
+    // size the image
+    size_t num_sessions = (size_t) wl_list_length(&manager.sessions);
+    size_t num_windows = 0;
+    size_t strings_len = 0;
+    struct ws_session* session;
+    wl_list_for_each(session, &manager.sessions, link) {
+        strings_len += session->name_len;
+    }
+    struct ws_window* window = NULL;
+    while ((window = ws_compositor_next_window(window))) {
+        ++num_windows;
+    }
+    size_t num_actions = ws_action_count();
+    size_t i;
+    for (i = 0; i < num_actions; ++i) {
+        struct ws_action const* action = ws_action_at(i);
+        strings_len += action->name_len + action->body_len;
+    }
+    if (strings_len > UINT32_MAX) {
+        return -E2BIG;
+    }
+
+    struct image_header header;
+    memset(&header, 0, sizeof(header));
+    uint64_t size = sizeof(header);
+    header.sessions.offset = size;
+    header.sessions.count = num_sessions;
+    size += num_sessions * sizeof(struct image_session);
+    header.windows.offset = size;
+    header.windows.count = num_windows;
+    size += num_windows * sizeof(struct image_window);
+    header.actions.offset = size;
+    header.actions.count = num_actions;
+    size += num_actions * sizeof(struct image_action);
+    header.strings.offset = size;
+    header.strings.count = strings_len;
+    size += strings_len;
+
+    char* image = calloc(1, size);
+    if (!image) {
+        return -ENOMEM;
+    }
+    char* strings = image + header.strings.offset;
+    uint32_t strings_pos = 0;
+
+    // fill in the records
+    struct image_session* image_session;
+    image_session = (struct image_session*) (image + header.sessions.offset);
+    wl_list_for_each(session, &manager.sessions, link) {
+        image_session->id = ws_object_get_id(&session->obj);
+        image_session->name.offset = strings_pos;
+        image_session->name.len = (uint32_t) session->name_len;
+        memcpy(strings + strings_pos, session->name, session->name_len);
+        strings_pos += (uint32_t) session->name_len;
+        ++image_session;
+    }
+
+    struct image_window* image_window;
+    image_window = (struct image_window*) (image + header.windows.offset);
+    window = NULL;
+    while ((window = ws_compositor_next_window(window))) {
+        struct ws_geometry const* geometry = ws_window_get_geometry(window);
+        image_window->id = ws_object_get_id(&window->obj);
+        image_window->x = geometry->x;
+        image_window->y = geometry->y;
+        image_window->width = geometry->width;
+        image_window->height = geometry->height;
+
+        size_t pos;
+        if (assignment_find(image_window->id, &pos)) {
+            image_window->session = manager.assignments[pos].session;
+            image_window->workspace = manager.assignments[pos].workspace;
+            image_window->assigned = 1;
+        }
+        ++image_window;
+    }
+
+    struct image_action* image_action;
+    image_action = (struct image_action*) (image + header.actions.offset);
+    for (i = 0; i < num_actions; ++i) {
+        struct ws_action const* action = ws_action_at(i);
+        image_action->name.offset = strings_pos;
+        image_action->name.len = (uint32_t) action->name_len;
+        memcpy(strings + strings_pos, action->name, action->name_len);
+        strings_pos += (uint32_t) action->name_len;
+        image_action->body.offset = strings_pos;
+        image_action->body.len = (uint32_t) action->body_len;
+        memcpy(strings + strings_pos, action->body, action->body_len);
+        strings_pos += (uint32_t) action->body_len;
+        ++image_action;
+    }
+
+    struct ws_window* focus = ws_compositor_get_focus();
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.size = size;
+    header.focus = focus ? ws_object_get_id(&focus->obj) : 0;
+    memcpy(image, &header, sizeof(header));
+    header.crc = ws_crc32(0, image, size);
+    memcpy(image, &header, sizeof(header));
+
+    int res = write_file(path, image, size);
+    free(image);
+    if (res < 0) {
+        return res;
+    }
+
+    WS_LOG(WS_LOG_MODULE_SESSION, WS_LOG_INFO,
+           "snapshot of %zu sessions, %zu windows and %zu actions written to "
+           "%s in %lluus", num_sessions, num_windows, num_actions, path,
+           (unsigned long long) (ws_clock_now() - start) / 1000);
+    return 0;
+}
+
+struct ws_session_tree const*
+ws_session_manager_get_tree(void)
+{
+    return atomic_load(&manager.tree);
+}
+
+int
+ws_session_manager_restore(
+    char const* path
+) {
+    if (manager.image) {
+        return -EALREADY;
+    }
+
+    uint64_t start = ws_clock_now();
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int res = -errno;
+        close(fd);
+        return res;
+    }
+    size_t size = (size_t) st.st_size;
+    if (size < sizeof(struct image_header)) {
+        close(fd);
+        return -EINVAL;
+    }
+
+    void* image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return -errno;
+    }
+    if (!image_valid(image, size)) {
+        munmap(image, size);
+        return -EINVAL;
+    }
+    manager.image = image;
+    manager.image_size = size;
+
+    char const* base = image;
+    struct image_header const* header = image;
+    char const* strings = base + header->strings.offset;
+    size_t skipped = 0;
+    size_t i;
+
+    struct image_session const* sessions;
+    sessions = (struct image_session const*) (base + header->sessions.offset);
+    for (i = 0; i < header->sessions.count; ++i) {
+        if (!session_create(sessions[i].id, strings + sessions[i].name.offset,
+                            sessions[i].name.len, false)) {
+            ++skipped;
+        }
+    }
+
+    // windows are recreated bottom to top, which restores the stacking order
+    struct image_window const* windows;
+    windows = (struct image_window const*) (base + header->windows.offset);
+    for (i = 0; i < header->windows.count; ++i) {
+        struct ws_window* window = ws_window_new_with_id(windows[i].id);
+        if (!window) {
+            ++skipped;
+            continue;
+        }
+
+        struct ws_geometry geometry = {
+            .x = windows[i].x,
+            .y = windows[i].y,
+            .width = windows[i].width,
+            .height = windows[i].height,
+        };
+        ws_window_set_geometry(window, &geometry);
+
+        if (windows[i].assigned &&
+                (assignment_set(windows[i].id, windows[i].session,
+                                windows[i].workspace) < 0)) {
+            ++skipped;
+        }
+    }
+
+    struct image_action const* actions;
+    actions = (struct image_action const*) (base + header->actions.offset);
+    for (i = 0; i < header->actions.count; ++i) {
+        if (ws_action_register_borrowed(strings + actions[i].name.offset,
+                                        actions[i].name.len,
+                                        strings + actions[i].body.offset,
+                                        actions[i].body.len) < 0) {
+            ++skipped;
+        }
+    }
+
+    if (header->focus) {
+        struct ws_object* obj = ws_object_find(header->focus,
+                                               &WS_OBJECT_TYPE_WINDOW);
+        if (obj) {
+            struct ws_window* window;
+            ws_compositor_focus(wl_container_of(obj, window, obj));
+        }
+    }
+
+    if (skipped) {
+        WS_LOG(WS_LOG_MODULE_SESSION, WS_LOG_WARNING,
+               "%zu entries of %s could not be restored", skipped, path);
+    }
+    WS_LOG(WS_LOG_MODULE_SESSION, WS_LOG_INFO,
+           "restored %llu sessions, %llu windows and %llu actions from %s in "
+           "%lluus", (unsigned long long) header->sessions.count,
+           (unsigned long long) header->windows.count,
+           (unsigned long long) header->actions.count, path,
+           (unsigned long long) (ws_clock_now() - start) / 1000);
+    return 0;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static struct ws_session*
+session_create(
+    uint64_t id,
+    char const* name,
+    size_t name_len,
+    bool copy
+) {
+    struct ws_session* self = calloc(1, sizeof(*self));
+    if (!self) {
+        return NULL;
+    }
+
+    int res = id ? ws_object_init_id(&self->obj, &WS_OBJECT_TYPE_SESSION, id)
+                 : ws_object_init(&self->obj, &WS_OBJECT_TYPE_SESSION);
+    if (res < 0) {
+        free(self);
+        return NULL;
+    }
+
+    self->name = name;
+    self->name_len = name_len;
+    self->owned = copy;
+    if (copy) {
+        char* name_copy = malloc(name_len ? name_len : 1);
+        if (!name_copy) {
+            ws_object_deinit(&self->obj);
+            free(self);
+            return NULL;
+        }
+        memcpy(name_copy, name, name_len);
+        self->name = name_copy;
+    }
+
+    wl_list_insert(manager.sessions.prev, &self->link);
+    return self;
+}
+
+static bool
+assignment_find(
+    uint64_t window,
+    size_t* pos
+) {
+    size_t low = 0;
+    size_t high = manager.num_assignments;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (manager.assignments[mid].window < window) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    *pos = low;
+    return (low < manager.num_assignments) &&
+           (manager.assignments[low].window == window);
+}
+
+static int
+assignment_set(
+    uint64_t window,
+    uint64_t session,
+    uint32_t workspace
+) {
+    size_t pos;
+    if (!assignment_find(window, &pos)) {
+        // drop assignments of destroyed windows before growing
+        size_t kept = 0;
+        size_t i;
+        for (i = 0; i < manager.num_assignments; ++i) {
+            if (ws_object_find(manager.assignments[i].window,
+                               &WS_OBJECT_TYPE_WINDOW)) {
+                manager.assignments[kept++] = manager.assignments[i];
+            }
+        }
+        manager.num_assignments = kept;
+        assignment_find(window, &pos);
+
+        if (manager.num_assignments == manager.cap_assignments) {
+            size_t cap = manager.cap_assignments ?
+                         manager.cap_assignments * 2 : 64;
+            struct assignment* assignments;
+            assignments = realloc(manager.assignments,
+                                  cap * sizeof(*assignments));
+            if (!assignments) {
+                return -ENOMEM;
+            }
+            manager.assignments = assignments;
+            manager.cap_assignments = cap;
+        }
+
+        memmove(manager.assignments + pos + 1, manager.assignments + pos,
+                (manager.num_assignments - pos) *
+                sizeof(*manager.assignments));
+        ++manager.num_assignments;
+    }
+
+    uint64_t old_session;
+    uint32_t old_workspace;
+    tree_location(window, &old_session, &old_workspace);
+
+    manager.assignments[pos].window = window;
+    manager.assignments[pos].session = session;
+    manager.assignments[pos].workspace = workspace;
+    tree_move(window, old_session, old_workspace);
+    return 0;
+}
+
+static void
+tree_location(
+    uint64_t window,
+    uint64_t* session,
+    uint32_t* workspace
+) {
+    size_t pos;
+    *session = 0;
+    *workspace = 0;
+    if (assignment_find(window, &pos)) {
+        *session = manager.assignments[pos].session;
+        *workspace = manager.assignments[pos].workspace;
+    }
+}
+
+static void
+tree_move(
+    uint64_t window,
+    uint64_t session,
+    uint32_t workspace
+) {
+    struct ws_session_tree* tree = atomic_load(&manager.tree);
+    if (!tree) {
+        return;
+    }
+
+    // windows not mapped yet are inserted once they are
+    struct ws_session_node const* node;
+    node = ws_session_tree_find(tree, session, workspace, window);
+    if (!node) {
+        return;
+    }
+
+    uint64_t new_session;
+    uint32_t new_workspace;
+    tree_location(window, &new_session, &new_workspace);
+    if ((new_session == session) && (new_workspace == workspace)) {
+        return;
+    }
+
+    struct ws_geometry geometry = node->geometry;
+    struct ws_session_tree* removed;
+    removed = ws_session_tree_set_window(tree, session, workspace, window,
+                                         NULL);
+    if (!removed) {
+        tree_publish(NULL);
+        return;
+    }
+    tree_publish(ws_session_tree_set_window(removed, new_session,
+                                            new_workspace, window, &geometry));
+    ws_session_tree_unref(removed);
+}
+
+static void
+tree_publish(
+    struct ws_session_tree* tree
+) {
+    if (!tree) {
+        // readers keep seeing the previous version
+        WS_LOG(WS_LOG_MODULE_SESSION, WS_LOG_WARNING,
+               "could not create a new version of the tree");
+        return;
+    }
+
+    struct ws_session_tree* old = atomic_exchange(&manager.tree, tree);
+    if (old) {
+        ws_epoch_retire(&old->retire, tree_destroy);
+        ws_epoch_collect();
+    }
+}
+
+static void
+tree_destroy(
+    struct ws_epoch_node* node
+) {
+    struct ws_session_tree* tree;
+    tree = wl_container_of(node, tree, retire);
+    ws_session_tree_unref(tree);
+}
+
+static void
+tree_event(
+    enum ws_compositor_event event,
+    struct ws_object* subject,
+    void* data
+) {
+    struct ws_session_tree* tree = atomic_load(&manager.tree);
+    if (!tree) {
+        return;
+    }
+
+    if (event == WS_COMPOSITOR_EVENT_FOCUS) {
+        uint64_t focus = subject ? ws_object_get_id(subject) : 0;
+        if (focus != tree->focus) {
+            tree_publish(ws_session_tree_set_focus(tree, focus));
+        }
+        return;
+    }
+    if ((event != WS_COMPOSITOR_EVENT_WINDOW_MAP) &&
+            (event != WS_COMPOSITOR_EVENT_WINDOW_UNMAP) &&
+            (event != WS_COMPOSITOR_EVENT_GEOMETRY)) {
+        return;
+    }
+
+    struct ws_window* window = wl_container_of(subject, window, obj);
+    uint64_t id = ws_object_get_id(subject);
+    uint64_t session;
+    uint32_t workspace;
+    tree_location(id, &session, &workspace);
+
+    struct ws_geometry const* geometry = NULL;
+    if (event != WS_COMPOSITOR_EVENT_WINDOW_UNMAP) {
+        geometry = ws_window_get_geometry(window);
+    }
+    tree_publish(ws_session_tree_set_window(tree, session, workspace, id,
+                                            geometry));
+}
+
+static bool
+image_string_valid(
+    struct image_header const* header,
+    struct image_string str
+) {
+    return (uint64_t) str.offset + str.len <= header->strings.count;
+}
+
+static bool
+image_section_valid(
+    struct image_header const* header,
+    struct image_section section,
+    size_t record_size
+) {
+    if ((section.offset % 8) || (section.offset < sizeof(*header)) ||
+            (section.offset > header->size)) {
+        return false;
+    }
+    return section.count <= (header->size - section.offset) / record_size;
+}
+
+static bool
+image_valid(
+    void const* image,
+    size_t size
+) {
+    struct image_header header;
+    memcpy(&header, image, sizeof(header));
+    if ((memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0) ||
+            (header.version != IMAGE_VERSION) || (header.size != size)) {
+        return false;
+    }
+
+    // the checksum covers the whole image, with the checksum itself being 0
+    uint32_t crc = header.crc;
+    header.crc = 0;
+    uint32_t computed = ws_crc32(0, &header, sizeof(header));
+    computed = ws_crc32(computed, (char const*) image + sizeof(header),
+                        size - sizeof(header));
+    if (crc != computed) {
+        return false;
+    }
+
+    if (!image_section_valid(&header, header.sessions,
+                             sizeof(struct image_session)) ||
+            !image_section_valid(&header, header.windows,
+                                 sizeof(struct image_window)) ||
+            !image_section_valid(&header, header.actions,
+                                 sizeof(struct image_action)) ||
+            (header.strings.offset < sizeof(header)) ||
+            (header.strings.offset > size) ||
+            (header.strings.count > size - header.strings.offset)) {
+        return false;
+    }
+
+    char const* base = image;
+    size_t i;
+    struct image_session const* sessions;
+    sessions = (struct image_session const*) (base + header.sessions.offset);
+    for (i = 0; i < header.sessions.count; ++i) {
+        if (!image_string_valid(&header, sessions[i].name)) {
+            return false;
+        }
+    }
+
+    struct image_action const* actions;
+    actions = (struct image_action const*) (base + header.actions.offset);
+    for (i = 0; i < header.actions.count; ++i) {
+        if (!image_string_valid(&header, actions[i].name) ||
+                !image_string_valid(&header, actions[i].body) ||
+                !actions[i].name.len) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int
+write_file(
+    char const* path,
+    void const* data,
+    size_t size
+) {
+    size_t path_len = strlen(path);
+    char* tmp = malloc(path_len + sizeof(IMAGE_TMP_SUFFIX));
+    if (!tmp) {
+        return -ENOMEM;
+    }
+    memcpy(tmp, path, path_len);
+    memcpy(tmp + path_len, IMAGE_TMP_SUFFIX, sizeof(IMAGE_TMP_SUFFIX));
+
+    int res = 0;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        res = -errno;
+        goto cleanup_tmp;
+    }
+
+    char const* pos = data;
+    while (size) {
+        ssize_t written = write(fd, pos, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            res = -errno;
+            break;
+        }
+        pos += written;
+        size -= (size_t) written;
+    }
+
+    if ((res == 0) && (fsync(fd) < 0)) {
+        res = -errno;
+    }
+    close(fd);
+
+    if ((res == 0) && (rename(tmp, path) < 0)) {
+        res = -errno;
+    }
+    if (res < 0) {
+        unlink(tmp);
+    }
+
+cleanup_tmp:
+    free(tmp);
+    return res;
+}
+
+static struct ws_window*
+command_get_window(
+    struct ws_value const* arg
+) {
+    if (ws_value_get_type(arg) != WS_VALUE_TYPE_OBJECT_ID) {
+        return NULL;
+    }
+
+    struct ws_object* obj;
+    obj = ws_value_object_id_get_object(arg, &WS_OBJECT_TYPE_WINDOW);
+    if (!obj) {
+        return NULL;
+    }
+
+    struct ws_window* window;
+    return wl_container_of(obj, window, obj);
+}
+
+static int
+command_new(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc != 1) || (ws_value_get_type(args) != WS_VALUE_TYPE_STRING)) {
+        return -EINVAL;
+    }
+
+    struct ws_session* session = ws_session_new(ws_value_string_get(args),
+                                                ws_value_string_len(args));
+    if (!session) {
+        return -ENOMEM;
+    }
+
+    ws_value_deinit(result);
+    ws_value_object_id_init(result, ws_object_get_id(&session->obj));
+    return 0;
+}
+
+static int
+command_assign(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc != 3) || (ws_value_get_type(args + 2) != WS_VALUE_TYPE_INT)) {
+        return -EINVAL;
+    }
+
+    struct ws_window* window = command_get_window(args);
+    if (!window) {
+        return -EINVAL;
+    }
+
+    struct ws_session* session = NULL;
+    if (ws_value_get_type(args + 1) == WS_VALUE_TYPE_OBJECT_ID) {
+        struct ws_object* obj;
+        obj = ws_value_object_id_get_object(args + 1, &WS_OBJECT_TYPE_SESSION);
+        if (!obj) {
+            return -EINVAL;
+        }
+        session = wl_container_of(obj, session, obj);
+    } else if (ws_value_get_type(args + 1) != WS_VALUE_TYPE_NIL) {
+        return -EINVAL;
+    }
+
+    int64_t workspace = ws_value_int_get(args + 2);
+    if ((workspace < 0) || (workspace > UINT32_MAX)) {
+        return -EINVAL;
+    }
+    return ws_session_assign(window, session, (uint32_t) workspace);
+}
+
+static int
+command_workspace(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    struct ws_window* window = (argc == 1) ? command_get_window(args) : NULL;
+    if (!window) {
+        return -EINVAL;
+    }
+
+    struct ws_session* session;
+    uint32_t workspace;
+    int res = ws_session_get_assignment(window, &session, &workspace);
+    if (res < 0) {
+        return res;
+    }
+
+    ws_value_deinit(result);
+    ws_value_int_init(result, workspace);
+    return 0;
+}
+
+static int
+command_snapshot(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc != 1) || (ws_value_get_type(args) != WS_VALUE_TYPE_STRING)) {
+        return -EINVAL;
+    }
+
+    // the path is not necessarily 0-terminated
+    char const* path = ws_arena_strndup(ctx->arena, ws_value_string_get(args),
+                                        ws_value_string_len(args));
+    if (!path) {
+        return -ENOMEM;
+    }
+    return ws_session_manager_snapshot(path);
+}
+
+static int
+command_tree(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if (argc != 0) {
+        return -EINVAL;
+    }
+
+    struct ws_session_tree const* tree = ws_session_manager_get_tree();
+    if (!tree) {
+        return -ENOENT;
+    }
+
+    size_t size = (ws_session_tree_count(tree) + 1) * TREE_LINE_MAX + 1;
+    char* list = ws_arena_alloc(ctx->arena, size);
+    if (!list) {
+        return -ENOMEM;
+    }
+
+    int n = snprintf(list, size, "%llu %llu\n",
+                     (unsigned long long) tree->version,
+                     (unsigned long long) tree->focus);
+    if (n < 0) {
+        return -EIO;
+    }
+    size_t len = WS_MIN((size_t) n, size - 1);
+
+    struct ws_session_node const* root = tree->root;
+    size_t i;
+    for (i = 0; root && (i < root->num_children); ++i) {
+        struct ws_session_node const* session = root->children[i];
+        size_t k;
+        for (k = 0; k < session->num_children; ++k) {
+            struct ws_session_node const* workspace = session->children[k];
+            size_t l;
+            for (l = 0; l < workspace->num_children; ++l) {
+                struct ws_session_node const* window;
+                window = workspace->children[l];
+                n = snprintf(list + len, size - len,
+                             "%llu %llu %llu %d %d %d %d\n",
+                             (unsigned long long) session->id,
+                             (unsigned long long) workspace->id,
+                             (unsigned long long) window->id,
+                             (int) window->geometry.x,
+                             (int) window->geometry.y,
+                             (int) window->geometry.width,
+                             (int) window->geometry.height);
+                if (n < 0) {
+                    return -EIO;
+                }
+                len += WS_MIN((size_t) n, size - len - 1);
+            }
+        }
+    }
 
+    ws_value_deinit(result);
+    ws_value_string_init(result);
+    ws_value_string_set_borrowed(result, list, len);
+    return 0;
+}
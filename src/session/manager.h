@@ -28,6 +28,185 @@
 #ifndef __WS_SESSION_MANAGER_H__
 #define __WS_SESSION_MANAGER_H__
 
+/**
+ * @file manager.h
+ *
+ * @brief Sessions, workspaces and snapshots of the session state
+ *
+ * A session groups the windows of an application or a user session. Sessions
+ * are objects (see objects/object.h), so scripts refer to them by object ID.
+ * Each window may be assigned to a session and a workspace.
+ *
+ * The session manager can write the session state into a snapshot image: the
+ * sessions, the windows with their object IDs, geometry, session and
+ * workspace, the focused window and the actions registered by scripts (see
+ * action/manager.h). The image is flat and position-independent: it consists
+ * of fixed-size records referring to each other and to a string pool by
+ * offset only. A restarted waysome maps the image and resumes from it. All
+ * objects are recreated under their previous IDs, so IDs held by scripts stay
+ * valid, and strings are used in place without copying them.
+ *
+ * The session manager also keeps the windows in a persistent tree grouped by
+ * session and workspace (see session/tree.h). Each change of a window, its
+ * assignment or the focus creates a new version sharing all unchanged nodes
+ * with the previous one, which is then published by swapping a single
+ * pointer. Other threads, e.g. workers executing queries, read the tree
+ * without locking, versions replaced are retired with epoch based reclamation
+ * (see util/epoch.h). Holding a reference to a version, a layout script may
+ * compare it to a later one cheaply.
+ *
+ * Scripts use the commands
+ *
+ * - `["session_new", "<name>"]`, returning the ID of a new session,
+ * - `["session_assign", <window>, <session or nil>, <workspace>]`,
+ * - `["session_workspace", <window>]`, returning the workspace of a window,
+ * - `["session_snapshot", "<path>"]`, writing a snapshot,
+ * - `["session_tree"]`, a query returning a string with a line `<version>
+ *   <focus>` followed by a line `<session> <workspace> <window> <x> <y>
+ *   <width> <height>` per window.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-server.h>
+
+#include "objects/object.h"
+#include "util/attributes.h"
+
+struct ws_session_tree;
+struct ws_window;
+
+/**
+ * Session
+ */
+struct ws_session {
+    struct ws_object obj; //!< Object base
+    struct wl_list link; //!< Link in the list of sessions
+    char const* name; //!< Name of the session, not 0-terminated
+    size_t name_len; //!< Length of the name
+    bool owned; //!< Whether the name was copied
+};
 
+/**
+ * Object type of sessions
+ */
+extern struct ws_object_type const WS_OBJECT_TYPE_SESSION;
+
+/**
+ * Initialize the session manager
+ *
+ * Registers the session commands.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_session_manager_init(void);
+
+/**
+ * Deinitialize the session manager
+ *
+ * Destroys all sessions and unmaps the image restored from, if any. The
+ * action manager has to be deinitialized before, as actions restored from
+ * the image refer to it.
+ */
+void
+ws_session_manager_deinit(void);
+
+/**
+ * Create a session
+ *
+ * The name is copied.
+ *
+ * @return The new session or NULL on error
+ */
+struct ws_session*
+ws_session_new(
+    char const* name, //!< Name of the session
+    size_t name_len //!< Length of the name
+)
+__ws_nonnull__(1);
+
+/**
+ * Destroy a session
+ *
+ * Windows assigned to the session keep their workspace.
+ */
+void
+ws_session_destroy(
+    struct ws_session* self //!< The session
+)
+__ws_nonnull__(1);
+
+/**
+ * Assign a window to a session and a workspace
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_session_assign(
+    struct ws_window const* window, //!< The window
+    struct ws_session* session, //!< The session, may be NULL
+    uint32_t workspace //!< The workspace
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the session and workspace of a window
+ *
+ * @return 0 on success, -ENOENT if the window was never assigned
+ */
+int
+ws_session_get_assignment(
+    struct ws_window const* window, //!< The window
+    struct ws_session** session, //!< Output: the session, may be NULL
+    uint32_t* workspace //!< Output: the workspace
+)
+__ws_nonnull__(1, 2, 3);
+
+/**
+ * Get the version of the tree published last
+ *
+ * May be called from any thread. The version stays valid until the caller
+ * leaves the current critical section (see util/epoch.h) or, when called from
+ * the main thread, until the next change. Callers wanting to keep it longer
+ * take a reference with ws_session_tree_ref().
+ *
+ * @return The tree or NULL if the session manager is not initialized
+ */
+struct ws_session_tree const*
+ws_session_manager_get_tree(void);
+
+/**
+ * Write a snapshot of the session state
+ *
+ * The image is written to a temporary file first, which then replaces the
+ * file at `path`.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_session_manager_snapshot(
+    char const* path //!< Path of the image
+)
+__ws_nonnull__(1);
+
+/**
+ * Restore the session state from a snapshot
+ *
+ * Should be called right after the compositor, the action manager and the
+ * session manager were initialized, before any other objects are created.
+ * Objects whose IDs are already taken are skipped. The image stays mapped
+ * until the session manager is deinitialized.
+ *
+ * @return 0 on success, -EALREADY if an image was restored before, -EINVAL if
+ *         the file is not a valid image, another negative error number
+ *         otherwise
+ */
+int
+ws_session_manager_restore(
+    char const* path //!< Path of the image
+)
+__ws_nonnull__(1);
 
 #endif // __WS_SESSION_MANAGER_H__
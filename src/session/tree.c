@@ -0,0 +1,455 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "session/tree.h"
+
+/**
+ * Number of levels below the root: sessions, workspaces and windows
+ */
+#define TREE_DEPTH 3
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Create a node
+ *
+ * @return The node, with a reference count of 1, or NULL on error
+ */
+static struct ws_session_node*
+node_new(
+    uint64_t id, //!< ID of the node
+    size_t num_children //!< Number of children
+);
+
+/**
+ * Take a reference to a node
+ *
+ * @return The node
+ */
+static struct ws_session_node*
+node_ref(
+    struct ws_session_node* node //!< The node
+);
+
+/**
+ * Release a reference to a node, destroying it if it was the last one
+ */
+static void
+node_unref(
+    struct ws_session_node* node //!< The node
+);
+
+/**
+ * Find the child of a node with a given ID
+ *
+ * @return Whether the node has such a child
+ */
+static bool
+node_find(
+    struct ws_session_node const* node, //!< The node
+    uint64_t id, //!< ID of the child
+    size_t* pos //!< Output: position of the child or where it would be
+);
+
+/**
+ * Create a copy of a subtree with a window added, changed or removed
+ *
+ * Only the nodes on the path to the window are copied, the copy shares all
+ * other nodes with the original.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+node_update(
+    struct ws_session_node* node, //!< Root of the subtree, NULL if none
+    uint64_t id, //!< ID of the root of the subtree
+    uint64_t const* path, //!< IDs of the nodes below, down to the window
+    size_t depth, //!< Number of IDs in `path`
+    struct ws_geometry const* geometry, //!< Geometry, NULL to remove
+    struct ws_session_node** result //!< Output: the copy, NULL if empty
+);
+
+/**
+ * Compare two versions of a subtree
+ */
+static void
+node_diff(
+    struct ws_session_node const* old, //!< The older version, may be NULL
+    struct ws_session_node const* new, //!< The newer version, may be NULL
+    size_t level, //!< Level of the subtree, 0 for the root
+    uint64_t* path, //!< IDs of the nodes above, TREE_DEPTH entries
+    ws_session_tree_diff_func func, //!< Called for each difference
+    void* data //!< Passed to `func`
+);
+
+/**
+ * Create a version of a tree
+ *
+ * Takes over the reference to the root.
+ *
+ * @return The version or NULL on error
+ */
+static struct ws_session_tree*
+tree_create(
+    uint64_t version, //!< The version
+    uint64_t focus, //!< ID of the focused window, 0 if none
+    struct ws_session_node* root //!< The root, may be NULL
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+struct ws_session_tree*
+ws_session_tree_new(void)
+{
+    return tree_create(0, 0, NULL);
+}
+
+struct ws_session_tree*
+ws_session_tree_ref(
+    struct ws_session_tree const* self
+) {
+    struct ws_session_tree* tree = (struct ws_session_tree*) self;
+    atomic_fetch_add_explicit(&tree->refs, 1, memory_order_relaxed);
+    return tree;
+}
+
+void
+ws_session_tree_unref(
+    struct ws_session_tree* self
+) {
+    if (atomic_fetch_sub_explicit(&self->refs, 1, memory_order_acq_rel) > 1) {
+        return;
+    }
+
+    if (self->root) {
+        node_unref(self->root);
+    }
+    free(self);
+}
+
+struct ws_session_tree*
+ws_session_tree_set_window(
+    struct ws_session_tree const* self,
+    uint64_t session,
+    uint32_t workspace,
+    uint64_t window,
+    struct ws_geometry const* geometry
+) {
+    uint64_t path[TREE_DEPTH] = { session, workspace, window };
+    struct ws_session_node* root;
+    if (node_update(self->root, 0, path, TREE_DEPTH, geometry, &root) < 0) {
+        return NULL;
+    }
+
+    struct ws_session_tree* tree = tree_create(self->version + 1, self->focus,
+                                               root);
+    if (!tree && root) {
+        node_unref(root);
+    }
+    return tree;
+}
+
+struct ws_session_tree*
+ws_session_tree_set_focus(
+    struct ws_session_tree const* self,
+    uint64_t focus
+) {
+    struct ws_session_node* root = self->root ? node_ref(self->root) : NULL;
+    struct ws_session_tree* tree = tree_create(self->version + 1, focus, root);
+    if (!tree && root) {
+        node_unref(root);
+    }
+    return tree;
+}
+
+struct ws_session_node const*
+ws_session_tree_find(
+    struct ws_session_tree const* self,
+    uint64_t session,
+    uint32_t workspace,
+    uint64_t window
+) {
+    uint64_t path[TREE_DEPTH] = { session, workspace, window };
+    struct ws_session_node const* node = self->root;
+    size_t level;
+    for (level = 0; node && (level < TREE_DEPTH); ++level) {
+        size_t pos;
+        node = node_find(node, path[level], &pos) ? node->children[pos] : NULL;
+    }
+    return node;
+}
+
+size_t
+ws_session_tree_count(
+    struct ws_session_tree const* self
+) {
+    if (!self->root) {
+        return 0;
+    }
+
+    size_t num = 0;
+    size_t i;
+    for (i = 0; i < self->root->num_children; ++i) {
+        struct ws_session_node const* session = self->root->children[i];
+        size_t k;
+        for (k = 0; k < session->num_children; ++k) {
+            num += session->children[k]->num_children;
+        }
+    }
+    return num;
+}
+
+void
+ws_session_tree_diff(
+    struct ws_session_tree const* old,
+    struct ws_session_tree const* new,
+    ws_session_tree_diff_func func,
+    void* data
+) {
+    uint64_t path[TREE_DEPTH] = { 0 };
+    node_diff(old->root, new->root, 0, path, func, data);
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static struct ws_session_node*
+node_new(
+    uint64_t id,
+    size_t num_children
+) {
+    struct ws_session_node* node;
+    node = malloc(sizeof(*node) + num_children * sizeof(*node->children));
+    if (!node) {
+        return NULL;
+    }
+
+    atomic_init(&node->refs, 1);
+    node->id = id;
+    node->geometry = (struct ws_geometry) { 0, 0, 0, 0 };
+    node->num_children = num_children;
+    return node;
+}
+
+static struct ws_session_node*
+node_ref(
+    struct ws_session_node* node
+) {
+    atomic_fetch_add_explicit(&node->refs, 1, memory_order_relaxed);
+    return node;
+}
+
+static void
+node_unref(
+    struct ws_session_node* node
+) {
+    if (atomic_fetch_sub_explicit(&node->refs, 1, memory_order_acq_rel) > 1) {
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < node->num_children; ++i) {
+        node_unref(node->children[i]);
+    }
+    free(node);
+}
+
+static bool
+node_find(
+    struct ws_session_node const* node,
+    uint64_t id,
+    size_t* pos
+) {
+    size_t low = 0;
+    size_t high = node->num_children;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (node->children[mid]->id < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    *pos = low;
+    return (low < node->num_children) && (node->children[low]->id == id);
+}
+
+static int
+node_update(
+    struct ws_session_node* node,
+    uint64_t id,
+    uint64_t const* path,
+    size_t depth,
+    struct ws_geometry const* geometry,
+    struct ws_session_node** result
+) {
+    if (!depth) {
+        // the window itself
+        *result = NULL;
+        if (geometry) {
+            *result = node_new(id, 0);
+            if (!*result) {
+                return -ENOMEM;
+            }
+            (*result)->geometry = *geometry;
+        }
+        return 0;
+    }
+
+    size_t num = node ? node->num_children : 0;
+    size_t pos = 0;
+    bool found = node && node_find(node, path[0], &pos);
+
+    struct ws_session_node* child;
+    int res = node_update(found ? node->children[pos] : NULL, path[0],
+                          path + 1, depth - 1, geometry, &child);
+    if (res < 0) {
+        return res;
+    }
+    if (!found && !child) {
+        // removing what is not there changes nothing
+        *result = node ? node_ref(node) : NULL;
+        return 0;
+    }
+
+    // empty sessions and workspaces are dropped
+    size_t copy_num = num + (found ? 0 : 1) - (child ? 0 : 1);
+    if (!copy_num) {
+        *result = NULL;
+        return 0;
+    }
+
+    struct ws_session_node* copy = node_new(id, copy_num);
+    if (!copy) {
+        if (child) {
+            node_unref(child);
+        }
+        return -ENOMEM;
+    }
+
+    size_t k = 0;
+    size_t i;
+    for (i = 0; i < pos; ++i) {
+        copy->children[k++] = node_ref(node->children[i]);
+    }
+    if (child) {
+        copy->children[k++] = child;
+    }
+    for (i = pos + (found ? 1 : 0); i < num; ++i) {
+        copy->children[k++] = node_ref(node->children[i]);
+    }
+
+    *result = copy;
+    return 0;
+}
+
+static void
+node_diff(
+    struct ws_session_node const* old,
+    struct ws_session_node const* new,
+    size_t level,
+    uint64_t* path,
+    ws_session_tree_diff_func func,
+    void* data
+) {
+    // shared subtrees are the same, no need to look into them
+    if (old == new) {
+        return;
+    }
+    if (level) {
+        path[level - 1] = old ? old->id : new->id;
+    }
+
+    if (level == TREE_DEPTH) {
+        if (old && new &&
+                (old->geometry.x == new->geometry.x) &&
+                (old->geometry.y == new->geometry.y) &&
+                (old->geometry.width == new->geometry.width) &&
+                (old->geometry.height == new->geometry.height)) {
+            return;
+        }
+        func(path[0], (uint32_t) path[1], old, new, data);
+        return;
+    }
+
+    // both lists of children are sorted by ID
+    size_t num_old = old ? old->num_children : 0;
+    size_t num_new = new ? new->num_children : 0;
+    size_t i = 0;
+    size_t k = 0;
+    while ((i < num_old) || (k < num_new)) {
+        struct ws_session_node const* a = (i < num_old) ? old->children[i]
+                                                        : NULL;
+        struct ws_session_node const* b = (k < num_new) ? new->children[k]
+                                                        : NULL;
+        if (a && b && (a->id != b->id)) {
+            if (a->id < b->id) {
+                b = NULL;
+            } else {
+                a = NULL;
+            }
+        }
+
+        node_diff(a, b, level + 1, path, func, data);
+        i += a ? 1 : 0;
+        k += b ? 1 : 0;
+    }
+}
+
+static struct ws_session_tree*
+tree_create(
+    uint64_t version,
+    uint64_t focus,
+    struct ws_session_node* root
+) {
+    struct ws_session_tree* tree = malloc(sizeof(*tree));
+    if (!tree) {
+        return NULL;
+    }
+
+    atomic_init(&tree->refs, 1);
+    tree->version = version;
+    tree->focus = focus;
+    tree->root = root;
+    return tree;
+}
@@ -0,0 +1,193 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_SESSION_TREE_H__
+#define __WS_SESSION_TREE_H__
+
+/**
+ * @file tree.h
+ *
+ * @brief Persistent tree of sessions, workspaces and windows
+ *
+ * The tree holds the windows grouped by session and workspace: the children
+ * of the root are the sessions, the children of a session its workspaces and
+ * the children of a workspace its windows. Windows not assigned to a session
+ * are held by session 0. Sessions and workspaces without windows are not part
+ * of the tree.
+ *
+ * Trees are immutable. A change creates a new version of the tree, which
+ * copies the nodes on the path from the root to the window changed and shares
+ * all other nodes with the previous version. A change thus costs a few small
+ * allocations, no matter how many windows there are. Nodes and versions are
+ * reference counted with atomic counters, so versions may be held and
+ * released by any thread.
+ *
+ * Since unchanged subtrees are shared, two versions are compared by walking
+ * them side by side and skipping subtrees which are the same node in both,
+ * see ws_session_tree_diff().
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compositor/region.h"
+#include "util/attributes.h"
+#include "util/epoch.h"
+
+/**
+ * Node of a tree
+ */
+struct ws_session_node {
+    _Atomic size_t refs; //!< Reference count
+    uint64_t id; //!< ID of the session, workspace number or ID of the window
+    struct ws_geometry geometry; //!< Geometry, for windows only
+    size_t num_children; //!< Number of children
+    struct ws_session_node* children[]; //!< Children, sorted by ID
+};
+
+/**
+ * Version of a tree
+ */
+struct ws_session_tree {
+    struct ws_epoch_node retire; //!< Node for retiring the version
+    _Atomic size_t refs; //!< Reference count
+    uint64_t version; //!< Incremented with each change
+    uint64_t focus; //!< ID of the focused window, 0 if none
+    struct ws_session_node* root; //!< The root, NULL if there are no windows
+};
+
+/**
+ * Function called for each window which differs between two versions
+ *
+ * A window which was moved to another session or workspace is reported as
+ * removed from the old and added to the new one.
+ */
+typedef void (*ws_session_tree_diff_func)(
+    uint64_t session, //!< ID of the session of the window
+    uint32_t workspace, //!< Workspace of the window
+    struct ws_session_node const* old, //!< The window before, NULL if added
+    struct ws_session_node const* new, //!< The window after, NULL if removed
+    void* data //!< Data passed to ws_session_tree_diff()
+);
+
+/**
+ * Create an empty tree
+ *
+ * @return The tree, with a reference count of 1, or NULL on error
+ */
+struct ws_session_tree*
+ws_session_tree_new(void);
+
+/**
+ * Take a reference to a tree
+ *
+ * @return The tree
+ */
+struct ws_session_tree*
+ws_session_tree_ref(
+    struct ws_session_tree const* self //!< The tree
+)
+__ws_nonnull__(1);
+
+/**
+ * Release a reference to a tree, destroying it if it was the last one
+ */
+void
+ws_session_tree_unref(
+    struct ws_session_tree* self //!< The tree
+)
+__ws_nonnull__(1);
+
+/**
+ * Create a version with a window added, changed or removed
+ *
+ * @return The new version, with a reference count of 1, or NULL on error
+ */
+struct ws_session_tree*
+ws_session_tree_set_window(
+    struct ws_session_tree const* self, //!< The tree to change
+    uint64_t session, //!< ID of the session of the window, 0 for none
+    uint32_t workspace, //!< Workspace of the window
+    uint64_t window, //!< ID of the window
+    struct ws_geometry const* geometry //!< Geometry, NULL to remove
+)
+__ws_nonnull__(1);
+
+/**
+ * Create a version with another focused window
+ *
+ * @return The new version, with a reference count of 1, or NULL on error
+ */
+struct ws_session_tree*
+ws_session_tree_set_focus(
+    struct ws_session_tree const* self, //!< The tree to change
+    uint64_t focus //!< ID of the focused window, 0 for none
+)
+__ws_nonnull__(1);
+
+/**
+ * Find a window
+ *
+ * @return The window or NULL if it is not in the tree at the place given
+ */
+struct ws_session_node const*
+ws_session_tree_find(
+    struct ws_session_tree const* self, //!< The tree
+    uint64_t session, //!< ID of the session of the window, 0 for none
+    uint32_t workspace, //!< Workspace of the window
+    uint64_t window //!< ID of the window
+)
+__ws_nonnull__(1);
+
+/**
+ * Count the windows in a tree
+ *
+ * @return The number of windows
+ */
+size_t
+ws_session_tree_count(
+    struct ws_session_tree const* self //!< The tree
+)
+__ws_nonnull__(1);
+
+/**
+ * Compare two versions of a tree
+ *
+ * Calls `func` for each window which is only in one of the versions or whose
+ * geometry differs, in order of session, workspace and window.
+ */
+void
+ws_session_tree_diff(
+    struct ws_session_tree const* old, //!< The older version
+    struct ws_session_tree const* new, //!< The newer version
+    ws_session_tree_diff_func func, //!< Called for each difference
+    void* data //!< Passed to `func`
+)
+__ws_nonnull__(1, 2, 3);
+
+#endif // __WS_SESSION_TREE_H__
@@ -25,5 +25,1475 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "command/processor.h"
+#include "logger/module.h"
 #include "storage/module.h"
+#include "util/arena.h"
+#include "util/arithmetical.h"
+#include "util/clock.h"
+#include "util/crc32.h"
+#include "values/value.h"
+
+/**
+ * Magic number at the start of the file
+ */
+#define STORAGE_MAGIC "WSSTORE1"
+
+/**
+ * Version of the file format
+ */
+#define STORAGE_VERSION 1
+
+/**
+ * Alignment of records in the file
+ */
+#define STORAGE_ALIGN 8
+
+/**
+ * Minimum length of the mapping of the file
+ */
+#define STORAGE_MAP_MIN (1024 * 1024)
+
+/**
+ * Maximum length of keys and values
+ */
+#define STORAGE_MAX_LEN (16 * 1024 * 1024)
+
+/**
+ * Suffix of the file written by a compaction
+ */
+#define STORAGE_COMPACT_SUFFIX ".compact"
+
+/**
+ * Types of script values stored by the commands, the first byte of the value
+ */
+enum stored_type {
+    STORED_NIL = 'n', //!< Nil, no payload
+    STORED_BOOL = 'b', //!< Boolean, one byte
+    STORED_INT = 'i', //!< Integer, 8 bytes in native byte order
+    STORED_STRING = 's', //!< String, the bytes of the string
+};
+
+/**
+ * Types of records
+ */
+enum record_type {
+    RECORD_PUT = 1, //!< The key has a value
+    RECORD_DELETE, //!< The key was deleted
+};
+
+/**
+ * Header of the file
+ */
+struct file_header {
+    char magic[8]; //!< STORAGE_MAGIC
+    uint32_t version; //!< STORAGE_VERSION
+    uint32_t crc; //!< Checksum of the header, computed with `crc` being 0
+    uint64_t index_offset; //!< Offset of the index of the compacted segment
+    uint64_t index_count; //!< Number of keys in the compacted segment
+    uint64_t log_offset; //!< Offset of the log
+    uint64_t reserved[3]; //!< Reserved, 0
+};
+
+/**
+ * Header of a record
+ *
+ * The header is followed by the key and the value, padded to STORAGE_ALIGN.
+ */
+struct record_header {
+    uint32_t crc; //!< Checksum of the rest of the header, the key and value
+    uint32_t key_len; //!< Length of the key
+    uint32_t value_len; //!< Length of the value
+    uint32_t type; //!< An `enum record_type`
+};
+
+/**
+ * Internal state of the storage
+ */
+static struct {
+    int fd; //!< The file, -1 if the storage is not open
+    char* path; //!< Path of the file
+    uint8_t* map; //!< Mapping of the file
+    size_t map_len; //!< Length of the mapping, may exceed the file
+    uint64_t size; //!< Size of the file, i.e. the end of the log
+    uint64_t index_offset; //!< Offset of the index of the compacted segment
+    size_t index_count; //!< Number of keys in the compacted segment
+    uint64_t log_offset; //!< Offset of the log
+    struct {
+        uint64_t* offsets; //!< Latest record of each key, sorted by key
+        size_t len; //!< Number of keys
+        size_t cap; //!< Capacity of `offsets`
+        size_t records; //!< Number of records in the log
+    } log; //!< Index of the log
+    struct wl_event_source* timer; //!< Timer for periodic compaction
+    uint64_t compactions; //!< Number of compactions
+    uint64_t torn_bytes; //!< Bytes cut off the log at startup
+} storage = {
+    .fd = -1,
+};
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Compute the checksum of a record
+ *
+ * @return The checksum
+ */
+static uint32_t
+record_crc(
+    struct record_header const* header, //!< The header
+    char const* key, //!< The key
+    void const* value //!< The value
+);
+
+/**
+ * Get the size of a record in the file, including the padding
+ *
+ * @return The size of the record
+ */
+static uint64_t
+record_size(
+    uint64_t key_len, //!< Length of the key
+    uint64_t value_len //!< Length of the value
+);
+
+/**
+ * Get the record at an offset of the file
+ *
+ * @return The header of the record
+ */
+static struct record_header const*
+record_at(
+    uint64_t offset //!< Offset of the record
+);
+
+/**
+ * Compare two keys
+ *
+ * @return A value less than, equal to or greater than 0 if `a` is less than,
+ *         equal to or greater than `b`
+ */
+static int
+key_cmp(
+    char const* a, //!< The first key
+    size_t a_len, //!< Length of the first key
+    char const* b, //!< The second key
+    size_t b_len //!< Length of the second key
+);
+
+/**
+ * Compare the key of a record with a key
+ *
+ * @return A value less than, equal to or greater than 0 if the key of the
+ *         record is less than, equal to or greater than `key`
+ */
+static int
+record_cmp(
+    struct record_header const* record, //!< The record
+    char const* key, //!< The key
+    size_t key_len //!< Length of the key
+);
+
+/**
+ * Find a key in a sorted array of record offsets
+ *
+ * @return Whether the key was found
+ */
+static bool
+index_find(
+    uint64_t const* offsets, //!< The offsets, sorted by key
+    size_t num, //!< Number of offsets
+    char const* key, //!< The key
+    size_t key_len, //!< Length of the key
+    size_t* pos //!< Output: position of the key or where it would be
+);
+
+/**
+ * Get the record at a cursor and advance it
+ *
+ * Deleted keys are skipped.
+ *
+ * @return The record or NULL at the end of the storage
+ */
+static struct record_header const*
+cursor_next_record(
+    struct ws_storage_cursor* cursor //!< The cursor
+);
+
+/**
+ * Get the key argument of a storage command
+ *
+ * @return 0 on success, -EINVAL if the argument is not a valid key
+ */
+static int
+command_get_key(
+    struct ws_value const* arg, //!< The argument
+    char const** key, //!< Output: the key
+    size_t* key_len //!< Output: length of the key
+);
+
+/**
+ * Command looking up a key
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_get(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command storing a value
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_put(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command deleting a key
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_delete(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Command listing the keys with a prefix
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+command_scan(
+    struct ws_command_ctx* ctx, //!< The execution context
+    struct ws_value* args, //!< The arguments
+    size_t argc, //!< Number of arguments
+    struct ws_value* result //!< Output: result of the command
+);
+
+/**
+ * Commands of the storage
+ */
+static struct ws_command const storage_commands[] = {
+    { .name = "storage_get", .func = command_get },
+    { .name = "storage_put", .func = command_put },
+    { .name = "storage_delete", .func = command_delete },
+    { .name = "storage_scan", .func = command_scan },
+};
+
+/**
+ * Check a record found in the file
+ *
+ * @return Whether the record is intact and fits into `avail` bytes
+ */
+static bool
+record_valid(
+    struct record_header const* record, //!< The record
+    uint64_t avail //!< Number of bytes from the record to the end of its area
+);
+
+/**
+ * Get the index of the compacted segment
+ *
+ * @return The offsets of the records, sorted by key
+ */
+static uint64_t const*
+compacted_index(void);
+
+/**
+ * Check the index and the records of the compacted segment
+ *
+ * The compacted segment is read without further checks, so a truncated or
+ * corrupted segment is rejected when the file is opened.
+ *
+ * @return Whether the compacted segment is valid
+ */
+static bool
+compacted_valid(void);
+
+/**
+ * Find the latest record of a key
+ *
+ * @return The record or NULL if the key is not stored
+ */
+static struct record_header const*
+find_record(
+    char const* key, //!< The key
+    size_t key_len //!< Length of the key
+);
+
+/**
+ * Make sure the mapping covers the whole file
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+map_file(void);
+
+/**
+ * Open and map a storage file, scanning its log
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+open_file(void);
+
+/**
+ * Close the file and release the mapping and the index of the log
+ */
+static void
+close_file(void);
+
+/**
+ * Write a header to a file
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+write_header(
+    int fd, //!< The file
+    uint64_t index_offset, //!< Offset of the index of the compacted segment
+    uint64_t index_count, //!< Number of keys in the compacted segment
+    uint64_t log_offset //!< Offset of the log
+);
+
+/**
+ * Scan the log, building its index and cutting off torn records
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+scan_log(void);
+
+/**
+ * Add a record of the log to the index of the log
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+log_insert(
+    uint64_t offset //!< Offset of the record
+);
+
+/**
+ * Append a record to the log
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+append(
+    enum record_type type, //!< Type of the record
+    char const* key, //!< The key
+    size_t key_len, //!< Length of the key
+    void const* value, //!< The value
+    size_t value_len //!< Length of the value
+);
+
+/**
+ * Write the live records into a new file
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+write_compacted(
+    char const* path //!< Path of the new file
+);
+
+/**
+ * Sync the directory holding a file, making a rename durable
+ */
+static void
+sync_dir(
+    char const* path //!< Path of the file
+);
+
+/**
+ * Timer callback compacting the log
+ *
+ * @return 0
+ */
+static int
+compact_timer(
+    void* data //!< Unused
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+int
+ws_storage_init(
+    struct wl_event_loop* loop,
+    char const* path
+) {
+    if (storage.fd >= 0) {
+        return -EALREADY;
+    }
+
+    storage.path = strdup(path);
+    if (!storage.path) {
+        return -ENOMEM;
+    }
+    storage.compactions = 0;
+    storage.torn_bytes = 0;
+
+    int res = open_file();
+    if (res < 0) {
+        free(storage.path);
+        storage.path = NULL;
+        return res;
+    }
+
+    storage.timer = NULL;
+    if (loop) {
+        storage.timer = wl_event_loop_add_timer(loop, compact_timer, NULL);
+        if (storage.timer) {
+            wl_event_source_timer_update(storage.timer,
+                                         WS_STORAGE_COMPACT_INTERVAL);
+        }
+    }
+    return 0;
+}
+
+int
+ws_storage_register_commands(void)
+{
+    size_t i;
+    for (i = 0; i < sizeof(storage_commands) / sizeof(*storage_commands);
+         ++i) {
+        int res = ws_command_register(storage_commands + i);
+        if (res < 0) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+void
+ws_storage_deinit(void)
+{
+    if (storage.timer) {
+        wl_event_source_remove(storage.timer);
+        storage.timer = NULL;
+    }
+
+    // the file may already be closed if reopening it after a compaction
+    // failed
+    if (storage.fd >= 0) {
+        fdatasync(storage.fd);
+        close_file();
+    }
+    free(storage.path);
+    storage.path = NULL;
+}
+
+int
+ws_storage_get(
+    char const* key,
+    size_t key_len,
+    void const** value,
+    size_t* value_len
+) {
+    if (storage.fd < 0) {
+        return -ENODEV;
+    }
+
+    struct record_header const* record = find_record(key, key_len);
+    if (!record || (record->type != RECORD_PUT)) {
+        return -ENOENT;
+    }
+
+    *value = (char const*) (record + 1) + record->key_len;
+    *value_len = record->value_len;
+    return 0;
+}
+
+int
+ws_storage_put(
+    char const* key,
+    size_t key_len,
+    void const* value,
+    size_t value_len
+) {
+    if (storage.fd < 0) {
+        return -ENODEV;
+    }
+    if (!key_len || (key_len > STORAGE_MAX_LEN) ||
+            (value_len > STORAGE_MAX_LEN) || (!value && value_len)) {
+        return -EINVAL;
+    }
+
+    int res = append(RECORD_PUT, key, key_len, value, value_len);
+    if (res < 0) {
+        return res;
+    }
+
+    if (storage.log.records >= WS_STORAGE_COMPACT_RECORDS) {
+        // a failed compaction leaves the storage intact, retry next time
+        ws_storage_compact();
+    }
+    return 0;
+}
+
+int
+ws_storage_delete(
+    char const* key,
+    size_t key_len
+) {
+    if (storage.fd < 0) {
+        return -ENODEV;
+    }
+
+    struct record_header const* record = find_record(key, key_len);
+    if (!record || (record->type != RECORD_PUT)) {
+        return -ENOENT;
+    }
+    return append(RECORD_DELETE, key, key_len, NULL, 0);
+}
+
+void
+ws_storage_cursor_seek(
+    struct ws_storage_cursor* cursor,
+    char const* key,
+    size_t key_len
+) {
+    cursor->compacted = 0;
+    cursor->log = 0;
+    if (storage.fd < 0) {
+        return;
+    }
+
+    index_find(compacted_index(), storage.index_count, key, key_len,
+               &cursor->compacted);
+    index_find(storage.log.offsets, storage.log.len, key, key_len,
+               &cursor->log);
+}
+
+int
+ws_storage_cursor_next(
+    struct ws_storage_cursor* cursor,
+    char const** key,
+    size_t* key_len,
+    void const** value,
+    size_t* value_len
+) {
+    if (storage.fd < 0) {
+        return -ENODEV;
+    }
+
+    struct record_header const* record = cursor_next_record(cursor);
+    if (!record) {
+        return 0;
+    }
+
+    *key = (char const*) (record + 1);
+    *key_len = record->key_len;
+    *value = *key + record->key_len;
+    *value_len = record->value_len;
+    return 1;
+}
+
+int
+ws_storage_compact(void)
+{
+    if (storage.fd < 0) {
+        return -ENODEV;
+    }
+
+    uint64_t start = ws_clock_now();
+
+    size_t path_len = strlen(storage.path);
+    char* tmp = malloc(path_len + sizeof(STORAGE_COMPACT_SUFFIX));
+    if (!tmp) {
+        return -ENOMEM;
+    }
+    memcpy(tmp, storage.path, path_len);
+    memcpy(tmp + path_len, STORAGE_COMPACT_SUFFIX,
+           sizeof(STORAGE_COMPACT_SUFFIX));
+
+    int res = write_compacted(tmp);
+    if (res < 0) {
+        unlink(tmp);
+        free(tmp);
+        WS_LOG(WS_LOG_MODULE_STORAGE, WS_LOG_ERROR, "compaction failed: %s",
+               strerror(-res));
+        return res;
+    }
+
+    if (rename(tmp, storage.path) < 0) {
+        res = -errno;
+        unlink(tmp);
+        free(tmp);
+        return res;
+    }
+    free(tmp);
+    sync_dir(storage.path);
+
+    // the old file is gone, the data now lives in the new one
+    close_file();
+    res = open_file();
+    if (res < 0) {
+        WS_LOG(WS_LOG_MODULE_STORAGE, WS_LOG_ERROR,
+               "could not reopen %s after compaction: %s", storage.path,
+               strerror(-res));
+        ws_storage_deinit();
+        return res;
+    }
+
+    ++storage.compactions;
+    WS_LOG(WS_LOG_MODULE_STORAGE, WS_LOG_INFO,
+           "compacted %zu keys into %llu bytes in %llums",
+           storage.index_count, (unsigned long long) storage.size,
+           (unsigned long long) ((ws_clock_now() - start) /
+                                 WS_CLOCK_NS_PER_MS));
+    return 0;
+}
+
+int
+ws_storage_sync(void)
+{
+    if (storage.fd < 0) {
+        return -ENODEV;
+    }
+    return (fdatasync(storage.fd) < 0) ? -errno : 0;
+}
+
+void
+ws_storage_get_stats(
+    struct ws_storage_stats* stats
+) {
+    stats->compacted_keys = storage.index_count;
+    stats->log_records = storage.log.records;
+    stats->log_keys = storage.log.len;
+    stats->file_size = storage.size;
+    stats->compactions = storage.compactions;
+    stats->torn_bytes = storage.torn_bytes;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static uint32_t
+record_crc(
+    struct record_header const* header,
+    char const* key,
+    void const* value
+) {
+    uint32_t crc = ws_crc32(0, &header->key_len,
+                            sizeof(*header) - sizeof(header->crc));
+    crc = ws_crc32(crc, key, header->key_len);
+    return ws_crc32(crc, value, header->value_len);
+}
+
+static uint64_t
+record_size(
+    uint64_t key_len,
+    uint64_t value_len
+) {
+    return WS_ALIGN_UP(sizeof(struct record_header) + key_len + value_len,
+                       STORAGE_ALIGN);
+}
+
+static struct record_header const*
+record_at(
+    uint64_t offset
+) {
+    return (struct record_header const*) (storage.map + offset);
+}
+
+static int
+key_cmp(
+    char const* a,
+    size_t a_len,
+    char const* b,
+    size_t b_len
+) {
+    int res = memcmp(a, b, WS_MIN(a_len, b_len));
+    if (res) {
+        return res;
+    }
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+static int
+record_cmp(
+    struct record_header const* record,
+    char const* key,
+    size_t key_len
+) {
+    return key_cmp((char const*) (record + 1), record->key_len, key, key_len);
+}
+
+static bool
+index_find(
+    uint64_t const* offsets,
+    size_t num,
+    char const* key,
+    size_t key_len,
+    size_t* pos
+) {
+    size_t low = 0;
+    size_t high = num;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (record_cmp(record_at(offsets[mid]), key, key_len) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    *pos = low;
+    return (low < num) &&
+           (record_cmp(record_at(offsets[low]), key, key_len) == 0);
+}
+
+static struct record_header const*
+cursor_next_record(
+    struct ws_storage_cursor* cursor
+) {
+    uint64_t const* compacted = compacted_index();
+
+    // merge both indices, the log shadowing the compacted segment
+    for (;;) {
+        bool in_compacted = cursor->compacted < storage.index_count;
+        bool in_log = cursor->log < storage.log.len;
+
+        struct record_header const* record;
+        if (!in_compacted && !in_log) {
+            return NULL;
+        } else if (!in_log) {
+            record = record_at(compacted[cursor->compacted++]);
+        } else if (!in_compacted) {
+            record = record_at(storage.log.offsets[cursor->log++]);
+        } else {
+            struct record_header const* from_log;
+            from_log = record_at(storage.log.offsets[cursor->log]);
+            int cmp = record_cmp(record_at(compacted[cursor->compacted]),
+                                 (char const*) (from_log + 1),
+                                 from_log->key_len);
+            if (cmp < 0) {
+                record = record_at(compacted[cursor->compacted++]);
+            } else {
+                cursor->compacted += (cmp == 0);
+                record = from_log;
+                ++cursor->log;
+            }
+        }
+
+        if (record->type == RECORD_PUT) {
+            return record;
+        }
+    }
+}
+
+static bool
+record_valid(
+    struct record_header const* record,
+    uint64_t avail
+) {
+    if ((avail < sizeof(*record)) || (record->key_len == 0) ||
+            (record->key_len > STORAGE_MAX_LEN) ||
+            (record->value_len > STORAGE_MAX_LEN) ||
+            ((record->type != RECORD_PUT) &&
+             (record->type != RECORD_DELETE)) ||
+            (record_size(record->key_len, record->value_len) > avail)) {
+        return false;
+    }
+
+    char const* key = (char const*) (record + 1);
+    return record->crc == record_crc(record, key, key + record->key_len);
+}
+
+static uint64_t const*
+compacted_index(void)
+{
+    return (uint64_t const*) (storage.map + storage.index_offset);
+}
+
+static bool
+compacted_valid(void)
+{
+    uint64_t const* offsets = compacted_index();
+    struct record_header const* prev = NULL;
+    size_t i;
+    for (i = 0; i < storage.index_count; ++i) {
+        // records of the compacted segment lie in front of its index
+        uint64_t offset = offsets[i];
+        if ((offset < sizeof(struct file_header)) ||
+                (offset % STORAGE_ALIGN) ||
+                (offset > storage.index_offset)) {
+            return false;
+        }
+
+        struct record_header const* record = record_at(offset);
+        if (!record_valid(record, storage.index_offset - offset)) {
+            return false;
+        }
+
+        // lookups rely on the keys being sorted
+        if (prev && (record_cmp(prev, (char const*) (record + 1),
+                                record->key_len) >= 0)) {
+            return false;
+        }
+        prev = record;
+    }
+    return true;
+}
+
+static struct record_header const*
+find_record(
+    char const* key,
+    size_t key_len
+) {
+    // the log shadows the compacted segment
+    size_t pos;
+    if (index_find(storage.log.offsets, storage.log.len, key, key_len, &pos)) {
+        return record_at(storage.log.offsets[pos]);
+    }
+    if (index_find(compacted_index(), storage.index_count, key, key_len,
+                   &pos)) {
+        return record_at(compacted_index()[pos]);
+    }
+    return NULL;
+}
+
+static int
+map_file(void)
+{
+    if (storage.map && (storage.size <= storage.map_len)) {
+        return 0;
+    }
+
+    // map generously, so appends rarely need a new mapping
+    size_t len = STORAGE_MAP_MIN;
+    while (len < storage.size * 2) {
+        len *= 2;
+    }
+
+    void* map = mmap(NULL, len, PROT_READ, MAP_SHARED, storage.fd, 0);
+    if (map == MAP_FAILED) {
+        return -errno;
+    }
+
+    if (storage.map) {
+        munmap(storage.map, storage.map_len);
+    }
+    storage.map = map;
+    storage.map_len = len;
+    return 0;
+}
+
+static int
+open_file(void)
+{
+    int res;
+
+    storage.fd = open(storage.path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (storage.fd < 0) {
+        return -errno;
+    }
+    storage.map = NULL;
+    storage.map_len = 0;
+    memset(&storage.log, 0, sizeof(storage.log));
+
+    struct stat st;
+    if (fstat(storage.fd, &st) < 0) {
+        res = -errno;
+        goto cleanup;
+    }
+
+    if (st.st_size == 0) {
+        // a new, empty storage
+        uint64_t log_offset = sizeof(struct file_header);
+        res = write_header(storage.fd, log_offset, 0, log_offset);
+        if (res < 0) {
+            goto cleanup;
+        }
+        st.st_size = (off_t) log_offset;
+    }
+    storage.size = (uint64_t) st.st_size;
+
+    if (storage.size < sizeof(struct file_header)) {
+        res = -EINVAL;
+        goto cleanup;
+    }
+
+    res = map_file();
+    if (res < 0) {
+        goto cleanup;
+    }
+
+    struct file_header header;
+    memcpy(&header, storage.map, sizeof(header));
+    uint32_t crc = header.crc;
+    header.crc = 0;
+    if ((memcmp(header.magic, STORAGE_MAGIC, sizeof(header.magic)) != 0) ||
+            (header.version != STORAGE_VERSION) ||
+            (crc != ws_crc32(0, &header, sizeof(header))) ||
+            (header.index_offset < sizeof(header)) ||
+            (header.index_offset % STORAGE_ALIGN) ||
+            (header.index_offset > storage.size) ||
+            (header.index_count > (storage.size - header.index_offset) /
+                                  sizeof(uint64_t)) ||
+            (header.log_offset != header.index_offset +
+                                  header.index_count * sizeof(uint64_t))) {
+        res = -EINVAL;
+        goto cleanup;
+    }
+    storage.index_offset = header.index_offset;
+    storage.index_count = (size_t) header.index_count;
+    storage.log_offset = header.log_offset;
+    if (!compacted_valid()) {
+        res = -EINVAL;
+        goto cleanup;
+    }
+
+    res = scan_log();
+    if (res < 0) {
+        goto cleanup;
+    }
+    return 0;
+
+cleanup:
+    close_file();
+    return res;
+}
+
+static void
+close_file(void)
+{
+    if (storage.map) {
+        munmap(storage.map, storage.map_len);
+        storage.map = NULL;
+        storage.map_len = 0;
+    }
+    if (storage.fd >= 0) {
+        close(storage.fd);
+        storage.fd = -1;
+    }
+    free(storage.log.offsets);
+    memset(&storage.log, 0, sizeof(storage.log));
+}
+
+static int
+write_header(
+    int fd,
+    uint64_t index_offset,
+    uint64_t index_count,
+    uint64_t log_offset
+) {
+    struct file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STORAGE_MAGIC, sizeof(header.magic));
+    header.version = STORAGE_VERSION;
+    header.index_offset = index_offset;
+    header.index_count = index_count;
+    header.log_offset = log_offset;
+    header.crc = ws_crc32(0, &header, sizeof(header));
+
+    ssize_t written = pwrite(fd, &header, sizeof(header), 0);
+    if (written < 0) {
+        return -errno;
+    }
+    return ((size_t) written == sizeof(header)) ? 0 : -EIO;
+}
+
+static int
+scan_log(void)
+{
+    uint64_t offset = storage.log_offset;
+    while (storage.size - offset >= sizeof(struct record_header)) {
+        struct record_header const* record = record_at(offset);
+        if (!record_valid(record, storage.size - offset)) {
+            break;
+        }
+
+        int res = log_insert(offset);
+        if (res < 0) {
+            return res;
+        }
+        ++storage.log.records;
+        offset += record_size(record->key_len, record->value_len);
+    }
+
+    if (offset < storage.size) {
+        // a record torn by a crash, everything after it is garbage
+        storage.torn_bytes += storage.size - offset;
+        WS_LOG(WS_LOG_MODULE_STORAGE, WS_LOG_WARNING,
+               "cutting %llu bytes of torn records off %s",
+               (unsigned long long) (storage.size - offset), storage.path);
+        if (ftruncate(storage.fd, (off_t) offset) < 0) {
+            return -errno;
+        }
+        storage.size = offset;
+    }
+    return 0;
+}
+
+static int
+log_insert(
+    uint64_t offset
+) {
+    struct record_header const* record = record_at(offset);
+    char const* key = (char const*) (record + 1);
+
+    size_t pos;
+    if (index_find(storage.log.offsets, storage.log.len, key, record->key_len,
+                   &pos)) {
+        storage.log.offsets[pos] = offset;
+        return 0;
+    }
+
+    if (storage.log.len == storage.log.cap) {
+        size_t cap = storage.log.cap ? storage.log.cap * 2 : 64;
+        uint64_t* offsets = realloc(storage.log.offsets,
+                                    cap * sizeof(*offsets));
+        if (!offsets) {
+            return -ENOMEM;
+        }
+        storage.log.offsets = offsets;
+        storage.log.cap = cap;
+    }
+
+    memmove(storage.log.offsets + pos + 1, storage.log.offsets + pos,
+            (storage.log.len - pos) * sizeof(*storage.log.offsets));
+    storage.log.offsets[pos] = offset;
+    ++storage.log.len;
+    return 0;
+}
+
+static int
+append(
+    enum record_type type,
+    char const* key,
+    size_t key_len,
+    void const* value,
+    size_t value_len
+) {
+    uint64_t size = record_size(key_len, value_len);
+    uint8_t* buf = calloc(1, size);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    struct record_header* header = (struct record_header*) buf;
+    header->key_len = (uint32_t) key_len;
+    header->value_len = (uint32_t) value_len;
+    header->type = type;
+    memcpy(buf + sizeof(*header), key, key_len);
+    if (value_len) {
+        memcpy(buf + sizeof(*header) + key_len, value, value_len);
+    }
+    header->crc = record_crc(header, key, buf + sizeof(*header) + key_len);
+
+    uint64_t offset = storage.size;
+    ssize_t written = pwrite(storage.fd, buf, size, (off_t) offset);
+    int res = (written < 0) ? -errno : 0;
+    free(buf);
+    if ((res == 0) && ((uint64_t) written != size)) {
+        res = -EIO;
+    }
+    if (res < 0) {
+        // do not leave a partial record behind
+        if (ftruncate(storage.fd, (off_t) offset) < 0) {
+            WS_LOG(WS_LOG_MODULE_STORAGE, WS_LOG_ERROR,
+                   "could not remove a partial record from %s", storage.path);
+        }
+        return res;
+    }
+
+    storage.size += size;
+    res = map_file();
+    if (res < 0) {
+        return res;
+    }
+
+    res = log_insert(offset);
+    if (res < 0) {
+        return res;
+    }
+    ++storage.log.records;
+    return 0;
+}
+
+static int
+write_compacted(
+    char const* path
+) {
+    int res;
+
+    size_t cap = storage.index_count + storage.log.len;
+    uint64_t* offsets = malloc((cap ? cap : 1) * sizeof(*offsets));
+    if (!offsets) {
+        return -ENOMEM;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        res = -errno;
+        goto cleanup_offsets;
+    }
+
+    uint64_t pos = sizeof(struct file_header);
+    if (fseek(file, (long) pos, SEEK_SET) < 0) {
+        res = -errno;
+        goto cleanup_file;
+    }
+
+    struct ws_storage_cursor cursor = { 0, 0 };
+    struct record_header const* record;
+    size_t num = 0;
+    while ((record = cursor_next_record(&cursor))) {
+        uint64_t size = record_size(record->key_len, record->value_len);
+        if (fwrite(record, 1, size, file) != size) {
+            res = -EIO;
+            goto cleanup_file;
+        }
+        offsets[num++] = pos;
+        pos += size;
+    }
+
+    if (fwrite(offsets, sizeof(*offsets), num, file) != num) {
+        res = -EIO;
+        goto cleanup_file;
+    }
+    if (fflush(file) != 0) {
+        res = -errno;
+        goto cleanup_file;
+    }
+
+    res = write_header(fileno(file), pos, num, pos + num * sizeof(*offsets));
+    if (res < 0) {
+        goto cleanup_file;
+    }
+    if (fsync(fileno(file)) < 0) {
+        res = -errno;
+        goto cleanup_file;
+    }
+
+cleanup_file:
+    if ((fclose(file) != 0) && (res == 0)) {
+        res = -errno;
+    }
+
+cleanup_offsets:
+    free(offsets);
+    return res;
+}
+
+static void
+sync_dir(
+    char const* path
+) {
+    char const* slash = strrchr(path, '/');
+    char* dir = slash ? strndup(path, (size_t) (slash - path) + 1)
+                      : strdup(".");
+    if (!dir) {
+        return;
+    }
+
+    int fd = open(dir, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+}
+
+static int
+compact_timer(
+    void* data
+) {
+    if (storage.log.records >= WS_STORAGE_COMPACT_IDLE_RECORDS) {
+        ws_storage_compact();
+    }
+
+    // the timer is gone if the compaction closed the storage
+    if (storage.timer) {
+        wl_event_source_timer_update(storage.timer,
+                                     WS_STORAGE_COMPACT_INTERVAL);
+    }
+    return 0;
+}
+
+static int
+command_get_key(
+    struct ws_value const* arg,
+    char const** key,
+    size_t* key_len
+) {
+    if (ws_value_get_type(arg) != WS_VALUE_TYPE_STRING) {
+        return -EINVAL;
+    }
+
+    *key = ws_value_string_get(arg);
+    *key_len = ws_value_string_len(arg);
+    if (!*key_len || memchr(*key, '\n', *key_len)) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int
+command_get(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    char const* key;
+    size_t key_len;
+    if ((argc != 1) || (command_get_key(args, &key, &key_len) < 0)) {
+        return -EINVAL;
+    }
+
+    void const* value;
+    size_t value_len;
+    int res = ws_storage_get(key, key_len, &value, &value_len);
+    if (res < 0) {
+        return res;
+    }
+    if (!value_len) {
+        return -EINVAL;
+    }
+
+    char const* payload = (char const*) value + 1;
+    size_t payload_len = value_len - 1;
+    ws_value_deinit(result);
+    switch (*(char const*) value) {
+    case STORED_NIL:
+        ws_value_nil_init(result);
+        return 0;
+
+    case STORED_BOOL:
+        ws_value_bool_init(result, payload_len && payload[0]);
+        return 0;
+
+    case STORED_INT: {
+        int64_t i = 0;
+        memcpy(&i, payload, WS_MIN(payload_len, sizeof(i)));
+        ws_value_int_init(result, i);
+        return 0;
+    }
+
+    case STORED_STRING: {
+        // later commands of the batch may remap the file, so copy the string
+        char* copy = ws_arena_strndup(ctx->arena, payload, payload_len);
+        if (!copy) {
+            ws_value_nil_init(result);
+            return -ENOMEM;
+        }
+        ws_value_string_init(result);
+        ws_value_string_set_borrowed(result, copy, payload_len);
+        return 0;
+    }
+
+    default:
+        ws_value_nil_init(result);
+        return -EINVAL;
+    }
+}
+
+static int
+command_put(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    char const* key;
+    size_t key_len;
+    if ((argc != 2) || (command_get_key(args, &key, &key_len) < 0)) {
+        return -EINVAL;
+    }
+
+    char const* payload = NULL;
+    size_t payload_len = 0;
+    char type;
+    bool b;
+    int64_t i;
+    switch (ws_value_get_type(args + 1)) {
+    case WS_VALUE_TYPE_NIL:
+        type = STORED_NIL;
+        break;
+
+    case WS_VALUE_TYPE_BOOL:
+        type = STORED_BOOL;
+        b = ws_value_bool_get(args + 1);
+        payload = (char const*) &b;
+        payload_len = sizeof(b);
+        break;
+
+    case WS_VALUE_TYPE_INT:
+        type = STORED_INT;
+        i = ws_value_int_get(args + 1);
+        payload = (char const*) &i;
+        payload_len = sizeof(i);
+        break;
+
+    case WS_VALUE_TYPE_STRING:
+        type = STORED_STRING;
+        payload = ws_value_string_get(args + 1);
+        payload_len = ws_value_string_len(args + 1);
+        break;
+
+    default:
+        return -EINVAL;
+    }
+
+    char* value = ws_arena_alloc(ctx->arena, payload_len + 1);
+    if (!value) {
+        return -ENOMEM;
+    }
+    value[0] = type;
+    if (payload_len) {
+        memcpy(value + 1, payload, payload_len);
+    }
+    return ws_storage_put(key, key_len, value, payload_len + 1);
+}
+
+static int
+command_delete(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    char const* key;
+    size_t key_len;
+    if ((argc != 1) || (command_get_key(args, &key, &key_len) < 0)) {
+        return -EINVAL;
+    }
+    return ws_storage_delete(key, key_len);
+}
+
+static int
+command_scan(
+    struct ws_command_ctx* ctx,
+    struct ws_value* args,
+    size_t argc,
+    struct ws_value* result
+) {
+    if ((argc < 1) || (argc > 3) ||
+            (ws_value_get_type(args) != WS_VALUE_TYPE_STRING)) {
+        return -EINVAL;
+    }
+    char const* prefix = ws_value_string_get(args);
+    size_t prefix_len = ws_value_string_len(args);
+
+    char const* after = NULL;
+    size_t after_len = 0;
+    if (argc > 1) {
+        enum ws_value_type type = ws_value_get_type(args + 1);
+        if (type == WS_VALUE_TYPE_STRING) {
+            after = ws_value_string_get(args + 1);
+            after_len = ws_value_string_len(args + 1);
+        } else if (type != WS_VALUE_TYPE_NIL) {
+            return -EINVAL;
+        }
+    }
+
+    int64_t limit = WS_STORAGE_SCAN_MAX;
+    if (argc > 2) {
+        if (ws_value_get_type(args + 2) != WS_VALUE_TYPE_INT) {
+            return -EINVAL;
+        }
+        limit = WS_MIN(ws_value_int_get(args + 2), limit);
+        if (limit < 0) {
+            return -EINVAL;
+        }
+    }
+
+    // start at the prefix, or after the last key of a previous scan
+    struct ws_storage_cursor start;
+    if (after && (key_cmp(after, after_len, prefix, prefix_len) > 0)) {
+        ws_storage_cursor_seek(&start, after, after_len);
+    } else {
+        ws_storage_cursor_seek(&start, prefix, prefix_len);
+        after = NULL;
+    }
+
+    // the first pass sizes the result, the second one fills it in
+    char* list = NULL;
+    size_t size = 0;
+    int pass;
+    for (pass = 0; pass < 2; ++pass) {
+        struct ws_storage_cursor cursor = start;
+        size_t len = 0;
+        int64_t num = 0;
+        char const* key;
+        size_t key_len;
+        void const* value;
+        size_t value_len;
+        int res = 0;
+        while ((num < limit) &&
+               ((res = ws_storage_cursor_next(&cursor, &key, &key_len, &value,
+                                              &value_len)) > 0)) {
+            if ((key_len < prefix_len) || memcmp(key, prefix, prefix_len)) {
+                break;
+            }
+            if (after && (key_len == after_len) &&
+                    (memcmp(key, after, after_len) == 0)) {
+                continue;
+            }
+
+            if (list) {
+                memcpy(list + len, key, key_len);
+                list[len + key_len] = '\n';
+            }
+            len += key_len + 1;
+            ++num;
+        }
+        if (res < 0) {
+            return res;
+        }
+
+        if (pass == 0) {
+            size = len;
+            list = ws_arena_alloc(ctx->arena, size ? size : 1);
+            if (!list) {
+                return -ENOMEM;
+            }
+        }
+    }
 
+    ws_value_deinit(result);
+    ws_value_string_init(result);
+    ws_value_string_set_borrowed(result, list, size);
+    return 0;
+}
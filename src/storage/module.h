@@ -28,6 +28,278 @@
 #ifndef __WS_STORAGE_MODULE_H__
 #define __WS_STORAGE_MODULE_H__
 
+/**
+ * @file module.h
+ *
+ * @brief Persistent key-value storage
+ *
+ * The storage holds the state which survives restarts: window rules, the
+ * geometry remembered per application, tag assignments and variables of
+ * scripts. Keys and values are arbitrary byte strings. By convention, keys are
+ * paths starting with one of the WS_STORAGE_NS_* prefixes, e.g.
+ * `geometry/firefox`.
+ *
+ * The storage is a single file, consisting of a compacted segment followed by
+ * a log:
+ *
+ * - The compacted segment holds one record per key, sorted by key, and an
+ *   array with the offsets of these records, i.e. a sorted index.
+ * - The log holds the records appended since the last compaction: new values
+ *   and deletions (tombstones).
+ *
+ * The file is memory-mapped and read in place, values returned by lookups
+ * point into the mapping. Opening the storage neither parses nor copies the
+ * compacted segment, only the log is scanned to rebuild an index of the keys
+ * changed since the last compaction. As the log is compacted periodically, the
+ * startup time does not depend on the number of keys stored.
+ *
+ * Each record of the log carries a checksum. Records torn by a crash are
+ * detected when the storage is opened and cut off the log. A compaction writes
+ * a new file which atomically replaces the old one once it is complete, so the
+ * file is never left half-compacted.
+ *
+ * Appended records are written to the file right away, but not synced: they
+ * survive a crash of waysome, but not necessarily one of the system. The log
+ * is synced by ws_storage_sync(), by compactions and when the storage is
+ * closed.
+ *
+ * Both the compacted segment and the log are indexed by sorted arrays, so
+ * keys are iterated in order: a range scan, e.g. over all keys starting with
+ * `rules/app/firefox/`, is a binary search in each index followed by a merge
+ * of the two sequences.
+ *
+ * Scripts access the storage through commands (see
+ * ws_storage_register_commands()). Values stored by commands are script
+ * values: nil, booleans, integers and strings, each stored with its type.
+ *
+ * - `["storage_get", "<key>"]` returns the value of a key,
+ * - `["storage_put", "<key>", <value>]` stores a value,
+ * - `["storage_delete", "<key>"]` deletes a key,
+ * - `["storage_scan", "<prefix>", "<after>", <limit>]` returns the keys
+ *   starting with `<prefix>` as a string, one key per line. Only keys greater
+ *   than `<after>` are returned, if given, and at most `<limit>` (by default
+ *   and at most WS_STORAGE_SCAN_MAX) keys, so a scan may be continued from the
+ *   last key returned.
+ *
+ * Keys stored by commands may not contain newlines.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-server.h>
 
+#include "util/attributes.h"
+
+/**
+ * Key prefix of window rules
+ */
+#define WS_STORAGE_NS_RULES "rules/"
+
+/**
+ * Key prefix of the geometry remembered per application
+ */
+#define WS_STORAGE_NS_GEOMETRY "geometry/"
+
+/**
+ * Key prefix of tag assignments
+ */
+#define WS_STORAGE_NS_TAGS "tags/"
+
+/**
+ * Key prefix of script variables
+ */
+#define WS_STORAGE_NS_VARS "vars/"
+
+/**
+ * Number of log records after which the log is compacted right away
+ */
+#define WS_STORAGE_COMPACT_RECORDS 16384
+
+/**
+ * Number of log records after which the log is compacted when idle
+ */
+#define WS_STORAGE_COMPACT_IDLE_RECORDS 1024
+
+/**
+ * Interval in which the log is checked for idle compaction, in milliseconds
+ */
+#define WS_STORAGE_COMPACT_INTERVAL 30000
+
+/**
+ * Maximum number of keys returned by the `storage_scan` command
+ */
+#define WS_STORAGE_SCAN_MAX 1024
+
+/**
+ * Cursor iterating over the keys in order
+ *
+ * A cursor is invalidated by any modification of the storage.
+ */
+struct ws_storage_cursor {
+    size_t compacted; //!< Position in the index of the compacted segment
+    size_t log; //!< Position in the index of the log
+};
+
+/**
+ * Statistics of the storage
+ */
+struct ws_storage_stats {
+    size_t compacted_keys; //!< Number of keys in the compacted segment
+    size_t log_records; //!< Number of records in the log
+    size_t log_keys; //!< Number of keys changed in the log
+    uint64_t file_size; //!< Size of the file
+    uint64_t compactions; //!< Number of compactions
+    uint64_t torn_bytes; //!< Bytes of torn records cut off at startup
+};
+
+/**
+ * Open the storage
+ *
+ * Creates the file if it does not exist. If `loop` is not NULL, the log is
+ * compacted from a timer of the loop once it has more than
+ * WS_STORAGE_COMPACT_IDLE_RECORDS records.
+ *
+ * The compacted segment is checked as a whole, a file whose compacted segment
+ * is truncated or corrupted is rejected.
+ *
+ * @return 0 on success, -EALREADY if the storage is already open, -EINVAL if
+ *         the file is not a valid storage file, another negative error number
+ *         otherwise
+ */
+int
+ws_storage_init(
+    struct wl_event_loop* loop, //!< Event loop for periodic compaction
+    char const* path //!< Path of the file
+)
+__ws_nonnull__(2);
+
+/**
+ * Register the storage commands with the command processor
+ *
+ * The commands fail with -ENODEV while the storage is not open.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_storage_register_commands(void);
+
+/**
+ * Close the storage
+ *
+ * Syncs the file. Does nothing if the storage is not open.
+ */
+void
+ws_storage_deinit(void);
+
+/**
+ * Look up a key
+ *
+ * The value points into the mapping of the file and is not 0-terminated. It is
+ * valid until the storage is modified or closed.
+ *
+ * @return 0 on success, -ENOENT if there is no such key, -ENODEV if the
+ *         storage is not open
+ */
+int
+ws_storage_get(
+    char const* key, //!< The key
+    size_t key_len, //!< Length of the key
+    void const** value, //!< Output: the value
+    size_t* value_len //!< Output: length of the value
+)
+__ws_nonnull__(1, 3, 4);
+
+/**
+ * Store a value
+ *
+ * Replaces the value if the key is already present.
+ *
+ * @return 0 on success, -ENODEV if the storage is not open, another negative
+ *         error number otherwise
+ */
+int
+ws_storage_put(
+    char const* key, //!< The key
+    size_t key_len, //!< Length of the key, not 0
+    void const* value, //!< The value
+    size_t value_len //!< Length of the value
+)
+__ws_nonnull__(1);
+
+/**
+ * Delete a key
+ *
+ * @return 0 on success, -ENOENT if there is no such key, -ENODEV if the
+ *         storage is not open, another negative error number otherwise
+ */
+int
+ws_storage_delete(
+    char const* key, //!< The key
+    size_t key_len //!< Length of the key
+)
+__ws_nonnull__(1);
+
+/**
+ * Position a cursor at the first key not less than a key
+ */
+void
+ws_storage_cursor_seek(
+    struct ws_storage_cursor* cursor, //!< The cursor
+    char const* key, //!< The key
+    size_t key_len //!< Length of the key
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the key and value at a cursor and advance it
+ *
+ * Keys are returned in ascending order of their bytes. Key and value point
+ * into the mapping of the file, as for ws_storage_get().
+ *
+ * @return 1 if a key was returned, 0 at the end of the storage, -ENODEV if
+ *         the storage is not open
+ */
+int
+ws_storage_cursor_next(
+    struct ws_storage_cursor* cursor, //!< The cursor
+    char const** key, //!< Output: the key
+    size_t* key_len, //!< Output: length of the key
+    void const** value, //!< Output: the value
+    size_t* value_len //!< Output: length of the value
+)
+__ws_nonnull__(1, 2, 3, 4, 5);
+
+/**
+ * Compact the storage
+ *
+ * Writes all live keys into a new compacted segment and starts a new, empty
+ * log.
+ *
+ * If the compacted file replaced the old one but can not be opened, the
+ * storage is closed as if ws_storage_deinit() was called.
+ *
+ * @return 0 on success, -ENODEV if the storage is not open, another negative
+ *         error number otherwise, in which case the storage is unchanged
+ *         unless it was closed
+ */
+int
+ws_storage_compact(void);
+
+/**
+ * Sync the file to disk
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_storage_sync(void);
+
+/**
+ * Get statistics of the storage
+ */
+void
+ws_storage_get_stats(
+    struct ws_storage_stats* stats //!< Output: the statistics
+)
+__ws_nonnull__(1);
 
 #endif // __WS_STORAGE_MODULE_H__
@@ -0,0 +1,215 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/arena.h"
+#include "util/arithmetical.h"
+
+/**
+ * Alignment of all allocations
+ */
+#define ARENA_ALIGN (alignof(max_align_t))
+
+struct ws_arena_chunk {
+    struct ws_arena_chunk* next; //!< Next (older) chunk
+    size_t size; //!< Usable size of the chunk
+    size_t pos; //!< Bump pointer, offset of the next free byte
+    alignas(max_align_t) unsigned char data[]; //!< The memory
+};
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Allocate a new chunk and make it the current one
+ *
+ * @return The new chunk or NULL if the allocation failed
+ */
+static struct ws_arena_chunk*
+arena_add_chunk(
+    struct ws_arena* self, //!< The arena
+    size_t min_size //!< Minimum usable size of the new chunk
+);
+
+/**
+ * Release a list of chunks
+ */
+static void
+arena_free_chunks(
+    struct ws_arena_chunk* chunk //!< The first chunk of the list
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+void
+ws_arena_init(
+    struct ws_arena* self,
+    size_t chunk_size
+) {
+    self->chunks = NULL;
+    self->chunk_size = chunk_size;
+    self->used = 0;
+    self->peak = 0;
+}
+
+void
+ws_arena_deinit(
+    struct ws_arena* self
+) {
+    arena_free_chunks(self->chunks);
+    self->chunks = NULL;
+    self->used = 0;
+}
+
+void*
+ws_arena_alloc(
+    struct ws_arena* self,
+    size_t size
+) {
+    if (size > SIZE_MAX - ARENA_ALIGN) {
+        return NULL;
+    }
+    size = WS_ALIGN_UP(size, ARENA_ALIGN);
+
+    struct ws_arena_chunk* chunk = self->chunks;
+    if (!chunk || (chunk->size - chunk->pos < size)) {
+        chunk = arena_add_chunk(self, size);
+        if (!chunk) {
+            return NULL;
+        }
+    }
+
+    void* retval = chunk->data + chunk->pos;
+    chunk->pos += size;
+
+    self->used += size;
+    if (self->used > self->peak) {
+        self->peak = self->used;
+    }
+    return retval;
+}
+
+char*
+ws_arena_strndup(
+    struct ws_arena* self,
+    char const* str,
+    size_t len
+) {
+    char* retval = ws_arena_alloc(self, len + 1);
+    if (retval) {
+        memcpy(retval, str, len);
+        retval[len] = '\0';
+    }
+    return retval;
+}
+
+size_t
+ws_arena_reset(
+    struct ws_arena* self
+) {
+    size_t used = self->used;
+    self->used = 0;
+
+    struct ws_arena_chunk* chunk = self->chunks;
+    if (!chunk) {
+        return used;
+    }
+
+    if (chunk->next) {
+        // merge all chunks into one, so the next cycle fits into one chunk
+        size_t total = 0;
+        for (struct ws_arena_chunk* it = chunk; it; it = it->next) {
+            total += it->size;
+        }
+        arena_free_chunks(chunk);
+        self->chunks = NULL;
+        if (!arena_add_chunk(self, total)) {
+            return used;
+        }
+        chunk = self->chunks;
+    }
+
+    chunk->pos = 0;
+    return used;
+}
+
+size_t
+ws_arena_used(
+    struct ws_arena const* self
+) {
+    return self->used;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static struct ws_arena_chunk*
+arena_add_chunk(
+    struct ws_arena* self,
+    size_t min_size
+) {
+    size_t size = WS_MAX(min_size, self->chunk_size);
+    if (size > SIZE_MAX - sizeof(struct ws_arena_chunk)) {
+        return NULL;
+    }
+
+    struct ws_arena_chunk* chunk = malloc(sizeof(*chunk) + size);
+    if (!chunk) {
+        return NULL;
+    }
+
+    chunk->size = size;
+    chunk->pos = 0;
+    chunk->next = self->chunks;
+    self->chunks = chunk;
+    return chunk;
+}
+
+static void
+arena_free_chunks(
+    struct ws_arena_chunk* chunk
+) {
+    while (chunk) {
+        struct ws_arena_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_UTIL_ARENA_H__
+#define __WS_UTIL_ARENA_H__
+
+/**
+ * @file arena.h
+ *
+ * @brief Bump allocator for short lived scratch memory
+ *
+ * An arena hands out memory by bumping a pointer through a chunk of memory.
+ * Individual allocations are never freed. Instead, all the memory is released
+ * at once by resetting the arena.
+ *
+ * Resetting an arena does not return the memory to the system. If more than
+ * one chunk was in use, the chunks are merged into a single one big enough to
+ * hold everything, so an arena which is reused for similar workloads stops
+ * allocating after a few cycles.
+ */
+
+#include <stddef.h>
+
+#include "util/attributes.h"
+
+/**
+ * Chunk of memory managed by an arena
+ */
+struct ws_arena_chunk;
+
+/**
+ * Arena type
+ */
+struct ws_arena {
+    struct ws_arena_chunk* chunks; //!< All chunks, the current one first
+    size_t chunk_size; //!< Minimum size of new chunks
+    size_t used; //!< Bytes handed out since the last reset
+    size_t peak; //!< Highest value of `used` ever observed
+};
+
+/**
+ * Initialize an arena
+ *
+ * No memory is allocated until the first allocation is made.
+ */
+void
+ws_arena_init(
+    struct ws_arena* self, //!< The arena to initialize
+    size_t chunk_size //!< Minimum size of the chunks to allocate, in bytes
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize an arena
+ *
+ * Releases all memory held by the arena.
+ */
+void
+ws_arena_deinit(
+    struct ws_arena* self //!< The arena to deinitialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Allocate memory from an arena
+ *
+ * The memory returned is suitably aligned for any type. It remains valid
+ * until the arena is reset or deinitialized.
+ *
+ * @return Pointer to the memory or NULL if the allocation failed
+ */
+void*
+ws_arena_alloc(
+    struct ws_arena* self, //!< The arena to allocate from
+    size_t size //!< Number of bytes to allocate
+)
+__ws_nonnull__(1)
+__ws_malloc__
+__ws_alloc_size__(2);
+
+/**
+ * Copy a string into an arena
+ *
+ * @return A 0-terminated copy of the string or NULL if the allocation failed
+ */
+char*
+ws_arena_strndup(
+    struct ws_arena* self, //!< The arena to allocate from
+    char const* str, //!< The string to copy, not necessarily 0-terminated
+    size_t len //!< Length of the string
+)
+__ws_nonnull__(1)
+__ws_malloc__;
+
+/**
+ * Reset an arena
+ *
+ * All memory allocated from the arena becomes invalid.
+ *
+ * @return The number of bytes which were handed out since the last reset
+ */
+size_t
+ws_arena_reset(
+    struct ws_arena* self //!< The arena to reset
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the number of bytes handed out since the last reset
+ *
+ * @return The number of bytes allocated from the arena
+ */
+size_t
+ws_arena_used(
+    struct ws_arena const* self //!< The arena
+)
+__ws_nonnull__(1);
+
+#endif // __WS_UTIL_ARENA_H__
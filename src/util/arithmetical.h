@@ -28,6 +28,29 @@
 #ifndef __WS_UTIL_ARITHMETICAL_H__
 #define __WS_UTIL_ARITHMETICAL_H__
 
+/**
+ * @file arithmetical.h
+ *
+ * @brief Arithmetical helper macros
+ */
+
+/**
+ * Get the smaller one of two values
+ *
+ * @warning the arguments may be evaluated twice
+ */
+#define WS_MIN(a, b) (((a) < (b)) ? (a) : (b))
 
+/**
+ * Get the bigger one of two values
+ *
+ * @warning the arguments may be evaluated twice
+ */
+#define WS_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+/**
+ * Round `x` up to the next multiple of `align`, which must be a power of two
+ */
+#define WS_ALIGN_UP(x, align) (((x) + ((align) - 1)) & ~((align) - 1))
 
 #endif // __WS_UTIL_ARITHMETICAL_H__
@@ -69,14 +69,14 @@
 #define __ws_noreturn__             __attribute__((noreturn))
 #define __ws_unused__               __attribute__((unused))
 #define __ws_visibility__(x)        __attribute__((visibility(x)))
+#define __ws_target__(x)            __attribute__((target(x)))
 
 #define __ws_vis_default__          __ws_visibility__(default)
 #define __ws_vis_hidden__           __ws_visibility__(hidden)
 #define __ws_vis_internal__         __ws_visibility__(internal)
 #define __ws_vis_protected__        __ws_visibility__(protected)
 
-#define __ws_alloc_size__(x,y)        __attribute__((alloc_size(x,y)))
-#define __ws_alloc_size__(x)          __attribute__((alloc_size(x)))
+#define __ws_alloc_size__(...)      __attribute__((alloc_size(__VA_ARGS__)))
 
 #define __ws_warn_unused_result__   __attribute__((warn_unused_result))
 
@@ -102,18 +102,18 @@
 #define __ws_noreturn__
 #define __ws_unused__
 #define __ws_visibility__(x)
+#define __ws_target__(x)
 
 #define __ws_default__
 #define __ws_hidden__
 #define __ws_internal__
 #define __ws_protected__
 
-#define __ws_alloc_size__(x,y)
-#define __ws_alloc_size__(x)
+#define __ws_alloc_size__(...)
 
 #define __ws_warn_unused_result__
 
-#define R_FORCE_INLINE
+#define WS_FORCE_INLINE
 
 #endif // __GNUC__
 
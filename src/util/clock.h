@@ -0,0 +1,57 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_UTIL_CLOCK_H__
+#define __WS_UTIL_CLOCK_H__
+
+/**
+ * @file clock.h
+ *
+ * @brief Monotonic time
+ */
+
+#include <stdint.h>
+
+/**
+ * Nanoseconds per millisecond
+ */
+#define WS_CLOCK_NS_PER_MS UINT64_C(1000000)
+
+/**
+ * Nanoseconds per second
+ */
+#define WS_CLOCK_NS_PER_SEC UINT64_C(1000000000)
+
+/**
+ * Get the current monotonic time
+ *
+ * @return The time in nanoseconds
+ */
+uint64_t
+ws_clock_now(void);
+
+#endif // __WS_UTIL_CLOCK_H__
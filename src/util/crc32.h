@@ -0,0 +1,61 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_UTIL_CRC32_H__
+#define __WS_UTIL_CRC32_H__
+
+/**
+ * @file crc32.h
+ *
+ * @brief CRC-32 checksums
+ *
+ * The checksum is the one of zlib and PNG (reflected polynomial 0xedb88320),
+ * computed with a small table, so there is nothing to initialize.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+
+/**
+ * Compute a CRC-32 checksum
+ *
+ * Checksums of data split into several parts are computed by passing the
+ * checksum of the previous parts.
+ *
+ * @return The checksum of the data
+ */
+uint32_t
+ws_crc32(
+    uint32_t crc, //!< Checksum of the data before, 0 at the start
+    void const* data, //!< The data
+    size_t len //!< Length of the data
+)
+__ws_pure__;
+
+#endif // __WS_UTIL_CRC32_H__
@@ -28,6 +28,49 @@
 #ifndef __WS_UTIL_DEBUG_H__
 #define __WS_UTIL_DEBUG_H__
 
+/**
+ * @file debug.h
+ *
+ * @brief Helpers for debugging and tracing code
+ *
+ * Code which is only there for debugging, e.g. tracing, should cost nothing
+ * while it is disabled. Checks deciding whether it is enabled are hinted as
+ * unlikely, so the compiler moves the disabled code out of the hot path, and
+ * whole levels of log messages can be removed at compile time by defining
+ * WS_LOG_MAX_LEVEL.
+ */
+
+#include "util/attributes.h"
+
+#ifdef __GNUC__
+
+/**
+ * Hint that a condition is most likely true
+ */
+#define WS_LIKELY(x)    __builtin_expect(!!(x), 1)
 
+/**
+ * Hint that a condition is most likely false
+ */
+#define WS_UNLIKELY(x)  __builtin_expect(!!(x), 0)
+
+#else // __GNUC__
+
+#define WS_LIKELY(x)    (x)
+#define WS_UNLIKELY(x)  (x)
+
+#endif // __GNUC__
+
+/**
+ * Least severe log level compiled in
+ *
+ * The numeric value of an `enum ws_log_level` (see logger/module.h), from 0
+ * for errors only to 4 for everything including traces. Log calls for less
+ * severe levels are removed at compile time. By default, everything is
+ * compiled in and the levels are selected at runtime.
+ */
+#ifndef WS_LOG_MAX_LEVEL
+#define WS_LOG_MAX_LEVEL 4
+#endif
 
 #endif // __WS_UTIL_DEBUG_H__
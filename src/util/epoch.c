@@ -0,0 +1,126 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "util/epoch.h"
+
+/**
+ * State of the epoch based reclamation
+ */
+static struct {
+    _Atomic uint64_t current; //!< The global epoch, readers use 0 as "none"
+    struct ws_epoch_reader* readers[WS_EPOCH_MAX_READERS]; //!< The readers
+    size_t num_readers; //!< Number of registered readers
+    struct ws_epoch_node* oldest; //!< Data retired first
+    struct ws_epoch_node* newest; //!< Data retired last
+} epoch = {
+    .current = 1,
+};
+
+int
+ws_epoch_register(
+    struct ws_epoch_reader* reader
+) {
+    if (epoch.num_readers >= WS_EPOCH_MAX_READERS) {
+        return -ENOSPC;
+    }
+
+    atomic_store(&reader->epoch, 0);
+    epoch.readers[epoch.num_readers++] = reader;
+    return 0;
+}
+
+void
+ws_epoch_unregister(
+    struct ws_epoch_reader* reader
+) {
+    size_t i;
+    for (i = 0; i < epoch.num_readers; ++i) {
+        if (epoch.readers[i] == reader) {
+            epoch.readers[i] = epoch.readers[--epoch.num_readers];
+            return;
+        }
+    }
+}
+
+void
+ws_epoch_enter(
+    struct ws_epoch_reader* reader
+) {
+    // sequentially consistent: either the main thread sees the reader inside
+    // the section, or the reader sees whatever was published before
+    atomic_store(&reader->epoch, atomic_load(&epoch.current));
+}
+
+void
+ws_epoch_exit(
+    struct ws_epoch_reader* reader
+) {
+    atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
+
+void
+ws_epoch_retire(
+    struct ws_epoch_node* node,
+    void (*destroy)(struct ws_epoch_node* node)
+) {
+    node->next = NULL;
+    node->epoch = atomic_fetch_add(&epoch.current, 1);
+    node->destroy = destroy;
+
+    if (epoch.newest) {
+        epoch.newest->next = node;
+    } else {
+        epoch.oldest = node;
+    }
+    epoch.newest = node;
+}
+
+void
+ws_epoch_collect(void)
+{
+    uint64_t min = UINT64_MAX;
+    size_t i;
+    for (i = 0; i < epoch.num_readers; ++i) {
+        uint64_t entered = atomic_load(&epoch.readers[i]->epoch);
+        if (entered && (entered < min)) {
+            min = entered;
+        }
+    }
+
+    // nodes are retired in order of their epochs
+    while (epoch.oldest && (epoch.oldest->epoch < min)) {
+        struct ws_epoch_node* node = epoch.oldest;
+        epoch.oldest = node->next;
+        node->destroy(node);
+    }
+    if (!epoch.oldest) {
+        epoch.newest = NULL;
+    }
+}
@@ -0,0 +1,148 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_UTIL_EPOCH_H__
+#define __WS_UTIL_EPOCH_H__
+
+/**
+ * @file epoch.h
+ *
+ * @brief Epoch based reclamation
+ *
+ * Lets reader threads access data published by the main thread without
+ * locking, while the main thread replaces the data at will. The main thread
+ * publishes a new version by swapping a pointer and hands the old version to
+ * ws_epoch_retire(). A retired version is destroyed by ws_epoch_collect() once
+ * no reader may still see it.
+ *
+ * Readers announce themselves by entering a critical section with
+ * ws_epoch_enter() and leave it with ws_epoch_exit(). A pointer loaded within
+ * a critical section stays valid until the reader leaves the section. Entering
+ * and leaving is a store each, readers never wait for the main thread or each
+ * other.
+ *
+ * To decide whether a retired version may be destroyed, the main thread keeps
+ * a global epoch, which it advances on each retirement. Readers record the
+ * epoch they entered in. A version retired in some epoch is only destroyed once
+ * every reader inside a critical section entered in a later epoch.
+ *
+ * Except for entering and leaving critical sections, all functions must be
+ * called from the main thread.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+
+/**
+ * Maximum number of readers registered at the same time
+ */
+#define WS_EPOCH_MAX_READERS 64
+
+/**
+ * A reader thread
+ */
+struct ws_epoch_reader {
+    _Atomic uint64_t epoch; //!< Epoch entered in, 0 outside critical sections
+};
+
+/**
+ * Node of data retired, to be embedded into the data
+ */
+struct ws_epoch_node {
+    struct ws_epoch_node* next; //!< Next node retired
+    uint64_t epoch; //!< Epoch the data was retired in
+    void (*destroy)(struct ws_epoch_node* node); //!< Destroys the data
+};
+
+/**
+ * Register a reader
+ *
+ * @return 0 on success, -ENOSPC if too many readers are registered
+ */
+int
+ws_epoch_register(
+    struct ws_epoch_reader* reader //!< The reader to register
+)
+__ws_nonnull__(1);
+
+/**
+ * Unregister a reader
+ *
+ * The reader must not be inside a critical section.
+ */
+void
+ws_epoch_unregister(
+    struct ws_epoch_reader* reader //!< The reader to unregister
+)
+__ws_nonnull__(1);
+
+/**
+ * Enter a critical section
+ *
+ * May be called from the thread owning the reader only.
+ */
+void
+ws_epoch_enter(
+    struct ws_epoch_reader* reader //!< The reader
+)
+__ws_nonnull__(1);
+
+/**
+ * Leave a critical section
+ *
+ * May be called from the thread owning the reader only.
+ */
+void
+ws_epoch_exit(
+    struct ws_epoch_reader* reader //!< The reader
+)
+__ws_nonnull__(1);
+
+/**
+ * Retire data no longer reachable for readers entering from now on
+ *
+ * The data is destroyed by a later call to ws_epoch_collect(). The data must
+ * have been unpublished before, e.g. by swapping the pointer to it.
+ */
+void
+ws_epoch_retire(
+    struct ws_epoch_node* node, //!< Node embedded into the data
+    void (*destroy)(struct ws_epoch_node* node) //!< Destroys the data
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Destroy all retired data no reader may see anymore
+ *
+ * If no reader is registered, all retired data is destroyed.
+ */
+void
+ws_epoch_collect(void);
+
+#endif // __WS_UTIL_EPOCH_H__
@@ -0,0 +1,55 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_UTIL_HASH_H__
+#define __WS_UTIL_HASH_H__
+
+/**
+ * @file hash.h
+ *
+ * @brief Hashing helpers
+ */
+
+#include <stdint.h>
+
+#include "util/attributes.h"
+
+/**
+ * Mix the bits of a 64 bit integer (finalizer of MurmurHash3)
+ *
+ * Every input bit affects every output bit, so the low bits of the result are
+ * usable as a table index even if the input is poorly distributed.
+ *
+ * @return The mixed integer
+ */
+uint64_t
+ws_hash_mix64(
+    uint64_t x //!< The integer to mix
+)
+__ws_const__;
+
+#endif // __WS_UTIL_HASH_H__
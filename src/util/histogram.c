@@ -0,0 +1,201 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "util/histogram.h"
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Get the bucket a value is counted in
+ *
+ * @return The index of the bucket
+ */
+static size_t
+bucket_index(
+    uint64_t value //!< The value
+);
+
+/**
+ * Get the biggest value counted in a bucket
+ *
+ * @return The upper bound of the bucket
+ */
+static uint64_t
+bucket_upper(
+    size_t index //!< The index of the bucket
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+void
+ws_histogram_init(
+    struct ws_histogram* self
+) {
+    size_t i;
+    for (i = 0; i < WS_HISTOGRAM_BUCKETS; ++i) {
+        atomic_init(&self->buckets[i], 0);
+    }
+    atomic_init(&self->count, 0);
+    atomic_init(&self->sum, 0);
+    atomic_init(&self->max, 0);
+}
+
+void
+ws_histogram_reset(
+    struct ws_histogram* self
+) {
+    size_t i;
+    for (i = 0; i < WS_HISTOGRAM_BUCKETS; ++i) {
+        atomic_store_explicit(&self->buckets[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&self->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&self->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&self->max, 0, memory_order_relaxed);
+}
+
+void
+ws_histogram_record(
+    struct ws_histogram* self,
+    uint64_t value
+) {
+    atomic_fetch_add_explicit(&self->buckets[bucket_index(value)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&self->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&self->sum, value, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&self->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&self->max, &max, value,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+uint64_t
+ws_histogram_count(
+    struct ws_histogram const* self
+) {
+    return atomic_load_explicit(&self->count, memory_order_relaxed);
+}
+
+uint64_t
+ws_histogram_mean(
+    struct ws_histogram const* self
+) {
+    uint64_t count = atomic_load_explicit(&self->count, memory_order_relaxed);
+    if (!count) {
+        return 0;
+    }
+    return atomic_load_explicit(&self->sum, memory_order_relaxed) / count;
+}
+
+uint64_t
+ws_histogram_percentile(
+    struct ws_histogram const* self,
+    double percentile
+) {
+    // the total is summed up from the buckets so it matches what we iterate
+    uint64_t counts[WS_HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    size_t i;
+    for (i = 0; i < WS_HISTOGRAM_BUCKETS; ++i) {
+        counts[i] = atomic_load_explicit(&self->buckets[i],
+                                         memory_order_relaxed);
+        total += counts[i];
+    }
+    if (!total) {
+        return 0;
+    }
+
+    if (percentile < 0) {
+        percentile = 0;
+    } else if (percentile > 100) {
+        percentile = 100;
+    }
+
+    uint64_t rank = (uint64_t) (percentile / 100 * (double) total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > total) {
+        rank = total;
+    }
+
+    uint64_t max = atomic_load_explicit(&self->max, memory_order_relaxed);
+    uint64_t seen = 0;
+    for (i = 0; i < WS_HISTOGRAM_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint64_t upper = bucket_upper(i);
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static size_t
+bucket_index(
+    uint64_t value
+) {
+    if (value < WS_HISTOGRAM_SUB_BUCKETS) {
+        return (size_t) value;
+    }
+
+    // position of the highest bit, at least 3 since the value is >= 8
+    unsigned exp = 63 - (unsigned) __builtin_clzll(value);
+    unsigned shift = exp - 3;
+    size_t sub = (size_t) (value >> shift) & (WS_HISTOGRAM_SUB_BUCKETS - 1);
+    return (exp - 2) * WS_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+static uint64_t
+bucket_upper(
+    size_t index
+) {
+    if (index < WS_HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    // inverse of bucket_index(): the highest bit is at index / 8 + 2
+    unsigned shift = (unsigned) (index / WS_HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t sub = index % WS_HISTOGRAM_SUB_BUCKETS;
+    uint64_t lower = (WS_HISTOGRAM_SUB_BUCKETS + sub) << shift;
+    return lower + ((UINT64_C(1) << shift) - 1);
+}
@@ -0,0 +1,142 @@
+/*
+ * waysome - wayland based window manager
+ *
+ * Copyright in alphabetical order:
+ *
+ * Copyright (C) 2014-2015 Julian Ganz
+ * Copyright (C) 2014-2015 Manuel Messner
+ * Copyright (C) 2014-2015 Marcel Müller
+ * Copyright (C) 2014-2015 Matthias Beyer
+ * Copyright (C) 2014-2015 Nadja Sommerfeld
+ *
+ * This file is part of waysome.
+ *
+ * waysome is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * waysome is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with waysome. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WS_UTIL_HISTOGRAM_H__
+#define __WS_UTIL_HISTOGRAM_H__
+
+/**
+ * @file histogram.h
+ *
+ * @brief Lock-free latency histograms
+ *
+ * A histogram counts samples in log-linear buckets: every power of two is
+ * split into WS_HISTOGRAM_SUB_BUCKETS buckets of equal width, values below
+ * WS_HISTOGRAM_SUB_BUCKETS get a bucket each. Percentiles are thus reported
+ * with a relative error of at most 1/WS_HISTOGRAM_SUB_BUCKETS over the whole
+ * range of 64 bit values, using a fixed amount of memory.
+ *
+ * Recording a sample is a handful of relaxed atomic increments. Samples may be
+ * recorded and percentiles queried from any thread without locking. Queries
+ * running concurrently with recording see a slightly inconsistent view, which
+ * is fine for statistics.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+
+/**
+ * Number of buckets per power of two
+ */
+#define WS_HISTOGRAM_SUB_BUCKETS (8)
+
+/**
+ * Total number of buckets
+ */
+#define WS_HISTOGRAM_BUCKETS (62 * WS_HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Histogram
+ */
+struct ws_histogram {
+    _Atomic uint64_t buckets[WS_HISTOGRAM_BUCKETS]; //!< Samples per bucket
+    _Atomic uint64_t count; //!< Total number of samples
+    _Atomic uint64_t sum; //!< Sum of all samples
+    _Atomic uint64_t max; //!< Biggest sample
+};
+
+/**
+ * Initialize a histogram
+ */
+void
+ws_histogram_init(
+    struct ws_histogram* self //!< The histogram
+)
+__ws_nonnull__(1);
+
+/**
+ * Reset a histogram
+ *
+ * Samples recorded concurrently may or may not survive the reset.
+ */
+void
+ws_histogram_reset(
+    struct ws_histogram* self //!< The histogram
+)
+__ws_nonnull__(1);
+
+/**
+ * Record a sample
+ */
+void
+ws_histogram_record(
+    struct ws_histogram* self, //!< The histogram
+    uint64_t value //!< The sample
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the number of samples recorded
+ *
+ * @return The number of samples
+ */
+uint64_t
+ws_histogram_count(
+    struct ws_histogram const* self //!< The histogram
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the mean of the samples recorded
+ *
+ * @return The mean, or 0 if no samples were recorded
+ */
+uint64_t
+ws_histogram_mean(
+    struct ws_histogram const* self //!< The histogram
+)
+__ws_nonnull__(1);
+
+/**
+ * Get a percentile
+ *
+ * The value returned is the upper bound of the bucket holding the percentile,
+ * but never more than the biggest sample recorded.
+ *
+ * @return The value below or at which `percentile` percent of the samples
+ *         lie, or 0 if no samples were recorded
+ */
+uint64_t
+ws_histogram_percentile(
+    struct ws_histogram const* self, //!< The histogram
+    double percentile //!< The percentile, between 0 and 100
+)
+__ws_nonnull__(1);
+
+#endif // __WS_UTIL_HISTOGRAM_H__
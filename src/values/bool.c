@@ -26,4 +26,28 @@
  */
 
 #include "values/bool.h"
+#include "values/value.h"
 
+void
+ws_value_bool_init(
+    struct ws_value* self,
+    bool b
+) {
+    self->type = WS_VALUE_TYPE_BOOL;
+    self->b = b;
+}
+
+bool
+ws_value_bool_get(
+    struct ws_value const* self
+) {
+    return self->b;
+}
+
+void
+ws_value_bool_set(
+    struct ws_value* self,
+    bool b
+) {
+    self->b = b;
+}
@@ -28,6 +28,41 @@
 #ifndef __WS_VALUES_BOOL_H__
 #define __WS_VALUES_BOOL_H__
 
+#include <stdbool.h>
 
+#include "util/attributes.h"
+
+struct ws_value;
+
+/**
+ * Initialize a value as boolean
+ */
+void
+ws_value_bool_init(
+    struct ws_value* self, //!< The value to initialize
+    bool b //!< Initial value
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the boolean stored in a value
+ *
+ * @return The boolean stored in the value
+ */
+bool
+ws_value_bool_get(
+    struct ws_value const* self //!< The value
+)
+__ws_nonnull__(1);
+
+/**
+ * Set the boolean stored in a value
+ */
+void
+ws_value_bool_set(
+    struct ws_value* self, //!< The value
+    bool b //!< The boolean to store
+)
+__ws_nonnull__(1);
 
 #endif // __WS_VALUES_BOOL_H__
@@ -26,4 +26,28 @@
  */
 
 #include "values/int.h"
+#include "values/value.h"
 
+void
+ws_value_int_init(
+    struct ws_value* self,
+    int64_t i
+) {
+    self->type = WS_VALUE_TYPE_INT;
+    self->i = i;
+}
+
+int64_t
+ws_value_int_get(
+    struct ws_value const* self
+) {
+    return self->i;
+}
+
+void
+ws_value_int_set(
+    struct ws_value* self,
+    int64_t i
+) {
+    self->i = i;
+}
@@ -28,6 +28,41 @@
 #ifndef __WS_VALUES_INT_H__
 #define __WS_VALUES_INT_H__
 
+#include <stdint.h>
 
+#include "util/attributes.h"
+
+struct ws_value;
+
+/**
+ * Initialize a value as integer
+ */
+void
+ws_value_int_init(
+    struct ws_value* self, //!< The value to initialize
+    int64_t i //!< Initial value
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the integer stored in a value
+ *
+ * @return The integer stored in the value
+ */
+int64_t
+ws_value_int_get(
+    struct ws_value const* self //!< The value
+)
+__ws_nonnull__(1);
+
+/**
+ * Set the integer stored in a value
+ */
+void
+ws_value_int_set(
+    struct ws_value* self, //!< The value
+    int64_t i //!< The integer to store
+)
+__ws_nonnull__(1);
 
 #endif // __WS_VALUES_INT_H__
@@ -26,4 +26,11 @@
  */
 
 #include "values/nil.h"
+#include "values/value.h"
 
+void
+ws_value_nil_init(
+    struct ws_value* self
+) {
+    self->type = WS_VALUE_TYPE_NIL;
+}
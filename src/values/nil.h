@@ -28,6 +28,17 @@
 #ifndef __WS_VALUES_NIL_H__
 #define __WS_VALUES_NIL_H__
 
+#include "util/attributes.h"
 
+struct ws_value;
+
+/**
+ * Initialize a value as nil
+ */
+void
+ws_value_nil_init(
+    struct ws_value* self //!< The value to initialize
+)
+__ws_nonnull__(1);
 
 #endif // __WS_VALUES_NIL_H__
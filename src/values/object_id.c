@@ -25,5 +25,30 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "objects/object.h"
 #include "values/object_id.h"
+#include "values/value.h"
 
+void
+ws_value_object_id_init(
+    struct ws_value* self,
+    uint64_t id
+) {
+    self->type = WS_VALUE_TYPE_OBJECT_ID;
+    self->oid = id;
+}
+
+uint64_t
+ws_value_object_id_get(
+    struct ws_value const* self
+) {
+    return self->oid;
+}
+
+struct ws_object*
+ws_value_object_id_get_object(
+    struct ws_value const* self,
+    struct ws_object_type const* type
+) {
+    return ws_object_find(self->oid, type);
+}
@@ -28,6 +28,56 @@
 #ifndef __WS_VALUES_OBJECT_ID_H__
 #define __WS_VALUES_OBJECT_ID_H__
 
+/**
+ * @file object_id.h
+ *
+ * @brief Object ID values
+ *
+ * An object ID value refers to a registered object (see objects/object.h).
+ * IDs are generation-tagged, so an ID kept by a client after the object was
+ * destroyed simply does not resolve anymore.
+ */
+
+#include <stdint.h>
 
+#include "util/attributes.h"
+
+struct ws_object;
+struct ws_object_type;
+struct ws_value;
+
+/**
+ * Initialize a value as object ID
+ */
+void
+ws_value_object_id_init(
+    struct ws_value* self, //!< The value to initialize
+    uint64_t id //!< The object ID
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the object ID stored in a value
+ *
+ * @return The object ID stored in the value
+ */
+uint64_t
+ws_value_object_id_get(
+    struct ws_value const* self //!< The value
+)
+__ws_nonnull__(1);
+
+/**
+ * Resolve the object ID stored in a value
+ *
+ * @return The object or NULL if the ID does not refer to a live object of the
+ *         type requested
+ */
+struct ws_object*
+ws_value_object_id_get_object(
+    struct ws_value const* self, //!< The value
+    struct ws_object_type const* type //!< Required type or NULL for any type
+)
+__ws_nonnull__(1);
 
 #endif // __WS_VALUES_OBJECT_ID_H__
@@ -25,5 +25,520 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "values/set.h"
 
+/**
+ * Number of control bytes probed at once
+ */
+#define SET_GROUP_WIDTH 16
+
+/**
+ * Control byte of an empty slot
+ */
+#define SET_CTRL_EMPTY ((int8_t) -128)
+
+/**
+ * Control byte of a slot whose value was removed
+ */
+#define SET_CTRL_DELETED ((int8_t) -2)
+
+/**
+ * Bit mask with one bit per control byte of a group
+ */
+typedef uint32_t group_mask;
+
+/*
+ *
+ * Forward declarations
+ *
+ */
+
+/**
+ * Get the bits of a group whose control bytes equal a value
+ *
+ * @return Bit i is set if the control byte at `ctrl[i]` equals `c`
+ */
+static group_mask
+group_match(
+    int8_t const* ctrl, //!< Start of the group
+    int8_t c //!< The control byte to match
+);
+
+/**
+ * Get the bits of a group whose control bytes are empty or deleted
+ *
+ * @return Bit i is set if the slot at `ctrl[i]` is empty or deleted
+ */
+static group_mask
+group_match_free(
+    int8_t const* ctrl //!< Start of the group
+);
+
+/**
+ * Set a control byte, including its mirror
+ */
+static void
+set_ctrl(
+    struct ws_value_set* self, //!< The set
+    size_t index, //!< Index of the slot
+    int8_t c //!< The new control byte
+);
+
+/**
+ * Find the slot of a value
+ *
+ * @return The index of the slot or `self->cap` if the value is not in the set
+ */
+static size_t
+find(
+    struct ws_value_set const* self, //!< The set
+    struct ws_value const* value, //!< The value to look up
+    uint64_t hash //!< Hash of the value
+);
+
+/**
+ * Find a free slot for a hash
+ *
+ * The table must have at least one empty slot.
+ *
+ * @return The index of the slot
+ */
+static size_t
+find_free(
+    struct ws_value_set const* self, //!< The set
+    uint64_t hash //!< Hash of the value to insert
+);
+
+/**
+ * Mark a slot as unused
+ */
+static void
+erase(
+    struct ws_value_set* self, //!< The set
+    size_t index //!< Index of the slot
+);
+
+/**
+ * Move all values to a new table
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+static int
+resize(
+    struct ws_value_set* self, //!< The set
+    size_t cap //!< Capacity of the new table, a power of two
+);
+
+/**
+ * Get the number of values a table may hold before it is grown
+ *
+ * @return The number of values
+ */
+static size_t
+max_load(
+    size_t cap //!< Capacity of the table
+);
+
+/**
+ * Count the trailing zero bits of a group mask
+ *
+ * @return The number of trailing zeros, the group width if `mask` is 0
+ */
+static unsigned int
+mask_trailing_zeros(
+    group_mask mask //!< The mask
+);
+
+/**
+ * Count the leading zero bits of a group mask, in the group's width
+ *
+ * @return The number of leading zeros, the group width if `mask` is 0
+ */
+static unsigned int
+mask_leading_zeros(
+    group_mask mask //!< The mask
+);
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+void
+ws_value_set_init(
+    struct ws_value_set* self
+) {
+    self->ctrl = NULL;
+    self->slots = NULL;
+    self->cap = 0;
+    self->len = 0;
+    self->growth_left = 0;
+}
+
+void
+ws_value_set_deinit(
+    struct ws_value_set* self
+) {
+    ws_value_set_clear(self);
+    free(self->ctrl);
+    free(self->slots);
+    ws_value_set_init(self);
+}
+
+int
+ws_value_set_reserve(
+    struct ws_value_set* self,
+    size_t num
+) {
+    size_t cap = self->cap ? self->cap : SET_GROUP_WIDTH;
+    while (max_load(cap) < num) {
+        if (cap > SIZE_MAX / 2 / sizeof(*self->slots)) {
+            return -ENOMEM;
+        }
+        cap *= 2;
+    }
+
+    if (cap == self->cap) {
+        return 0;
+    }
+    return resize(self, cap);
+}
+
+int
+ws_value_set_insert(
+    struct ws_value_set* self,
+    struct ws_value const* value
+) {
+    uint64_t hash = ws_value_hash(value);
+    if (find(self, value, hash) < self->cap) {
+        return 0;
+    }
+
+    if (!self->growth_left) {
+        // reclaim deleted slots if they make up for most of the load
+        size_t cap = self->cap ? self->cap : SET_GROUP_WIDTH;
+        if (self->len >= max_load(cap) / 2) {
+            cap *= 2;
+        }
+        int res = resize(self, cap);
+        if (res < 0) {
+            return res;
+        }
+    }
+
+    size_t index = find_free(self, hash);
+    struct ws_value_set_slot* slot = self->slots + index;
+    ws_value_init(&slot->value);
+    int res = ws_value_copy(&slot->value, value);
+    if (res < 0) {
+        return res;
+    }
+    slot->hash = hash;
+
+    if (self->ctrl[index] == SET_CTRL_EMPTY) {
+        --self->growth_left;
+    }
+    set_ctrl(self, index, (int8_t) (hash & 0x7f));
+    ++self->len;
+    return 1;
+}
+
+bool
+ws_value_set_contains(
+    struct ws_value_set const* self,
+    struct ws_value const* value
+) {
+    return find(self, value, ws_value_hash(value)) < self->cap;
+}
+
+bool
+ws_value_set_remove(
+    struct ws_value_set* self,
+    struct ws_value const* value
+) {
+    size_t index = find(self, value, ws_value_hash(value));
+    if (index >= self->cap) {
+        return false;
+    }
+
+    erase(self, index);
+    return true;
+}
+
+void
+ws_value_set_retain(
+    struct ws_value_set* self,
+    struct ws_value_set const* other
+) {
+    size_t i;
+    for (i = 0; i < self->cap; ++i) {
+        if (self->ctrl[i] < 0) {
+            continue;
+        }
+
+        // the hash is the same in both sets, no need to compute it again
+        struct ws_value_set_slot* slot = self->slots + i;
+        if (find(other, &slot->value, slot->hash) >= other->cap) {
+            erase(self, i);
+        }
+    }
+}
+
+void
+ws_value_set_clear(
+    struct ws_value_set* self
+) {
+    size_t i;
+    for (i = 0; i < self->cap; ++i) {
+        if (self->ctrl[i] >= 0) {
+            ws_value_deinit(&self->slots[i].value);
+        }
+    }
+
+    if (self->ctrl) {
+        memset(self->ctrl, (unsigned char) SET_CTRL_EMPTY,
+               self->cap + SET_GROUP_WIDTH);
+    }
+    self->len = 0;
+    self->growth_left = max_load(self->cap);
+}
+
+size_t
+ws_value_set_len(
+    struct ws_value_set const* self
+) {
+    return self->len;
+}
+
+struct ws_value const*
+ws_value_set_next(
+    struct ws_value_set const* self,
+    size_t* iter
+) {
+    while (*iter < self->cap) {
+        size_t index = (*iter)++;
+        if (self->ctrl[index] >= 0) {
+            return &self->slots[index].value;
+        }
+    }
+    return NULL;
+}
+
+/*
+ *
+ * Internal implementation
+ *
+ */
+
+static group_mask
+group_match(
+    int8_t const* ctrl,
+    int8_t c
+) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((__m128i const*) ctrl);
+    return (group_mask) _mm_movemask_epi8(_mm_cmpeq_epi8(group,
+                                                         _mm_set1_epi8(c)));
+#else
+    group_mask mask = 0;
+    unsigned int i;
+    for (i = 0; i < SET_GROUP_WIDTH; ++i) {
+        mask |= (group_mask) (ctrl[i] == c) << i;
+    }
+    return mask;
+#endif
+}
+
+static group_mask
+group_match_free(
+    int8_t const* ctrl
+) {
+#ifdef __SSE2__
+    // empty and deleted are the only negative control bytes
+    __m128i group = _mm_loadu_si128((__m128i const*) ctrl);
+    return (group_mask) _mm_movemask_epi8(group);
+#else
+    group_mask mask = 0;
+    unsigned int i;
+    for (i = 0; i < SET_GROUP_WIDTH; ++i) {
+        mask |= (group_mask) (ctrl[i] < 0) << i;
+    }
+    return mask;
+#endif
+}
+
+static void
+set_ctrl(
+    struct ws_value_set* self,
+    size_t index,
+    int8_t c
+) {
+    self->ctrl[index] = c;
+    // the first group is mirrored behind the table, so groups never wrap
+    if (index < SET_GROUP_WIDTH) {
+        self->ctrl[self->cap + index] = c;
+    }
+}
+
+static size_t
+find(
+    struct ws_value_set const* self,
+    struct ws_value const* value,
+    uint64_t hash
+) {
+    if (!self->len) {
+        return self->cap;
+    }
+
+    size_t mask = self->cap - 1;
+    size_t pos = (hash >> 7) & mask;
+    size_t step = 0;
+    int8_t h2 = (int8_t) (hash & 0x7f);
+
+    while (1) {
+        group_mask match = group_match(self->ctrl + pos, h2);
+        while (match) {
+            size_t index = (pos + mask_trailing_zeros(match)) & mask;
+            struct ws_value_set_slot const* slot = self->slots + index;
+            if ((slot->hash == hash) && ws_value_equal(&slot->value, value)) {
+                return index;
+            }
+            match &= match - 1;
+        }
+
+        if (group_match(self->ctrl + pos, SET_CTRL_EMPTY)) {
+            return self->cap;
+        }
+
+        // triangular probing visits every group of a power of two table
+        step += SET_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+static size_t
+find_free(
+    struct ws_value_set const* self,
+    uint64_t hash
+) {
+    size_t mask = self->cap - 1;
+    size_t pos = (hash >> 7) & mask;
+    size_t step = 0;
+
+    while (1) {
+        group_mask match = group_match_free(self->ctrl + pos);
+        if (match) {
+            return (pos + mask_trailing_zeros(match)) & mask;
+        }
+
+        step += SET_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+static void
+erase(
+    struct ws_value_set* self,
+    size_t index
+) {
+    ws_value_deinit(&self->slots[index].value);
+    --self->len;
+
+    // If no group covering the slot was ever full, no probe sequence went
+    // past it and the slot may become empty again instead of deleted.
+    size_t before = (index - SET_GROUP_WIDTH) & (self->cap - 1);
+    group_mask empty_after = group_match(self->ctrl + index, SET_CTRL_EMPTY);
+    group_mask empty_before = group_match(self->ctrl + before, SET_CTRL_EMPTY);
+    if (empty_after && empty_before &&
+            (mask_trailing_zeros(empty_after) +
+             mask_leading_zeros(empty_before) < SET_GROUP_WIDTH)) {
+        set_ctrl(self, index, SET_CTRL_EMPTY);
+        ++self->growth_left;
+        return;
+    }
+    set_ctrl(self, index, SET_CTRL_DELETED);
+}
+
+static int
+resize(
+    struct ws_value_set* self,
+    size_t cap
+) {
+    int8_t* ctrl = malloc(cap + SET_GROUP_WIDTH);
+    struct ws_value_set_slot* slots = malloc(cap * sizeof(*slots));
+    if (!ctrl || !slots) {
+        free(ctrl);
+        free(slots);
+        return -ENOMEM;
+    }
+    memset(ctrl, (unsigned char) SET_CTRL_EMPTY, cap + SET_GROUP_WIDTH);
+
+    struct ws_value_set old = *self;
+    self->ctrl = ctrl;
+    self->slots = slots;
+    self->cap = cap;
+    self->growth_left = max_load(cap) - old.len;
+
+    // values are moved bitwise, their hashes are kept
+    size_t i;
+    for (i = 0; i < old.cap; ++i) {
+        if (old.ctrl[i] < 0) {
+            continue;
+        }
+        size_t index = find_free(self, old.slots[i].hash);
+        self->slots[index] = old.slots[i];
+        set_ctrl(self, index, old.ctrl[i]);
+    }
+
+    free(old.ctrl);
+    free(old.slots);
+    return 0;
+}
+
+static size_t
+max_load(
+    size_t cap
+) {
+    return cap - cap / 8;
+}
+
+static unsigned int
+mask_trailing_zeros(
+    group_mask mask
+) {
+    if (!mask) {
+        return SET_GROUP_WIDTH;
+    }
+#ifdef __GNUC__
+    return (unsigned int) __builtin_ctz(mask);
+#else
+    unsigned int n = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+static unsigned int
+mask_leading_zeros(
+    group_mask mask
+) {
+    unsigned int n = 0;
+    group_mask bit = (group_mask) 1 << (SET_GROUP_WIDTH - 1);
+    while (bit && !(mask & bit)) {
+        bit >>= 1;
+        ++n;
+    }
+    return n;
+}
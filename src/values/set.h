@@ -28,6 +28,166 @@
 #ifndef __WS_VALUES_SET_H__
 #define __WS_VALUES_SET_H__
 
+/**
+ * @file set.h
+ *
+ * @brief Set of values
+ *
+ * The set is an open-addressing hash table. Next to the slots, which hold the
+ * values along with their precomputed hashes, it keeps one control byte per
+ * slot: either "empty", "deleted" or the low 7 bits of the hash of the value in
+ * the slot. A lookup probes a group of 16 control bytes at once (with SSE2, if
+ * available) and only compares values whose control byte matches, so most
+ * lookups touch one cache line of control bytes and a single slot.
+ *
+ * Slots are stored in one flat array, iterating a set scans the control bytes
+ * and never follows pointers. Growing the table reuses the stored hashes.
+ *
+ * Values are copied into the set, strings are deep copies. Named values are
+ * copied shallowly (see ws_value_copy()).
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+#include "values/value.h"
+
+/**
+ * Slot of a set
+ */
+struct ws_value_set_slot {
+    uint64_t hash; //!< Precomputed hash of the value
+    struct ws_value value; //!< The value
+};
+
+/**
+ * Set of values
+ */
+struct ws_value_set {
+    int8_t* ctrl; //!< Control bytes, one per slot plus a mirrored group
+    struct ws_value_set_slot* slots; //!< The slots
+    size_t cap; //!< Number of slots, 0 or a power of two
+    size_t len; //!< Number of values in the set
+    size_t growth_left; //!< Inserts possible before the table is grown
+};
+
+/**
+ * Initialize a set
+ */
+void
+ws_value_set_init(
+    struct ws_value_set* self //!< The set to initialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize a set, releasing all values in it
+ */
+void
+ws_value_set_deinit(
+    struct ws_value_set* self //!< The set to deinitialize
+)
+__ws_nonnull__(1);
 
+/**
+ * Reserve space for a number of values
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_value_set_reserve(
+    struct ws_value_set* self, //!< The set
+    size_t num //!< Number of values the set should hold without growing
+)
+__ws_nonnull__(1);
+
+/**
+ * Insert a value into a set
+ *
+ * @return 1 if the value was inserted, 0 if it was already in the set, a
+ *         negative error number otherwise
+ */
+int
+ws_value_set_insert(
+    struct ws_value_set* self, //!< The set
+    struct ws_value const* value //!< The value to insert, copied
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Check whether a value is in a set
+ *
+ * @return true if the value is in the set, false otherwise
+ */
+bool
+ws_value_set_contains(
+    struct ws_value_set const* self, //!< The set
+    struct ws_value const* value //!< The value to look up
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Remove a value from a set
+ *
+ * @return true if the value was removed, false if it was not in the set
+ */
+bool
+ws_value_set_remove(
+    struct ws_value_set* self, //!< The set
+    struct ws_value const* value //!< The value to remove
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Remove all values from a set which are not in another set
+ *
+ * Runs in O(n) of the size of `self`, independent of the size of `other`.
+ */
+void
+ws_value_set_retain(
+    struct ws_value_set* self, //!< The set to modify
+    struct ws_value_set const* other //!< The set to intersect with
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Remove all values from a set
+ *
+ * The memory of the table is kept.
+ */
+void
+ws_value_set_clear(
+    struct ws_value_set* self //!< The set
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the number of values in a set
+ *
+ * @return The number of values
+ */
+size_t
+ws_value_set_len(
+    struct ws_value_set const* self //!< The set
+)
+__ws_nonnull__(1);
+
+/**
+ * Iterate over the values of a set
+ *
+ * `iter` must be set to 0 before the first call. The order of the values is
+ * unspecified. The set must not be modified while iterating, except for
+ * removing the value returned last.
+ *
+ * @return The next value or NULL if all values were visited
+ */
+struct ws_value const*
+ws_value_set_next(
+    struct ws_value_set const* self, //!< The set
+    size_t* iter //!< Iterator state
+)
+__ws_nonnull__(1, 2);
 
 #endif // __WS_VALUES_SET_H__
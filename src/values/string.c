@@ -25,5 +25,118 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "objects/string.h"
 #include "values/string.h"
+#include "values/value.h"
+
+void
+ws_value_string_init(
+    struct ws_value* self
+) {
+    self->type = WS_VALUE_TYPE_STRING;
+    self->str.buf[0] = '\0';
+    self->str.inline_len = 0;
+    self->str.mode = WS_VALUE_STRING_INLINE;
+}
+
+void
+ws_value_string_deinit(
+    struct ws_value* self
+) {
+    if (self->str.mode == WS_VALUE_STRING_HEAP) {
+        free((char*) self->str.ext.str);
+    }
+    self->str.buf[0] = '\0';
+    self->str.inline_len = 0;
+    self->str.mode = WS_VALUE_STRING_INLINE;
+}
+
+int
+ws_value_string_set(
+    struct ws_value* self,
+    char const* str,
+    size_t len
+) {
+    if (len <= WS_VALUE_STRING_INLINE_MAX) {
+        // `str` may point into the value itself, e.g. into its heap buffer
+        char copy[WS_VALUE_STRING_INLINE_MAX];
+        memcpy(copy, str, len);
+        ws_value_string_deinit(self);
+        memcpy(self->str.buf, copy, len);
+        self->str.buf[len] = '\0';
+        self->str.inline_len = (uint8_t) len;
+        return 0;
+    }
+
+    char* buf = malloc(len + 1);
+    if (!buf) {
+        return -ENOMEM;
+    }
+    memcpy(buf, str, len);
+    buf[len] = '\0';
+
+    ws_value_string_deinit(self);
+    self->str.ext.str = buf;
+    self->str.ext.len = len;
+    self->str.mode = WS_VALUE_STRING_HEAP;
+    return 0;
+}
+
+void
+ws_value_string_set_borrowed(
+    struct ws_value* self,
+    char const* str,
+    size_t len
+) {
+    ws_value_string_deinit(self);
+    self->str.ext.str = str;
+    self->str.ext.len = len;
+    self->str.mode = WS_VALUE_STRING_BORROWED;
+}
+
+void
+ws_value_string_set_interned(
+    struct ws_value* self,
+    struct ws_string_interned const* str
+) {
+    ws_value_string_deinit(self);
+    self->str.ext.str = str->str;
+    self->str.ext.len = str->len;
+    self->str.mode = WS_VALUE_STRING_INTERNED;
+}
+
+struct ws_string_interned const*
+ws_value_string_get_interned(
+    struct ws_value const* self
+) {
+    if (self->str.mode != WS_VALUE_STRING_INTERNED) {
+        return NULL;
+    }
+    return (struct ws_string_interned const*)
+        (self->str.ext.str - offsetof(struct ws_string_interned, str));
+}
+
+char const*
+ws_value_string_get(
+    struct ws_value const* self
+) {
+    if (self->str.mode == WS_VALUE_STRING_INLINE) {
+        return self->str.buf;
+    }
+    return self->str.ext.str;
+}
 
+size_t
+ws_value_string_len(
+    struct ws_value const* self
+) {
+    if (self->str.mode == WS_VALUE_STRING_INLINE) {
+        return self->str.inline_len;
+    }
+    return self->str.ext.len;
+}
@@ -28,6 +28,147 @@
 #ifndef __WS_VALUES_STRING_H__
 #define __WS_VALUES_STRING_H__
 
+#include <stddef.h>
+#include <stdint.h>
 
+#include "util/attributes.h"
+
+struct ws_string_interned;
+struct ws_value;
+
+/**
+ * Maximum length of a string which is stored inline
+ */
+#define WS_VALUE_STRING_INLINE_MAX 23
+
+/**
+ * Storage modes of a string value
+ */
+enum ws_value_string_mode {
+    WS_VALUE_STRING_INLINE = 0, //!< Stored inside the value itself
+    WS_VALUE_STRING_HEAP, //!< Stored in memory owned by the value
+    WS_VALUE_STRING_BORROWED, //!< Stored in memory not owned by the value
+    WS_VALUE_STRING_INTERNED, //!< An interned string (see objects/string.h)
+};
+
+/**
+ * Payload of a string value
+ *
+ * Strings up to WS_VALUE_STRING_INLINE_MAX bytes are stored inline, longer
+ * strings are stored on the heap. Alternatively, a string value may borrow
+ * memory owned by someone else, e.g. an arena or a receive buffer, or refer
+ * to an interned string. Interned strings are compared by pointer and carry a
+ * precomputed hash.
+ */
+struct ws_value_string {
+    union {
+        char buf[WS_VALUE_STRING_INLINE_MAX + 1]; //!< Inline storage
+        struct {
+            char const* str; //!< The string
+            size_t len; //!< Length of the string
+        } ext; //!< External storage
+    };
+    uint8_t inline_len; //!< Length of the string if stored inline
+    uint8_t mode; //!< Storage mode, a `enum ws_value_string_mode`
+};
+
+/**
+ * Initialize a value as empty string
+ */
+void
+ws_value_string_init(
+    struct ws_value* self //!< The value to initialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Release the memory held by a string value
+ *
+ * The value is an empty string afterwards.
+ */
+void
+ws_value_string_deinit(
+    struct ws_value* self //!< The value
+)
+__ws_nonnull__(1);
+
+/**
+ * Set the string stored in a value
+ *
+ * The string is copied. No allocation takes place if the string is not
+ * longer than WS_VALUE_STRING_INLINE_MAX.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_value_string_set(
+    struct ws_value* self, //!< The value
+    char const* str, //!< The string, not necessarily 0-terminated
+    size_t len //!< Length of the string
+)
+__ws_nonnull__(1);
+
+/**
+ * Set the string stored in a value without copying it
+ *
+ * The value only references the string. The caller has to make sure the
+ * memory stays valid as long as the value is in use.
+ */
+void
+ws_value_string_set_borrowed(
+    struct ws_value* self, //!< The value
+    char const* str, //!< The string, not necessarily 0-terminated
+    size_t len //!< Length of the string
+)
+__ws_nonnull__(1);
+
+/**
+ * Set the string stored in a value to an interned string
+ *
+ * No allocation takes place, copies of the value refer to the same interned
+ * string.
+ */
+void
+ws_value_string_set_interned(
+    struct ws_value* self, //!< The value
+    struct ws_string_interned const* str //!< The interned string
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Get the interned string stored in a value
+ *
+ * @return The interned string or NULL if the value does not hold one
+ */
+struct ws_string_interned const*
+ws_value_string_get_interned(
+    struct ws_value const* self //!< The value
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the string stored in a value
+ *
+ * @note Borrowed strings are not necessarily 0-terminated, use
+ *       ws_value_string_len() to determine the length of the string.
+ *
+ * @return The string stored in the value
+ */
+char const*
+ws_value_string_get(
+    struct ws_value const* self //!< The value
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the length of the string stored in a value
+ *
+ * @return The length of the string
+ */
+size_t
+ws_value_string_len(
+    struct ws_value const* self //!< The value
+)
+__ws_nonnull__(1);
 
 #endif // __WS_VALUES_STRING_H__
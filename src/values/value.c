@@ -25,5 +25,163 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+
+#include "objects/string.h"
+#include "util/hash.h"
 #include "values/value.h"
 
+/*
+ * Values are meant to be passed around by value and stored in arrays, keep them
+ * small.
+ */
+_Static_assert(sizeof(struct ws_value) <= 40, "struct ws_value grew too large");
+
+/*
+ *
+ * Interface implementation
+ *
+ */
+
+void
+ws_value_init(
+    struct ws_value* self
+) {
+    self->type = WS_VALUE_TYPE_NONE;
+}
+
+void
+ws_value_deinit(
+    struct ws_value* self
+) {
+    switch (self->type) {
+    case WS_VALUE_TYPE_STRING:
+        ws_value_string_deinit(self);
+        break;
+    default:
+        // nothing to release
+        break;
+    }
+    self->type = WS_VALUE_TYPE_NONE;
+}
+
+enum ws_value_type
+ws_value_get_type(
+    struct ws_value const* self
+) {
+    return self->type;
+}
+
+int
+ws_value_copy(
+    struct ws_value* dest,
+    struct ws_value const* src
+) {
+    if (dest == src) {
+        return 0;
+    }
+
+    ws_value_deinit(dest);
+
+    if ((src->type != WS_VALUE_TYPE_STRING) ||
+            (src->str.mode == WS_VALUE_STRING_INTERNED)) {
+        // everything except non-interned strings may be copied bitwise
+        *dest = *src;
+        return 0;
+    }
+
+    ws_value_string_init(dest);
+    return ws_value_string_set(dest, ws_value_string_get(src),
+                               ws_value_string_len(src));
+}
+
+bool
+ws_value_equal(
+    struct ws_value const* self,
+    struct ws_value const* other
+) {
+    if (self->type != other->type) {
+        return false;
+    }
+
+    switch (self->type) {
+    case WS_VALUE_TYPE_NONE:
+    case WS_VALUE_TYPE_NIL:
+        return true;
+
+    case WS_VALUE_TYPE_BOOL:
+        return self->b == other->b;
+
+    case WS_VALUE_TYPE_INT:
+        return self->i == other->i;
+
+    case WS_VALUE_TYPE_OBJECT_ID:
+        return self->oid == other->oid;
+
+    case WS_VALUE_TYPE_STRING:
+        {
+            // interned strings are equal if and only if they are the same
+            if ((self->str.mode == WS_VALUE_STRING_INTERNED) &&
+                    (other->str.mode == WS_VALUE_STRING_INTERNED)) {
+                return self->str.ext.str == other->str.ext.str;
+            }
+
+            size_t len = ws_value_string_len(self);
+            return (len == ws_value_string_len(other)) &&
+                   (memcmp(ws_value_string_get(self),
+                           ws_value_string_get(other), len) == 0);
+        }
+
+    case WS_VALUE_TYPE_NAMED:
+        return (self->named.name_len == other->named.name_len) &&
+               (memcmp(self->named.name, other->named.name,
+                       self->named.name_len) == 0) &&
+               ws_value_equal(self->named.value, other->named.value);
+    }
+
+    return false;
+}
+
+uint64_t
+ws_value_hash(
+    struct ws_value const* self
+) {
+    // the type is mixed in so e.g. `1` and `#1` do not collide
+    uint64_t h = (uint64_t) self->type * UINT64_C(0x9e3779b97f4a7c15);
+
+    switch (self->type) {
+    case WS_VALUE_TYPE_BOOL:
+        h ^= self->b;
+        break;
+
+    case WS_VALUE_TYPE_INT:
+        h ^= (uint64_t) self->i;
+        break;
+
+    case WS_VALUE_TYPE_OBJECT_ID:
+        h ^= self->oid;
+        break;
+
+    case WS_VALUE_TYPE_STRING:
+        {
+            // strings are hashed like interned strings, which carry theirs
+            struct ws_string_interned const* interned;
+            interned = ws_value_string_get_interned(self);
+            if (interned) {
+                return interned->hash;
+            }
+            return ws_string_hash(ws_value_string_get(self),
+                                  ws_value_string_len(self));
+        }
+
+    case WS_VALUE_TYPE_NAMED:
+        h ^= ws_string_hash(self->named.name, self->named.name_len);
+        h ^= ws_value_hash(self->named.value);
+        break;
+
+    default:
+        break;
+    }
+
+    return ws_hash_mix64(h);
+}
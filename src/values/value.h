@@ -28,6 +28,135 @@
 #ifndef __WS_VALUES_VALUE_H__
 #define __WS_VALUES_VALUE_H__
 
+/**
+ * @file value.h
+ *
+ * @brief Generic value type
+ *
+ * A `struct ws_value` is a fixed-size tagged union. Primitive values (nil,
+ * bool, int, object IDs) as well as short strings are stored inline, so
+ * constructing a value never requires an allocation in the common case.
+ * Values may live on the stack, in arrays or in arena memory.
+ *
+ * Each type has its own header providing the type specific constructors and
+ * accessors. This header pulls them all in.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/attributes.h"
+#include "values/bool.h"
+#include "values/int.h"
+#include "values/nil.h"
+#include "values/object_id.h"
+#include "values/string.h"
+#include "values/value_named.h"
+
+/**
+ * Value types
+ */
+enum ws_value_type {
+    WS_VALUE_TYPE_NONE = 0, //!< Uninitialized value
+    WS_VALUE_TYPE_NIL, //!< Nil value
+    WS_VALUE_TYPE_BOOL, //!< Boolean value
+    WS_VALUE_TYPE_INT, //!< Integer value
+    WS_VALUE_TYPE_STRING, //!< String value
+    WS_VALUE_TYPE_OBJECT_ID, //!< Object ID value
+    WS_VALUE_TYPE_NAMED, //!< Named value
+};
 
+/**
+ * Value type
+ *
+ * The payload is selected by the `type` member. Do not access the payload
+ * directly, use the type specific accessors.
+ */
+struct ws_value {
+    enum ws_value_type type; //!< Type of the value
+    union {
+        bool b; //!< Payload for WS_VALUE_TYPE_BOOL
+        int64_t i; //!< Payload for WS_VALUE_TYPE_INT
+        uint64_t oid; //!< Payload for WS_VALUE_TYPE_OBJECT_ID
+        struct ws_value_string str; //!< Payload for WS_VALUE_TYPE_STRING
+        struct ws_value_named named; //!< Payload for WS_VALUE_TYPE_NAMED
+    };
+};
+
+/**
+ * Initialize a value
+ *
+ * The value will have the type WS_VALUE_TYPE_NONE afterwards.
+ */
+void
+ws_value_init(
+    struct ws_value* self //!< The value to initialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Deinitialize a value
+ *
+ * Releases all resources held by the value. The value will have the type
+ * WS_VALUE_TYPE_NONE afterwards and may be reused.
+ */
+void
+ws_value_deinit(
+    struct ws_value* self //!< The value to deinitialize
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the type of a value
+ *
+ * @return The type of the value
+ */
+enum ws_value_type
+ws_value_get_type(
+    struct ws_value const* self //!< The value
+)
+__ws_nonnull__(1);
+
+/**
+ * Copy a value
+ *
+ * `dest` must be an initialized value. It is deinitialized before the copy.
+ * Named values are copied shallowly.
+ *
+ * @return 0 on success, a negative error number otherwise
+ */
+int
+ws_value_copy(
+    struct ws_value* dest, //!< The value to copy to
+    struct ws_value const* src //!< The value to copy from
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Check whether two values are equal
+ *
+ * Values of different types are never equal.
+ *
+ * @return true if the values are equal, false otherwise
+ */
+bool
+ws_value_equal(
+    struct ws_value const* self, //!< The value
+    struct ws_value const* other //!< The value to compare with
+)
+__ws_nonnull__(1, 2);
+
+/**
+ * Compute the hash of a value
+ *
+ * Equal values (see ws_value_equal()) have equal hashes.
+ *
+ * @return The hash of the value
+ */
+uint64_t
+ws_value_hash(
+    struct ws_value const* self //!< The value to hash
+)
+__ws_nonnull__(1);
 
 #endif // __WS_VALUES_VALUE_H__
@@ -25,5 +25,36 @@
  * along with waysome. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "values/value.h"
 #include "values/value_named.h"
 
+void
+ws_value_named_init(
+    struct ws_value* self,
+    char const* name,
+    size_t name_len,
+    struct ws_value* value
+) {
+    self->type = WS_VALUE_TYPE_NAMED;
+    self->named.name = name;
+    self->named.name_len = name_len;
+    self->named.value = value;
+}
+
+char const*
+ws_value_named_get_name(
+    struct ws_value const* self,
+    size_t* len
+) {
+    if (len) {
+        *len = self->named.name_len;
+    }
+    return self->named.name;
+}
+
+struct ws_value*
+ws_value_named_get_value(
+    struct ws_value const* self
+) {
+    return self->named.value;
+}
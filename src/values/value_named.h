@@ -28,6 +28,58 @@
 #ifndef __WS_VALUES_VALUE_NAMED_H__
 #define __WS_VALUES_VALUE_NAMED_H__
 
+#include <stddef.h>
 
+#include "util/attributes.h"
+
+struct ws_value;
+
+/**
+ * Payload of a named value
+ *
+ * A named value associates a name with another value. Neither the name nor
+ * the value are owned by the named value: the creator is responsible for
+ * keeping them alive while the named value is in use.
+ */
+struct ws_value_named {
+    char const* name; //!< The name, not necessarily 0-terminated
+    size_t name_len; //!< Length of the name
+    struct ws_value* value; //!< The value associated with the name
+};
+
+/**
+ * Initialize a value as named value
+ */
+void
+ws_value_named_init(
+    struct ws_value* self, //!< The value to initialize
+    char const* name, //!< The name
+    size_t name_len, //!< Length of the name
+    struct ws_value* value //!< The value to associate with the name
+)
+__ws_nonnull__(1, 2, 4);
+
+/**
+ * Get the name of a named value
+ *
+ * @return The name, which is not necessarily 0-terminated
+ */
+char const*
+ws_value_named_get_name(
+    struct ws_value const* self, //!< The value
+    size_t* len //!< Output: length of the name, may be NULL
+)
+__ws_nonnull__(1);
+
+/**
+ * Get the value associated with the name
+ *
+ * @return The value associated with the name
+ */
+struct ws_value*
+ws_value_named_get_value(
+    struct ws_value const* self //!< The value
+)
+__ws_nonnull__(1);
 
 #endif // __WS_VALUES_VALUE_NAMED_H__